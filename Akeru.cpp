@@ -47,12 +47,23 @@ Akeru::Akeru(unsigned int rx, unsigned int tx)
   //  Init the module with the specified transmit and receive pins.
   //  Default to no echo.
   //Serial.begin(9600); Serial.print(String(F("Akeru.Akeru: (rx,tx)=")) + rx + ',' + tx + '\n');
-  serialPort = new SoftwareSerial(rx, tx);
+  serialPort.attach(new SoftwareSerial(rx, tx));
   echoPort = &nullPort2;
   lastEchoPort = &Serial;
   _lastSend = 0;
 }
 
+#ifdef MODEM_PORT_HARDWARE
+Akeru::Akeru(HardwareSerial *port)
+{
+  //  Init the module connected to a hardware UART, e.g. Serial1.
+  serialPort.attach(port);
+  echoPort = &nullPort2;
+  lastEchoPort = &Serial;
+  _lastSend = 0;
+}
+#endif  //  MODEM_PORT_HARDWARE
+
 void Akeru::echoOn()
 {
   //  Echo commands and responses to the echo port.
@@ -78,6 +89,11 @@ void Akeru::echo(String msg) {
   echoPort->println(msg);
 }
 
+void Akeru::echo(const char *msg) {
+  //  Echo debug message to the echo port.
+  echoPort->println(msg);
+}
+
 bool Akeru::begin()
 {
   //  Wait for the module to power up. Return true if module is ready to send.
@@ -283,195 +299,205 @@ bool Akeru::setPower(int power)
 	}
 }
 
-bool Akeru::receive(String &data)
+bool Akeru::sendMessageAndGetResponse(const String payload, uint8_t downlink[MAX_BYTES_PER_DOWNLINK])
+{
+  // Payload must be a String formatted in hexadecimal, 12 bytes max, use toHex()
+  // Return the 8 bytes of the downlink response in downlink.
+	if (!isReady()) return false; // prevent user from sending to many messages
+	if (_emulationMode)
+	{
+		echoPort->println(F("TD LAN mode has no downlink"));
+		return false;
+	}
+	String message = ATSIGFOXTX;
+	message.concat(payload);  //  Max 12 bytes
+	message.concat(ATSIGFOXTX_DOWNLINK);
+
+	return sendAndReceive(message, downlink);
+}
+
+bool Akeru::receive(uint8_t downlink[MAX_BYTES_PER_DOWNLINK])
 {
 	if (!isReady()) return false;
-	
-	if (sendATCommand(ATDOWNLINK, ATSIGFOXTX_TIMEOUT, data))
+	return sendAndReceive(ATDOWNLINK, downlink);
+}
+
+bool Akeru::sendAndReceive(const String &command, uint8_t downlink[MAX_BYTES_PER_DOWNLINK])
+{
+	// Send the uplink command and wait for the downlink.  Keep the port open after OK, else the
+	// +RX lines that follow are lost.
+	String data = "";
+	beginSession();
+#if UNABIZ_COMMAND_STATS
+	const unsigned long startTime = millis();
+	_sessionTxBytes = _sessionRxBytes = 0;
+#endif  //  UNABIZ_COMMAND_STATS
+	bool status = sendATCommand(command, ATSIGFOXTX_TIMEOUT, data);
+	if (status)
 	{
-		// Restart serial interface
-		serialPort->begin(9600);
-		delay(200);	
-		serialPort->flush();
-		serialPort->listen();
-		
-		// Read response 
-		String response = "";
-		
-		unsigned int startTime = millis();
-		volatile unsigned int currentTime = millis();
-		volatile char rxChar = '\0';
-
-		// RX management : two ways to break the loop
-		// - Timeout
-		// - Receive 
-		do
-		{
-			if (serialPort->available() > 0)
-			{
-				rxChar = (char)serialPort->read();
-				response.concat(rxChar);
-			}
-			currentTime = millis();
-		}while(((currentTime - startTime) < ATDOWNLINK_TIMEOUT) && response.endsWith(DOWNLINKEND) == false);
+		_lastSend = millis();
+		status = receiveDownlink(downlink);
+	}
+	endSession();
+#if UNABIZ_COMMAND_STATS
+	// Record the uplink and the downlink as one command, e.g. "SS+RX", which may take 45 seconds.
+	char key[COMMAND_KEY_MAX + 1];
+	CommandStats::getATKey(command.c_str(), key);
+	if (strlen(key) + 3 <= COMMAND_KEY_MAX) strcat(key, "+RX");
+	_commandStats.record(key, millis() - startTime, status, _sessionTxBytes, _sessionRxBytes);
+#endif  //  UNABIZ_COMMAND_STATS
+	return status;
+}
 
-		serialPort->end();
-    echoPort->println(response);
+bool Akeru::receive(String &data)
+{
+	// Return the received bytes as hex digits
+	uint8_t downlink[MAX_BYTES_PER_DOWNLINK];
+	if (!receive(downlink)) return false;
+	data = "";
+	appendHex(data, downlink, MAX_BYTES_PER_DOWNLINK, true);  //  Uppercase like the module.
+	return true;
+}
 
-		// Now that we have the full answer we can look for the received bytes
-		if (response.length() != 0)
+bool Akeru::receiveDownlink(uint8_t downlink[MAX_BYTES_PER_DOWNLINK])
+{
+	// The port is still open from the uplink, so the chars received after OK are kept.
+	// Read response, decoding the downlink bytes as they arrive
+	ResponseParser parser;
+	unsigned int startTime = millis();
+	volatile unsigned int currentTime = millis();
+	ResponseToken token = TOKEN_NONE;
+
+	// RX management : two ways to break the loop
+	// - Timeout
+	// - Receive +RX END
+	do
+	{
+		if (serialPort.available() > 0)
 		{
-			// Search for transmission start
-			int index = response.indexOf("=");
-			// Get the chunk, it's 8 bytes long + separating spaces = 23 chars
-			String chunk = response.substring(index, index+24);
-			if (chunk.length() > 0)
-			{
-				// Remove the spaces
-				chunk.replace(" ", "");
-				data = chunk;
-				return true;
-			}
+			const char rxChar = (char)serialPort.read();
+#if UNABIZ_COMMAND_STATS
+			_sessionRxBytes++;
+#endif  //  UNABIZ_COMMAND_STATS
+			echoPort->write((uint8_t) rxChar);
+			token = parser.feed(rxChar);
 		}
-	}
-	else 
+		currentTime = millis();
+	}while(((currentTime - startTime) < ATDOWNLINK_TIMEOUT) && token != TOKEN_RX_END);
+
+	echoPort->write((uint8_t) '\n');
+
+	// Return the 8 downlink bytes
+	if (!parser.hasDownlink() || parser.getDownlinkLength() != MAX_BYTES_PER_DOWNLINK)
 	{
+		echoPort->println(F("Incomplete downlink"));
 		return false;
 	}
+	memcpy(downlink, parser.getDownlink(), MAX_BYTES_PER_DOWNLINK);
+	return true;
+}
+
+void Akeru::beginSession()
+{
+	// Keep the serial port open across the uplink and the downlink, until endSession() is called.
+	_sessionDepth++;
+}
+
+void Akeru::endSession()
+{
+	// End the session and stop the serial port.
+	if (_sessionDepth == 0) return;
+	_sessionDepth--;
+	if (_sessionDepth == 0) closePort();
+}
+
+void Akeru::openPort()
+{
+	// Start the serial port and discard any old chars, unless already started.
+	if (_portOpen) return;
+	serialPort.begin(9600);
+	delay(200);
+	serialPort.clearInput();
+	serialPort.listen();
+	_portOpen = true;
+}
+
+void Akeru::closePort()
+{
+	// Stop the serial port if started.
+	if (!_portOpen) return;
+	serialPort.end();
+	_portOpen = false;
 }
 
 String Akeru::toHex(int i)
 {
-	byte *b = (byte*) & i;
-	
+	// Convert the integer to a string of 4 hex digits.
 	String bytes = "";
-	for (int j=0; j<2; j++)
-	{
-		if (b[j] <= 0xF) // single char
-		{
-			bytes.concat("0"); // add a "0" to make sure every byte is read correctly
-		}
-		bytes.concat(String(b[j], 16));
-	}
+	appendHex(bytes, (const uint8_t *) &i, 2);
 	return bytes;
 }
 
 String Akeru::toHex(unsigned int ui)
 {
-	byte * b = (byte*) & ui;
-	
+	// Convert the integer to a string of 4 hex digits.
 	String bytes = "";
-	for (int i=0; i<2; i++)
-	{
-		if (b[i] <= 0xF) // single char
-		{
-			bytes.concat("0"); // add a "0" to make sure every byte is read correctly
-		}
-		bytes.concat(String(b[i], 16));
-	}
+	appendHex(bytes, (const uint8_t *) &ui, 2);
 	return bytes;
 }
 
 String Akeru::toHex(long l)
 {
-	byte * b = (byte*) & l;
-	
+	// Convert the long to a string of 8 hex digits.
 	String bytes = "";
-	for (int i=0; i<4; i++)
-	{
-		if (b[i] <= 0xF) // single char
-		{
-			bytes.concat("0"); // add a "0" to make sure every byte is read correctly
-		}
-		bytes.concat(String(b[i], 16));
-	}
+	appendHex(bytes, (const uint8_t *) &l, 4);
 	return bytes;
 }
 
 String Akeru::toHex(unsigned long ul)
 {
-	byte * b = (byte*) & ul;
-	
+	// Convert the long to a string of 8 hex digits.
 	String bytes = "";
-	for (int i=0; i<4; i++)
-	{
-		if (b[i] <= 0xF) // single char
-		{
-			bytes.concat("0"); // add a "0" to make sure every byte is read correctly
-		}
-		bytes.concat(String(b[i], 16));
-	}
+	appendHex(bytes, (const uint8_t *) &ul, 4);
 	return bytes;
 }
 
 String Akeru::toHex(float f)
 {
-	byte * b = (byte*) & f;
-
+	// Convert the float to a string of 8 hex digits.
 	String bytes = "";
-	for (int i=0; i<4; i++)
-	{
-		if (b[i] <= 0xF) // single char
-		{
-			bytes.concat("0"); // add a "0" to make sure every byte is read correctly
-		}
-		bytes.concat(String(b[i], 16));
-	}
+	appendHex(bytes, (const uint8_t *) &f, 4);
 	return bytes;
 }
 
 String Akeru::toHex(double d)
 {
-	byte * b = (byte*) & d;
-
+	// Convert the double to a string of 8 hex digits.
 	String bytes = "";
-	for (int i=0; i<4; i++)
-	{
-		if (b[i] <= 0xF) // single char
-		{
-			bytes.concat("0"); // add a "0" to make sure every byte is read correctly
-		}
-		bytes.concat(String(b[i], 16));
-	}
+	appendHex(bytes, (const uint8_t *) &d, 4);
 	return bytes;
 }
 
 String Akeru::toHex(char c)
 {
-	byte *b = (byte*) & c;
-	
+	// Convert the char to a string of 2 hex digits.
 	String bytes = "";
-	if (b[0] <= 0xF) // single char
-	{
-		bytes.concat("0"); // add a "0" to make sure every byte is read correctly
-	}
-	bytes.concat(String(b[0], 16));
+	appendHex(bytes, (const uint8_t *) &c, 1);
 	return bytes;
 }
 
 String Akeru::toHex(char *c, int length)
 {
-	byte * b = (byte*) c;
-	
+	// Convert the string to a string of hex digits.
 	String bytes = "";
-	for (int i=0; i<length; i++)
-	{
-		if (b[i] <= 0xF) // single char
-		{
-			bytes.concat("0"); // add a "0" to make sure every byte is read correctly
-		}
-		bytes.concat(String(b[i], 16));
-	}
+	appendHex(bytes, (const uint8_t *) c, length);
 	return bytes;
 }
 
 bool Akeru::sendATCommand(const String command, const int timeout, String &dataOut)
 {
-	// Start serial interface
-	serialPort->begin(9600);
-	delay(200);	
-	serialPort->flush();
-	serialPort->listen();
+	// Start serial interface, unless the session keeps it open
+	openPort();
 
 	// Add CRLF to the command
 	String ATCommand = "";
@@ -479,106 +505,90 @@ bool Akeru::sendATCommand(const String command, const int timeout, String &dataO
 	ATCommand.concat("\r\n");
   echoPort->print((String)"\n>> " + ATCommand);
 
-	// Send the command : need to write/read char by char because of echo
+	// Send the command : need to write/read char by char because of echo.
+	// A hardware UART sends from its FIFO, so the echo arrives later as the first response line.
+	const bool hardware = serialPort.isHardware();
+	bool echoPending = hardware;
 	for (int i = 0; i < ATCommand.length(); ++i)
 	{
-		serialPort->print(ATCommand.c_str()[i]);
-		serialPort->read();
+		serialPort.write((uint8_t) ATCommand.c_str()[i]);
+		if (!hardware) serialPort.read();
 	}
-  echoPort->print("<< ");
+  echoPort->print(F("<< "));
 
-	// Read response 
-	String response = "";
+	// Read response, one line at a time as it arrives
+	ResponseParser parser;
+	String firstData = "";
+	bool error = false;
 	unsigned int startTime = millis();
 	volatile unsigned int currentTime = millis();
-	volatile char rxChar = '\0';
+	ResponseToken token = TOKEN_NONE;
+#if UNABIZ_COMMAND_STATS
+	unsigned int rxBytes = 0;
+#endif  //  UNABIZ_COMMAND_STATS
 
 	// RX management : two ways to break the loop
 	// - Timeout
-	// - Receive 
+	// - Receive OK
 	do
 	{
-		if (serialPort->available() > 0)
+		if (serialPort.available() > 0)
 		{
-			rxChar = (char)serialPort->read();
-			response.concat(rxChar);
+			const char rxChar = (char)serialPort.read();
+#if UNABIZ_COMMAND_STATS
+			rxBytes++;
+#endif  //  UNABIZ_COMMAND_STATS
+			token = parser.feed(rxChar);
+			if (token == TOKEN_LINE && echoPending)
+			{
+				// Skip the echo of the command
+				echoPending = false;
+			}
+			else if (token == TOKEN_LINE)
+			{
+				// Keep the data line that comes before OK
+				echoPort->println(parser.getLine());
+				if (firstData == "") firstData = parser.getLine();
+				else error = true;
+			}
 		}
 
 		currentTime = millis();
-	}while(((currentTime - startTime) < timeout) && response.endsWith(ATOK) == false);
-
-	serialPort->end();
-  String res = response;
-  while (res.length() > 0 && (res.charAt(0) == '\r' || res.charAt(0) == '\n'))
-    res = res.substring(1);  //  Strip off leading newline.
-  echoPort->print(res);
+	}while(((currentTime - startTime) < timeout) && token != TOKEN_OK);
 
-	// Split the response
-	int index = 0;
-	String firstData = "";
-	String secondData = "";
-
-	if (response.length() != 0)
+	if (_sessionDepth == 0) closePort();
+	diagnose(firstData.length());  //  Record the response length and free memory.
+#if UNABIZ_COMMAND_STATS
+	if (_sessionDepth > 0)
 	{
-		// Split CRLF
-		do
-		{
-			// Save previous index
-			int previous = index;
-
-			// Get next index
-			index = response.indexOf("\r\n", index);
-
-			// Check that index change
-			if (previous != index)
-			{
-				// Get the chunk
-				String chunk = response.substring(previous+1, index);
-				if (chunk.length() > 0)
-				{
-					// Remove \r\n 
-					chunk.replace("\r\n", "");
-					
-					if (firstData != "")
-					{
-						secondData = chunk;
-					}
-					else if (firstData == "" && secondData == "")
-					{
-						firstData = chunk;
-					}
-					else
-					{
-						echoPort->println("ERROR on rx frame");
-						return false;
-					}
-				}
-			}
-
-			// Increment index
-			if (index >= 0) index++;
-		
-		} while (index < response.length() && index >= 0);
+		// Recorded with the downlink by sendAndReceive()
+		_sessionTxBytes += ATCommand.length();
+		_sessionRxBytes += rxBytes;
 	}
 	else
 	{
-		return false;
+		char key[COMMAND_KEY_MAX + 1];
+		CommandStats::getATKey(command.c_str(), key);
+		_commandStats.record(key, (unsigned int) (currentTime - startTime), !error && token == TOKEN_OK,
+		                     ATCommand.length(), rxBytes);
 	}
+#endif  //  UNABIZ_COMMAND_STATS
 
-	// Check if we have data on the first string and OK on second = data + OK
-	if (firstData != "" && secondData == ATOK)
+	if (error)
 	{
-		dataOut = firstData;
-		return true;
+		echoPort->println(F("ERROR on rx frame"));
+		return false;
 	}
-	// Check if we have only an OK
-	else if (firstData == ATOK && secondData == "")
+	// Check if we have data followed by OK, or only an OK
+	if (token == TOKEN_OK)
 	{
+		echoPort->println(ATOK);
+		if (firstData != "") dataOut = firstData;
 		return true;
 	}
 	else
 	{
-		echoPort->println("Wrong AT response");
+		echoPort->println(F("Wrong AT response"));
 		return false;
 	}
 }
@@ -777,6 +787,14 @@ bool Akeru::getPowerActive(String &result)
 	}
 }
 
+#if UNABIZ_COMMAND_STATS
+const CommandStats &Akeru::getCommandStats()
+{
+	//  Return the round-trip time and bytes for each command sent.
+	return _commandStats;
+}
+#endif  //  UNABIZ_COMMAND_STATS
+
 bool Akeru::getLibraryVersion(String &result)
 {
 	//  Get RF library version.
@@ -798,10 +816,7 @@ bool Akeru::sendString(const String str)
 	//  TODO: If string is over 12 characters, split into multiple messages.
 	//  Convert each character into 2 bytes.
 	String payload = "";
-	for (int i = 0; i < str.length(); i++) {
-		char ch = str.charAt(i);
-		payload += toHex(ch);
-	}
+	appendHex(payload, (const uint8_t *) str.c_str(), str.length());
 	//  Send the encoded payload.
 	return sendMessage(payload);
 }
@@ -50,6 +50,7 @@
 #define ATPOWER "ATS302"
 #define ATDOWNLINK "AT$SB=1,2,1"
 #define ATSIGFOXTX "AT$SS="
+#define ATSIGFOXTX_DOWNLINK ",2,1"  //  Append to AT$SS= for 2 retries and a downlink request.
 #define ATTDLANTX "AT$SL="
 #define DOWNLINKEND "+RX END"
 
@@ -92,17 +93,25 @@ class Akeru
 	public:
     Akeru();
 		Akeru(unsigned int rx, unsigned int tx);
+#ifdef MODEM_PORT_HARDWARE
+		//  Use a spare hardware UART for the module, e.g. Serial1 on Mega, Leonardo and SAMD boards.
+		Akeru(HardwareSerial *port);
+#endif  //  MODEM_PORT_HARDWARE
     bool begin();
     void echoOn();  //  Turn on send/receive echo.
     void echoOff();  //  Turn off send/receive echo.
     void setEchoPort(Print *port);  //  Set the port for sending echo output.
 		void echo(String msg);  //  Echo the debug message.
+		void echo(const char *msg);  //  Echo the debug message without allocating a String.
     bool isReady();
     bool sendMessage(const String payload);  //  Send the payload of hex digits to the network, max 12 bytes.
 		bool sendString(const String str);  //  Sending a text string, max 12 characters allowed.
-    bool receive(String &data);  //  Receive a message.
-    bool enterCommandMode() {}  //  Enter Command Mode for sending module commands, not data.
-    bool exitCommandMode() {}  //  Exit Command Mode so we can send data.
+    //  Send the payload of hex digits to the network and get the 8 bytes of the downlink response.
+    bool sendMessageAndGetResponse(const String payload, uint8_t downlink[MAX_BYTES_PER_DOWNLINK]);
+    bool receive(uint8_t downlink[MAX_BYTES_PER_DOWNLINK]);  //  Send a bit and get the 8 bytes of the downlink response.
+    bool receive(String &data);  //  Receive a message as hex digits.
+    bool enterCommandMode() { return true; }  //  Enter Command Mode for sending module commands, not data.
+    bool exitCommandMode() { return true; }  //  Exit Command Mode so we can send data.
 
     //  Commands for the module, must be run in Command Mode.
     bool getEmulator(int &result)  //  Return 0 if emulator mode disabled, else return 1.
@@ -151,18 +160,34 @@ class Akeru
 		bool getRFRevision(String &revision);  //  Get RF chip revision number.
 		bool getPowerActive(String &power);  //  Get module RF active power supply voltage
 		bool getLibraryVersion(String &version); //  Get RF library version.
+#if UNABIZ_COMMAND_STATS
+		const CommandStats &getCommandStats();  //  Return the round-trip time and bytes for each command sent.
+#endif  //  UNABIZ_COMMAND_STATS
 
 private:
     bool sendAT();
 		bool sendATCommand(const String command, const int timeout, String &dataOut);
-		SoftwareSerial* serialPort;
+    bool sendAndReceive(const String &command, uint8_t downlink[MAX_BYTES_PER_DOWNLINK]);  //  Send and wait for the downlink.
+    bool receiveDownlink(uint8_t downlink[MAX_BYTES_PER_DOWNLINK]);  //  Wait for the downlink after sending.
+    void beginSession();  //  Keep the serial port open across the uplink and the downlink.
+    void endSession();  //  End the session and stop the serial port.
+    void openPort();  //  Start the serial port if not started.
+    void closePort();  //  Stop the serial port if started.
+		ModemPort serialPort;  //  Serial port for the SIGFOX module.
     Print *echoPort;  //  Port for sending echo output.  Defaults to Serial.
     Print *lastEchoPort;  //  Last port used for sending echo output.
     bool _emulationMode = false;  //  True if using emulation (TD LAN) mode.
+    bool _portOpen = false;  //  True if the serial port has been started.
+    uint8_t _sessionDepth = 0;  //  Number of nested sessions keeping the serial port open.
 		unsigned long _lastSend;  //  Timestamp of last send.
     unsigned int _sequenceNumber;  //  Sequence number for the message.
     String _id = "";  //  SIGFOX device ID.
     String _pac = "";  //  SIGFOX PAC.
+#if UNABIZ_COMMAND_STATS
+    CommandStats _commandStats;  //  Round-trip time and bytes for each command.
+    unsigned int _sessionTxBytes;  //  Bytes sent since the start of the uplink with downlink.
+    unsigned int _sessionRxBytes;  //  Bytes received since the start of the uplink with downlink.
+#endif  //  UNABIZ_COMMAND_STATS
 };
 
 #endif // AKERU_H
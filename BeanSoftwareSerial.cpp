@@ -57,9 +57,7 @@ http://arduiniana.org.
 // Statics
 //
 BeanSoftwareSerial *BeanSoftwareSerial::active_object = 0;
-char BeanSoftwareSerial::_receive_buffer[_SS_MAX_RX_BUFF];
-volatile uint8_t BeanSoftwareSerial::_receive_buffer_tail = 0;
-volatile uint8_t BeanSoftwareSerial::_receive_buffer_head = 0;
+char BeanSoftwareSerial::_default_receive_buffer[_SS_MAX_RX_BUFF];
 
 //
 // Debugging
@@ -102,6 +100,7 @@ bool BeanSoftwareSerial::listen()
       active_object->stopListening();
 
     _buffer_overflow = false;
+    _overflow_count = 0;
     _receive_buffer_head = _receive_buffer_tail = 0;
     active_object = this;
 
@@ -174,8 +173,11 @@ void BeanSoftwareSerial::recv()
     if (_inverse_logic)
       d = ~d;
 
-    // if buffer full, set the overflow flag and return
-    uint8_t next = (_receive_buffer_tail + 1) % _SS_MAX_RX_BUFF;
+    // if buffer full, set the overflow flag and return.  Wrap without
+    // dividing, since the buffer size is not a constant
+    uint8_t next = _receive_buffer_tail + 1;
+    if (next >= _receive_buffer_size)
+      next = 0;
     if (next != _receive_buffer_head)
     {
       // save new data in buffer: tail points to where byte goes
@@ -186,6 +188,8 @@ void BeanSoftwareSerial::recv()
     {
       DebugPulse(_DEBUG_PIN1, 1);
       _buffer_overflow = true;
+      if (_overflow_count != 0xffff)
+        _overflow_count++;
     }
 
     // skip the stop bit
@@ -261,12 +265,24 @@ ISR(PCINT3_vect, ISR_ALIASOF(PCINT0_vect));
 // Constructor
 //
 BeanSoftwareSerial::BeanSoftwareSerial(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic /* = false */) :
+  BeanSoftwareSerial(receivePin, transmitPin, _default_receive_buffer, _SS_MAX_RX_BUFF, inverse_logic)
+{
+}
+
+BeanSoftwareSerial::BeanSoftwareSerial(uint8_t receivePin, uint8_t transmitPin,
+                                       char *receiveBuffer, uint8_t receiveBufferSize,
+                                       bool inverse_logic /* = false */) :
   _rx_delay_centering(0),
   _rx_delay_intrabit(0),
   _rx_delay_stopbit(0),
   _tx_delay(0),
   _buffer_overflow(false),
-  _inverse_logic(inverse_logic)
+  _inverse_logic(inverse_logic),
+  _receive_buffer(receiveBuffer),
+  _receive_buffer_size(receiveBufferSize),
+  _receive_buffer_tail(0),
+  _receive_buffer_head(0),
+  _overflow_count(0)
 {
   setTX(transmitPin);
   setRX(receivePin);
@@ -420,8 +436,11 @@ int BeanSoftwareSerial::read()
     return -1;
 
   // Read from "head"
-  uint8_t d = _receive_buffer[_receive_buffer_head]; // grab next byte
-  _receive_buffer_head = (_receive_buffer_head + 1) % _SS_MAX_RX_BUFF;
+  uint8_t head = _receive_buffer_head;
+  uint8_t d = _receive_buffer[head]; // grab next byte
+  if (++head >= _receive_buffer_size)
+    head = 0;
+  _receive_buffer_head = head;
   return d;
 }
 
@@ -430,7 +449,39 @@ int BeanSoftwareSerial::available()
   if (!isListening())
     return 0;
 
-  return (_receive_buffer_tail + _SS_MAX_RX_BUFF - _receive_buffer_head) % _SS_MAX_RX_BUFF;
+  uint8_t tail = _receive_buffer_tail;
+  uint8_t head = _receive_buffer_head;
+  return tail >= head ? tail - head : tail + _receive_buffer_size - head;
+}
+
+uint8_t BeanSoftwareSerial::readAvailable(uint8_t *buffer, uint8_t length)
+{
+  if (!isListening())
+    return 0;
+
+  // Copy from "head" to the "tail" seen on entry.  Bytes received while
+  // copying are left for the next call.  Only the reader moves "head".
+  uint8_t tail = _receive_buffer_tail;
+  uint8_t head = _receive_buffer_head;
+  uint8_t count = 0;
+  while (head != tail && count < length)
+  {
+    buffer[count++] = _receive_buffer[head];
+    if (++head >= _receive_buffer_size)
+      head = 0;
+  }
+  _receive_buffer_head = head;
+  return count;
+}
+
+uint16_t BeanSoftwareSerial::overflowCount()
+{
+  // Read the 16-bit counter with interrupts off, since recv() may update it
+  uint8_t oldSREG = SREG;
+  cli();
+  uint16_t count = _overflow_count;
+  SREG = oldSREG;
+  return count;
 }
 
 size_t BeanSoftwareSerial::write(uint8_t b)
@@ -45,7 +45,9 @@ http://arduiniana.org.
 * Definitions
 ******************************************************************************/
 
-#define _SS_MAX_RX_BUFF 64 // RX buffer size
+#ifndef _SS_MAX_RX_BUFF
+#define _SS_MAX_RX_BUFF 64 // Size of the RX buffer shared by instances without their own buffer
+#endif
 #ifndef GCC_VERSION
 #define GCC_VERSION (__GNUC__ * 10000 + __GNUC_MINOR__ * 100 + __GNUC_PATCHLEVEL__)
 #endif
@@ -71,10 +73,15 @@ private:
   uint16_t _buffer_overflow:1;
   uint16_t _inverse_logic:1;
 
+  // RX ring buffer: either owned by this object or the shared default buffer
+  char *_receive_buffer;
+  uint8_t _receive_buffer_size;
+  volatile uint8_t _receive_buffer_tail;
+  volatile uint8_t _receive_buffer_head;
+  volatile uint16_t _overflow_count;  // Number of bytes dropped because the RX buffer was full
+
   // static data
-  static char _receive_buffer[_SS_MAX_RX_BUFF]; 
-  static volatile uint8_t _receive_buffer_tail;
-  static volatile uint8_t _receive_buffer_head;
+  static char _default_receive_buffer[_SS_MAX_RX_BUFF];
   static BeanSoftwareSerial *active_object;
 
   // private methods
@@ -94,6 +101,9 @@ private:
 public:
   // public methods
   BeanSoftwareSerial(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic = false);
+  // Use receiveBuffer of receiveBufferSize bytes as the RX ring buffer, which holds up to receiveBufferSize - 1 bytes
+  BeanSoftwareSerial(uint8_t receivePin, uint8_t transmitPin, char *receiveBuffer, uint8_t receiveBufferSize,
+                     bool inverse_logic = false);
   ~BeanSoftwareSerial();
   void begin(long speed);
   bool listen();
@@ -101,7 +111,10 @@ public:
   bool isListening() { return this == active_object; }
   bool stopListening();
   bool overflow() { bool ret = _buffer_overflow; if (ret) _buffer_overflow = false; return ret; }
+  uint16_t overflowCount();  // Number of bytes dropped since listen() because the RX buffer was full
   int peek();
+  // Copy up to length received bytes into buffer without waiting.  Returns the number of bytes copied.
+  uint8_t readAvailable(uint8_t *buffer, uint8_t length);
 
   virtual size_t write(uint8_t byte);
   virtual int read();
@@ -115,6 +128,17 @@ public:
   static inline void handle_interrupt() __attribute__((__always_inline__));
 };
 
+// BeanSoftwareSerial with its own RX ring buffer of RX_BUFFER_SIZE bytes, instead of the shared buffer
+template <uint8_t RX_BUFFER_SIZE> class BeanSoftwareSerialBuffer : public BeanSoftwareSerial
+{
+public:
+  BeanSoftwareSerialBuffer(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic = false) :
+    BeanSoftwareSerial(receivePin, transmitPin, _buffer, RX_BUFFER_SIZE, inverse_logic) {}
+
+private:
+  char _buffer[RX_BUFFER_SIZE];
+};
+
 // Arduino 0012 workaround
 #undef int
 #undef char
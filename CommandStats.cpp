@@ -0,0 +1,90 @@
+//  Count the commands sent to the SIGFOX module, with the round-trip time and bytes sent and
+//  received for each command.
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+#include "SIGFOX.h"
+
+static const char overflowKey[] = "*";  //  Key for the commands that don't fit in the table.
+
+CommandStats::CommandStats() {
+  reset();
+}
+
+void CommandStats::reset() {
+  //  Clear all stats.
+  memset(stats, 0, sizeof(stats));
+  count = 0;
+}
+
+void CommandStats::record(const char *key, unsigned long millis, bool ok,
+                          unsigned int txBytes, unsigned int rxBytes) {
+  //  Record one command.  If the table is full, the last entry counts all other commands.
+  CommandStat *stat = (CommandStat *) find(key);
+  if (stat == 0 && count >= COMMAND_STATS_SIZE - 1) {
+    key = overflowKey;
+    stat = (CommandStat *) find(key);
+  }
+  if (stat == 0) {
+    stat = &stats[count++];
+    strncpy(stat->key, key, COMMAND_KEY_MAX);
+    stat->key[COMMAND_KEY_MAX] = 0;
+  }
+  const uint16_t ms = millis > 0xffff ? 0xffff : (uint16_t) millis;
+  if (stat->count == 0 || ms < stat->minMillis) stat->minMillis = ms;
+  if (ms > stat->maxMillis) stat->maxMillis = ms;
+  stat->count++;
+  if (!ok) stat->failures++;
+  stat->totalMillis = stat->totalMillis + millis;
+  stat->txBytes = stat->txBytes + txBytes;
+  stat->rxBytes = stat->rxBytes + rxBytes;
+}
+
+uint8_t CommandStats::getCount() const {
+  return count;
+}
+
+const CommandStat *CommandStats::get(uint8_t index) const {
+  if (index >= count) return 0;
+  return &stats[index];
+}
+
+const CommandStat *CommandStats::find(const char *key) const {
+  for (uint8_t i = 0; i < count; i++)
+    if (strncmp(stats[i].key, key, COMMAND_KEY_MAX) == 0) return &stats[i];
+  return 0;
+}
+
+void CommandStats::dump(Print *port) const {
+  //  Print one line per command: key, count, failures, min/avg/max ms and bytes sent/received.
+  for (uint8_t i = 0; i < count; i++) {
+    const CommandStat &stat = stats[i];
+    port->print(stat.key);
+    port->print(F(" n=")); port->print(stat.count);
+    port->print(F(" fail=")); port->print(stat.failures);
+    port->print(F(" ms=")); port->print(stat.minMillis);
+    port->print('/'); port->print(stat.totalMillis / stat.count);
+    port->print('/'); port->print(stat.maxMillis);
+    port->print(F(" tx=")); port->print(stat.txBytes);
+    port->print(F(" rx=")); port->println(stat.rxBytes);
+  }
+}
+
+void CommandStats::getATKey(const char *command, char key[COMMAND_KEY_MAX + 1]) {
+  //  Convert the AT command to its key, e.g. "AT$SF=0102" to "SF" and "AT$I=10" to "I=10".
+  if (strncmp(command, "AT", 2) == 0 && command[2] != 0 && command[2] != '\r') command = command + 2;
+  if (command[0] == '$') command++;
+  uint8_t length = 0;
+  while (length < COMMAND_KEY_MAX) {
+    const char ch = command[length];
+    if (ch == 0 || ch == ',' || ch == '\r' || ch == '\n') break;
+    if (ch == '=' && length > 1) break;
+    key[length++] = ch;
+  }
+  key[length] = 0;
+}
@@ -0,0 +1,51 @@
+//  Count the commands sent to the SIGFOX module, with the round-trip time and bytes sent and
+//  received for each command, so that we may see which commands keep the module awake.
+//  Enable with UNABIZ_COMMAND_STATS in SIGFOX.h.
+#ifndef UNABIZ_ARDUINO_COMMANDSTATS_H
+#define UNABIZ_ARDUINO_COMMANDSTATS_H
+
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+const uint8_t COMMAND_STATS_SIZE = 10;  //  Number of commands tracked.  Further commands are counted under "*".
+const uint8_t COMMAND_KEY_MAX = 5;  //  Max chars in the command key, e.g. "SF", "I=10", "GI?".
+
+//  Stats for one command.
+struct CommandStat {
+  char key[COMMAND_KEY_MAX + 1];  //  Command key, e.g. "SF" for AT$SF=...
+  uint16_t count;  //  Number of times sent.
+  uint16_t failures;  //  Number of times the response was missing or incomplete.
+  uint16_t minMillis;  //  Shortest round trip, from the first char sent to the end of the response.
+  uint16_t maxMillis;  //  Longest round trip.
+  unsigned long totalMillis;  //  Total round trip time, for the average.
+  unsigned long txBytes;  //  Total bytes sent.
+  unsigned long rxBytes;  //  Total bytes received.
+};
+
+class CommandStats
+{
+public:
+  CommandStats();
+  //  Record one command sent with the round-trip time and the bytes sent and received.
+  void record(const char *key, unsigned long millis, bool ok,
+              unsigned int txBytes, unsigned int rxBytes);
+  void reset();  //  Clear all stats.
+  uint8_t getCount() const;  //  Return the number of commands in the table.
+  const CommandStat *get(uint8_t index) const;  //  Return the stats at the index, or 0.
+  const CommandStat *find(const char *key) const;  //  Return the stats for the command, or 0.
+  void dump(Print *port) const;  //  Print one line per command.
+  //  Convert an AT command to its key: strip "AT$" or "AT", stop at ',' or '\r', and at '='
+  //  unless the name is 1 char (e.g. "I=10").  So "AT$SF=0102,1" becomes "SF" and "AT" stays "AT".
+  static void getATKey(const char *command, char key[COMMAND_KEY_MAX + 1]);
+
+private:
+  CommandStat stats[COMMAND_STATS_SIZE];
+  uint8_t count;  //  Number of commands in the table.
+};
+
+#endif  //  UNABIZ_ARDUINO_COMMANDSTATS_H
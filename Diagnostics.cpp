@@ -0,0 +1,96 @@
+//  Record the lowest free memory and the longest module response, to track down resets caused by
+//  running out of RAM.
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+#include "SIGFOX.h"
+
+#if UNABIZ_DIAGNOSTICS
+
+#ifdef __AVR__
+//  Maintained by malloc() in avr-libc.
+extern char _end;  //  End of the static variables, where the heap starts.
+extern char __stack;  //  Top of RAM, where the stack starts.
+extern char *__brkval;  //  Top of the heap, 0 if nothing allocated yet.
+struct __freelist {
+  size_t sz;
+  struct __freelist *nx;
+};
+extern struct __freelist *__flp;  //  Blocks freed below the top of the heap.
+
+const uint8_t STACK_PAINT = 0xc5;  //  Unused RAM is filled with this byte at startup.
+
+//  Fill the RAM between the heap and the stack with STACK_PAINT before main() starts.  Runs in
+//  section .init1, before the stack and the zero register are set up, so it's written in assembly.
+void paintStack() __attribute__((naked, used, section(".init1")));
+void paintStack() {
+  __asm volatile (
+    "    ldi r30,lo8(_end)\n"
+    "    ldi r31,hi8(_end)\n"
+    "    ldi r24,lo8(0xc5)\n"  //  STACK_PAINT
+    "    ldi r25,hi8(__stack)\n"
+    "    rjmp .paintcmp\n"
+    ".paintloop:\n"
+    "    st Z+,r24\n"
+    ".paintcmp:\n"
+    "    cpi r30,lo8(__stack)\n"
+    "    cpc r31,r25\n"
+    "    brlo .paintloop\n"
+    "    breq .paintloop" ::);
+}
+
+static char *heapTop() {
+  //  Return the top of the heap.
+  return __brkval == 0 ? &_end : __brkval;
+}
+#endif  //  __AVR__
+
+static Diagnostics diagnostics = { 0xffff, 0xffff, 0, 0, 0 };
+
+void sampleDiagnostics(unsigned int responseLength) {
+  //  Update the low-water marks for the heap and the longest response.
+  if (responseLength > diagnostics.responseMax)
+    diagnostics.responseMax = responseLength > 0xff ? 0xff : (uint8_t) responseLength;
+#ifdef __AVR__
+  uint8_t marker;  //  Address of this local variable is the current stack pointer.
+  const uint16_t heapFree = (uint16_t) (&marker - heapTop());
+  if (heapFree < diagnostics.heapLow) diagnostics.heapLow = heapFree;
+  //  Count the freed blocks that String left behind when it grew.
+  uint16_t freeBytes = 0;
+  uint8_t fragments = 0;
+  for (struct __freelist *block = __flp; block != 0; block = block->nx) {
+    freeBytes = freeBytes + block->sz;
+    if (fragments < 0xff) fragments++;
+  }
+  if (freeBytes > diagnostics.freeListMax) diagnostics.freeListMax = freeBytes;
+  if (fragments > diagnostics.fragmentsMax) diagnostics.fragmentsMax = fragments;
+#endif  //  __AVR__
+}
+
+const Diagnostics &getDiagnostics() {
+  //  Return the low-water marks.  The stack low-water mark is the number of painted bytes
+  //  above the heap that were never overwritten by the stack.
+  sampleDiagnostics(0);
+#ifdef __AVR__
+  const uint8_t *p = (const uint8_t *) heapTop();
+  uint16_t painted = 0;
+  while (p < (const uint8_t *) &__stack && *p == STACK_PAINT) { p++; painted++; }
+  diagnostics.stackLow = painted;
+#else  //  __AVR__
+  diagnostics.heapLow = 0;
+  diagnostics.stackLow = 0;
+#endif  //  __AVR__
+  return diagnostics;
+}
+
+char *getDiagnosticsHex(char *hex) {
+  //  Write the low-water marks as hex digits for sending in an uplink.
+  return bytesToHex((const uint8_t *) &getDiagnostics(), DIAGNOSTICS_BYTES, hex);
+}
+
+#endif  //  UNABIZ_DIAGNOSTICS
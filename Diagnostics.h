@@ -0,0 +1,41 @@
+//  Record the lowest free memory and the longest module response, to track down resets caused by
+//  running out of RAM.  Enable with UNABIZ_DIAGNOSTICS in SIGFOX.h.  When disabled, the transceivers
+//  don't record anything and the stack is not painted.
+#ifndef UNABIZ_ARDUINO_DIAGNOSTICS_H
+#define UNABIZ_ARDUINO_DIAGNOSTICS_H
+
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+const uint8_t DIAGNOSTICS_BYTES = 8;  //  Size of the Diagnostics struct when sent in an uplink.
+
+//  Memory low-water marks since reset.  8 bytes, little endian, so that it may be sent
+//  as the payload of a diagnostic uplink.  The memory fields are 0 when not running on AVR.
+struct Diagnostics {
+  uint16_t heapLow;  //  Lowest free bytes seen between the top of the heap and the stack pointer.
+  uint16_t stackLow;  //  Lowest free bytes between the heap and the stack, from the stack painting.
+  uint16_t freeListMax;  //  Most bytes seen in freed heap blocks below the top of the heap.
+  uint8_t fragmentsMax;  //  Most freed heap blocks seen, i.e. fragmentation by String.
+  uint8_t responseMax;  //  Longest response received from the SIGFOX module.
+} __attribute__((packed));
+
+#if UNABIZ_DIAGNOSTICS
+//  Called by the transceivers after each response from the SIGFOX module.  Call from the sketch
+//  with responseLength 0 at other points where memory usage is high.
+void sampleDiagnostics(unsigned int responseLength);
+//  Return the low-water marks.  Scans the painted stack, so don't call in a tight loop.
+const Diagnostics &getDiagnostics();
+//  Write the low-water marks as 16 hex digits into hex, which must have 17 chars, for sending
+//  with sendMessage().  Returns hex.
+char *getDiagnosticsHex(char *hex);
+#define diagnose(responseLength) sampleDiagnostics(responseLength)
+#else  //  UNABIZ_DIAGNOSTICS
+#define diagnose(responseLength) {}
+#endif  //  UNABIZ_DIAGNOSTICS
+
+#endif  //  UNABIZ_ARDUINO_DIAGNOSTICS_H
@@ -0,0 +1,159 @@
+//  Send the messages through several SIGFOX transceivers, with failover.
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+#include "SIGFOX.h"
+
+#if UNABIZ_LOG_LEVEL >= 1
+//  Log line of TransceiverGroup, e.g. "TransceiverGroup.send: transceiver 1".
+static char failoverEcho[64];
+#endif  //  UNABIZ_LOG_LEVEL >= 1
+
+FailoverRouter::FailoverRouter() {
+  probeInterval = FAILOVER_PROBE_INTERVAL;
+  memberCount = 0;
+  lastTransceiver = -1;
+}
+
+void FailoverRouter::addMember(UplinkBudget &budget) {
+  //  Add the next transceiver.  Assume it works until it fails.
+  if (memberCount >= FAILOVER_MAX_TRANSCEIVERS) return;
+  budgets[memberCount] = &budget;
+  FailoverStats &memberStats = stats[memberCount];
+  memberStats.successRate = FAILOVER_RATE_MAX;
+  memberStats.latency = 0;
+  memberStats.sentCount = 0;
+  memberStats.failedCount = 0;
+  memberStats.probeCount = 0;
+  probeTimes[memberCount] = 0;
+  memberCount++;
+}
+
+int FailoverRouter::selectTransceiver(uint8_t tried) {
+  //  Return the transceiver not tried yet with the lowest expected time per successful send,
+  //  i.e. latency divided by success rate, whose budget allows an uplink now.  Transceivers
+  //  that have never sent have latency 0, so they are tried first, in the order added.  The
+  //  transceivers that are due to be probed, see selectProbe(), are tried only after the others.
+  int best = -1;
+  bool bestFailing = false;
+  unsigned long bestCost = 0;
+  for (uint8_t i = 0; i < memberCount; i++) {
+    if (tried & ((uint8_t) 1 << i)) continue;
+    if (!budgets[i]->isAvailable()) continue;
+    const bool failing = stats[i].successRate <= FAILOVER_RATE_PROBE;
+    const unsigned long cost = stats[i].latency * 256 / (stats[i].successRate + 1);
+    if (best < 0 || (bestFailing && !failing) || (bestFailing == failing && cost < bestCost)) {
+      best = i;  bestFailing = failing;  bestCost = cost;
+    }
+  }
+  return best;
+}
+
+void FailoverRouter::update(uint8_t index, bool ok, unsigned long elapsed, unsigned int commandFailures) {
+  //  Record the result of a send.  The success rate recovers by 1/8 of the way to the max
+  //  after each success but is halved after each failure, so that a module that fails quickly,
+  //  e.g. when unplugged, is tried after the slower modules that work.  A send that succeeded
+  //  after failed commands doesn't recover the rate.  The latency is a moving average that
+  //  weights the latest send by 1/4.
+  FailoverStats &memberStats = stats[index];
+  if (!ok) {
+    memberStats.successRate = memberStats.successRate >> 1;
+    probeTimes[index] = millis();  //  Probe again one interval after the last failure.
+  } else if (commandFailures == 0) {
+    memberStats.successRate = memberStats.successRate + ((FAILOVER_RATE_MAX - memberStats.successRate) >> 3);
+  }
+  memberStats.latency = (memberStats.latency == 0) ? elapsed :
+      memberStats.latency - (memberStats.latency >> 2) + (elapsed >> 2);
+  if (ok) memberStats.sentCount++;
+  else memberStats.failedCount++;
+}
+
+int FailoverRouter::selectProbe() {
+  //  Return the first transceiver with a low success rate that hasn't failed or been probed
+  //  for one probe interval.
+  if (probeInterval == 0) return -1;
+  const unsigned long now = millis();
+  for (uint8_t i = 0; i < memberCount; i++) {
+    if (stats[i].successRate > FAILOVER_RATE_PROBE) continue;
+    if (now - probeTimes[i] >= probeInterval) return i;
+  }
+  return -1;
+}
+
+void FailoverRouter::probed(uint8_t index, bool ok) {
+  //  Record the result of a probe.  A module that responds gets back just enough success rate
+  //  to stop the probes, so that it's tried again but a failed send soon sends it back to probing.
+  FailoverStats &memberStats = stats[index];
+  memberStats.probeCount++;
+  probeTimes[index] = millis();
+  if (ok && memberStats.successRate <= FAILOVER_RATE_PROBE) memberStats.successRate = FAILOVER_RATE_PROBE + 1;
+}
+
+#if UNABIZ_COMMAND_STATS
+void FailoverRouter::getCommandTotals(const CommandStats &commandStats, unsigned long &totalMillis,
+                                      unsigned int &failures) {
+  //  Add up the round-trip time and failures of all commands, including those counted under "*".
+  totalMillis = 0;
+  failures = 0;
+  for (uint8_t i = 0; i < commandStats.getCount(); i++) {
+    const CommandStat *stat = commandStats.get(i);
+    totalMillis = totalMillis + stat->totalMillis;
+    failures = failures + stat->failures;
+  }
+}
+#endif  //  UNABIZ_COMMAND_STATS
+
+#if UNABIZ_LOG_LEVEL >= 1
+const char *FailoverRouter::logLine(const __FlashStringHelper *text, int index,
+                                    const __FlashStringHelper *suffix) {
+  //  Write the text, the transceiver number and the suffix into failoverEcho.
+  const char *last = failoverEcho + sizeof(failoverEcho) - 1;
+  strncpy_P(failoverEcho, (PGM_P) text, sizeof(failoverEcho) - 1);
+  failoverEcho[sizeof(failoverEcho) - 1] = 0;
+  char *end = failoverEcho + strlen(failoverEcho);
+  if (index >= 0 && end < last) *end++ = '0' + index;
+  *end = 0;
+  if (suffix) strncpy_P(end, (PGM_P) suffix, last - end);
+  failoverEcho[sizeof(failoverEcho) - 1] = 0;
+  return failoverEcho;
+}
+#endif  //  UNABIZ_LOG_LEVEL >= 1
+
+bool FailoverRouter::isAvailable() {
+  //  Return true if the budget of any transceiver allows an uplink now.
+  for (uint8_t i = 0; i < memberCount; i++)
+    if (budgets[i]->isAvailable()) return true;
+  return false;
+}
+
+unsigned long FailoverRouter::getWaitMillis() {
+  //  Return the milliseconds until any transceiver may send, or 0xffffffff if no transceivers.
+  unsigned long wait = 0xffffffff;
+  for (uint8_t i = 0; i < memberCount; i++) {
+    const unsigned long memberWait = budgets[i]->getWaitMillis();
+    if (memberWait < wait) wait = memberWait;
+  }
+  return wait;
+}
+
+int FailoverRouter::getLastTransceiver() {
+  //  Return the transceiver that sent the last uplink, or -1 if all failed.
+  return lastTransceiver;
+}
+
+bool FailoverRouter::getStats(uint8_t index, FailoverStats &memberStats) {
+  //  Return the recent results of the transceiver.
+  if (index >= memberCount) return false;
+  memberStats = stats[index];
+  return true;
+}
+
+void FailoverRouter::setProbeInterval(unsigned long intervalMillis) {
+  //  Probe a failing transceiver every intervalMillis, or never if 0.
+  probeInterval = intervalMillis;
+}
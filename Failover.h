@@ -0,0 +1,254 @@
+//  Send the messages through several SIGFOX transceivers, e.g. UnaShield V1 and V2S on the same
+//  Arduino.  Each uplink is routed to the transceiver with the best recent success rate and
+//  latency, and is sent again with the next transceiver if it fails, e.g. when the module doesn't
+//  respond.  Each transceiver has its own message budget, so a group of 2 transceivers may send
+//  twice as many uplinks in a burst.  A transceiver whose sends failed is probed again after a
+//  while with probe(), without sending an uplink, so that it's preferred again once it recovers.
+//  Construct a Message with the group like any transceiver, e.g.
+//  TransceiverGroup<UnaShieldV2S, UnaShieldV1> group(wisol, wisolBudget, radiocrafts, radiocraftsBudget).
+#ifndef UNABIZ_ARDUINO_FAILOVER_H
+#define UNABIZ_ARDUINO_FAILOVER_H
+
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+const uint8_t FAILOVER_MAX_TRANSCEIVERS = 3;  //  Max number of transceivers in a group.
+const uint8_t FAILOVER_RATE_MAX = 248;  //  Success rate after many successful sends.
+//  Transceivers with this success rate or lower, e.g. after a failed send, are probed again.
+const uint8_t FAILOVER_RATE_PROBE = FAILOVER_RATE_MAX / 2;
+const unsigned long FAILOVER_PROBE_INTERVAL = 600000;  //  By default, probe a failing transceiver every 10 minutes.
+
+//  Recent results of a transceiver in the group.
+struct FailoverStats {
+  uint8_t successRate;  //  Recent sends that succeeded, 0 to FAILOVER_RATE_MAX.  Halved after each failure.
+  unsigned long latency;  //  Moving average of the milliseconds per send, 0 if never sent.
+  unsigned int sentCount;  //  Number of successful sends.
+  unsigned int failedCount;  //  Number of failed sends.
+  unsigned int probeCount;  //  Number of times probed after failing.
+};
+
+//  Placeholder for the unused transceivers of a TransceiverGroup.  Never sends.
+struct NoTransceiver {
+  void echo(const char *msg) {}
+  bool sendMessage(const String &payload) { return false; }
+  bool sendMessageAndGetResponse(const String &payload, uint8_t *downlink) { return false; }
+  bool getVoltage(float &voltage) { return false; }
+};
+
+//  Chooses the transceiver for each uplink from the recent results, the same code for all
+//  transceivers.  TransceiverGroup calls the transceivers.
+class FailoverRouter
+{
+public:
+  bool isAvailable();  //  Return true if the budget of any transceiver allows an uplink now.
+  unsigned long getWaitMillis();  //  Return the milliseconds until any transceiver may send.
+  int getLastTransceiver();  //  Return the transceiver that sent the last uplink, or -1 if all failed.
+  bool getStats(uint8_t index, FailoverStats &stats);  //  Return the recent results of the transceiver.
+  //  Probe a failing transceiver every intervalMillis, default FAILOVER_PROBE_INTERVAL.  0 to never probe.
+  void setProbeInterval(unsigned long intervalMillis);
+
+protected:
+  FailoverRouter();
+  void addMember(UplinkBudget &budget);  //  Add the next transceiver with its budget.
+  int selectTransceiver(uint8_t tried);  //  Return the best transceiver not tried yet, or -1 if none.
+  //  Record the result of a send.  commandFailures is the number of commands that the driver
+  //  reported as failed during the send, see CommandStats.
+  void update(uint8_t index, bool ok, unsigned long elapsed, unsigned int commandFailures);
+  int selectProbe();  //  Return the failing transceiver that is due to be probed, or -1 if none.
+  void probed(uint8_t index, bool ok);  //  Record the result of a probe.
+#if UNABIZ_COMMAND_STATS
+  //  Return the total round-trip milliseconds and failures of all commands in the stats.
+  static void getCommandTotals(const CommandStats &commandStats, unsigned long &totalMillis,
+                               unsigned int &failures);
+#endif  //  UNABIZ_COMMAND_STATS
+#if UNABIZ_LOG_LEVEL >= 1
+  //  Return the log line: the text from flash, then the transceiver number if not negative and the
+  //  suffix from flash if not 0.  Doesn't allocate a String.  The line is kept until the next call.
+  static const char *logLine(const __FlashStringHelper *text, int index = -1,
+                             const __FlashStringHelper *suffix = 0);
+#endif  //  UNABIZ_LOG_LEVEL >= 1
+
+  UplinkBudget *budgets[FAILOVER_MAX_TRANSCEIVERS];  //  Message budget of each transceiver.
+  FailoverStats stats[FAILOVER_MAX_TRANSCEIVERS];  //  Recent results of each transceiver.
+  unsigned long probeTimes[FAILOVER_MAX_TRANSCEIVERS];  //  millis() of the last failure or probe.
+  unsigned long probeInterval;  //  Milliseconds between probes of a failing transceiver, or 0.
+  uint8_t memberCount;  //  Number of transceivers.
+  int lastTransceiver;  //  Transceiver that sent the last uplink, or -1.
+};
+
+//  Up to 3 transceivers: Wisol, Radiocrafts or Akeru.  Each transceiver is called directly,
+//  so only the code for these transceivers is linked into the sketch.
+template <class T0, class T1 = NoTransceiver, class T2 = NoTransceiver> class TransceiverGroup:
+    public FailoverRouter
+{
+public:
+  //  Group the transceivers, which must have been started with begin().  Uplinks are sent with
+  //  each transceiver only when its budget allows.  Transceivers listed first are preferred until
+  //  the results are known.
+  TransceiverGroup(T0 &transceiver0, UplinkBudget &budget0);
+  TransceiverGroup(T0 &transceiver0, UplinkBudget &budget0, T1 &transceiver1, UplinkBudget &budget1);
+  TransceiverGroup(T0 &transceiver0, UplinkBudget &budget0, T1 &transceiver1, UplinkBudget &budget1,
+                   T2 &transceiver2, UplinkBudget &budget2);
+  void echo(const String &msg);  //  Echo the debug message with the first transceiver.
+  void echo(const char *msg);  //  Echo the debug message without allocating a String.
+  bool sendMessage(const String &payload);  //  Send the payload of hex digits to the network, max 12 bytes.
+  //  Send the payload of hex digits to the network and return the 8 bytes of the downlink response.
+  bool sendMessageAndGetResponse(const String &payload, uint8_t downlink[MAX_BYTES_PER_DOWNLINK]);
+  //  Probe the next failing transceiver that is due, by reading its voltage, without sending an
+  //  uplink.  Call this from loop() when no message is being sent.  Returns true if probed.
+  bool probe();
+
+private:
+  bool send(const String &payload, uint8_t *downlink);  //  Send with the best transceivers in turn.
+  bool sendWith(uint8_t index, const String &payload, uint8_t *downlink);  //  Send with the transceiver.
+  bool probeWith(uint8_t index);  //  Probe the transceiver.
+  //  Send with the transceiver and record the result.
+  template <class Transceiver> bool sendTransceiver(uint8_t index, Transceiver &transceiver,
+                                                    const String &payload, uint8_t *downlink);
+#if UNABIZ_COMMAND_STATS
+  //  Return the total round-trip milliseconds and failures of the commands sent by the transceiver.
+  template <class Transceiver> static void getCommandTotals(Transceiver &transceiver,
+                                                            unsigned long &totalMillis, unsigned int &failures)
+    { FailoverRouter::getCommandTotals(transceiver.getCommandStats(), totalMillis, failures); }
+  static void getCommandTotals(NoTransceiver &transceiver, unsigned long &totalMillis, unsigned int &failures)
+    { totalMillis = 0;  failures = 0; }
+#endif  //  UNABIZ_COMMAND_STATS
+
+  T0 *transceiver0;  //  First transceiver.
+  T1 *transceiver1 = 0;  //  Second transceiver, or 0 if none.
+  T2 *transceiver2 = 0;  //  Third transceiver, or 0 if none.
+};
+
+template <class T0, class T1, class T2> TransceiverGroup<T0, T1, T2>::TransceiverGroup(
+    T0 &transceiver0_, UplinkBudget &budget0): transceiver0(&transceiver0_) {
+  addMember(budget0);
+}
+
+template <class T0, class T1, class T2> TransceiverGroup<T0, T1, T2>::TransceiverGroup(
+    T0 &transceiver0_, UplinkBudget &budget0, T1 &transceiver1_, UplinkBudget &budget1):
+    transceiver0(&transceiver0_), transceiver1(&transceiver1_) {
+  addMember(budget0);
+  addMember(budget1);
+}
+
+template <class T0, class T1, class T2> TransceiverGroup<T0, T1, T2>::TransceiverGroup(
+    T0 &transceiver0_, UplinkBudget &budget0, T1 &transceiver1_, UplinkBudget &budget1,
+    T2 &transceiver2_, UplinkBudget &budget2):
+    transceiver0(&transceiver0_), transceiver1(&transceiver1_), transceiver2(&transceiver2_) {
+  addMember(budget0);
+  addMember(budget1);
+  addMember(budget2);
+}
+
+template <class T0, class T1, class T2> void TransceiverGroup<T0, T1, T2>::echo(const String &msg) {
+  //  Echo the debug message with the first transceiver.
+  echo(msg.c_str());
+}
+
+template <class T0, class T1, class T2> void TransceiverGroup<T0, T1, T2>::echo(const char *msg) {
+  //  Echo the debug message with the first transceiver.
+  transceiver0->echo(msg);
+}
+
+template <class T0, class T1, class T2> bool TransceiverGroup<T0, T1, T2>::sendMessage(const String &payload) {
+  //  Payload contains a string of hex digits, up to 24 digits / 12 bytes.  Return true if
+  //  any transceiver sent the payload.
+  return send(payload, 0);
+}
+
+template <class T0, class T1, class T2> bool TransceiverGroup<T0, T1, T2>::sendMessageAndGetResponse(
+    const String &payload, uint8_t downlink[MAX_BYTES_PER_DOWNLINK]) {
+  //  Payload contains a string of hex digits, up to 24 digits / 12 bytes.  Return the 8 bytes
+  //  of the downlink response from Sigfox in downlink.
+  return send(payload, downlink);
+}
+
+template <class T0, class T1, class T2> bool TransceiverGroup<T0, T1, T2>::send(const String &payload,
+                                                                             uint8_t *downlink) {
+  //  Send with the best transceiver whose budget allows.  If it fails, send with the next best
+  //  transceiver, until all have been tried.  Each attempt uses up the budget of the transceiver,
+  //  since the module may have transmitted before it failed.
+  lastTransceiver = -1;
+  uint8_t tried = 0;  //  Bit n is set if transceiver n has been tried.
+  for (;;) {
+    const int index = selectTransceiver(tried);
+    if (index < 0) break;
+    tried |= (uint8_t) 1 << index;
+#if UNABIZ_LOG_LEVEL >= 2
+    echo(logLine(F("TransceiverGroup.send: transceiver "), index));
+#endif  //  UNABIZ_LOG_LEVEL >= 2
+    budgets[index]->consume();
+    if (sendWith(index, payload, downlink)) { lastTransceiver = index; return true; }
+#if UNABIZ_LOG_LEVEL >= 1
+    echo(logLine(F("TransceiverGroup.send: Failed with transceiver "), index));
+#endif  //  UNABIZ_LOG_LEVEL >= 1
+  }
+#if UNABIZ_LOG_LEVEL >= 1
+  if (tried == 0) echo(logLine(F("TransceiverGroup.send: Error: No transceiver may send now")));
+#endif  //  UNABIZ_LOG_LEVEL >= 1
+  return false;
+}
+
+template <class T0, class T1, class T2> bool TransceiverGroup<T0, T1, T2>::sendWith(uint8_t index,
+    const String &payload, uint8_t *downlink) {
+  //  Send with the transceiver number index.
+  switch (index) {
+    case 0: return sendTransceiver(index, *transceiver0, payload, downlink);
+    case 1: return sendTransceiver(index, *transceiver1, payload, downlink);
+    default: return sendTransceiver(index, *transceiver2, payload, downlink);
+  }
+}
+
+template <class T0, class T1, class T2> template <class Transceiver> bool TransceiverGroup<T0, T1, T2>::
+    sendTransceiver(uint8_t index, Transceiver &transceiver, const String &payload, uint8_t *downlink) {
+  //  Send with the transceiver and record the result.  With UNABIZ_COMMAND_STATS, the latency is
+  //  the round-trip time of the commands measured by the driver, without the time to start the
+  //  port, and the commands that failed during the send count against the transceiver.
+  unsigned long elapsed = millis();
+  unsigned int commandFailures = 0;
+#if UNABIZ_COMMAND_STATS
+  unsigned long startMillis, endMillis;
+  unsigned int startFailures, endFailures;
+  getCommandTotals(transceiver, startMillis, startFailures);
+#endif  //  UNABIZ_COMMAND_STATS
+  const bool ok = downlink ? transceiver.sendMessageAndGetResponse(payload, downlink) :
+      transceiver.sendMessage(payload);
+  elapsed = millis() - elapsed;
+#if UNABIZ_COMMAND_STATS
+  getCommandTotals(transceiver, endMillis, endFailures);
+  if (endMillis != startMillis) elapsed = endMillis - startMillis;
+  commandFailures = endFailures - startFailures;
+#endif  //  UNABIZ_COMMAND_STATS
+  update(index, ok, elapsed, commandFailures);
+  return ok;
+}
+
+template <class T0, class T1, class T2> bool TransceiverGroup<T0, T1, T2>::probe() {
+  //  Probe the next failing transceiver that is due.  If the module responds, it's tried again
+  //  for the next uplinks.
+  const int index = selectProbe();
+  if (index < 0) return false;
+  const bool ok = probeWith(index);
+#if UNABIZ_LOG_LEVEL >= 2
+  echo(logLine(F("TransceiverGroup.probe: transceiver "), index, ok ? F(" OK") : F(" failed")));
+#endif  //  UNABIZ_LOG_LEVEL >= 2
+  probed(index, ok);
+  return true;
+}
+
+template <class T0, class T1, class T2> bool TransceiverGroup<T0, T1, T2>::probeWith(uint8_t index) {
+  //  Read the voltage of the module, which needs a round trip but no uplink.
+  float voltage;
+  switch (index) {
+    case 0: return transceiver0->getVoltage(voltage);
+    case 1: return transceiver1->getVoltage(voltage);
+    default: return transceiver2->getVoltage(voltage);
+  }
+}
+
+#endif  //  UNABIZ_ARDUINO_FAILOVER_H
@@ -0,0 +1,178 @@
+//  Keep the uplink messages that can't be sent now in EEPROM, and send them later.
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+#include <stddef.h>
+#include "SIGFOX.h"
+#ifdef ARDUINO
+  #include <EEPROM.h>
+#endif  //  ARDUINO
+
+static const uint8_t framePending = 0x80;  //  Bit 7 of StoredFrame.flags: frame not sent yet.
+static const uint8_t frameLengthMask = 0x0f;  //  Bits 0 to 3 of StoredFrame.flags: length.
+static const uint8_t framePriorityShift = 4;  //  Bits 4 and 5 of StoredFrame.flags: priority.
+
+FrameStore::FrameStore(int address0, uint8_t slotCount0) {
+  //  Keep the slots clear of the identity cache at the end of the EEPROM.
+  const int end = (int) EEPROM.length() - FRAME_STORE_RESERVED;
+  slotCount = (slotCount0 > FRAME_STORE_MAX_SLOTS) ? FRAME_STORE_MAX_SLOTS : slotCount0;
+  address = (address0 == FRAME_STORE_ADDRESS_AUTO) ? end - slotCount * (int) sizeof(StoredFrame) : address0;
+  if (address < 0) address = 0;
+  if (address + slotCount * (int) sizeof(StoredFrame) > end)
+    slotCount = (end > address) ? (end - address) / sizeof(StoredFrame) : 0;
+  head = 0;
+  nextSequence = 0;
+  for (uint8_t p = 0; p < FRAME_STORE_PRIORITIES; p++) pending[p] = 0;
+  count = 0;
+  lostCount = 0;
+}
+
+bool FrameStore::begin() {
+  //  Read all slots.  The slot with the highest sequence number was written last, so the next
+  //  frame is written after it.  Slots with the wrong CRC, e.g. erased or written during a
+  //  brownout, are skipped.
+  head = 0;
+  count = 0;
+  for (uint8_t p = 0; p < FRAME_STORE_PRIORITIES; p++) pending[p] = 0;
+  bool found = false;
+  uint16_t newest = 0;
+  for (uint8_t slot = 0; slot < slotCount; slot++) {
+    StoredFrame frame;
+    if (!readSlot(slot, frame)) continue;
+    //  Compare the sequence numbers across the rollover from 65535 to 0.
+    if (!found || (int16_t) (frame.sequence - newest) > 0) {
+      found = true;
+      newest = frame.sequence;
+      head = (slot + 1) % slotCount;
+    }
+    if (!(frame.flags & framePending)) continue;
+    pending[(frame.flags >> framePriorityShift) & 3] |= (uint32_t) 1 << slot;
+    count++;
+  }
+  nextSequence = found ? newest + 1 : 0;
+  return count > 0;
+}
+
+bool FrameStore::add(const uint8_t *payload, uint8_t length, uint8_t priority) {
+  //  Write the frame into the next slot.  If the slot has a frame not sent yet, it's the oldest
+  //  frame, which is lost.
+  if (length == 0 || length > MAX_BYTES_PER_MESSAGE || slotCount == 0) return false;
+  if (priority >= FRAME_STORE_PRIORITIES) priority = FRAME_STORE_PRIORITIES - 1;
+  const uint8_t slot = head;
+  const uint32_t bit = (uint32_t) 1 << slot;
+  for (uint8_t p = 0; p < FRAME_STORE_PRIORITIES; p++) {
+    if (!(pending[p] & bit)) continue;
+    pending[p] &= ~bit;
+    count--;
+    lostCount++;
+  }
+  StoredFrame frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.sequence = nextSequence;
+  frame.flags = framePending | (priority << framePriorityShift) | length;
+  memcpy(frame.payload, payload, length);
+  frame.crc = frameCrc(frame);
+  //  update() writes only the bytes that have changed, to reduce EEPROM wear.  The CRC is
+  //  written last, so a frame that is cut off by a brownout is skipped by begin().
+  const uint8_t *bytes = (const uint8_t *) &frame;
+  const int slotStart = slotAddress(slot);
+  for (uint8_t i = 0; i < sizeof(frame); i++) EEPROM.update(slotStart + i, bytes[i]);
+  pending[priority] |= bit;
+  count++;
+  head = (head + 1) % slotCount;
+  nextSequence++;
+  return true;
+}
+
+bool FrameStore::take(uint8_t *payload, uint8_t &length, uint8_t &priority, uint16_t &age) {
+  //  Remove the highest priority frame, oldest first, and mark it as sent in the EEPROM so that
+  //  it's not sent again after a reset.
+  for (int p = FRAME_STORE_PRIORITIES - 1; p >= 0; p--) {
+    const int slot = findOldest(p);
+    if (slot < 0) continue;
+    pending[p] &= ~((uint32_t) 1 << slot);
+    count--;
+    StoredFrame frame;
+    if (!readSlot(slot, frame)) {
+      //  Slot was overwritten since begin(), e.g. by another sketch.  Try the next frame.
+      lostCount++;
+      p++;
+      continue;
+    }
+    //  Clearing the pending bit writes only 1 byte.
+    EEPROM.update(slotAddress(slot) + offsetof(StoredFrame, flags), frame.flags & ~framePending);
+    length = frame.flags & frameLengthMask;
+    memcpy(payload, frame.payload, length);
+    priority = p;
+    age = nextSequence - frame.sequence - 1;
+    return true;
+  }
+  return false;
+}
+
+int FrameStore::getPriority() {
+  //  Return the highest priority of the frames not sent yet, or -1 if none.
+  for (int p = FRAME_STORE_PRIORITIES - 1; p >= 0; p--)
+    if (pending[p]) return p;
+  return -1;
+}
+
+uint8_t FrameStore::getCount() {
+  //  Return the number of frames not sent yet.
+  return count;
+}
+
+unsigned int FrameStore::getLostCount() {
+  //  Return the number of frames replaced before they were sent.
+  return lostCount;
+}
+
+uint8_t FrameStore::getSlotCount() {
+  //  Return the number of slots that fit into the EEPROM.
+  return slotCount;
+}
+
+int FrameStore::slotAddress(uint8_t slot) {
+  //  Return the EEPROM address of the slot.
+  return address + slot * sizeof(StoredFrame);
+}
+
+bool FrameStore::readSlot(uint8_t slot, StoredFrame &frame) {
+  //  Read the slot.  Returns false if the CRC is wrong or the length is not valid.
+  uint8_t *bytes = (uint8_t *) &frame;
+  const int slotStart = slotAddress(slot);
+  for (uint8_t i = 0; i < sizeof(frame); i++) bytes[i] = EEPROM.read(slotStart + i);
+  //  The CRC was computed before the frame was marked as sent.
+  const uint8_t flags = frame.flags;
+  frame.flags |= framePending;
+  const bool valid = frame.crc == frameCrc(frame);
+  frame.flags = flags;
+  const uint8_t length = flags & frameLengthMask;
+  return valid && length > 0 && length <= MAX_BYTES_PER_MESSAGE;
+}
+
+int FrameStore::findOldest(uint8_t priority) {
+  //  The slots after head are the oldest.  Rotate the bits so that head comes first, then the
+  //  first bit set is the oldest frame with the priority.
+  const uint32_t mask = pending[priority];
+  if (mask == 0) return -1;
+  const uint32_t rotated = (head == 0) ? mask : ((mask >> head) | (mask << (slotCount - head)));
+  return (head + __builtin_ctzl(rotated)) % slotCount;
+}
+
+uint8_t FrameStore::frameCrc(const StoredFrame &frame) {
+  //  Compute the CRC-8 (polynomial 0x07) of the frame, except the CRC itself.
+  const uint8_t *bytes = (const uint8_t *) &frame;
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < sizeof(frame) - 1; i++) {
+    crc ^= bytes[i];
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+  }
+  return crc;
+}
@@ -0,0 +1,75 @@
+//  Keep the uplink messages that can't be sent now in EEPROM, e.g. when the message budget is
+//  used up or the network is out of coverage, and send them later.  The frames are written to the
+//  slots in turn, so each slot wears out at the same rate.  Each slot has a write sequence number
+//  and a CRC, so the frames waiting to be sent are found again after a reset or a brownout.
+//  Adding and removing a frame take constant time, the slots are scanned only by begin().
+//  Attach the store to an UplinkQueue to keep the messages that don't fit into the queue.
+#ifndef UNABIZ_ARDUINO_FRAMESTORE_H
+#define UNABIZ_ARDUINO_FRAMESTORE_H
+
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+const uint8_t FRAME_STORE_MAX_SLOTS = 32;  //  Max number of frames in the store.
+const uint8_t FRAME_STORE_SLOTS = 16;  //  By default, keep up to 16 frames.
+//  By default, the slots end just before the identity cache at the end of the EEPROM, away from
+//  the sketch's own data at the start, whatever the size of the EEPROM.
+const int FRAME_STORE_ADDRESS_AUTO = -1;
+const uint8_t FRAME_STORE_PRIORITIES = 4;  //  Priorities 0 to 3, e.g. UPLINK_PRIORITY_ALARM.
+#if UNABIZ_IDENTITY_CACHE
+const uint8_t FRAME_STORE_RESERVED = WISOL_IDENTITY_SIZE;  //  Bytes at the end of the EEPROM not used.
+#else  //  UNABIZ_IDENTITY_CACHE
+const uint8_t FRAME_STORE_RESERVED = 0;
+#endif  //  UNABIZ_IDENTITY_CACHE
+
+//  A frame in the EEPROM.  16 bytes.  There is no timestamp, since millis() starts again from 0
+//  after a reset.  The sequence number tells the age of the frame in frames added instead.
+struct StoredFrame {
+  uint16_t sequence;  //  Increases with each frame added, to find the newest slot after a reset.
+  uint8_t flags;  //  Bits 0 to 3: length.  Bits 4 and 5: priority.  Bit 7: 1 if not sent yet.
+  uint8_t payload[MAX_BYTES_PER_MESSAGE];  //  Encoded message.
+  uint8_t crc;  //  CRC-8 of the bytes above, with bit 7 of flags set.
+};
+
+class FrameStore
+{
+public:
+  //  Use slotCount slots of the EEPROM, starting at address.  The slots that would overlap the
+  //  identity cache or go past the end of the EEPROM are not used, see getSlotCount().
+  FrameStore(int address = FRAME_STORE_ADDRESS_AUTO, uint8_t slotCount = FRAME_STORE_SLOTS);
+  //  Find the frames not sent yet, e.g. after a reset.  Call this from setup().  Returns true
+  //  if there are frames to be sent.
+  bool begin();
+  //  Add the payload of up to 12 bytes.  If the store is full, the oldest frame is replaced and
+  //  counted as lost.  Returns false if the frame is not valid or there are no slots.
+  bool add(const uint8_t *payload, uint8_t length, uint8_t priority);
+  //  Remove the highest priority frame, oldest first, into payload, which must have 12 bytes.
+  //  age is the number of frames added after it, also before a reset, e.g. to drop stale frames.
+  //  Returns false if the store is empty.
+  bool take(uint8_t *payload, uint8_t &length, uint8_t &priority, uint16_t &age);
+  int getPriority();  //  Return the highest priority of the frames not sent yet, or -1 if none.
+  uint8_t getCount();  //  Return the number of frames not sent yet.
+  unsigned int getLostCount();  //  Return the number of frames replaced before they were sent.
+  uint8_t getSlotCount();  //  Return the number of slots that fit into the EEPROM.
+
+private:
+  int slotAddress(uint8_t slot);  //  Return the EEPROM address of the slot.
+  bool readSlot(uint8_t slot, StoredFrame &frame);  //  Read the slot.  Returns false if the CRC is wrong.
+  int findOldest(uint8_t priority);  //  Return the oldest slot with the priority, or -1 if none.
+  static uint8_t frameCrc(const StoredFrame &frame);  //  Return the CRC-8 of the frame.
+
+  int address;  //  EEPROM address of the first slot.
+  uint8_t slotCount;  //  Number of slots.
+  uint8_t head;  //  Next slot to be written.  The oldest frames follow it.
+  uint16_t nextSequence;  //  Sequence number of the next frame.
+  uint32_t pending[FRAME_STORE_PRIORITIES];  //  Bit n is set if slot n has a frame with the priority, not sent yet.
+  uint8_t count;  //  Number of frames not sent yet.
+  unsigned int lostCount;  //  Frames replaced before they were sent.
+};
+
+#endif  //  UNABIZ_ARDUINO_FRAMESTORE_H
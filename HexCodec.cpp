@@ -0,0 +1,77 @@
+//  Convert between binary bytes and hex digits, shared by all transceivers and Message.
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+#include "HexCodec.h"
+
+//  Convert nibble to hex digit.
+static const char nibbleToHex[] PROGMEM = "0123456789abcdef";
+
+//  Convert hex digit to nibble, indexed by (ch - '0') for '0'..'f'.  Other chars are HEX_INVALID.
+static const uint8_t hexFirstDigit = '0';
+static const uint8_t hexLastDigit = 'f';
+static const uint8_t hexToNibbleTable[hexLastDigit - hexFirstDigit + 1] PROGMEM = {
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,  //  '0'..'9'
+  HEX_INVALID, HEX_INVALID, HEX_INVALID, HEX_INVALID,  //  ':'..'='
+  HEX_INVALID, HEX_INVALID, HEX_INVALID,  //  '>'..'@'
+  10, 11, 12, 13, 14, 15,  //  'A'..'F'
+  HEX_INVALID, HEX_INVALID, HEX_INVALID, HEX_INVALID, HEX_INVALID,  //  'G'..'K'
+  HEX_INVALID, HEX_INVALID, HEX_INVALID, HEX_INVALID, HEX_INVALID,  //  'L'..'P'
+  HEX_INVALID, HEX_INVALID, HEX_INVALID, HEX_INVALID, HEX_INVALID,  //  'Q'..'U'
+  HEX_INVALID, HEX_INVALID, HEX_INVALID, HEX_INVALID, HEX_INVALID,  //  'V'..'Z'
+  HEX_INVALID, HEX_INVALID, HEX_INVALID, HEX_INVALID, HEX_INVALID,  //  '['..'_'
+  HEX_INVALID,  //  '`'
+  10, 11, 12, 13, 14, 15,  //  'a'..'f'
+};
+
+char nibbleToHexDigit(uint8_t nibble) {
+  //  Convert 0..15 to lowercase hex digit '0'..'f'.
+  return (char) pgm_read_byte(&nibbleToHex[nibble & 0xf]);
+}
+
+uint8_t hexToNibble(char ch) {
+  //  Convert '0'..'9', 'a'..'f', 'A'..'F' to 0..15, else HEX_INVALID.
+  const uint8_t index = (uint8_t) ch - hexFirstDigit;  //  Wraps around for chars below '0'.
+  if (index > hexLastDigit - hexFirstDigit) return HEX_INVALID;
+  return pgm_read_byte(&hexToNibbleTable[index]);
+}
+
+char *bytesToHex(const uint8_t *bytes, unsigned int length, char *hex) {
+  //  Write length bytes as 2 * length hex digits plus a null terminator.  Returns hex.
+  char *out = hex;
+  for (unsigned int i = 0; i < length; i++) {
+    *out++ = nibbleToHexDigit(bytes[i] >> 4);
+    *out++ = nibbleToHexDigit(bytes[i]);
+  }
+  *out = 0;
+  return hex;
+}
+
+unsigned int hexToBytes(const char *hex, unsigned int hexLength, uint8_t *bytes) {
+  //  Decode pairs of hex digits into bytes.  Stops at the first invalid digit.
+  unsigned int count = 0;
+  for (unsigned int i = 0; i + 1 < hexLength; i = i + 2) {
+    const uint8_t high = hexToNibble(hex[i]);
+    const uint8_t low = hexToNibble(hex[i + 1]);
+    if (high == HEX_INVALID || low == HEX_INVALID) break;
+    bytes[count++] = (high << 4) | low;
+  }
+  return count;
+}
+
+void appendHex(String &str, const uint8_t *bytes, unsigned int length, bool upperCase) {
+  //  Append length bytes as hex digits to str.  Reserve the space first so that
+  //  the String is grown at most once.
+  const char caseShift = upperCase ? 'a' - 'A' : 0;
+  str.reserve(str.length() + length * 2);
+  for (unsigned int i = 0; i < length; i++) {
+    const char high = nibbleToHexDigit(bytes[i] >> 4), low = nibbleToHexDigit(bytes[i]);
+    str.concat((char) (high >= 'a' ? high - caseShift : high));
+    str.concat((char) (low >= 'a' ? low - caseShift : low));
+  }
+}
@@ -0,0 +1,28 @@
+//  Convert between binary bytes and hex digits, shared by all transceivers and Message.
+//  Uses lookup tables in flash memory and never allocates memory.
+#ifndef UNABIZ_ARDUINO_HEXCODEC_H
+#define UNABIZ_ARDUINO_HEXCODEC_H
+
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+const uint8_t HEX_INVALID = 0xff;  //  Returned by hexToNibble() for a char that is not a hex digit.
+
+char nibbleToHexDigit(uint8_t nibble);  //  Convert 0..15 to lowercase hex digit '0'..'f'.
+uint8_t hexToNibble(char ch);  //  Convert '0'..'9', 'a'..'f', 'A'..'F' to 0..15, else HEX_INVALID.
+//  Write length bytes as 2 * length lowercase hex digits plus a null terminator into hex,
+//  which must have 2 * length + 1 chars.  Returns hex.
+char *bytesToHex(const uint8_t *bytes, unsigned int length, char *hex);
+//  Decode hexLength hex digits into bytes, which must have hexLength / 2 bytes.
+//  Stops at the first invalid digit.  Returns the number of bytes decoded.
+unsigned int hexToBytes(const char *hex, unsigned int hexLength, uint8_t *bytes);
+//  Append length bytes as lowercase hex digits to str, growing str at most once.  Uppercase
+//  if upperCase is true, e.g. for the downlink, which the modules return in uppercase.
+void appendHex(String &str, const uint8_t *bytes, unsigned int length, bool upperCase = false);
+
+#endif  //  UNABIZ_ARDUINO_HEXCODEC_H
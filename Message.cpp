@@ -38,70 +38,266 @@ static char decodeLetter(uint8_t code) {
   return 0;
 }
 
-static String doubleToString(double d) {
-  //  Convert double to string, since Bean+ doesn't support double in Strings.
-  //  Assume 1 decimal place.
-  String result = String((int) (d)) + '.' + String(((int) (d * 10.0)) % 10);
-  return result;
+//  Log progress messages at UNABIZ_LOG_LEVEL 2 and above, errors at level 1 and above.
+//  Otherwise the log messages are not built at all.  See SIGFOX.h.  The log lines are written
+//  into buffers instead of Strings, so that adding the fields doesn't allocate memory.  Message
+//  echoes them with its transceiver after each call, see takeEcho().
+#if UNABIZ_LOG_LEVEL >= 2
+#define logEcho(x) { x; }
+#else  //  UNABIZ_LOG_LEVEL >= 2
+#define logEcho(x) {}
+#endif  //  UNABIZ_LOG_LEVEL >= 2
+#if UNABIZ_LOG_LEVEL >= 1
+#define logEchoErr(x) { x; }
+#else  //  UNABIZ_LOG_LEVEL >= 1
+#define logEchoErr(x) {}
+#endif  //  UNABIZ_LOG_LEVEL >= 1
+
+//  Log messages shared by the functions below, kept in flash memory so that they don't use up RAM.
+#if UNABIZ_LOG_LEVEL >= 1
+static const char tooLong[] PROGMEM = "****ERROR: Message too long, already ";
+static const char notNumber[] PROGMEM = "****ERROR: Packed message fields must be numbers";
+static const char outOfRange[] PROGMEM = "****ERROR: Value out of range for ";
+static const char notInSchema[] PROGMEM = "****ERROR: Field not in schema: ";
+static const char nothingToSend[] PROGMEM = "****ERROR: Nothing to send";
+
+static const uint8_t echoField = 1;  //  Bit of pendingEcho: fieldEcho not echoed yet.
+static const uint8_t echoError = 2;  //  Bit of pendingEcho: errorEcho not echoed yet.
+static uint8_t pendingEcho = 0;  //  Log lines not echoed yet.
+
+//  Log line for the last error, e.g. "****ERROR: Message too long, already 12 bytes".
+static char errorEcho[sizeof(notNumber) + 4];
+
+static char *writeDecimal(char *end, long value) {
+  //  Write the value in decimal at end.  Return the new end.
+  unsigned long digits = value;
+  if (value < 0) { *end++ = '-'; digits = -value; }
+  char reversed[10];  uint8_t count = 0;
+  do { reversed[count++] = '0' + digits % 10; digits = digits / 10; } while (digits > 0);
+  while (count > 0) *end++ = reversed[--count];
+  *end = 0;
+  return end;
+}
+
+static void logError(const char *text, const char *name) {
+  //  Write the error text from flash memory and the field name, if not 0, into errorEcho.
+  strcpy_P(errorEcho, text);
+  char *end = errorEcho + strlen(errorEcho);
+  const char *last = errorEcho + sizeof(errorEcho) - 1;
+  while (name && *name != 0 && end < last) *end++ = *name++;
+  *end = 0;
+  pendingEcho |= echoError;
+}
+
+static void logTooLong(unsigned int bytes) {
+  //  Write the error for a message that has no space for the field into errorEcho.
+  logError(tooLong, 0);
+  strcpy(writeDecimal(errorEcho + strlen(errorEcho), bytes), " bytes");
+}
+#endif  //  UNABIZ_LOG_LEVEL >= 1
+
+#if UNABIZ_LOG_LEVEL >= 2
+static const char addFieldHeader[] PROGMEM = "Message.addField: ";
+
+//  Log line for the field being added, e.g. "Message.addField: tmp=25.5".
+static char fieldEcho[sizeof(addFieldHeader) + 3 + 1 + 14];
+
+static char *beginFieldEcho(const char *name) {
+  //  Write the header and "name=" into fieldEcho.  Return the end.
+  strcpy_P(fieldEcho, addFieldHeader);
+  char *end = fieldEcho + sizeof(addFieldHeader) - 1;
+  for (uint8_t i = 0; i < 3 && name[i] != 0; i++) *end++ = name[i];
+  *end++ = '=';
+  *end = 0;
+  pendingEcho |= echoField;
+  return end;
+}
+
+static void fieldEchoInt(const char *name, long value, const char *suffix) {
+  //  Write the log line for an integer field, e.g. "tmp=255/10" for suffix "/10".
+  strcpy(writeDecimal(beginFieldEcho(name), value), suffix);
+}
+
+static void fieldEchoTenths(const char *name, int tenths) {
+  //  Write the log line for a field scaled by 10, with 1 decimal place, e.g. "tmp=-2.5".
+  char *end = beginFieldEcho(name);
+  if (tenths < 0) { *end++ = '-'; tenths = -tenths; }
+  end = writeDecimal(end, tenths / 10);
+  *end++ = '.';  *end++ = '0' + tenths % 10;  *end = 0;
+}
+
+static void fieldEchoText(const char *name, const char *value) {
+  //  Write the log line for a string field, cut off at the end of the buffer.
+  char *end = beginFieldEcho(name);
+  const char *last = fieldEcho + sizeof(fieldEcho) - 1;
+  while (*value != 0 && end < last) *end++ = *value++;
+  *end = 0;
+}
+#endif  //  UNABIZ_LOG_LEVEL >= 2
+
+#if UNABIZ_LOG_LEVEL >= 1
+const char *MessageCodec::takeEcho() {
+  //  Return the field added, then the error, or 0 if both have been echoed.
+#if UNABIZ_LOG_LEVEL >= 2
+  if (pendingEcho & echoField) { pendingEcho &= ~echoField; return fieldEcho; }
+#endif  //  UNABIZ_LOG_LEVEL >= 2
+  if (pendingEcho & echoError) { pendingEcho &= ~echoError; return errorEcho; }
+  return 0;
+}
+#endif  //  UNABIZ_LOG_LEVEL >= 1
+
+const MessageSchema *MessageSchema::first = 0;
+
+MessageSchema::MessageSchema(uint8_t id0, const MessageField *fields0, uint8_t fieldCount0) {
+  //  Register the schema so that decodeMessage() can find it by ID.
+  id = id0;
+  fields = fields0;
+  fieldCount = fieldCount0;
+  bitCount = 0;
+  for (uint8_t i = 0; i < fieldCount; i++) bitCount = bitCount + fields[i].bits;
+  next = first;
+  first = this;
+}
+
+const MessageSchema *MessageSchema::find(uint8_t id) {
+  //  Return the registered schema with the ID, or 0 if not found.
+  for (const MessageSchema *schema = first; schema; schema = schema->next)
+    if (schema->id == id) return schema;
+  return 0;
+}
+
+MessageDelta::MessageDelta(uint8_t keyframeInterval0) {
+  //  The first message is always a keyframe.
+  fieldCount = 0;
+  keyframeInterval = keyframeInterval0 > 0 ? keyframeInterval0 : 1;
+  untilKeyframe = 0;
+}
+
+int MessageDelta::findField(unsigned int name) {
+  //  Return the index of the encoded name, adding it if necessary.  Returns -1 if no space.
+  for (uint8_t i = 0; i < fieldCount; i++)
+    if (fields[i].name == name) return i;
+  if (fieldCount >= DELTA_MAX_FIELDS) return -1;
+  Field &field = fields[fieldCount];
+  field.name = name;
+  field.lastValue = 0;
+  field.deadband = 0;
+  field.hasValue = false;
+  return fieldCount++;
+}
+
+bool MessageDelta::setDeadband(const char *name, float deadband) {
+  //  Send the field only if it changes by more than deadband.  Text fields are sent
+  //  whenever they change.
+  const int i = findField(MessageCodec::encodeName(name));
+  if (i < 0) return false;
+  fields[i].deadband = (unsigned int) (deadband * 10.0);
+  return true;
+}
+
+void MessageDelta::requestKeyframe() {
+  //  Send all fields in the next message.
+  untilKeyframe = 0;
+}
+
+bool MessageDelta::isKeyframe() {
+  //  Return true if the next message will contain all fields.
+  return untilKeyframe == 0;
 }
 
-void Message::echo(String msg) {
-  if (wisol) wisol->echo(msg);
-  else if (radiocrafts) radiocrafts->echo(msg);
+bool MessageDelta::isChanged(unsigned int name, int value) {
+  //  Return true if the encoded field should be sent: keyframe, never sent, changed beyond
+  //  the deadband, or not tracked because the table is full.
+  if (untilKeyframe == 0) return true;
+  const int i = findField(name);
+  if (i < 0 || !fields[i].hasValue) return true;
+  long change = (long) value - fields[i].lastValue;
+  if (change < 0) change = -change;
+  return change > (long) fields[i].deadband;
+}
+
+void MessageDelta::sent(const uint8_t *payload, uint8_t length) {
+  //  Remember the fields in the structured message sent: 2 bytes name, 2 bytes value, ...
+  //  The sequence number changes with every message, so it's not tracked.
+  const unsigned int sequenceName = MessageCodec::encodeName("seq");
+  for (uint8_t i = 0; i + 3 < length; i = i + 4) {
+    const unsigned int name = payload[i] + (payload[i + 1] << 8);
+    if (name == sequenceName) continue;
+    const int f = findField(name);
+    if (f < 0) continue;
+    //  Sign-extend the 16-bit value, in case int has 32 bits, e.g. SAMD.
+    fields[f].lastValue = (int16_t) (payload[i + 2] + (payload[i + 3] << 8));
+    fields[f].hasValue = true;
+  }
+  untilKeyframe = (untilKeyframe == 0) ? keyframeInterval - 1 : untilKeyframe - 1;
 }
 
-Message::Message(Radiocrafts &transceiver) {
-  //  Construct a message for Radiocrafts.
-  radiocrafts = &transceiver;
+//  Encoded message as hex digits, shared by all messages since only one message is sent at a time.
+static char encodedBuffer[MAX_BYTES_PER_MESSAGE * 2 + 1];
+
+MessageCodec::MessageCodec() {
+  //  Construct a structured message.
 }
 
-Message::Message(Wisol &transceiver) {
-  //  Construct a message for Wisol.
-  wisol = &transceiver;
+MessageCodec::MessageCodec(const MessageSchema &schema0) {
+  //  Construct a packed message.
+  beginPacked(&schema0);
 }
 
-//  TODO: Move these messages to Flash memory.
-static String addFieldHeader = "Message.addField: ";
-static String tooLong = "****ERROR: Message too long, already ";
+MessageCodec::MessageCodec(MessageDelta &delta0): delta(&delta0) {
+  //  Construct a structured message that adds only the changed fields.
+}
 
-bool Message::addField(const String name, int value) {
+bool MessageCodec::addField(const char *name, int value) {
   //  Add an integer field scaled by 10.  2 bytes.
-  echo(addFieldHeader + name + '=' + value);
+  logEcho(fieldEchoInt(name, value, ""));
   int val = value * 10;
   return addIntField(name, val);
 }
 
-bool Message::addField(const String name, float value) {
+bool MessageCodec::addScaledField(const char *name, int value) {
+  //  Add an integer field that is already scaled by 10.  2 bytes.
+  logEcho(fieldEchoInt(name, value, "/10"));
+  return addIntField(name, value);
+}
+
+bool MessageCodec::addField(const char *name, float value) {
   //  Add a float field with 1 decimal place.  2 bytes.
-  echo(addFieldHeader + name + '=' + doubleToString(value));
   int val = (int) (value * 10.0);
+  logEcho(fieldEchoTenths(name, val));
   return addIntField(name, val);
 }
 
-bool Message::addField(const String name, double value) {
+bool MessageCodec::addField(const char *name, double value) {
   //  Add a double field with 1 decimal place.  2 bytes.
-  echo(addFieldHeader + name + '=' + doubleToString(value));
   int val = (int) (value * 10.0);
+  logEcho(fieldEchoTenths(name, val));
   return addIntField(name, val);
 }
 
-bool Message::addIntField(const String name, int value) {
+bool MessageCodec::addIntField(const char *name, int value) {
   //  Add an int field that is already scaled.  2 bytes for name, 2 bytes for value.
-  if (encodedMessage.length() + (4 * 2) > MAX_BYTES_PER_MESSAGE * 2) {
-    echo(tooLong + (encodedMessage.length() / 2) + " bytes");
+  if (schema) return addPackedField(name, value);
+  if (delta && !delta->isChanged(encodeName(name), value)) return true;  //  Unchanged, don't send.
+  if (length + 4 > MAX_BYTES_PER_MESSAGE) {
+    logEchoErr(logTooLong(length));
     return false;
   }
   addName(name);
-  if (wisol) encodedMessage.concat(wisol->toHex(value));
-  else if (radiocrafts) encodedMessage.concat(radiocrafts->toHex(value));
+  addWord((unsigned int) value);
   return true;
 }
 
-bool Message::addField(const String name, const String value) {
+bool MessageCodec::addField(const char *name, const char *value) {
   //  Add a string field with max 3 chars.  2 bytes for name, 2 bytes for value.
-  echo(addFieldHeader + name + '=' + value);
-  if (encodedMessage.length() + (4 * 2) > MAX_BYTES_PER_MESSAGE * 2) {
-    echo(tooLong + (encodedMessage.length() / 2) + " bytes");
+  logEcho(fieldEchoText(name, value));
+  if (schema) {
+    logEchoErr(logError(notNumber, 0));
+    return false;
+  }
+  if (delta && !delta->isChanged(encodeName(name), (int) encodeName(value))) return true;  //  Unchanged, don't send.
+  if (length + 4 > MAX_BYTES_PER_MESSAGE) {
+    logEchoErr(logTooLong(length));
     return false;
   }
   addName(name);
@@ -109,16 +305,27 @@ bool Message::addField(const String name, const String value) {
   return true;
 }
 
-bool Message::addName(const String name) {
+//  String versions of addField, for compatibility.
+bool MessageCodec::addField(const String &name, int value) { return addField(name.c_str(), value); }
+bool MessageCodec::addField(const String &name, float value) { return addField(name.c_str(), value); }
+bool MessageCodec::addField(const String &name, double value) { return addField(name.c_str(), value); }
+bool MessageCodec::addField(const String &name, const String &value) { return addField(name.c_str(), value.c_str()); }
+
+bool MessageCodec::addName(const char *name) {
   //  Add the encoded field name with 3 letters.
+  addWord(encodeName(name));
+  return true;
+}
+
+unsigned int MessageCodec::encodeName(const char *name) {
+  //  Encode the field name with 3 letters.
   //  1 header bit + 5 bits for each letter, total 16 bits.
   //  TODO: Assert name has 3 letters.
-  //  TODO: Assert encodedMessage is less than 12 bytes.
   //  Convert 3 letters to 3 bytes.
   uint8_t buffer[] = {0, 0, 0};
-  for (int i = 0; i <= 2 && i <= name.length(); i++) {
+  for (int i = 0; i <= 2 && name[i] != 0; i++) {
     //  5 bits for each letter.
-    char ch = name.charAt(i);
+    char ch = name[i];
     buffer[i] = encodeLetter(ch);
   }
   //  [x000] [0011] [1112] [2222]
@@ -127,91 +334,223 @@ bool Message::addName(const String name) {
       (buffer[0] << 10) +
       (buffer[1] << 5) +
       (buffer[2]);
-  if (wisol) encodedMessage.concat(wisol->toHex(result));
-  else if (radiocrafts) encodedMessage.concat(radiocrafts->toHex(result));
-  return true;
+  return result;
 }
 
-bool Message::send() {
-  //  Send the encoded message to SIGFOX.
-  String msg = getEncodedMessage();
-  if (msg.length() == 0) {
-    echo("****ERROR: Nothing to send");  //  TODO: Move to Flash.
-    return false;
+bool MessageCodec::setSequence(uint8_t sequence) {
+  //  Packed mode: set bits 8 to 11 of the header and the sequence header bit.  Structured mode:
+  //  send the sequence number as the field "seq", replacing the field if already added.
+  sequence = sequence % SEQUENCE_MODULO;
+  if (schema) {
+    payload[1] = (payload[1] & ~0x1f) | (PACKED_SEQUENCE >> 8) | sequence;
+    return true;
+  }
+  const unsigned int name = encodeName("seq");
+  for (uint8_t i = 0; i + 3 < length; i = i + 4) {
+    if (payload[i] + (payload[i + 1] << 8) != name) continue;
+    payload[i + 2] = sequence * 10;  payload[i + 3] = 0;
+    return true;
   }
-  if (msg.length() > MAX_BYTES_PER_MESSAGE * 2) {
-    echo(tooLong + (encodedMessage.length() / 2) + " bytes");
+  if (length + 4 > MAX_BYTES_PER_MESSAGE) {
+    logEchoErr(logTooLong(length));
     return false;
   }
-  if (wisol) return wisol->sendMessage(msg);
-  else if (radiocrafts) return radiocrafts->sendMessage(msg);
-  return false;
+  addWord(name);
+  addWord(sequence * 10);  //  Scaled by 10 like the other fields.
+  return true;
 }
 
-bool Message::sendAndGetResponse(String &response) {
-  //  Send the structured message and get the downlink response.
-  String msg = getEncodedMessage();
-  if (msg.length() == 0) {
-    echo("****ERROR: Nothing to send");  //  TODO: Move to Flash.
-    return false;
+void MessageCodec::addWord(unsigned int value) {
+  //  Add 2 bytes to the encoded message, least significant byte first.
+  //  Caller must check that there is space.
+  payload[length++] = (uint8_t) (value & 0xff);
+  payload[length++] = (uint8_t) ((value >> 8) & 0xff);
+}
+
+void MessageCodec::beginPacked(const MessageSchema *schema0) {
+  //  Add the packed mode header and clear the space for all fields in the schema.
+  //  Fields that are not added will be sent as 0.
+  schema = schema0;
+  length = 0;
+  addWord(PACKED_HEADER | schema->id);
+  const unsigned int bits = PACKED_HEADER_BITS + schema->bitCount;
+  const unsigned int bytes = (bits + 7) / 8;
+  if (bytes > MAX_BYTES_PER_MESSAGE) {
+    logEchoErr(logTooLong(bytes));
+    return;  //  addField() will reject the fields that don't fit.
   }
-  if (msg.length() > MAX_BYTES_PER_MESSAGE * 2) {
-    echo(tooLong + (encodedMessage.length() / 2) + " bytes");
-    return false;
+  while (length < bytes) payload[length++] = 0;
+}
+
+bool MessageCodec::addPackedField(const char *name, long value) {
+  //  Pack the value, already scaled by 10, into the field at its declared bit width.
+  //  Bits are packed least significant bit first, starting after the header.
+  unsigned int pos = PACKED_HEADER_BITS;
+  for (uint8_t i = 0; i < schema->fieldCount; i++) {
+    const MessageField &field = schema->fields[i];
+    if (strncmp(field.name, name, 3) != 0) { pos = pos + field.bits; continue; }
+    if (pos + field.bits > MAX_BYTES_PER_MESSAGE * 8) {
+      logEchoErr(logTooLong(pos / 8));
+      return false;
+    }
+    const long raw = value * field.scale / 10 - field.offset;
+    if (raw < 0 || raw >= (1L << field.bits)) {
+      logEchoErr(logError(outOfRange, name));
+      return false;
+    }
+    for (uint8_t bit = 0; bit < field.bits; bit++, pos++) {
+      const uint8_t mask = (uint8_t) (1 << (pos & 7));
+      if (raw & (1L << bit)) payload[pos >> 3] |= mask;
+      else payload[pos >> 3] &= (uint8_t) ~mask;
+    }
+    return true;
   }
-  if (wisol) return wisol->sendMessageAndGetResponse(msg, response);
-  else if (radiocrafts) return radiocrafts->sendMessage(msg);
+  logEchoErr(logError(notInSchema, name));
   return false;
 }
 
-String Message::getEncodedMessage() {
+static void decodePacked(const uint8_t *bytes, unsigned int byteCount, DecodedMessage &decoded) {
+  //  Decode the packed message with the schema registered for the ID in the header.
+  decoded.schema = bytes[0];
+  const MessageSchema *schema = MessageSchema::find(bytes[0]);
+  if (!schema) { decoded.unknownSchema = true; return; }
+  unsigned int pos = PACKED_HEADER_BITS;
+  for (uint8_t i = 0; i < schema->fieldCount && decoded.fieldCount < DECODED_MAX_FIELDS; i++) {
+    const MessageField &field = schema->fields[i];
+    if (pos + field.bits > byteCount * 8) break;  //  Message is truncated.
+    long raw = 0;
+    for (uint8_t bit = 0; bit < field.bits; bit++, pos++)
+      if (bytes[pos >> 3] & (1 << (pos & 7))) raw |= (1L << bit);
+    DecodedField &out = decoded.fields[decoded.fieldCount++];
+    strncpy(out.name, field.name, 3);  out.name[3] = 0;
+    out.value = (raw + field.offset) * 10 / field.scale;
+  }
+}
+
+const char *MessageCodec::beginSend() {
+  //  Return the encoded message as hex digits, or 0 if there is nothing to send.
+  if (length == 0) {
+    logEchoErr(logError(nothingToSend, 0));
+    return 0;
+  }
+  return getEncodedMessage(encodedBuffer);
+}
+
+void MessageCodec::sent() {
+  //  Remember the values sent, so that the next message with the same delta adds only the changes.
+  if (delta) delta->sent(payload, length);
+}
+
+bool MessageCodec::isEmpty() {
+  //  Return true if there is nothing worth sending, e.g. no fields have changed.  The sequence
+  //  number alone is not worth sending.
+  if (schema || length != 4) return length == 0;
+  return payload[0] + (payload[1] << 8) == encodeName("seq");
+}
+
+String MessageCodec::getEncodedMessage() {
   //  Return the encoded message to be transmitted.
-  return encodedMessage;
+  return String(getEncodedMessage(encodedBuffer));
 }
 
-static uint8_t hexDigitToDecimal(char ch) {
-  //  Convert 0..9, a..f, A..F to decimal.
-  if (ch >= '0' && ch <= '9') return (uint8_t) ch - '0';
-  if (ch >= 'a' && ch <= 'z') return (uint8_t) ch - 'a' + 10;
-  if (ch >= 'A' && ch <= 'Z') return (uint8_t) ch - 'A' + 10;
-  return 0;
+char *MessageCodec::getEncodedMessage(char *buffer) {
+  //  Write the encoded message as hex digits into buffer, which must have
+  //  MAX_BYTES_PER_MESSAGE * 2 + 1 chars.  Returns buffer.
+  return bytesToHex(payload, length, buffer);
+}
+
+const uint8_t *MessageCodec::getPayload() {
+  //  Return the encoded message in binary.
+  return payload;
+}
+
+uint8_t MessageCodec::getLength() {
+  //  Return the number of bytes in the encoded message.
+  return length;
+}
+
+String MessageCodec::decodeMessage(String msg) {
+  //  Decode the encoded message of hex digits as JSON.
+  uint8_t bytes[MAX_BYTES_PER_MESSAGE];
+  const unsigned int hexLength = msg.length() < MAX_BYTES_PER_MESSAGE * 2 ?
+    msg.length() : MAX_BYTES_PER_MESSAGE * 2;
+  const uint8_t byteCount = hexToBytes(msg.c_str(), hexLength, bytes);
+  DecodedMessage decoded;
+  decode(bytes, byteCount, decoded);
+  char json[DECODED_JSON_MAX];
+  return String(toJson(decoded, json, sizeof(json)));
 }
 
-String Message::decodeMessage(String msg) {
-  //  Decode the encoded message.
-  //  2 bytes name, 2 bytes float * 10, 2 bytes name, 2 bytes float * 10, ...
-  String result = "{";
-  for (int i = 0; i < msg.length(); i = i + 8) {
-    String name = msg.substring(i, i + 4);
-    String val = msg.substring(i + 4, i + 8);
-    unsigned long name2 =
-      (hexDigitToDecimal(name.charAt(2)) << 12) +
-      (hexDigitToDecimal(name.charAt(3)) << 8) +
-      (hexDigitToDecimal(name.charAt(0)) << 4) +
-      hexDigitToDecimal(name.charAt(1));
-    unsigned long val2 =
-      (hexDigitToDecimal(val.charAt(2)) << 12) +
-      (hexDigitToDecimal(val.charAt(3)) << 8) +
-      (hexDigitToDecimal(val.charAt(0)) << 4) +
-      hexDigitToDecimal(val.charAt(1));
-    if (i > 0) result.concat(',');
-    result.concat('"');
+bool MessageCodec::decode(const uint8_t *payload, uint8_t length, DecodedMessage &decoded) {
+  //  Decode the message bytes into fields.  Bytes beyond MAX_BYTES_PER_MESSAGE are ignored.
+  //  Structured mode: 2 bytes name, 2 bytes float * 10, 2 bytes name, 2 bytes float * 10, ...
+  //  Packed mode: 2 bytes header with schema ID, followed by the fields packed as bits.
+  decoded.schema = -1;
+  decoded.unknownSchema = false;
+  decoded.sequence = -1;
+  decoded.fieldCount = 0;
+  if (length > MAX_BYTES_PER_MESSAGE) length = MAX_BYTES_PER_MESSAGE;
+  if (length >= 2 && (payload[1] & (PACKED_HEADER >> 8))) {
+    if (payload[1] & (PACKED_SEQUENCE >> 8)) decoded.sequence = payload[1] & 0x0f;
+    decodePacked(payload, length, decoded);
+    return !decoded.unknownSchema;
+  }
+  for (uint8_t i = 0; i + 3 < length; i = i + 4) {
+    //  Name and value are stored least significant byte first.
+    unsigned int name2 = payload[i] + (payload[i + 1] << 8);
+    DecodedField &out = decoded.fields[decoded.fieldCount++];
     //  Decode name.
-    char name3[] = {0, 0, 0, 0};
+    memset(out.name, 0, sizeof(out.name));
     for (int j = 0; j < 3; j++) {
-      uint8_t code = name2 & 31;
-      char ch = decodeLetter(code);
-      if (ch > 0) name3[2 - j] = ch;
+      char ch = decodeLetter(name2 & 31);
+      if (ch > 0) out.name[2 - j] = ch;
       name2 = name2 >> 5;
     }
-    name3[3] = 0;
-    result.concat(name3);
-    //  Decode value.
-    result.concat("\":"); result.concat((int)(val2 / 10));
-    result.concat('.'); result.concat((int)(val2 % 10));
+    //  Decode value, sent as a 16-bit int.
+    out.value = (int16_t) (payload[i + 2] + (payload[i + 3] << 8));
   }
-  result.concat('}');
-  return result;
+  return true;
+}
+
+//  Append to the JSON buffer without overflowing it.  The buffer is always null-terminated.
+struct JsonWriter {
+  char *buffer;  unsigned int size, pos;
+  void add(char ch) { if (pos + 1 < size) { buffer[pos++] = ch; buffer[pos] = 0; } }
+  void add(const char *text) { while (*text) add(*text++); }
+  void addNumber(unsigned long number) {
+    char digits[12];  uint8_t count = 0;
+    do { digits[count++] = '0' + number % 10;  number = number / 10; } while (number > 0);
+    while (count > 0) add(digits[--count]);
+  }
+  void addTenths(long tenths) {
+    //  Append the value scaled by 10 with 1 decimal place.
+    if (tenths < 0) add('-');
+    const unsigned long magnitude = tenths < 0 ? 0UL - (unsigned long) tenths : (unsigned long) tenths;
+    addNumber(magnitude / 10);  add('.');  add((char) ('0' + magnitude % 10));
+  }
+};
+
+char *MessageCodec::toJson(const DecodedMessage &decoded, char *buffer, unsigned int size) {
+  //  Write the decoded fields as JSON, e.g. {"tmp":25.5}.  Returns {"schema":id} if the schema
+  //  of the packed message is unknown.  The JSON is truncated if buffer is too small.
+  JsonWriter json = { buffer, size, 0 };
+  if (size > 0) buffer[0] = 0;
+  json.add('{');
+  if (decoded.unknownSchema) {
+    json.add("\"schema\":");  json.addNumber((unsigned long) decoded.schema);
+  }
+  for (uint8_t i = 0; i < decoded.fieldCount; i++) {
+    if (i > 0) json.add(',');
+    json.add('"');  json.add(decoded.fields[i].name);  json.add("\":");
+    json.addTenths(decoded.fields[i].value);
+  }
+  if (decoded.sequence >= 0) {
+    //  Same as the "seq" field of a structured message.
+    if (decoded.unknownSchema || decoded.fieldCount > 0) json.add(',');
+    json.add("\"seq\":");  json.addTenths(decoded.sequence * 10);
+  }
+  json.add('}');
+  return buffer;
 }
 
 void stop(const String msg) {
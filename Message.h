@@ -10,27 +10,253 @@
   #endif  //  ARDUINO  >= 100
 #endif  //  ARDUINO
 
-class Message
+//  Send the encoded message with the transceiver.  If downlink is not 0, wait for the
+//  8 bytes of the downlink response.
+template <class Transceiver> bool sendEncodedMessage(Transceiver &transceiver, const char *msg,
+                                                     uint8_t *downlink) {
+  if (downlink) return transceiver.sendMessageAndGetResponse(msg, downlink);
+  return transceiver.sendMessage(msg);
+}
+
+//  Packed mode: the first 2 bytes of the message, least significant byte first, contain
+//  this header bit and the schema ID in bits 0 to 7.  The header bit is never set by a
+//  3-letter field name, so decodeMessage() can tell both modes apart.
+const unsigned int PACKED_HEADER = 0x8000;
+const uint8_t PACKED_HEADER_BITS = 16;  //  Bits used by the packed mode header.
+//  Packed mode: this header bit is set if bits 8 to 11 of the header contain the 4-bit sequence
+//  number added by setSequence().  Structured messages carry it in the field "seq" instead.
+const unsigned int PACKED_SEQUENCE = 0x1000;
+const uint8_t SEQUENCE_MODULO = 16;  //  Sequence numbers roll over from 15 to 0.
+
+//  A field in a packed message schema.  The value is sent as (value * scale) - offset
+//  in the declared number of bits.  E.g. temperature from -20.0 to 82.3 with 1 decimal place:
+//  {"tmp", 10, 10, -200}.  Switch: {"sw1", 1, 1, 0}.
+struct MessageField {
+  const char *name;  //  3-letter field name, used by addField() and decodeMessage().
+  uint8_t bits;  //  Number of bits for the value, 1 to 16.
+  uint8_t scale;  //  1 for integer values, 10 for values with 1 decimal place.
+  int offset;  //  Subtracted from the scaled value.  Use negative offsets for negative values.
+};
+
+//  Declares the fields of a packed message.  Both the sender and decodeMessage() must declare
+//  the same schema with the same ID.  Schemas should be declared as static variables, so that
+//  they stay registered.
+class MessageSchema
 {
 public:
-  Message(Radiocrafts &transceiver);  //  Construct a message for Radiocrafts.
-  Message(Wisol &transceiver);  //  Construct a message for Wisol.
-  bool addField(const String name, int value);  //  Add an integer field scaled by 10.
-  bool addField(const String name, float value);  //  Add a float field with 1 decimal place.
-  bool addField(const String name, double value);  //  Add a double field with 1 decimal place.
-  bool addField(const String name, const String value);  //  Add a string field with max 3 chars.
-  bool send();  //  Send the structured message.
-  bool sendAndGetResponse(String &response);  //  Send the structured message and get the downlink response.
+  MessageSchema(uint8_t id, const MessageField *fields, uint8_t fieldCount);
+  static const MessageSchema *find(uint8_t id);  //  Return the registered schema with the ID, or 0 if not found.
+  uint8_t id;  //  Schema ID sent in the header of the packed message.
+  const MessageField *fields;  //  Fields in the order they are packed.
+  uint8_t fieldCount;  //  Number of fields.
+  uint8_t bitCount;  //  Total bits for all fields.
+
+private:
+  const MessageSchema *next;  //  Next registered schema.
+  static const MessageSchema *first;  //  First registered schema.
+};
+
+const uint8_t DELTA_MAX_FIELDS = 6;  //  Max number of field names tracked for delta encoding.
+const uint8_t DELTA_KEYFRAME_INTERVAL = 6;  //  By default, send all fields every 6 messages.
+
+//  Remembers the last value sent for each field name, so that a structured Message
+//  constructed with this MessageDelta adds only the fields that have changed beyond the
+//  deadband.  Every keyframeInterval messages, all fields are sent so that the receiving cloud
+//  can rebuild the state.  Declare as a static variable so it lasts across messages.
+class MessageDelta
+{
+public:
+  MessageDelta(uint8_t keyframeInterval = DELTA_KEYFRAME_INTERVAL);
+  bool setDeadband(const char *name, float deadband);  //  Send the field only if it changes by more than deadband.
+  void requestKeyframe();  //  Send all fields in the next message.
+  bool isKeyframe();  //  Return true if the next message will contain all fields.
+
+private:
+  friend class MessageCodec;
+  bool isChanged(unsigned int name, int value);  //  Return true if the encoded field should be sent.
+  void sent(const uint8_t *payload, uint8_t length);  //  Remember the fields in the structured message sent.
+  int findField(unsigned int name);  //  Return the index of the encoded name, adding it if necessary.
+
+  //  Last value sent for a field.
+  struct Field {
+    unsigned int name;  //  Encoded field name.
+    int lastValue;  //  Last value sent, scaled by 10.
+    unsigned int deadband;  //  Max change that is not sent, scaled by 10.
+    bool hasValue;  //  True if lastValue has been sent.
+  };
+  Field fields[DELTA_MAX_FIELDS];  //  Tracked fields.
+  uint8_t fieldCount;  //  Number of tracked fields.
+  uint8_t keyframeInterval;  //  Send all fields every keyframeInterval messages.
+  uint8_t untilKeyframe;  //  Number of messages before the next keyframe.  0 means the next message.
+};
+
+const uint8_t DECODED_MAX_FIELDS = 12;  //  Max number of fields returned by MessageCodec::decode().
+//  Chars needed by MessageCodec::toJson() for DECODED_MAX_FIELDS fields like "tmp":-3276.8, and the null.
+const unsigned int DECODED_JSON_MAX = DECODED_MAX_FIELDS * 16 + 2;
+
+//  A field decoded from a structured or packed message.
+struct DecodedField {
+  char name[4];  //  3-letter field name, null-terminated.
+  long value;  //  Value scaled by 10, e.g. 255 for 25.5.  Packed fields may exceed 16 bits.
+};
+
+//  Fields decoded from a message by MessageCodec::decode(), without allocating memory.
+struct DecodedMessage {
+  int schema;  //  Schema ID of a packed message, or -1 for a structured message.
+  bool unknownSchema;  //  True if the schema of the packed message is not registered.
+  int sequence;  //  Sequence number in the header of a packed message, or -1 if none.
+  uint8_t fieldCount;  //  Number of fields decoded.
+  DecodedField fields[DECODED_MAX_FIELDS];  //  Decoded fields, in the order they were sent.
+};
+
+//  Encodes and decodes the structured and packed messages, without a transceiver.  The code
+//  is shared by all transceivers, Message<Transceiver> adds the echo and send for one transceiver.
+class MessageCodec
+{
+public:
+  MessageCodec();  //  Construct a structured message.
+  //  Construct a packed message with the fields declared in the schema.  Fields are packed at
+  //  the declared bit widths, so more fields fit into 12 bytes.  Only numeric fields are allowed.
+  explicit MessageCodec(const MessageSchema &schema);
+  //  Construct a structured message that adds only the fields that have changed since the last
+  //  message sent with the same delta.  Check isEmpty() before sending.
+  explicit MessageCodec(MessageDelta &delta);
+  bool addField(const char *name, int value);  //  Add an integer field scaled by 10.
+  //  Add an integer field that is already scaled by 10, e.g. deci-degrees, without float conversion.
+  bool addScaledField(const char *name, int value);
+  bool addField(const char *name, float value);  //  Add a float field with 1 decimal place.
+  bool addField(const char *name, double value);  //  Add a double field with 1 decimal place.
+  bool addField(const char *name, const char *value);  //  Add a string field with max 3 chars.
+  bool addField(const String &name, int value);  //  Add an integer field scaled by 10.
+  bool addField(const String &name, float value);  //  Add a float field with 1 decimal place.
+  bool addField(const String &name, double value);  //  Add a double field with 1 decimal place.
+  bool addField(const String &name, const String &value);  //  Add a string field with max 3 chars.
+  //  Add the 4-bit rolling sequence number, so that the receiving cloud can drop the resends of the
+  //  same message.  Takes no space in packed messages, 4 bytes in structured messages.  Calling
+  //  again replaces the sequence number.  Returns false if there is no space.
+  bool setSequence(uint8_t sequence);
+  bool isEmpty();  //  Return true if there is nothing worth sending, e.g. no fields have changed.
   String getEncodedMessage();  //  Return the encoded message to be transmitted.
-  static String decodeMessage(String msg);  //  Decode the encoded message.
+  char *getEncodedMessage(char *buffer);  //  Write the encoded message as hex digits into buffer, which must have 25 chars.
+  const uint8_t *getPayload();  //  Return the encoded message in binary.
+  uint8_t getLength();  //  Return the number of bytes in the encoded message.
+  static String decodeMessage(String msg);  //  Decode the encoded message, structured or packed, as JSON.
+  //  Decode the message bytes into fields without allocating memory, e.g. on a gateway that decodes
+  //  many frames.  Returns false if the packed message has an unknown schema.
+  static bool decode(const uint8_t *payload, uint8_t length, DecodedMessage &decoded);
+  //  Write the decoded fields as JSON, e.g. {"tmp":25.5}, into buffer with size chars.  Returns buffer.
+  static char *toJson(const DecodedMessage &decoded, char *buffer, unsigned int size);
+  static unsigned int encodeName(const char *name);  //  Encode the 3-letter name into 15 bits.
+
+protected:
+  //  Encode the message for sending into the buffer shared by all messages.  Returns 0 and logs
+  //  the error if there is nothing to send.
+  const char *beginSend();
+  void sent();  //  Update the delta after sending.
+#if UNABIZ_LOG_LEVEL >= 1
+  //  Return the next log line of the last call, or 0 if none.  The lines are kept in buffers
+  //  shared by all messages until Message echoes them with its transceiver.
+  static const char *takeEcho();
+#else  //  UNABIZ_LOG_LEVEL >= 1
+  static const char *takeEcho() { return 0; }
+#endif  //  UNABIZ_LOG_LEVEL >= 1
+
+private:
+  bool addIntField(const char *name, int value);  //  Add an integer field already scaled.
+  bool addName(const char *name);  //  Encode and add the 3-letter name.
+  void addWord(unsigned int value);  //  Add 2 bytes, least significant byte first.
+  void beginPacked(const MessageSchema *schema);  //  Add the packed mode header.
+  bool addPackedField(const char *name, long value);  //  Pack the value scaled by 10 into the field.
+  uint8_t payload[MAX_BYTES_PER_MESSAGE];  //  Encoded message.
+  uint8_t length = 0;  //  Number of bytes in the encoded message.
+  const MessageSchema *schema = 0;  //  Schema for packed mode, or 0 for structured mode.
+  MessageDelta *delta = 0;  //  Last values sent, for adding only the changed fields.
+};
+
+//  A message sent with the transceiver: Wisol, Radiocrafts, Akeru or TransceiverGroup, e.g.
+//  Message<UnaShieldV2S> msg(transceiver).  The transceiver is called directly, so only the code
+//  for this transceiver is linked into the sketch.  May be returned by value.
+template <class Transceiver> class Message: public MessageCodec
+{
+public:
+  Message(Transceiver &transceiver);  //  Construct a structured message for the transceiver.
+  //  Construct a packed message with the fields declared in the schema, see MessageCodec.
+  Message(Transceiver &transceiver, const MessageSchema &schema);
+  //  Construct a structured message that adds only the changed fields, see MessageCodec.
+  Message(Transceiver &transceiver, MessageDelta &delta);
+  //  Add the fields like MessageCodec, and echo the field and the errors with the transceiver.
+  bool addField(const char *name, int value) { return logged(MessageCodec::addField(name, value)); }
+  bool addScaledField(const char *name, int value) { return logged(MessageCodec::addScaledField(name, value)); }
+  bool addField(const char *name, float value) { return logged(MessageCodec::addField(name, value)); }
+  bool addField(const char *name, double value) { return logged(MessageCodec::addField(name, value)); }
+  bool addField(const char *name, const char *value) { return logged(MessageCodec::addField(name, value)); }
+  bool addField(const String &name, int value) { return logged(MessageCodec::addField(name, value)); }
+  bool addField(const String &name, float value) { return logged(MessageCodec::addField(name, value)); }
+  bool addField(const String &name, double value) { return logged(MessageCodec::addField(name, value)); }
+  bool addField(const String &name, const String &value) { return logged(MessageCodec::addField(name, value)); }
+  bool setSequence(uint8_t sequence) { return logged(MessageCodec::setSequence(sequence)); }
+  bool send();  //  Send the structured message.
+  bool sendAndGetResponse(String &response);  //  Send the structured message and get the downlink response as hex digits.
+  bool sendAndGetResponse(uint8_t downlink[MAX_BYTES_PER_DOWNLINK]);  //  Send the structured message and get the 8 downlink bytes.
 
 private:
-  bool addIntField(const String name, int value);  //  Add an integer field already scaled.
-  bool addName(const String name);  //  Encode and add the 3-letter name.
-  void echo(String msg);
-  String encodedMessage;  //  Encoded message.
-  Radiocrafts *radiocrafts = 0;  //  Reference to Radiocrafts transceiver for sending the message.
-  Wisol *wisol = 0;  //  Reference to Wisol transceiver for sending the message.
+  bool logged(bool ok);  //  Echo the log lines of the last call with the transceiver.  Returns ok.
+  bool send(uint8_t *downlink);  //  Send the message.  If downlink is not 0, wait for the downlink.
+  Transceiver &transceiver;  //  Transceiver for sending the message.
 };
 
+template <class Transceiver> Message<Transceiver>::Message(Transceiver &transceiver0):
+    transceiver(transceiver0) {
+  //  Construct a message for the transceiver.
+}
+
+template <class Transceiver> Message<Transceiver>::Message(Transceiver &transceiver0,
+                                                           const MessageSchema &schema0):
+    MessageCodec(schema0), transceiver(transceiver0) {
+  //  Construct a packed message for the transceiver.  Echo the error if the schema is too long.
+  logged(true);
+}
+
+template <class Transceiver> Message<Transceiver>::Message(Transceiver &transceiver0,
+                                                           MessageDelta &delta0):
+    MessageCodec(delta0), transceiver(transceiver0) {
+  //  Construct a structured message that adds only the changed fields.
+}
+
+template <class Transceiver> bool Message<Transceiver>::send() {
+  //  Send the encoded message to SIGFOX.
+  return send(0);
+}
+
+template <class Transceiver> bool Message<Transceiver>::sendAndGetResponse(String &response) {
+  //  Send the structured message and get the downlink response as hex digits.
+  uint8_t downlink[MAX_BYTES_PER_DOWNLINK];
+  if (!send(downlink)) return false;
+  response = "";
+  appendHex(response, downlink, MAX_BYTES_PER_DOWNLINK);
+  return true;
+}
+
+template <class Transceiver> bool Message<Transceiver>::sendAndGetResponse(
+    uint8_t downlink[MAX_BYTES_PER_DOWNLINK]) {
+  //  Send the structured message and get the 8 downlink bytes.
+  return send(downlink);
+}
+
+template <class Transceiver> bool Message<Transceiver>::send(uint8_t *downlink) {
+  //  Send the message and update the delta.
+  const char *msg = beginSend();
+  if (!logged(msg != 0)) return false;
+  if (!sendEncodedMessage(transceiver, msg, downlink)) return false;
+  sent();
+  return true;
+}
+
+template <class Transceiver> bool Message<Transceiver>::logged(bool ok) {
+  //  Echo the field added and the errors, which MessageCodec has logged without a transceiver.
+  //  Nothing is logged at UNABIZ_LOG_LEVEL 0.
+  for (const char *line = takeEcho(); line; line = takeEcho()) transceiver.echo(line);
+  return ok;
+}
+
 #endif // UNABIZ_ARDUINO_MESSAGE_H
@@ -0,0 +1,115 @@
+//  Serial port for the SIGFOX module: either SoftwareSerial on any 2 pins, or a spare hardware
+//  UART (e.g. Serial1 on Mega, Leonardo and SAMD boards).  The hardware UART sends from its FIFO
+//  with interrupts enabled, so the transceivers don't pace the chars sent and sensor interrupts
+//  are not missed during an uplink.  Calls are inline with no virtual functions.
+#ifndef UNABIZ_ARDUINO_MODEMPORT_H
+#define UNABIZ_ARDUINO_MODEMPORT_H
+
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+
+  #ifdef CLION
+    #include <src/SoftwareSerial.h>
+  #else  //  CLION
+    #ifndef BEAN_BEAN_BEAN_H
+      //  Bean+ firmware 0.6.1 can't receive serial data properly. We provide
+      //  an alternative class BeanSoftwareSerial to work around this.
+      //  See SIGFOX.h.
+      #include <SoftwareSerial.h>
+    #endif // BEAN_BEAN_BEAN_H
+  #endif  //  CLION
+
+#else  //  ARDUINO
+#endif  //  ARDUINO
+
+//  Bean+ has no spare hardware UART, so only SoftwareSerial is supported.
+#ifndef BEAN_BEAN_BEAN_H
+#define MODEM_PORT_HARDWARE
+#endif  //  BEAN_BEAN_BEAN_H
+
+class ModemPort
+{
+public:
+  ModemPort(): softwarePort(0)
+#ifdef MODEM_PORT_HARDWARE
+    , hardwarePort(0)
+#endif  //  MODEM_PORT_HARDWARE
+    {}
+  void attach(SoftwareSerial *port) {  //  Use SoftwareSerial for the module.
+    softwarePort = port;
+#ifdef MODEM_PORT_HARDWARE
+    hardwarePort = 0;
+#endif  //  MODEM_PORT_HARDWARE
+  }
+#ifdef MODEM_PORT_HARDWARE
+  void attach(HardwareSerial *port) {  //  Use a hardware UART for the module.
+    hardwarePort = port;
+    softwarePort = 0;
+  }
+#endif  //  MODEM_PORT_HARDWARE
+  //  Return true if the port is a hardware UART, which doesn't block while sending.
+  bool isHardware() const {
+#ifdef MODEM_PORT_HARDWARE
+    return hardwarePort != 0;
+#else  //  MODEM_PORT_HARDWARE
+    return false;
+#endif  //  MODEM_PORT_HARDWARE
+  }
+  SoftwareSerial *getSoftwarePort() { return softwarePort; }  //  Return the SoftwareSerial port, or 0.
+
+  void begin(unsigned long bps) {
+#ifdef MODEM_PORT_HARDWARE
+    if (hardwarePort) { hardwarePort->begin(bps); return; }
+#endif  //  MODEM_PORT_HARDWARE
+    softwarePort->begin(bps);
+  }
+  void end() {
+#ifdef MODEM_PORT_HARDWARE
+    if (hardwarePort) { hardwarePort->end(); return; }
+#endif  //  MODEM_PORT_HARDWARE
+    softwarePort->end();
+  }
+  void listen() {
+    //  Only one SoftwareSerial port may receive at a time.  A hardware UART always receives.
+    if (softwarePort) softwarePort->listen();
+  }
+  void clearInput() {
+    //  Discard the chars received so far.
+#ifdef MODEM_PORT_HARDWARE
+    if (hardwarePort) { while (hardwarePort->available() > 0) hardwarePort->read(); return; }
+#endif  //  MODEM_PORT_HARDWARE
+    softwarePort->flush();  //  SoftwareSerial flush() discards the receive buffer.
+  }
+  int available() {
+#ifdef MODEM_PORT_HARDWARE
+    if (hardwarePort) return hardwarePort->available();
+#endif  //  MODEM_PORT_HARDWARE
+    return softwarePort->available();
+  }
+  int read() {
+#ifdef MODEM_PORT_HARDWARE
+    if (hardwarePort) return hardwarePort->read();
+#endif  //  MODEM_PORT_HARDWARE
+    return softwarePort->read();
+  }
+  void write(uint8_t ch) {
+    //  SoftwareSerial returns after the char has been sent.  A hardware UART returns as soon as the
+    //  char is in the transmit FIFO.
+#ifdef MODEM_PORT_HARDWARE
+    if (hardwarePort) { hardwarePort->write(ch); return; }
+#endif  //  MODEM_PORT_HARDWARE
+    softwarePort->write(ch);
+  }
+
+private:
+  SoftwareSerial *softwarePort;  //  SoftwareSerial port, or 0 if using a hardware UART.
+#ifdef MODEM_PORT_HARDWARE
+  HardwareSerial *hardwarePort;  //  Hardware UART, or 0 if using SoftwareSerial.
+#endif  //  MODEM_PORT_HARDWARE
+};
+
+#endif  //  UNABIZ_ARDUINO_MODEMPORT_H
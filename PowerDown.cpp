@@ -0,0 +1,136 @@
+//  Put the Arduino into the lowest power mode between uplinks, waking up by watchdog timer
+//  or by a change on an input pin.
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+#include "SIGFOX.h"
+
+#if UNABIZ_POWER_DOWN && defined(__AVR__) && !defined(BEAN_BEAN_BEAN_H)
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+
+//  Maintained by the Arduino core in wiring.c.  We advance it by the time spent in power-down,
+//  since timer 0 is stopped.
+extern volatile unsigned long timer0_millis;
+
+static volatile bool watchdogFired = false;  //  Set by the watchdog interrupt.
+
+ISR(WDT_vect) {
+  //  Watchdog timer woke us up.
+  watchdogFired = true;
+}
+
+//  Watchdog periods, longest first, and the prescaler value for each.
+static const uint16_t watchdogMillis[] = { 8000, 4000, 2000, 1000, 500, 250, 120, 60, 30, 15 };
+static const uint8_t watchdogPrescaler[] = { WDTO_8S, WDTO_4S, WDTO_2S, WDTO_1S, WDTO_500MS,
+                                             WDTO_250MS, WDTO_120MS, WDTO_60MS, WDTO_30MS, WDTO_15MS };
+
+//  Pin change handlers that only wake us up.  SoftwareSerial has handlers for the pin change
+//  interrupts, but they are not linked if SoftwareSerial isn't, e.g. when the module is on a
+//  hardware UART with MODEM_PORT_HARDWARE.  Without a handler, the wake-up would jump to
+//  __bad_interrupt and reset the Arduino.  These handlers are weak, so the handlers of
+//  SoftwareSerial or of the sketch are used instead when linked.
+#define WAKE_PIN_HANDLER(vector) ISR(vector, __attribute__((naked, weak))) { reti(); }
+#ifdef PCINT0_vect
+WAKE_PIN_HANDLER(PCINT0_vect)
+#endif  //  PCINT0_vect
+#ifdef PCINT1_vect
+WAKE_PIN_HANDLER(PCINT1_vect)
+#endif  //  PCINT1_vect
+#ifdef PCINT2_vect
+WAKE_PIN_HANDLER(PCINT2_vect)
+#endif  //  PCINT2_vect
+#ifdef PCINT3_vect
+WAKE_PIN_HANDLER(PCINT3_vect)
+#endif  //  PCINT3_vect
+
+static bool sleepWatchdog(uint8_t prescaler) {
+  //  Power down until the watchdog fires after the prescaler period, or until another interrupt.
+  //  Returns true if the watchdog fired.
+  watchdogFired = false;
+  cli();
+  MCUSR &= ~(1 << WDRF);
+  wdt_reset();
+  //  Interrupt only, don't reset the Arduino.
+  WDTCSR = (1 << WDCE) | (1 << WDE);
+  WDTCSR = (1 << WDIE) | ((prescaler & 0x08) ? (1 << WDP3) : 0) | (prescaler & 0x07);
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  sleep_enable();
+  sei();
+  sleep_cpu();
+  sleep_disable();
+  wdt_disable();
+  return watchdogFired;
+}
+
+static void enableWakePin(int pin, bool enable) {
+  //  Enable the pin change interrupt for the pin.  The interrupt is serviced by the pin change
+  //  handler of SoftwareSerial, which ignores pins that it is not listening to, or else by
+  //  WAKE_PIN_HANDLER.
+  volatile uint8_t *pcicr = digitalPinToPCICR(pin);
+  if (pcicr == 0) return;  //  Pin doesn't support pin change interrupts.
+  if (enable) {
+    *digitalPinToPCMSK(pin) |= (1 << digitalPinToPCMSKbit(pin));
+    PCIFR |= (1 << digitalPinToPCICRbit(pin));  //  Clear any pending interrupt.
+    *pcicr |= (1 << digitalPinToPCICRbit(pin));
+  } else {
+    *digitalPinToPCMSK(pin) &= ~(1 << digitalPinToPCMSKbit(pin));
+  }
+}
+#endif  //  UNABIZ_POWER_DOWN && __AVR__ && !BEAN_BEAN_BEAN_H
+
+static PowerDownStats powerDownStats = { 0, 0, 0 };
+
+unsigned long powerDown(unsigned long duration, int wakePin) {
+  //  Power down the Arduino for up to duration milliseconds, or until wakePin changes.
+  //  Returns the number of milliseconds spent in power-down.
+  unsigned long slept = 0;
+  powerDownStats.powerDowns++;
+#if UNABIZ_POWER_DOWN && defined(__AVR__) && !defined(BEAN_BEAN_BEAN_H)
+  const uint8_t adcsra = ADCSRA;
+  ADCSRA &= ~(1 << ADEN);  //  Turn off the ADC, else it keeps drawing current.
+  if (wakePin >= 0) enableWakePin(wakePin, true);
+  uint8_t i = 0;
+  while (i < sizeof(watchdogMillis) / sizeof(watchdogMillis[0])) {
+    if (duration - slept < watchdogMillis[i]) { i++; continue; }  //  Try a shorter period.
+    const int wakeLevel = (wakePin >= 0) ? digitalRead(wakePin) : LOW;
+    if (!sleepWatchdog(watchdogPrescaler[i])) {
+      //  Woken by the pin or another interrupt.  The time spent in this period is unknown.
+      //  The pin change interrupt is shared with the other pins of the port, e.g. the
+      //  SoftwareSerial receive pin, so end the power-down only if the wake pin has changed.
+      if (wakePin >= 0 && digitalRead(wakePin) != wakeLevel) { powerDownStats.pinWakeups++; break; }
+      continue;  //  Woken by another interrupt, e.g. serial port.  Power down again.
+    }
+    slept = slept + watchdogMillis[i];
+    //  Timer 0 was stopped, so advance millis() by the time spent.
+    cli();
+    timer0_millis = timer0_millis + watchdogMillis[i];
+    sei();
+  }
+  if (wakePin >= 0) enableWakePin(wakePin, false);
+  ADCSRA = adcsra;
+#else  //  UNABIZ_POWER_DOWN && __AVR__ && !BEAN_BEAN_BEAN_H
+  //  No power-down mode, just wait.
+  (void) wakePin;
+  const unsigned long start = millis();
+  #ifdef BEAN_BEAN_BEAN_H
+    Bean.sleep(duration);  //  Bean manages its own low power mode.
+  #else  //  BEAN_BEAN_BEAN_H
+    delay(duration);
+  #endif  //  BEAN_BEAN_BEAN_H
+  slept = millis() - start;
+#endif  //  UNABIZ_POWER_DOWN && __AVR__ && !BEAN_BEAN_BEAN_H
+  powerDownStats.powerDownMillis = powerDownStats.powerDownMillis + slept;
+  return slept;
+}
+
+const PowerDownStats &getPowerDownStats() {
+  //  Return the time spent in power-down mode.
+  return powerDownStats;
+}
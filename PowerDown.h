@@ -0,0 +1,31 @@
+//  Put the Arduino into the lowest power mode between uplinks, waking up by watchdog timer
+//  or by a change on an input pin.
+#ifndef UNABIZ_ARDUINO_POWERDOWN_H
+#define UNABIZ_ARDUINO_POWERDOWN_H
+
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+//  Time spent in power-down mode.
+struct PowerDownStats {
+  unsigned long powerDownMillis;  //  Total milliseconds spent in power-down mode.
+  unsigned int powerDowns;  //  Number of calls to powerDown().
+  unsigned int pinWakeups;  //  Number of times the wake pin ended the power-down early.
+};
+
+//  Power down the Arduino for up to duration milliseconds.  If wakePin is not -1, a change
+//  on wakePin ends the power-down early.  The new level must last until the Arduino has woken
+//  up, else the change is ignored, like the changes of the other pins that share the pin change
+//  interrupt.  Returns the number of milliseconds spent in power-down.
+//  On AVR, millis() is advanced by the time spent, so that the send delay and message budget
+//  still work.  The watchdog timer is accurate to about 10%.  Set UNABIZ_POWER_DOWN to 0
+//  in SIGFOX.h if the sketch uses the watchdog interrupt itself.
+unsigned long powerDown(unsigned long duration, int wakePin = -1);
+const PowerDownStats &getPowerDownStats();  //  Return the time spent in power-down mode.
+
+#endif  //  UNABIZ_ARDUINO_POWERDOWN_H
@@ -10,18 +10,38 @@
 #include "SIGFOX.h"
 
 //  Use a macro for logging because Flash strings not supported with String class in Bean+
+//  Progress messages are logged at UNABIZ_LOG_LEVEL 2 and above, errors at level 1 and above.
+#if UNABIZ_LOG_LEVEL >= 2
 #define log1(x) { echoPort->println(x); }
 #define log2(x, y) { echoPort->print(x); echoPort->println(y); }
 // #define log3(x, y, z) { echoPort->print(x); echoPort->print(y); echoPort->println(z); }
 #define log4(x, y, z, a) { echoPort->print(x); echoPort->print(y); echoPort->print(z); echoPort->println(a); }
-
-#define MODEM_BITS_PER_SECOND 19200
-#define END_OF_RESPONSE '>'  //  Character '>' marks the end of response.
+#else  //  UNABIZ_LOG_LEVEL >= 2
+#define log1(x) {}
+#define log2(x, y) {}
+#define log4(x, y, z, a) {}
+#endif  //  UNABIZ_LOG_LEVEL >= 2
+#if UNABIZ_LOG_LEVEL >= 1
+#define logErr1(x) { echoPort->println(x); }
+#define logErr2(x, y) { echoPort->print(x); echoPort->println(y); }
+#else  //  UNABIZ_LOG_LEVEL >= 1
+#define logErr1(x) {}
+#define logErr2(x, y) {}
+#endif  //  UNABIZ_LOG_LEVEL >= 1
+
+#define RADIOCRAFTS_BITS_PER_SECOND 19200
+#define RADIOCRAFTS_STARTUP_DELAY 200  //  Wait 200 milliseconds for the serial port to settle after starting.
+#define RADIOCRAFTS_WARMUP_DELAY 2000  //  Wait 2 seconds for the module to warm up before begin() configures it.
+//  Time to transmit 1 char (start bit + 8 data bits + stop bit) at the modem bps, in microseconds.
+#define RADIOCRAFTS_CHAR_MICROS (10 * 1000000UL / RADIOCRAFTS_BITS_PER_SECOND)
+#define RADIOCRAFTS_END_OF_RESPONSE '>'  //  Character '>' marks the end of response.
 #define CMD_READ_MEMORY 'Y'  //  'Y' to read memory.
 #define CMD_ENTER_CONFIG 'M'  //  'M' to enter config mode.
 #define CMD_EXIT_CONFIG (char) 0xff  //  Exit config mode.
+#define CMD_SEND_DOWNLINK "42"  //  'B' to send a frame with downlink request, in command mode.
 
 static NullPort nullPort;
+static RetryPolicy beginRetry(5, 2000, 16000);  //  Wait 1 to 2 seconds before retrying begin(), doubling up to 16 seconds.
 
 /* TODO: Run some sanity checks to ensure that Radiocrafts module is configured OK.
   //  Get network mode for transmission.  Should return network mode = 0 for uplink only, no downlink.
@@ -40,17 +60,34 @@ Radiocrafts::Radiocrafts(Country country0, bool useEmulator0, const String devic
                          uint8_t rx, uint8_t tx) {
   //  Init the module with the specified transmit and receive pins.
   //  Default to no echo.
+  //  Bean+ firmware 0.6.1 can't receive serial data properly. We provide
+  //  an alternative class BeanSoftwareSerial to work around this.
+  //  For Bean, SoftwareSerial is a #define alias for BeanSoftwareSerial.
+  serialPort.attach(new SoftwareSerial(rx, tx));
+  init(country0, useEmulator0, device0, echo);
+}
+
+#ifdef MODEM_PORT_HARDWARE
+Radiocrafts::Radiocrafts(Country country0, bool useEmulator0, const String device0, bool echo,
+                         HardwareSerial *port) {
+  //  Init the module connected to a hardware UART, e.g. Serial1.
+  serialPort.attach(port);
+  init(country0, useEmulator0, device0, echo);
+}
+#endif  //  MODEM_PORT_HARDWARE
+
+void Radiocrafts::init(Country country0, bool useEmulator0, const String &device0, bool echo) {
+  //  Init the state shared by the constructors.
   mode = SEND_MODE;
   country = country0;
   useEmulator = useEmulator0;
   device = device0;
-  //  Bean+ firmware 0.6.1 can't receive serial data properly. We provide
-  //  an alternative class BeanSoftwareSerial to work around this.
-  //  For Bean, SoftwareSerial is a #define alias for BeanSoftwareSerial.
-  serialPort = new SoftwareSerial(rx, tx);
   if (echo) echoPort = &Serial;
   else echoPort = &nullPort;
   lastEchoPort = &Serial;
+  portOpen = false;
+  sessionDepth = 0;
+  modeDepth = 0;
 }
 
 bool Radiocrafts::begin() {
@@ -62,46 +99,70 @@ bool Radiocrafts::begin() {
 #ifdef BEAN_BEAN_BEAN_H
     Bean.sleep(7000);  //  For Bean, delay longer to allow Bluetooth debug console to connect.
 #else  // BEAN_BEAN_BEAN_H
-    delay(2000);
+    //  Wait for the module to warm up, then wait longer after each failure.
+    delay(i == 0 ? RADIOCRAFTS_WARMUP_DELAY : beginRetry.getDelay(i - 1));
 #endif // BEAN_BEAN_BEAN_H
-    String result;
+    //  Keep the port open for all the commands below.
+    beginSession();
+    const bool status = configure();
+    endSession();
+    if (status) return true;  //  Init module succeeded.
+  }
+  return false;  //  Failed to init module.
+}
+
+bool Radiocrafts::configure() {
+  //  Write the config in one Config Mode batch, then read it back in the enclosing Command Mode
+  //  batch.  The module doesn't acknowledge the config writes and the exit to Send Mode, so each
+  //  of them waits for the command timeout.  Switching modes only once keeps begin() short.
+  String result;
+  if (!beginMode(COMMAND_MODE)) return false;
+  bool status = beginMode(CONFIG_MODE);
+  if (status) {
     if (useEmulator) {
       //  Emulation mode.
-      if (!enableEmulator(result)) continue;
+      status = enableEmulator(result);
     } else {
       //  Disable emulation mode.
       log1(F(" - Disabling emulation mode..."));
-      if (!disableEmulator(result)) continue;
-
-      //  Check whether emulator is used for transmission.
-      log1(F(" - Checking emulation mode (expecting 0)...")); int emulator = 0;
-      if (!getEmulator(emulator)) continue;
+      status = disableEmulator(result);
     }
-
+    if (status) {
+      //  Set the frequency of SIGFOX module.
+      log2(F(" - Setting frequency for country "), (int) country);
+      if (country == COUNTRY_US) {  //  US runs on different frequency (RCZ2).
+        status = setFrequencyUS(result);
+      } else if (country == COUNTRY_FR) {  //  France runs on different frequency (RCZ1).
+        status = setFrequencyETSI(result);
+      } else { //  Rest of the world runs on RCZ4.
+        status = setFrequencySG(result);
+      }
+      if (status) log2(F(" - Set frequency result = "), result);
+    }
+    endMode();  //  Back to Command Mode.
+  }
+  if (status && !useEmulator) {
+    //  Check whether emulator is used for transmission.
+    log1(F(" - Checking emulation mode (expecting 0)...")); int emulator = 0;
+    status = getEmulator(emulator);
+  }
+  if (status) {
     //  Read SIGFOX ID and PAC from module.
     log1(F(" - Getting SIGFOX ID..."));  String id, pac;
-    if (!getID(id, pac)) continue;
-    echoPort->print(F(" - SIGFOX ID = "));  Serial.println(id);
-    echoPort->print(F(" - PAC = "));  Serial.println(pac);
-
-    //  Set the frequency of SIGFOX module.
-    log2(F(" - Setting frequency for country "), (int) country);
-    if (country == COUNTRY_US) {  //  US runs on different frequency (RCZ2).
-      if (!setFrequencyUS(result)) continue;
-    } else if (country == COUNTRY_FR) {  //  France runs on different frequency (RCZ1).
-      if (!setFrequencyETSI(result)) continue;
-    } else { //  Rest of the world runs on RCZ4.
-      if (!setFrequencySG(result)) continue;
+    status = getID(id, pac);
+    if (status) {
+      log2(F(" - SIGFOX ID = "), id);
+      log2(F(" - PAC = "), pac);
     }
-    log2(F(" - Set frequency result = "), result);
-
+  }
+  if (status) {
     //  Get and display the frequency used by the SIGFOX module.  Should return 3 for RCZ4 (SG/TW).
     log1(F(" - Getting frequency (expecting 3)..."));  String frequency;
-    if (!getFrequency(frequency)) continue;
-    log2(F(" - Frequency (expecting 3) = "), frequency);
-    return true;  //  Init module succeeded.
+    status = getFrequency(frequency);
+    if (status) log2(F(" - Frequency (expecting 3) = "), frequency);
   }
-  return false;  //  Failed to init module.
+  endMode();  //  Back to Send Mode.
+  return status;
 }
 
 bool Radiocrafts::sendMessage(const String &payload) {
@@ -109,27 +170,60 @@ bool Radiocrafts::sendMessage(const String &payload) {
   //  We convert to binary and send to SIGFOX.  Return true if successful.
   //  We represent the payload as hex instead of binary because 0x00 is a
   //  valid payload and this causes string truncation in C libraries.
-  //  Assumes we are in Send Mode.
+  //  Switches to Send Mode if called inside a beginMode() batch.
   log2(F(" - Radiocrafts.sendMessage: "), device + ',' + payload);
   if (!isReady()) return false;  //  Prevent user from sending too many messages without sufficient delay.
+  if (!switchMode(SEND_MODE)) return false;
 
   //  Decode and send the data.
   //  First byte is payload length, followed by rest of payload.
   String message = toHex((char) (payload.length() / 2)) + payload, data;
   uint8_t markers = 0;
-  if (sendBuffer(message, COMMAND_TIMEOUT, 0, data, markers)) {  //  No markers expected.
-    log1(data);
-    lastSend = millis();
-    return true;
+  const bool status = sendBuffer(message, COMMAND_TIMEOUT, 0, data, markers);  //  No markers expected.
+  restoreMode();
+  if (!status) return false;
+  log1(data);
+  lastSend = millis();
+  return true;
+}
+
+bool Radiocrafts::sendMessageAndGetResponse(const String &payload,
+                                            uint8_t downlink[MAX_BYTES_PER_DOWNLINK]) {
+  //  Payload contains a string of hex digits, up to 24 digits / 12 bytes.  Send the payload
+  //  with a downlink request in Command Mode.  The module returns the 8 downlink bytes followed by '>'.
+  //  Return the downlink bytes in downlink.
+  log2(F(" - Radiocrafts.sendMessageAndGetResponse: "), device + ',' + payload);
+  if (useEmulator) {
+    logErr1(F(" - Radiocrafts.sendMessageAndGetResponse: Error: Emulator has no downlink"));
+    return false;
   }
-  return false;
+  if (!isReady()) return false;  //  Prevent user from sending too many messages without sufficient delay.
+
+  //  'B', then payload length, followed by rest of payload.
+  String message = String(CMD_SEND_DOWNLINK) + toHex((char) (payload.length() / 2)) + payload, data;
+  uint8_t markers = 0;
+  beginSession();
+  if (!enterCommandMode()) { endSession(); return false; }
+  //  The downlink bytes may contain '>', so the marker is only checked after 8 bytes.
+  bool status = sendBuffer(message, RADIOCRAFTS_DOWNLINK_TIMEOUT, 1, data,
+                           markers, MAX_BYTES_PER_DOWNLINK);
+  //  Return to the mode of the batch, else Send Mode so that the device is normally in send mode.
+  restoreMode();
+  endSession();
+  if (!status) return false;
+  lastSend = millis();
+  if (hexToBytes(data.c_str(), MAX_BYTES_PER_DOWNLINK * 2, downlink) != MAX_BYTES_PER_DOWNLINK) {
+    logErr2(F(" - Radiocrafts.sendMessageAndGetResponse: Error: Unknown downlink response: "), data);
+    return false;
+  }
+  return true;
 }
 
 bool Radiocrafts::sendCommand(const String &cmd, uint8_t expectedMarkerCount,
                               String &result, uint8_t &actualMarkerCount) {
   //  Send a Radiocrafts command in Command Mode.
-  //  Switches to Command Mode and returns to Send Mode after sending.
-  //  Device must be already in Send Mode.
+  //  Switches to Command Mode and returns to Send Mode after sending, unless called
+  //  inside a beginMode() batch, which stays in its mode until endMode().
   //  cmd contains a string of hex digits, up to 24 digits / 12 bytes.
   //  We convert to binary and send to SIGFOX.  Return true if successful.
   String data;
@@ -138,15 +232,15 @@ bool Radiocrafts::sendCommand(const String &cmd, uint8_t expectedMarkerCount,
   bool status = sendBuffer(cmd, COMMAND_TIMEOUT, expectedMarkerCount,
     data, actualMarkerCount);
   if (status) result = data;
-  //  Always exit command mode so that the device is normally in send mode.
-  if (!exitCommandMode()) return false;
+  //  Return to the mode of the batch, else Send Mode so that the device is normally in send mode.
+  if (!restoreMode()) return false;
   return status;
 }
 
 bool Radiocrafts::sendConfigCommand(const String &cmd, String &result) {
   //  Send a Radiocrafts config command in Config Mode.
-  //  Switches to Config Mode and returns to Send Mode after sending.
-  //  Device must be already in Send Mode.
+  //  Switches to Config Mode and returns to Send Mode after sending, unless called
+  //  inside a beginMode() batch, which stays in its mode until endMode().
   //  cmd contains a string of hex digits, up to 24 digits / 12 bytes.
   //  We convert to binary and send to SIGFOX.  Return true if successful.
   String data;
@@ -156,8 +250,8 @@ bool Radiocrafts::sendConfigCommand(const String &cmd, String &result) {
   bool status = sendBuffer(cmd, COMMAND_TIMEOUT, 0,
                            data, actualMarkerCount);
   if (status) result = data;
-  //  Always exit config mode so that the device is normally in send mode.
-  if (!exitConfigMode()) return false;
+  //  Return to the mode of the batch, else Send Mode so that the device is normally in send mode.
+  if (!restoreMode()) return false;
   return status;
 }
 
@@ -165,49 +259,50 @@ bool Radiocrafts::sendConfigCommand(const String &cmd, String &result) {
 const uint8_t markerPosMax = 5;
 static uint8_t markerPos[markerPosMax];
 
-bool Radiocrafts::sendBuffer(const String &buffer, const int timeout,
+bool Radiocrafts::sendBuffer(const String &buffer, const unsigned long timeout,
                              uint8_t expectedMarkerCount, String &response,
-                             uint8_t &actualMarkerCount) {
+                             uint8_t &actualMarkerCount, uint8_t dataBytes) {
   //  buffer contains a string of hex digits, up to 24 digits / 12 bytes.
   //  We convert to binary and send to SIGFOX.  Return true if successful.
   //  We represent the payload as hex instead of binary because 0x00 is a
   //  valid payload and this causes string truncation in C libraries.
   //  expectedMarkerCount is the number of end-of-command markers '>' we
   //  expect to see.  actualMarkerCount contains the actual number seen.
+  //  The first dataBytes bytes of the response are data, even if they contain '>'.
   log2(F(" - Radiocrafts.sendBuffer: "), buffer);
   response = "";
   if (useEmulator) return true;
 
   actualMarkerCount = 0;
-  //  Start serial interface.
-  serialPort->begin(MODEM_BITS_PER_SECOND);
-#ifdef BEAN_BEAN_BEAN_H
-  Bean.sleep(200);
-#else  // BEAN_BEAN_BEAN_H
-  delay(200);
-#endif // BEAN_BEAN_BEAN_H
-  serialPort->flush();
-  serialPort->listen();
+  //  Start serial interface, unless already started in this session.
+  openPort();
+  serialPort.listen();
 
   //  Send the buffer: need to write/read char by char because of echo.
   const char *rawBuffer = buffer.c_str();
   //  Send buffer and read response.  Loop until timeout or we see the end of response marker.
   unsigned long startTime = millis(); int i = 0;
+#if UNABIZ_COMMAND_STATS
+  const unsigned long commandStartTime = startTime;
+#endif  //  UNABIZ_COMMAND_STATS
+  unsigned long txMicros = 0;  bool txPaced = false;
   //  Previous code for verifying that data was sent correctly.
   //static String echoSend = "", echoReceive = "";
   for (;;) {
-    //  If there is data to send, send it.
-    if (i < buffer.length()) {
+    //  If there is data to send, send it.  SoftwareSerial write() returns after the char has been
+    //  transmitted, so we may send the next char right away at the full line rate.  If the module
+    //  is echoing while we send, we leave a gap of 1 char time after each char so that the receive
+    //  interrupt is not blocked by the transmit.
+    if (i < buffer.length() &&
+        (!txPaced || micros() - txMicros >= RADIOCRAFTS_CHAR_MICROS)) {
       //  Convert 2 hex digits to 1 char and send.
-      uint8_t txChar = hexDigitToDecimal(rawBuffer[i]) * 16 +
-                       hexDigitToDecimal(rawBuffer[i + 1]);
+      uint8_t txChar = 0;
+      if (hexToBytes(rawBuffer + i, 2, &txChar) == 0) {
+        logErr2(F(" - Radiocrafts.sendBuffer: Error: Invalid hex digits at "), i);
+      }
       //echoSend.concat(toHex((char) txChar) + ' ');
-      serialPort->write(txChar);
-#ifdef BEAN_BEAN_BEAN_H
-      Bean.sleep(10);
-#else  // BEAN_BEAN_BEAN_H
-      delay(10);  //  Need to wait a while because SoftwareSerial has no FIFO and may overflow.
-#endif // BEAN_BEAN_BEAN_H
+      serialPort.write(txChar);
+      txMicros = micros();
       i = i + 2;
       startTime = millis();  //  Start the timer only when all data has been sent.
     }
@@ -217,53 +312,134 @@ bool Radiocrafts::sendBuffer(const String &buffer, const int timeout,
     if (currentTime - startTime > timeout) break;
 
     //  If data is available to receive, receive it.
-    if (serialPort->available() > 0) {
-      int rxChar = serialPort->read();
+    if (serialPort.available() > 0) {
+      int rxChar = serialPort.read();
       //  echoReceive.concat(toHex((char) rxChar) + ' ');
       if (rxChar == -1) continue;
-      if (rxChar == END_OF_RESPONSE) {
+      //  Module is talking while we send: interleave, unless the hardware UART sends from its FIFO.
+      if (i < buffer.length() && !serialPort.isHardware()) txPaced = true;
+      if (rxChar == RADIOCRAFTS_END_OF_RESPONSE && response.length() >= dataBytes * 2) {
         if (actualMarkerCount < markerPosMax)
           markerPos[actualMarkerCount] = response.length();  //  Remember the marker pos.
         actualMarkerCount++;  //  Count the number of end markers.
         if (actualMarkerCount >= expectedMarkerCount) break;  //  Seen all markers already.
       } else {
-        response.concat(toHex((char) rxChar));
+        response.concat(nibbleToHexDigit(rxChar >> 4));
+        response.concat(nibbleToHexDigit(rxChar));
       }
     }
 
-    //  TODO: Check for downlink response.
-
   }
-  serialPort->end();
+  if (sessionDepth == 0) closePort();
+  diagnose(response.length());  //  Record the response length and free memory.
+#if UNABIZ_COMMAND_STATS
+  //  Key the command by its first byte: the mode switches 00, X, M and ff, the commands
+  //  9, U, V, Y and B, and "SEND" or "CFG" for the payloads in Send Mode and Config Mode.
+  char key[COMMAND_KEY_MAX + 1];
+  uint8_t command = 0;
+  hexToBytes(rawBuffer, 2, &command);
+  if (mode == SEND_MODE && command != 0x00) strcpy(key, "SEND");
+  else if (mode == CONFIG_MODE && command != 0xff) strcpy(key, "CFG");
+  else if (command >= '0' && command <= 'Z') { key[0] = command; key[1] = 0; }
+  else bytesToHex(&command, 1, key);
+  commandStats.record(key, millis() - commandStartTime, actualMarkerCount >= expectedMarkerCount,
+                      i / 2, response.length() / 2 + actualMarkerCount);
+#endif  //  UNABIZ_COMMAND_STATS
   //  Log the actual bytes sent and received.
   //log2(F(">> "), echoSend);
   //  if (echoReceive.length() > 0) { log2(F("<< "), echoReceive); }
+#if UNABIZ_LOG_LEVEL >= 3
   logBuffer(F(">> "), rawBuffer, 0, 0);
   logBuffer(F("<< "), response.c_str(), markerPos, actualMarkerCount);
+#endif  //  UNABIZ_LOG_LEVEL >= 3
 
   //  If we did not see the terminating '>', something is wrong.
   if (actualMarkerCount < expectedMarkerCount) {
     if (response.length() == 0) {
-      log1(F(" - Radiocrafts.sendBuffer: Error: No response"));  //  Response timeout.
+      logErr1(F(" - Radiocrafts.sendBuffer: Error: No response"));  //  Response timeout.
     } else {
-      log2(F(" - Radiocrafts.sendBuffer: Error: Unknown response: "), response);
+      logErr2(F(" - Radiocrafts.sendBuffer: Error: Unknown response: "), response);
     }
     return false;
   }
   log2(F(" - Radiocrafts.sendBuffer: response: "), response);
-  //  TODO: Parse the downlink response.
   return true;
 }
 
+void Radiocrafts::openPort() {
+  //  Start the serial port if not already started, and wait for it to settle.
+  if (portOpen) return;
+  serialPort.begin(RADIOCRAFTS_BITS_PER_SECOND);
+#ifdef BEAN_BEAN_BEAN_H
+  Bean.sleep(RADIOCRAFTS_STARTUP_DELAY);
+#else  // BEAN_BEAN_BEAN_H
+  delay(RADIOCRAFTS_STARTUP_DELAY);
+#endif // BEAN_BEAN_BEAN_H
+  serialPort.clearInput();
+  portOpen = true;
+}
+
+void Radiocrafts::closePort() {
+  //  Stop the serial port if started.
+  if (!portOpen) return;
+  serialPort.end();
+  portOpen = false;
+}
+
+void Radiocrafts::beginSession() {
+  //  Keep the serial port open across a batch of commands, until endSession() is called.
+  //  This avoids restarting the port and waiting for it to settle before every command.
+  sessionDepth++;
+}
+
+void Radiocrafts::endSession() {
+  //  End the batch of commands and stop the serial port.
+  if (sessionDepth == 0) return;
+  sessionDepth--;
+  if (sessionDepth == 0) closePort();
+}
+
+bool Radiocrafts::beginMode(Mode target) {
+  //  Enter the mode for a batch of commands, until endMode() is called.  The port is kept open
+  //  for the batch.  The commands for the other mode still work: they switch modes as needed.
+  if (modeDepth >= RADIOCRAFTS_MODE_DEPTH) {
+    logErr1(F(" - Radiocrafts.beginMode: Error: Too many nested batches"));
+    return false;
+  }
+  beginSession();
+  modeStack[modeDepth++] = target;
+  if (switchMode(target)) return true;
+  endMode();
+  return false;
+}
+
+void Radiocrafts::endMode() {
+  //  End the batch and return to the mode of the enclosing batch, or Send Mode if none.
+  if (modeDepth == 0) return;
+  modeDepth--;
+  restoreMode();
+  endSession();
+}
+
+bool Radiocrafts::switchMode(Mode target) {
+  //  Switch to the target mode.  Send Mode and Config Mode are switched through Command Mode.
+  //  We track the current mode, so the switches that are not needed are skipped.
+  if (target == COMMAND_MODE) return enterCommandMode();
+  if (target == CONFIG_MODE) return enterConfigMode();
+  return exitCommandMode();
+}
+
+bool Radiocrafts::restoreMode() {
+  //  Return to the mode of the current batch, or Send Mode if none.
+  return switchMode(modeDepth > 0 ? modeStack[modeDepth - 1] : SEND_MODE);
+}
+
 bool Radiocrafts::sendString(const String &str) {
   //  For convenience, allow sending of a text string with automatic encoding into bytes.  Max 12 characters allowed.
   //  Convert each character into 2 bytes.
   log2(F(" - Radiocrafts.sendString: "), str);
   String payload;
-  for (unsigned i = 0; i < str.length(); i++) {
-    char ch = str.charAt(i);
-    payload.concat(toHex(ch));
-  }
+  appendHex(payload, (const uint8_t *) str.c_str(), str.length());
   //  Send the encoded payload.
   return sendMessage(payload);
 }
@@ -295,7 +471,7 @@ bool Radiocrafts::isReady()
   const unsigned long elapsedTime = currentTime - lastSend;
   //  For development, allow sending every 2 seconds.
   if (elapsedTime <= 2 * 1000) {
-    log1(F("***MESSAGE NOT SENT - Must wait 2 seconds before sending the next message"));
+    logErr1(F("***MESSAGE NOT SENT - Must wait 2 seconds before sending the next message"));
     return false;
   }  //  Wait before sending.
   if (elapsedTime <= SEND_DELAY)
@@ -307,12 +483,10 @@ static String data;  //  Used by all functions except enter/exit command/config
 static String modeData;  //  Used by enter/exit command/config mode only.
 
 bool Radiocrafts::enterCommandMode() {
-  //  Enter Command Mode for sending module commands, not data.  Assumes we are in Send Mode.
+  //  Enter Command Mode for sending module commands, not data.  Does nothing if already in Command Mode.
+  if (mode == COMMAND_MODE) return true;
+  if (mode == CONFIG_MODE) return exitConfigMode();  //  Config Mode exits to Command Mode.
   log1(F(" - Entering command mode..."));
-  //  Confirm we are in SEND_MODE
-  if (mode != SEND_MODE) {
-    log1(F(" - Warning: Radiocrafts.enterCommandMode did not detect expected Send Mode, may be in incorrect mode"));
-  }
   uint8_t markers = 0;
   if (!sendBuffer("00", COMMAND_TIMEOUT, 1, modeData, markers)) return false;
   //  Confirm response = '>'
@@ -325,12 +499,10 @@ bool Radiocrafts::enterCommandMode() {
 }
 
 bool Radiocrafts::exitCommandMode() {
-  //  Exit Command Mode and return to Send Mode so we can send data.  Assumes we are in Command Mode.
+  //  Exit Command Mode and return to Send Mode so we can send data.  Does nothing if already in Send Mode.
+  if (mode == SEND_MODE) return true;
+  if (mode == CONFIG_MODE && !exitConfigMode()) return false;  //  Exit to Command Mode first.
   log1(F(" - Exiting command mode..."));
-  //  Confirm we are in COMMAND_MODE.
-  if (mode != COMMAND_MODE) {
-    log1(F(" - Warning: Radiocrafts.exitCommandMode did not detect expected Command Mode, may be in incorrect mode"));
-  }
   for (;;) {
     //  Keep sending the exit command until we are really sure.  Sometimes we might out of sync.
     uint8_t markers = 0;
@@ -344,15 +516,12 @@ bool Radiocrafts::exitCommandMode() {
 }
 
 bool Radiocrafts::enterConfigMode() {
-  //  Enter Config Mode for setting config.  Assumes we are in Send Mode.
-  //  Device is normally in Send Mode.  We switch to Command Mode first.
+  //  Enter Config Mode for setting config.  Does nothing if already in Config Mode.
+  //  Device is normally in Send Mode.  We switch to Command Mode first, if not already there.
+  if (mode == CONFIG_MODE) return true;
   if (!enterCommandMode()) return false;
-  //  Confirm we are in COMMAND_MODE
-  if (mode != COMMAND_MODE) {
-    log1(F(" - Warning: Radiocrafts.enterConfigMode did not detect expected Command Mode, may be in incorrect mode"));
-  }
   //  Now switch from Command Mode to Config Mode.
-  log1(F(" - Entering config mode from send mode..."));
+  log1(F(" - Entering config mode from command mode..."));
   uint8_t markers = 0;
   if (!sendBuffer(toHex(CMD_ENTER_CONFIG), COMMAND_TIMEOUT, 1, modeData, markers)) return false;
   mode = CONFIG_MODE;
@@ -361,19 +530,14 @@ bool Radiocrafts::enterConfigMode() {
 }
 
 bool Radiocrafts::exitConfigMode() {
-  //  Exit Config Mode and return to Send Mode so we can send data.
-  //  We exit to Command Mode first.
-  log1(F(" - Exiting config mode to send mode..."));
-  //  Confirm we are in CONFIG_MODE
-  if (mode != CONFIG_MODE) {
-    log1(F(" - Warning: Radiocrafts.exitConfigMode did not detect expected Config Mode, may be in incorrect mode"));
-  }
+  //  Exit Config Mode and return to Command Mode.  Does nothing if not in Config Mode.
+  //  Call exitCommandMode() to return to Send Mode.
+  if (mode != CONFIG_MODE) return true;
+  log1(F(" - Exiting config mode to command mode..."));
   uint8_t markers = 0;
   if (!sendBuffer(toHex(CMD_EXIT_CONFIG), COMMAND_TIMEOUT, 1, modeData, markers)) return false;
   mode = COMMAND_MODE;
   log1(F(" - Radiocrafts.exitConfigMode: OK "));
-  //  Then exit to Send Mode.
-  exitCommandMode();
   return true;
 }
 
@@ -384,7 +548,7 @@ bool Radiocrafts::getID(String &id, String &pac) {
   //  Returns with 12 bytes: 4 bytes ID (LSB first) and 8 bytes PAC (MSB first).
   if (data.length() != 12 * 2) {
     if (useEmulator) { id = device; return true; }
-    log2(F(" - Radiocrafts.getID: Unknown response: "), data);
+    logErr2(F(" - Radiocrafts.getID: Unknown response: "), data);
     return false;
   }
   id = data.substring(6, 8) + data.substring(4, 6) + data.substring(2, 4) + data.substring(0, 2);
@@ -400,11 +564,12 @@ bool Radiocrafts::getTemperature(int &temperature) {
   if (!sendCommand(toHex('U'), 1, data, markers)) return false;
   if (data.length() != 2) {
     if (useEmulator) { temperature = 36; return true; }
-    log2(F(" - Radiocrafts.getTemperature: Unknown response: "), data);
+    logErr2(F(" - Radiocrafts.getTemperature: Unknown response: "), data);
     return false;
   }
-  temperature = hexDigitToDecimal(data.charAt(0)) * 16 +
-                   hexDigitToDecimal(data.charAt(1)) - 128;
+  uint8_t value = 0;
+  hexToBytes(data.c_str(), 2, &value);
+  temperature = value - 128;
   log2(F(" - Radiocrafts.getTemperature: returned "), temperature);
   return true;
 }
@@ -415,29 +580,37 @@ bool Radiocrafts::getVoltage(float &voltage) {
   if (!sendCommand(toHex('V'), 1, data, markers)) return false;
   if (data.length() != 2) {
     if (useEmulator) { voltage = 12.3; return true; }
-    log2(F(" - Radiocrafts.getVoltage: Unknown response: "), data);
+    logErr2(F(" - Radiocrafts.getVoltage: Unknown response: "), data);
     return false;
   }
-  voltage = 0.030 * (hexDigitToDecimal(data.charAt(0)) * 16 +
-                hexDigitToDecimal(data.charAt(1)));
+  uint8_t value = 0;
+  hexToBytes(data.c_str(), 2, &value);
+  voltage = 0.030 * value;
   log2(F(" - Radiocrafts.getVoltage: returned "), voltage);
   return true;
 }
 
 bool Radiocrafts::getHardware(String &hardware) {
   //  TODO
-  log1(F(" - Radiocrafts.getHardware: ERROR - Not implemented"));
+  logErr1(F(" - Radiocrafts.getHardware: ERROR - Not implemented"));
   hardware = "TODO";
   return true;
 }
 
 bool Radiocrafts::getFirmware(String &firmware) {
   //  TODO
-  log1(F(" - Radiocrafts.getFirmware: ERROR - Not implemented"));
+  logErr1(F(" - Radiocrafts.getFirmware: ERROR - Not implemented"));
   firmware = "TODO";
   return true;
 }
 
+#if UNABIZ_COMMAND_STATS
+const CommandStats &Radiocrafts::getCommandStats() {
+  //  Return the round-trip time and bytes for each command sent.
+  return commandStats;
+}
+#endif  //  UNABIZ_COMMAND_STATS
+
 bool Radiocrafts::getParameter(uint8_t address, String &value) {
   //  Read the parameter at the address.
   log2(F(" - Radiocrafts.getParameter: address=0x"), toHex((char) address));
@@ -461,7 +634,7 @@ bool Radiocrafts::getPower(int &power) {
 
 bool Radiocrafts::setPower(int power) {
   //  TODO: Power value: 0...14
-  log1(F(" - Radiocrafts.receive: ERROR - Not implemented"));
+  logErr1(F(" - Radiocrafts.receive: ERROR - Not implemented"));
   return true;
 }
 
@@ -501,8 +674,7 @@ bool Radiocrafts::getFrequency(String &result) {
   //  0: Europe (RCZ1)
   //  1: US (RCZ2)
   //  3: SG, TW, AU, NZ (RCZ4)
-  uint8_t markers = 0;
-  if (!sendCommand(toHex(CMD_READ_MEMORY) + "00", 1, data, markers)) return false;
+  if (!getParameter(0x00, data)) return false;  //  Address of parameter = RF_FREQUENCY_DOMAIN (0x00)
   result = data;
   return true;
 }
@@ -542,13 +714,13 @@ bool Radiocrafts::setFrequencyUS(String &result) {
 
 bool Radiocrafts::writeSettings(String &result) {
   //  TODO: Write settings to module's flash memory.
-  log1(F(" - Radiocrafts.writeSettings: ERROR - Not implemented"));
+  logErr1(F(" - Radiocrafts.writeSettings: ERROR - Not implemented"));
   return true;
 }
 
 bool Radiocrafts::reboot(String &result) {
   //  TODO: Reboot the module.
-  log1(F(" - Radiocrafts.reboot: ERROR - Not implemented"));
+  logErr1(F(" - Radiocrafts.reboot: ERROR - Not implemented"));
   return true;
 }
 
@@ -574,110 +746,82 @@ void Radiocrafts::echo(const String &msg) {
   log2(F(" - "), msg);
 }
 
+void Radiocrafts::echo(const char *msg) {
+  //  Echo debug message to the echo port.
+  log2(F(" - "), msg);
+}
+
+bool Radiocrafts::receive(uint8_t downlink[MAX_BYTES_PER_DOWNLINK]) {
+  //  Send an empty frame with a downlink request and return the 8 bytes of the downlink response.
+  return sendMessageAndGetResponse("", downlink);
+}
+
 bool Radiocrafts::receive(String &data) {
-  //  TODO
-  log1(F(" - Radiocrafts.receive: ERROR - Not implemented"));
+  //  Return the received bytes as hex digits.
+  uint8_t downlink[MAX_BYTES_PER_DOWNLINK];
+  if (!receive(downlink)) return false;
+  data = "";
+  appendHex(data, downlink, MAX_BYTES_PER_DOWNLINK);
   return true;
 }
 
 String Radiocrafts::toHex(int i) {
   //  Convert the integer to a string of 4 hex digits.
-  byte *b = (byte *) &i;
   String bytes;
-  for (int j=0; j<2; j++) {
-    if (b[j] <= 0xF) bytes.concat('0');
-    bytes.concat(String(b[j], 16));
-  }
+  appendHex(bytes, (const uint8_t *) &i, 2);
   return bytes;
 }
 
 String Radiocrafts::toHex(unsigned int ui) {
   //  Convert the integer to a string of 4 hex digits.
-  byte *b = (byte *) &ui;
   String bytes;
-  for (int i=0; i<2; i++) {
-    if (b[i] <= 0xF) bytes.concat('0');
-    bytes.concat(String(b[i], 16));
-  }
+  appendHex(bytes, (const uint8_t *) &ui, 2);
   return bytes;
 }
 
 String Radiocrafts::toHex(long l) {
   //  Convert the long to a string of 8 hex digits.
-  byte *b = (byte *) &l;
   String bytes;
-  for (int i=0; i<4; i++) {
-    if (b[i] <= 0xF) bytes.concat('0');
-    bytes.concat(String(b[i], 16));
-  }
+  appendHex(bytes, (const uint8_t *) &l, 4);
   return bytes;
 }
 
 String Radiocrafts::toHex(unsigned long ul) {
   //  Convert the long to a string of 8 hex digits.
-  byte * b = (byte *) &ul;
   String bytes;
-  for (int i=0; i<4; i++) {
-    if (b[i] <= 0xF) bytes.concat('0');
-    bytes.concat(String(b[i], 16));
-  }
+  appendHex(bytes, (const uint8_t *) &ul, 4);
   return bytes;
 }
 
 String Radiocrafts::toHex(float f) {
   //  Convert the float to a string of 8 hex digits.
-  byte *b = (byte *) &f;
   String bytes;
-  for (int i=0; i<4; i++) {
-    if (b[i] <= 0xF) bytes.concat('0');
-    bytes.concat(String(b[i], 16));
-  }
+  appendHex(bytes, (const uint8_t *) &f, 4);
   return bytes;
 }
 
 String Radiocrafts::toHex(double d) {
   //  Convert the double to a string of 8 hex digits.
-  byte *b = (byte *) &d;
   String bytes;
-  for (int i=0; i<4; i++) {
-    if (b[i] <= 0xF) bytes.concat('0');
-    bytes.concat(String(b[i], 16));
-  }
+  appendHex(bytes, (const uint8_t *) &d, 4);
   return bytes;
 }
 
 String Radiocrafts::toHex(char c) {
   //  Convert the char to a string of 2 hex digits.
-  byte *b = (byte *) &c;
   String bytes;
-  if (b[0] <= 0xF) bytes.concat('0');
-  bytes.concat(String(b[0], 16));
+  appendHex(bytes, (const uint8_t *) &c, 1);
   return bytes;
 }
 
 String Radiocrafts::toHex(char *c, int length) {
   //  Convert the string to a string of hex digits.
-  byte *b = (byte *) c;
   String bytes;
-  for (int i=0; i<length; i++) {
-    if (b[i] <= 0xF) bytes.concat('0');
-    bytes.concat(String(b[i], 16));
-  }
+  appendHex(bytes, (const uint8_t *) c, length);
   return bytes;
 }
 
-uint8_t Radiocrafts::hexDigitToDecimal(char ch) {
-  //  Convert 0..9, a..f, A..F to decimal.
-  if (ch >= '0' && ch <= '9') return (uint8_t) ch - '0';
-  if (ch >= 'a' && ch <= 'z') return (uint8_t) ch - 'a' + 10;
-  if (ch >= 'A' && ch <= 'Z') return (uint8_t) ch - 'A' + 10;
-  log2(F(" - Radiocrafts.hexDigitToDecimal: Error: Invalid hex digit "), ch);
-  return 0;
-}
-
-//  Convert nibble to hex digit.
-static const char nibbleToHex[] = "0123456789abcdef";
-
+#if UNABIZ_LOG_LEVEL >= 3
 void Radiocrafts::logBuffer(const __FlashStringHelper *prefix, const char *buffer,
                             uint8_t *markerPos, uint8_t markerCount) {
   //  Log the send/receive buffer for debugging.  markerPos is an array of positions in buffer
@@ -686,8 +830,8 @@ void Radiocrafts::logBuffer(const __FlashStringHelper *prefix, const char *buffe
   int m = 0, i = 0;
   for (i = 0; i < strlen(buffer); i = i + 2) {
     if (m < markerCount && markerPos[m] == i) {
-      echoPort->write((uint8_t) nibbleToHex[END_OF_RESPONSE / 16]);
-      echoPort->write((uint8_t) nibbleToHex[END_OF_RESPONSE % 16]);
+      echoPort->write((uint8_t) nibbleToHexDigit(RADIOCRAFTS_END_OF_RESPONSE >> 4));
+      echoPort->write((uint8_t) nibbleToHexDigit(RADIOCRAFTS_END_OF_RESPONSE));
       echoPort->write(' ');
       m++;
     }
@@ -696,10 +840,11 @@ void Radiocrafts::logBuffer(const __FlashStringHelper *prefix, const char *buffe
     echoPort->write(' ');
   }
   if (m < markerCount && markerPos[m] == i) {
-    echoPort->write((uint8_t) nibbleToHex[END_OF_RESPONSE / 16]);
-    echoPort->write((uint8_t) nibbleToHex[END_OF_RESPONSE % 16]);
+    echoPort->write((uint8_t) nibbleToHexDigit(RADIOCRAFTS_END_OF_RESPONSE >> 4));
+    echoPort->write((uint8_t) nibbleToHexDigit(RADIOCRAFTS_END_OF_RESPONSE));
     echoPort->write(' ');
     m++;
   }
   echoPort->write('\n');
 }
+#endif  //  UNABIZ_LOG_LEVEL >= 3
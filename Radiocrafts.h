@@ -25,6 +25,8 @@
 
 const uint8_t RADIOCRAFTS_TX = 4;  //  Transmit port for For UnaBiz / Radiocrafts Dev Kit
 const uint8_t RADIOCRAFTS_RX = 5;  //  Receive port for UnaBiz / Radiocrafts Dev Kit
+const unsigned long RADIOCRAFTS_DOWNLINK_TIMEOUT = 60000;  //  Wait up to 60 seconds for the downlink response.
+const uint8_t RADIOCRAFTS_MODE_DEPTH = 3;  //  Max number of nested beginMode() batches.
 
 enum Mode {
   SEND_MODE = 0,
@@ -38,17 +40,33 @@ public:
   Radiocrafts(Country country, bool useEmulator, const String device, bool echo);
   Radiocrafts(Country country, bool useEmulator, const String device, bool echo,
               uint8_t rx, uint8_t tx);
+#ifdef MODEM_PORT_HARDWARE
+  //  Use a spare hardware UART for the module, e.g. Serial1 on Mega, Leonardo and SAMD boards.
+  Radiocrafts(Country country, bool useEmulator, const String device, bool echo,
+              HardwareSerial *port);
+#endif  //  MODEM_PORT_HARDWARE
   bool begin();
   void echoOn();  //  Turn on send/receive echo.
   void echoOff();  //  Turn off send/receive echo.
   void setEchoPort(Print *port);  //  Set the port for sending echo output.
   void echo(const String &msg);  //  Echo the debug message.
+  void echo(const char *msg);  //  Echo the debug message without allocating a String.
   bool isReady();
   bool sendMessage(const String &payload);  //  Send the payload of hex digits to the network, max 12 bytes.
+  //  Send the payload of hex digits to the network and get the 8 bytes of the downlink response.
+  bool sendMessageAndGetResponse(const String &payload, uint8_t downlink[MAX_BYTES_PER_DOWNLINK]);
   bool sendString(const String &str);  //  Sending a text string, max 12 characters allowed.
-  bool receive(String &data);  //  Receive a message.
-  bool enterCommandMode();  //  Enter Command Mode for sending module commands, not data.
-  bool exitCommandMode();  //  Exit Command Mode and return to Send Mode so we can send data.
+  bool receive(uint8_t downlink[MAX_BYTES_PER_DOWNLINK]);  //  Send an empty frame and get the 8 bytes of the downlink response.
+  bool receive(String &data);  //  Receive a message as hex digits.
+  bool enterCommandMode();  //  Enter Command Mode for sending module commands, not data.  Does nothing if already there.
+  bool exitCommandMode();  //  Exit Command or Config Mode and return to Send Mode so we can send data.
+  //  Enter Command Mode or Config Mode once for a batch of commands, until endMode() is called.
+  //  The commands run back to back without returning to Send Mode in between.  Batches may be
+  //  nested, e.g. a Config Mode batch inside a Command Mode batch returns to Command Mode at the end.
+  bool beginMode(Mode mode);
+  void endMode();  //  End the batch and return to the mode of the enclosing batch, or Send Mode.
+  void beginSession();  //  Keep the serial port open across a batch of commands.
+  void endSession();  //  End the batch of commands and stop the serial port.
 
   //  Commands for the module, must be run in Command Mode.
   bool getEmulator(int &result);  //  Return 0 if emulator mode disabled, else return 1.
@@ -74,6 +92,9 @@ public:
   bool getPower(int &power);
   bool setPower(int power);
   bool getParameter(uint8_t address, String &value);  //  Return the parameter at that address.
+#if UNABIZ_COMMAND_STATS
+  const CommandStats &getCommandStats();  //  Return the round-trip time and bytes for each command sent.
+#endif  //  UNABIZ_COMMAND_STATS
 
   //  Message conversion functions.
   String toHex(int i);
@@ -86,26 +107,40 @@ public:
   String toHex(char *c, int length);
 
 private:
+  void init(Country country, bool useEmulator, const String &device, bool echo);  //  Shared by the constructors.
+  bool configure();  //  Write the emulator and frequency config and read it back, for begin().
   bool sendCommand(const String &cmd, uint8_t expectedMarkers,
                    String &result, uint8_t &actualMarkers);
   bool sendConfigCommand(const String &cmd, String &result);
-  bool sendBuffer(const String &buffer, int timeout, uint8_t expectedMarkers,
-                  String &dataOut, uint8_t &actualMarkers);
+  bool sendBuffer(const String &buffer, unsigned long timeout, uint8_t expectedMarkers,
+                  String &dataOut, uint8_t &actualMarkers, uint8_t dataBytes = 0);
   bool setFrequency(int zone, String &result);
-  bool enterConfigMode();  //  Enter Config Mode for setting config.
-  bool exitConfigMode();  //  Exit Config Mode and return to Send Mode so we can send data.
-  uint8_t hexDigitToDecimal(char ch);
+  bool enterConfigMode();  //  Enter Config Mode for setting config.  Does nothing if already there.
+  bool exitConfigMode();  //  Exit Config Mode and return to Command Mode.
+  bool switchMode(Mode target);  //  Switch to the target mode, skipping the switches not needed.
+  bool restoreMode();  //  Return to the mode of the current batch, or Send Mode if none.
+  void openPort();
+  void closePort();
+#if UNABIZ_LOG_LEVEL >= 3
   void logBuffer(const __FlashStringHelper *prefix, const char *buffer,
                  uint8_t markerPos[], uint8_t markerCount);
+#endif  //  UNABIZ_LOG_LEVEL >= 3
 
   Mode mode;  //  Current mode: command or send mode.
   Country country;   //  Country to be set for SIGFOX transmission frequencies.
   bool useEmulator;  //  Set to true if using UnaBiz Emulator.
   String device;  //  Name of device if using UnaBiz Emulator.
-  SoftwareSerial *serialPort;  //  Serial port for the SIGFOX module.
+  ModemPort serialPort;  //  Serial port for the SIGFOX module.
   Print *echoPort;  //  Port for sending echo output.  Defaults to Serial.
   Print *lastEchoPort;  //  Last port used for sending echo output.
   unsigned long lastSend;  //  Timestamp of last send.
+  bool portOpen;  //  True if the serial port has been started.
+  uint8_t sessionDepth;  //  Number of nested sessions keeping the serial port open.
+  Mode modeStack[RADIOCRAFTS_MODE_DEPTH];  //  Mode of each nested beginMode() batch.
+  uint8_t modeDepth;  //  Number of nested beginMode() batches.
+#if UNABIZ_COMMAND_STATS
+  CommandStats commandStats;  //  Round-trip time and bytes for each command.
+#endif  //  UNABIZ_COMMAND_STATS
 };
 
 #endif // UNABIZ_ARDUINO_RADIOCRAFTS_H
@@ -0,0 +1,105 @@
+//  Parse the AT responses from the SIGFOX module one byte at a time, as the bytes arrive.
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+#include "HexCodec.h"
+#include "ResponseParser.h"
+
+#define RESPONSE_OK "OK"  //  Command completed successfully.
+#define RESPONSE_RX_END "+RX END"  //  End of downlink response (TD1208).
+#define RESPONSE_RX_PREFIX "RX="  //  Start of downlink bytes: "RX=" (Wisol) or "+RX=" (TD1208).
+
+ResponseParser::ResponseParser() {
+  reset();
+}
+
+void ResponseParser::reset() {
+  //  Forget everything parsed so far.
+  line[0] = 0;
+  lineLength = 0;
+  lineDone = false;
+  inDownlink = false;
+  downlinkDone = false;
+  highNibble = HEX_INVALID;
+  downlinkLength = 0;
+}
+
+ResponseToken ResponseParser::feed(char ch) {
+  //  Parse the next byte.  Returns the token completed by this byte, or TOKEN_NONE.
+  if (ch == '\r' || ch == '\n') return endLine();
+  if (lineDone) {
+    //  Previous line has ended.  Start a new line.
+    lineLength = 0;
+    line[0] = 0;
+    lineDone = false;
+  }
+  if (inDownlink) {
+    //  Decode the hex digits straight into the downlink buffer, skipping the spaces.
+    const uint8_t nibble = hexToNibble(ch);
+    if (nibble == HEX_INVALID) return TOKEN_NONE;
+    if (highNibble == HEX_INVALID) { highNibble = nibble; return TOKEN_NONE; }
+    if (downlinkLength < MAX_BYTES_PER_DOWNLINK)
+      downlink[downlinkLength++] = (highNibble << 4) | nibble;
+    highNibble = HEX_INVALID;
+    return TOKEN_NONE;
+  }
+  if (lineLength >= RESPONSE_LINE_MAX) return TOKEN_NONE;  //  Truncate long lines.
+  line[lineLength++] = ch;
+  line[lineLength] = 0;
+  //  Check for "RX=" or "+RX=" at the start of the line.
+  const uint8_t prefixLength = sizeof(RESPONSE_RX_PREFIX) - 1;
+  if ((lineLength == prefixLength ||
+      (lineLength == prefixLength + 1 && line[0] == '+')) &&
+      strcmp(line + lineLength - prefixLength, RESPONSE_RX_PREFIX) == 0) {
+    inDownlink = true;
+    downlinkDone = false;
+    downlinkLength = 0;
+    highNibble = HEX_INVALID;
+  }
+  return TOKEN_NONE;
+}
+
+ResponseToken ResponseParser::endLine() {
+  //  Classify the line that has just ended.  Empty lines are ignored.
+  if (inDownlink) {
+    inDownlink = false;
+    downlinkDone = true;
+    lineDone = true;
+    return TOKEN_DOWNLINK;
+  }
+  if (lineDone || lineLength == 0) return TOKEN_NONE;
+  lineDone = true;
+  if (strcmp(line, RESPONSE_OK) == 0) return TOKEN_OK;
+  if (strcmp(line, RESPONSE_RX_END) == 0) return TOKEN_RX_END;
+  return TOKEN_LINE;
+}
+
+const char *ResponseParser::getLine() {
+  //  Return the last response line completed, without the line ending.
+  return line;
+}
+
+uint8_t ResponseParser::getLineLength() {
+  //  Return the number of chars in the last response line.
+  return lineLength;
+}
+
+bool ResponseParser::hasDownlink() {
+  //  Return true if a complete downlink line has been seen.
+  return downlinkDone;
+}
+
+const uint8_t *ResponseParser::getDownlink() {
+  //  Return the downlink bytes decoded from the "RX=" line.
+  return downlink;
+}
+
+uint8_t ResponseParser::getDownlinkLength() {
+  //  Return the number of downlink bytes decoded.
+  return downlinkLength;
+}
@@ -0,0 +1,52 @@
+//  Parse the AT responses from the SIGFOX module one byte at a time, as the bytes arrive.
+//  Recognises "OK", "RX=" / "+RX=" downlink lines, "+RX END" and other response lines
+//  without accumulating the response into a String.
+#ifndef UNABIZ_ARDUINO_RESPONSEPARSER_H
+#define UNABIZ_ARDUINO_RESPONSEPARSER_H
+
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+const uint8_t MAX_BYTES_PER_DOWNLINK = 8;  //  Only 8 bytes per downlink message.
+const uint8_t RESPONSE_LINE_MAX = 40;  //  Keep up to 40 chars of each response line.  Longer lines are truncated.
+
+//  Token recognised by ResponseParser::feed().
+enum ResponseToken {
+  TOKEN_NONE = 0,  //  No complete token yet, keep feeding.
+  TOKEN_LINE = 1,  //  A response line other than the ones below.  Call getLine() to get it.
+  TOKEN_OK = 2,  //  An "OK" line.
+  TOKEN_DOWNLINK = 3,  //  A "RX=" or "+RX=" line.  Call getDownlink() to get the decoded bytes.
+  TOKEN_RX_END = 4,  //  A "+RX END" line.
+};
+
+class ResponseParser
+{
+public:
+  ResponseParser();
+  void reset();  //  Forget everything parsed so far.
+  ResponseToken feed(char ch);  //  Parse the next byte.  Returns the token completed by this byte, if any.
+  const char *getLine();  //  Return the last response line completed, without the line ending.
+  uint8_t getLineLength();  //  Return the number of chars in the last response line.
+  bool hasDownlink();  //  Return true if a complete downlink line has been seen.
+  const uint8_t *getDownlink();  //  Return the downlink bytes decoded from the "RX=" line.
+  uint8_t getDownlinkLength();  //  Return the number of downlink bytes decoded.
+
+private:
+  ResponseToken endLine();  //  Classify the line that has just ended.
+
+  char line[RESPONSE_LINE_MAX + 1];  //  Current response line, null-terminated.
+  uint8_t lineLength;  //  Number of chars in line.
+  bool lineDone;  //  True if line has ended.  The next char starts a new line.
+  bool inDownlink;  //  True if we are decoding the hex digits after "RX=".
+  bool downlinkDone;  //  True if the downlink line has ended.
+  uint8_t highNibble;  //  First hex digit of the downlink byte being decoded, or HEX_INVALID.
+  uint8_t downlink[MAX_BYTES_PER_DOWNLINK];  //  Decoded downlink bytes.
+  uint8_t downlinkLength;  //  Number of decoded downlink bytes.
+};
+
+#endif  //  UNABIZ_ARDUINO_RESPONSEPARSER_H
@@ -0,0 +1,123 @@
+//  Resend the messages that failed, with capped exponential backoff and jitter.
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+#include "SIGFOX.h"
+
+RetryPolicy::RetryPolicy(uint8_t maxAttempts0, unsigned long baseDelay0, unsigned long maxDelay0) {
+  maxAttempts = maxAttempts0 > 0 ? maxAttempts0 : 1;
+  baseDelay = baseDelay0;
+  maxDelay = maxDelay0;
+  seed = 0x2545f491;
+  useSequence = false;
+  sequence = 0;
+  retryCount = 0;
+  failedCount = 0;
+  sending = false;
+  attempt = 0;
+  dueTime = 0;
+}
+
+void RetryPolicy::setSeed(unsigned long seed0) {
+  //  Seed the random waits.  0 would stop the pseudo-random numbers, so mix in a constant.
+  seed = (uint32_t) seed0 ^ 0x2545f491;
+  if (seed == 0) seed = 1;
+}
+
+void RetryPolicy::setSequence(bool enable) {
+  //  Add the 4-bit rolling sequence number to each message.
+  useSequence = enable;
+}
+
+void RetryPolicy::begin() {
+  //  Start the send.  The first attempt is due now.
+  if (useSequence) sequence = (sequence + 1) % SEQUENCE_MODULO;
+  sending = true;
+  attempt = 0;
+  dueTime = millis();
+}
+
+bool RetryPolicy::isDue(UplinkBudget &budget, SendStatus &status) {
+  //  Return true if the next attempt should be sent now.  The first attempt is given up if
+  //  the budget doesn't allow it.
+  status = SEND_IDLE;
+  if (!sending) return false;
+  status = SEND_BUSY;
+  if ((long) (millis() - dueTime) < 0) return false;  //  Not due yet.
+  if (attempt == 0 && !budget.isAvailable()) {
+    status = finish(false);
+    return false;
+  }
+  if (attempt > 0) retryCount++;
+  attempt++;
+  budget.consume();
+  return true;
+}
+
+SendStatus RetryPolicy::attempted(bool ok, UplinkBudget &budget) {
+  //  Schedule the retry after the attempt, or end the send.
+  if (ok) return finish(true);
+  //  The time of each failure differs between devices, so mix it into the random waits.
+  seed ^= (uint32_t) micros();
+  if (seed == 0) seed = 1;
+  if (attempt >= maxAttempts) return finish(false);
+  //  Wait for the backoff and for the budget, whichever is longer.  Don't wait for the budget
+  //  longer than maxDelay, the message may be queued and sent later instead.
+  unsigned long wait = getDelay(attempt - 1);
+  const unsigned long budgetWait = budget.getWaitMillis();
+  if (budgetWait > maxDelay) return finish(false);  //  Budget is used up, don't retry.
+  if (budgetWait > wait) wait = budgetWait;
+  dueTime = millis() + wait;
+  return SEND_BUSY;
+}
+
+unsigned long RetryPolicy::nextAttemptAt() {
+  //  Return the millis() when poll() sends the next attempt.
+  return dueTime;
+}
+
+SendStatus RetryPolicy::finish(bool ok) {
+  //  End the send of the pending message.
+  sending = false;
+  if (ok) return SEND_OK;
+  failedCount++;
+  return SEND_FAILED;
+}
+
+unsigned long RetryPolicy::getDelay(uint8_t retry) {
+  //  Return between half and all of the capped exponential backoff, so that the devices that
+  //  failed at the same time spread out their retries.
+  unsigned long backoff = baseDelay;
+  for (uint8_t i = 0; i < retry && backoff < maxDelay; i++) backoff = backoff * 2;
+  if (backoff > maxDelay) backoff = maxDelay;
+  const unsigned long half = backoff / 2;
+  return backoff - half + nextRandom() % (half + 1);
+}
+
+unsigned long RetryPolicy::nextRandom() {
+  //  Xorshift pseudo-random numbers, without the code and state of random().
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+uint8_t RetryPolicy::getSequence() {
+  //  Return the sequence number for the next message.
+  return sequence;
+}
+
+unsigned int RetryPolicy::getRetryCount() {
+  //  Return the number of retries sent.
+  return retryCount;
+}
+
+unsigned int RetryPolicy::getFailedCount() {
+  //  Return the number of messages not sent after all attempts.
+  return failedCount;
+}
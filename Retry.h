@@ -0,0 +1,106 @@
+//  Resend the messages that failed, waiting longer after each failure, e.g. during interference.
+//  The wait doubles after each failure up to a max, and is shortened by a random amount so that
+//  devices that failed at the same time don't retry at the same time.  Each attempt uses up the
+//  message budget of the zone, and no retry is sent if the budget doesn't allow it soon, so that
+//  the retries don't use up the uplinks for the rest of the day.
+#ifndef UNABIZ_ARDUINO_RETRY_H
+#define UNABIZ_ARDUINO_RETRY_H
+
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+const uint8_t RETRY_MAX_ATTEMPTS = 3;  //  By default, send each message up to 3 times.
+const unsigned long RETRY_BASE_DELAY = 5000;  //  By default, wait 2.5 to 5 seconds before the first retry.
+const unsigned long RETRY_MAX_DELAY = 60000;  //  By default, never wait more than 1 minute between attempts.
+
+class RetryPolicy
+{
+public:
+  //  Send each message up to maxAttempts times.  Wait up to baseDelay milliseconds before the
+  //  first retry, doubling for each retry up to maxDelay.
+  RetryPolicy(uint8_t maxAttempts = RETRY_MAX_ATTEMPTS, unsigned long baseDelay = RETRY_BASE_DELAY,
+              unsigned long maxDelay = RETRY_MAX_DELAY);
+  //  Seed the random waits, e.g. with the device ID, so that each device waits differently.
+  void setSeed(unsigned long seed);
+  //  Add the 4-bit rolling sequence number to each message, see Message::setSequence().  All
+  //  attempts of the same message send the same sequence number.  Off by default.
+  void setSequence(bool enable);
+  //  Send the message, retrying when it fails.  Each attempt uses up one uplink of the budget.
+  //  Gives up early if the budget doesn't allow the next attempt within maxDelay.  Blocks while
+  //  waiting for the retries, use startSend() and poll() to do other work in between.
+  template <class Transceiver> bool send(Message<Transceiver> &msg, UplinkBudget &budget);
+  //  Start sending the message without waiting for the retries.  Returns false if another message
+  //  is being sent or there is no space for the sequence number.
+  template <class Transceiver> bool startSend(Message<Transceiver> &msg, UplinkBudget &budget);
+  //  Send the next attempt of the message passed to startSend() if it's due, with the same budget.
+  //  Returns SEND_BUSY until the message is sent or given up, SEND_IDLE if nothing to send.
+  template <class Transceiver> SendStatus poll(Message<Transceiver> &msg, UplinkBudget &budget);
+  //  Return the millis() when the next attempt is due, to call poll() then, e.g. with
+  //  TaskScheduler::setTimer() or after UplinkQueue and the Wisol async send have had their turn.
+  unsigned long nextAttemptAt();
+  //  Return the milliseconds to wait before the retry: 0 for the first retry, 1 for the next, ...
+  //  Between half and all of baseDelay * 2^retry, capped at maxDelay.
+  unsigned long getDelay(uint8_t retry);
+  uint8_t getSequence();  //  Return the sequence number for the next message.
+  unsigned int getRetryCount();  //  Return the number of retries sent.
+  unsigned int getFailedCount();  //  Return the number of messages not sent after all attempts.
+
+private:
+  unsigned long nextRandom();  //  Return the next pseudo-random number.
+  void begin();  //  Start the send after adding the sequence number.
+  //  Return true if an attempt is due now.  Otherwise status is the result to return from poll().
+  bool isDue(UplinkBudget &budget, SendStatus &status);
+  SendStatus attempted(bool ok, UplinkBudget &budget);  //  Schedule the retry after the attempt.
+  SendStatus finish(bool ok);  //  End the send of the pending message.
+
+  uint8_t maxAttempts;  //  Max number of times to send each message.
+  unsigned long baseDelay;  //  Max wait before the first retry.
+  unsigned long maxDelay;  //  Max wait between attempts.
+  uint32_t seed;  //  State of the pseudo-random numbers, never 0.
+  bool useSequence;  //  True if the sequence number is added to each message.
+  uint8_t sequence;  //  Sequence number for the next message.
+  unsigned int retryCount;  //  Number of retries sent.
+  unsigned int failedCount;  //  Number of messages not sent after all attempts.
+  bool sending;  //  True if a message is being sent.
+  uint8_t attempt;  //  Number of attempts sent for the pending message.
+  unsigned long dueTime;  //  millis() when the next attempt is due.
+};
+
+template <class Transceiver> bool RetryPolicy::send(Message<Transceiver> &msg, UplinkBudget &budget) {
+  //  Send the message, waiting longer after each failure.  Blocks until sent or given up, the
+  //  same as startSend(), then poll() at each nextAttemptAt().
+  if (!startSend(msg, budget)) return false;
+  for (;;) {
+    const long wait = (long) (nextAttemptAt() - millis());
+    if (wait > 0) delay(wait);
+    const SendStatus status = poll(msg, budget);
+    if (status != SEND_BUSY) return status == SEND_OK;
+  }
+}
+
+template <class Transceiver> bool RetryPolicy::startSend(Message<Transceiver> &msg, UplinkBudget &budget) {
+  //  Start sending the message.  The first attempt is due now.
+  if (sending) return false;  //  Another message is being sent.
+  //  Don't send without the sequence number, e.g. if the message has no space for it.
+  //  setSequence() has logged the error.
+  if (useSequence && !msg.setSequence(sequence)) {
+    failedCount++;
+    return false;
+  }
+  begin();
+  return true;
+}
+
+template <class Transceiver> SendStatus RetryPolicy::poll(Message<Transceiver> &msg, UplinkBudget &budget) {
+  //  Send the next attempt if due.  Doesn't wait for the retries: call again at nextAttemptAt().
+  SendStatus status;
+  if (!isDue(budget, status)) return status;
+  return attempted(msg.send(), budget);
+}
+
+#endif  //  UNABIZ_ARDUINO_RETRY_H
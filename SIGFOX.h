@@ -8,6 +8,42 @@ const unsigned long SEND_DELAY = (unsigned long) 10 * 60 * 1000;
 const unsigned int MAX_BYTES_PER_MESSAGE = 12;  //  Only 12 bytes per message.
 const unsigned int COMMAND_TIMEOUT = 1000;  //  Wait up to 1 second for response from SIGFOX module.
 
+//  Log level, set at compile time.  Logging above this level is compiled away completely,
+//  including the Strings built for the log.  The library is compiled separately from the sketch,
+//  so change the level here or define UNABIZ_LOG_LEVEL in the build flags.
+//  0 = No logging.
+//  1 = Errors only.
+//  2 = Errors and progress messages.
+//  3 = Errors, progress messages and the bytes sent/received (default).
+//  For log levels 1 to 3, echoOn() and echoOff() still turn the log on and off at runtime.
+#ifndef UNABIZ_LOG_LEVEL
+#define UNABIZ_LOG_LEVEL 3
+#endif  //  UNABIZ_LOG_LEVEL
+
+//  Set to 1 to cache the module ID, PAC, emulator mode and zone in EEPROM, so that begin() may skip
+//  querying the module after a reboot.  The cache is stored at the end of the EEPROM.
+#ifndef UNABIZ_IDENTITY_CACHE
+#define UNABIZ_IDENTITY_CACHE 1
+#endif  //  UNABIZ_IDENTITY_CACHE
+
+//  Set to 0 if the sketch uses the watchdog interrupt itself.  powerDown() will then wait with delay()
+//  instead of powering down the Arduino.
+#ifndef UNABIZ_POWER_DOWN
+#define UNABIZ_POWER_DOWN 1
+#endif  //  UNABIZ_POWER_DOWN
+
+//  Set to 1 to record the free memory and stack low-water marks and the longest module response,
+//  see Diagnostics.h.  The stack is painted at startup, which adds a few ms to the boot time.
+#ifndef UNABIZ_DIAGNOSTICS
+#define UNABIZ_DIAGNOSTICS 0
+#endif  //  UNABIZ_DIAGNOSTICS
+
+//  Set to 1 to count the commands sent to the module, with the round-trip time and bytes sent
+//  and received, see getCommandStats().  Uses about 260 bytes of RAM per transceiver.
+#ifndef UNABIZ_COMMAND_STATS
+#define UNABIZ_COMMAND_STATS 0
+#endif  //  UNABIZ_COMMAND_STATS
+
 //  Define the countries that are supported.
 enum Country {
   COUNTRY_AU = 'A'+('U' << 8),  //  Australia: RCZ4
@@ -22,6 +58,17 @@ enum Country {
   COUNTRY_TW = 'T'+('W' << 8),  //  Taiwan: RCZ4
 };
 
+//  Status of an asynchronous send, returned by poll().
+enum SendStatus {
+  SEND_IDLE = 0,  //  No send in progress.
+  SEND_BUSY = 1,  //  Send in progress, call poll() again later.
+  SEND_OK = 2,  //  Send completed successfully.
+  SEND_FAILED = 3,  //  Send failed or timed out.
+};
+
+//  Callback for asynchronous send completion.  response contains the downlink response, if requested.
+typedef void (*SendCallback)(SendStatus status, const String &response);
+
 #ifdef BEAN_BEAN_BEAN_H
   //  Bean+ firmware 0.6.1 can't receive serial data properly. We provide
   //  an alternative class BeanSoftwareSerial to work around this.
@@ -29,6 +76,24 @@ enum Country {
   #include "BeanSoftwareSerial.h"
 #endif // BEAN_BEAN_BEAN_H
 
+//  Convert between bytes and hex digits without allocating memory.
+#include "HexCodec.h"
+
+//  Parse the AT responses from the SIGFOX module as the bytes arrive.
+#include "ResponseParser.h"
+
+//  Serial port for the SIGFOX module: SoftwareSerial or a hardware UART.
+#include "ModemPort.h"
+
+//  Power down the Arduino between uplinks.
+#include "PowerDown.h"
+
+//  Record the free memory low-water marks.
+#include "Diagnostics.h"
+
+//  Count the commands sent to the SIGFOX module.
+#include "CommandStats.h"
+
 //  Library for UnaShield V2S Shield by UnaBiz. Uses pin D4 for transmit, pin D5 for receive.
 #include "Wisol.h"
 
@@ -38,13 +103,31 @@ enum Country {
 //  Send structured messages to SIGFOX cloud.
 #include "Message.h"
 
+//  Keep the messages that can't be sent now in EEPROM.
+#include "FrameStore.h"
+
+//  Queue the messages and send them within the message budget of the zone.
+#include "UplinkQueue.h"
+
+//  Send the messages through several transceivers, with failover.
+#include "Failover.h"
+
+//  Resend the messages that failed, with backoff.
+#include "Retry.h"
+
+//  Sample the sensors and send the aggregates of each uplink window.
+#include "SensorPipeline.h"
+
+//  Run the sensor and transceiver tasks of the sketch.
+#include "Scheduler.h"
+
 //  Define aliases for each UnaShield and the transceiver it uses.
 #define UnaShieldV1 Radiocrafts
 #define UnaShieldV2S Wisol
 
 //  Drop all data passed to this port.  Used to suppress echo output.
 class NullPort: public Print {
-  virtual size_t write(uint8_t) {}
+  virtual size_t write(uint8_t) { return 1; }
 };
 
 //  Call this function if we need to stop.  This informs the emulator to stop listening.
@@ -0,0 +1,211 @@
+//  Cooperative scheduler for the sensor and transceiver tasks of a sketch.
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+#include "SIGFOX.h"
+
+TaskScheduler::TaskScheduler() {
+  taskCount = 0;
+  ready = 0;
+  heapCount = 0;
+  idleSleep = false;
+  wakePin = -1;
+  wakeTask = 0;
+  wakeEvent = 0;
+  dispatchCount = 0;
+  runCount = 0;
+  sending = false;
+  sendStatus = SEND_IDLE;
+  sendTask = 0;
+  sendEvent = 0;
+}
+
+int TaskScheduler::addTask(TaskHandler handler) {
+  //  Add the task.  Returns the task number, or -1 if too many tasks.
+  if (taskCount >= SCHEDULER_MAX_TASKS || handler == 0) return -1;
+  Task &task = tasks[taskCount];
+  task.handler = handler;
+  task.pending = 0;
+  task.deadline = 0;
+  task.timerEvent = 0;
+  task.heapPos = TIMER_NONE;
+  return taskCount++;
+}
+
+void TaskScheduler::post(uint8_t task, uint8_t event) {
+  //  Post the event to the task.  Constant time: only sets the bits.
+  if (task >= taskCount || event >= SCHEDULER_MAX_EVENTS) return;
+  tasks[task].pending |= (uint16_t) 1 << event;
+  ready |= (uint8_t) 1 << task;
+}
+
+void TaskScheduler::setTimer(uint8_t task, uint8_t event, unsigned long delayMillis) {
+  //  Post the event to the task after delayMillis, replacing the timer already set.
+  if (task >= taskCount || event >= SCHEDULER_MAX_EVENTS) return;
+  Task &t = tasks[task];
+  t.deadline = millis() + delayMillis;
+  t.timerEvent = event;
+  if (t.heapPos == TIMER_NONE) {
+    //  Add the timer at the bottom of the heap.
+    t.heapPos = heapCount;
+    heap[heapCount++] = task;
+  }
+  //  The deadline may be earlier or later than before.
+  heapUp(t.heapPos);
+  heapDown(t.heapPos);
+}
+
+void TaskScheduler::cancelTimer(uint8_t task) {
+  //  Cancel the timer of the task, if set.
+  if (task >= taskCount || tasks[task].heapPos == TIMER_NONE) return;
+  heapRemove(tasks[task].heapPos);
+}
+
+bool TaskScheduler::isTimerSet(uint8_t task) {
+  //  Return true if the timer of the task has not fired yet.
+  return task < taskCount && tasks[task].heapPos != TIMER_NONE;
+}
+
+bool TaskScheduler::isSending() {
+  //  Return true if an asynchronous send is in progress.
+  return sending;
+}
+
+SendStatus TaskScheduler::getSendStatus() {
+  //  Return the status of the last send.
+  return sendStatus;
+}
+
+void TaskScheduler::setIdleSleep(bool enable, int wakePin0, uint8_t wakeTask0, uint8_t wakeEvent0) {
+  //  Power down between events when nothing is pending.
+  idleSleep = enable;
+  wakePin = wakePin0;
+  wakeTask = wakeTask0;
+  wakeEvent = wakeEvent0;
+}
+
+void TaskScheduler::run() {
+  //  Dispatch the due timers and the pending events.  The send in progress is polled by
+  //  run(transceiver).
+  bool busy = sending;
+  fireTimers();
+  //  Dispatch the pending events, lowest task and lowest event first.  Each task is dispatched
+  //  once per run(), so a task that keeps posting to itself doesn't starve the others.
+  uint8_t batch = ready;
+  if (batch) busy = true;
+  while (batch) {
+    const uint8_t task = (uint8_t) __builtin_ctz(batch);
+    batch &= ~((uint8_t) 1 << task);
+    ready &= ~((uint8_t) 1 << task);
+    Task &t = tasks[task];
+    uint16_t events = t.pending;
+    t.pending = 0;
+    while (events) {
+      const uint8_t event = (uint8_t) __builtin_ctz(events);
+      events &= ~((uint16_t) 1 << event);
+      dispatchCount++;
+      t.handler(event);
+    }
+  }
+  if (busy) { runCount++; return; }
+  //  Nothing to do.  Power down until the next timer is due, or until the wake pin changes.
+  if (!idleSleep || sending || ready) return;
+  const unsigned long wait = getWaitMillis();
+  if (wait < SCHEDULER_MIN_SLEEP) return;
+  if (wait == 0xffffffff && wakePin < 0) return;  //  Nothing would wake us up.
+  Serial.flush();  //  Finish sending the log before the UART clock stops.
+  const unsigned int pinWakeups = getPowerDownStats().pinWakeups;
+  powerDown(wait, wakePin);
+  if (getPowerDownStats().pinWakeups != pinWakeups) post(wakeTask, wakeEvent);
+}
+
+void TaskScheduler::polled(SendStatus status) {
+  //  Notify the task that started the send when it completes.
+  if (status == SEND_BUSY) return;
+  sendStatus = status;
+  sending = false;
+  post(sendTask, sendEvent);
+}
+
+unsigned long TaskScheduler::getWaitMillis() {
+  //  Return the milliseconds until the next timer is due, or 0xffffffff if none.
+  if (heapCount == 0) return 0xffffffff;
+  const unsigned long wait = tasks[heap[0]].deadline - millis();
+  if ((long) wait <= 0) return 0;
+  return wait;
+}
+
+unsigned long TaskScheduler::getDispatchCount() {
+  //  Return the number of events dispatched.
+  return dispatchCount;
+}
+
+unsigned long TaskScheduler::getRunCount() {
+  //  Return the number of calls to run() that found something to do.
+  return runCount;
+}
+
+void TaskScheduler::fireTimers() {
+  //  Post the events of the due timers, earliest first.  Only the top of the heap is checked.
+  const unsigned long now = millis();
+  while (heapCount > 0) {
+    const uint8_t task = heap[0];
+    if ((long) (now - tasks[task].deadline) < 0) break;  //  Earliest timer is not due yet.
+    heapRemove(0);
+    post(task, tasks[task].timerEvent);
+  }
+}
+
+bool TaskScheduler::isEarlier(uint8_t i, uint8_t j) {
+  //  Return true if the timer at heap position i is due before j.  Works across millis() rollover.
+  return (long) (tasks[heap[i]].deadline - tasks[heap[j]].deadline) < 0;
+}
+
+void TaskScheduler::heapSwap(uint8_t i, uint8_t j) {
+  //  Swap two timers in the heap.
+  const uint8_t task = heap[i];
+  heap[i] = heap[j];
+  heap[j] = task;
+  tasks[heap[i]].heapPos = i;
+  tasks[heap[j]].heapPos = j;
+}
+
+void TaskScheduler::heapUp(uint8_t i) {
+  //  Move the timer up the heap until its parent is due earlier.
+  while (i > 0) {
+    const uint8_t parent = (i - 1) / 2;
+    if (!isEarlier(i, parent)) break;
+    heapSwap(i, parent);
+    i = parent;
+  }
+}
+
+void TaskScheduler::heapDown(uint8_t i) {
+  //  Move the timer down the heap until its children are due later.
+  for (;;) {
+    const uint8_t left = 2 * i + 1, right = 2 * i + 2;
+    uint8_t earliest = i;
+    if (left < heapCount && isEarlier(left, earliest)) earliest = left;
+    if (right < heapCount && isEarlier(right, earliest)) earliest = right;
+    if (earliest == i) break;
+    heapSwap(i, earliest);
+    i = earliest;
+  }
+}
+
+void TaskScheduler::heapRemove(uint8_t i) {
+  //  Remove the timer at position i by moving the last timer there.
+  tasks[heap[i]].heapPos = TIMER_NONE;
+  heapCount--;
+  if (i == heapCount) return;
+  heap[i] = heap[heapCount];
+  const uint8_t moved = heap[i];
+  tasks[moved].heapPos = i;
+  heapUp(i);
+  heapDown(tasks[moved].heapPos);
+}
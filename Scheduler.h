@@ -0,0 +1,112 @@
+//  Cooperative scheduler for the sensor and transceiver tasks of a sketch.  Each task is a function
+//  that handles one event at a time.  Events are dispatched in constant time from a bitmask of
+//  pending events per task.  Each task may set one timer, kept in a min-heap ordered by deadline,
+//  which posts an event when due.  When nothing is pending, run() may power down the Arduino until
+//  the next deadline, instead of polling every task on every loop.  run(transceiver) also polls the
+//  asynchronous send of the transceiver and posts an event to the task that started it.
+#ifndef UNABIZ_ARDUINO_SCHEDULER_H
+#define UNABIZ_ARDUINO_SCHEDULER_H
+
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+const uint8_t SCHEDULER_MAX_TASKS = 8;  //  Max number of tasks.
+const uint8_t SCHEDULER_MAX_EVENTS = 16;  //  Events are numbered 0 to 15.
+const unsigned long SCHEDULER_MIN_SLEEP = 15;  //  Don't power down for less than the shortest watchdog period.
+
+//  Handle the event posted to the task.  The task keeps its own state, e.g. in a static variable.
+typedef void (*TaskHandler)(uint8_t event);
+
+class TaskScheduler
+{
+public:
+  TaskScheduler();
+  int addTask(TaskHandler handler);  //  Add the task.  Returns the task number, or -1 if too many tasks.
+  void post(uint8_t task, uint8_t event);  //  Post the event to the task.  Posting a pending event again has no effect.
+  //  Post the event to the task after delayMillis.  Replaces the timer already set for the task.
+  void setTimer(uint8_t task, uint8_t event, unsigned long delayMillis);
+  void cancelTimer(uint8_t task);  //  Cancel the timer of the task, if set.
+  bool isTimerSet(uint8_t task);  //  Return true if the timer of the task has not fired yet.
+  //  Start sending the payload asynchronously with the transceiver, e.g. Wisol.  The event is
+  //  posted to the task when the send completes.  Call getSendStatus() to check the result.
+  //  Call run() with the same transceiver to poll the send.
+  template <class Transceiver> bool sendAsync(Transceiver &transceiver, const String &payload,
+                                              uint8_t task, uint8_t event);
+  bool isSending();  //  Return true if an asynchronous send is in progress.
+  SendStatus getSendStatus();  //  Return the status of the last send: SEND_BUSY, SEND_OK or SEND_FAILED.
+  //  Power down between events when nothing is pending and no send is in progress.  If wakePin
+  //  is not -1, a change on wakePin ends the power-down early and posts wakeEvent to wakeTask.
+  //  Off by default.
+  void setIdleSleep(bool enable, int wakePin = -1, uint8_t wakeTask = 0, uint8_t wakeEvent = 0);
+  //  Dispatch the due timers and the pending events.  Call this from loop().  If idle sleep is
+  //  enabled, powers down until the next deadline.
+  void run();
+  //  The same, and poll the asynchronous send started by sendAsync() with the transceiver.  The
+  //  transceiver is called directly, so only its code is linked into the sketch.
+  template <class Transceiver> void run(Transceiver &transceiver);
+  unsigned long getWaitMillis();  //  Return the milliseconds until the next timer is due, or 0xffffffff if none.
+  unsigned long getDispatchCount();  //  Return the number of events dispatched.
+  unsigned long getRunCount();  //  Return the number of calls to run() that found something to do.
+
+private:
+  void fireTimers();  //  Post the events of the due timers.
+  void heapSwap(uint8_t i, uint8_t j);  //  Swap two timers in the heap.
+  void heapUp(uint8_t i);  //  Move the timer up the heap until its parent is due earlier.
+  void heapDown(uint8_t i);  //  Move the timer down the heap until its children are due later.
+  void heapRemove(uint8_t i);  //  Remove the timer at position i of the heap.
+  bool isEarlier(uint8_t i, uint8_t j);  //  Return true if the timer at heap position i is due before j.
+  void polled(SendStatus status);  //  Notify the task that started the send when it completes.
+
+  //  A task and its timer.
+  struct Task {
+    TaskHandler handler;  //  Function that handles the events.
+    uint16_t pending;  //  Bit n is set if event n is pending.
+    unsigned long deadline;  //  Timestamp when the timer is due.
+    uint8_t timerEvent;  //  Event posted when the timer is due.
+    uint8_t heapPos;  //  Position of the timer in the heap, or TIMER_NONE if not set.
+  };
+  static const uint8_t TIMER_NONE = 0xff;
+  Task tasks[SCHEDULER_MAX_TASKS];  //  Registered tasks.
+  uint8_t taskCount;  //  Number of registered tasks.
+  uint8_t ready;  //  Bit n is set if task n has pending events.
+  uint8_t heap[SCHEDULER_MAX_TASKS];  //  Tasks with timers set, earliest deadline first.
+  uint8_t heapCount;  //  Number of timers set.
+  bool idleSleep;  //  True if we should power down when idle.
+  int wakePin;  //  Pin that ends the power-down early, or -1.
+  uint8_t wakeTask;  //  Task to be notified when the wake pin ends the power-down.
+  uint8_t wakeEvent;  //  Event to be posted when the wake pin ends the power-down.
+  unsigned long dispatchCount;  //  Number of events dispatched.
+  unsigned long runCount;  //  Number of calls to run() that found something to do.
+
+  //  State of the asynchronous send.
+  bool sending;  //  True if an asynchronous send is in progress.
+  SendStatus sendStatus;  //  Status of the last send.
+  uint8_t sendTask;  //  Task to be notified when the send completes.
+  uint8_t sendEvent;  //  Event to be posted when the send completes.
+};
+
+template <class Transceiver> bool TaskScheduler::sendAsync(Transceiver &transceiver, const String &payload,
+                                                       uint8_t task, uint8_t event) {
+  //  Start sending the payload.  Returns false if a send is already in progress or the
+  //  transceiver can't start the send.
+  if (sending || task >= taskCount || event >= SCHEDULER_MAX_EVENTS) return false;
+  if (!transceiver.sendMessageAsync(payload)) return false;
+  sending = true;
+  sendStatus = SEND_BUSY;
+  sendTask = task;
+  sendEvent = event;
+  return true;
+}
+
+template <class Transceiver> void TaskScheduler::run(Transceiver &transceiver) {
+  //  Poll the send.  When done, notify the task that started it.
+  if (sending) polled(transceiver.poll());
+  run();
+}
+
+#endif  //  UNABIZ_ARDUINO_SCHEDULER_H
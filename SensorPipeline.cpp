@@ -0,0 +1,116 @@
+//  Sample the sensors at their own periods and send the aggregates of each uplink window.
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+#include "SIGFOX.h"
+
+SensorPipeline::SensorPipeline() {
+  channelCount = 0;
+  fieldCount = 0;
+  missedCount = 0;
+}
+
+int SensorPipeline::addChannel(SensorSampler sampler, unsigned long periodMillis) {
+  //  Call the sampler every periodMillis, starting at the next poll().
+  if (channelCount >= SENSOR_MAX_CHANNELS || sampler == 0) return -1;
+  Channel &channel = channels[channelCount];
+  channel.sampler = sampler;
+  channel.period = periodMillis > 0 ? periodMillis : 1;
+  channel.nextSample = millis();
+  channel.ringPos = 0;
+  channel.ringCount = 0;
+  resetWindow(channelCount);
+  return channelCount++;
+}
+
+bool SensorPipeline::addField(const char *name, uint8_t channel, SensorAggregate aggregate) {
+  //  Send the aggregate of the channel as a message field with the 3-letter name.
+  if (fieldCount >= SENSOR_MAX_FIELDS || channel >= channelCount) return false;
+  Field &field = fields[fieldCount++];
+  field.name = name;
+  field.channel = channel;
+  field.aggregate = aggregate;
+  return true;
+}
+
+void SensorPipeline::poll() {
+  //  Take the samples that are due.  The next sample is due one period after the last one was
+  //  due, so the sampling doesn't drift.  If poll() was called too late for one or more samples,
+  //  they are skipped and counted, instead of being taken in a burst.
+  const unsigned long now = millis();
+  for (uint8_t i = 0; i < channelCount; i++) {
+    Channel &channel = channels[i];
+    if ((long) (now - channel.nextSample) < 0) continue;  //  Not due yet.
+    const unsigned long late = (now - channel.nextSample) / channel.period;
+    missedCount = missedCount + late;
+    channel.nextSample = channel.nextSample + (late + 1) * channel.period;
+    int value;
+    if (!channel.sampler(value)) continue;
+    channel.ring[channel.ringPos] = value;
+    channel.ringPos = (channel.ringPos + 1) % SENSOR_RING_SIZE;
+    if (channel.ringCount < SENSOR_RING_SIZE) channel.ringCount++;
+    SensorWindow &window = channel.window;
+    window.last = value;
+    if (window.count >= SENSOR_WINDOW_MAX) continue;  //  Window is full, keep the aggregates.
+    if (window.count == 0 || value < window.min) window.min = value;
+    if (window.count == 0 || value > window.max) window.max = value;
+    window.sum = window.sum + value;
+    window.count++;
+  }
+}
+
+bool SensorPipeline::getWindow(uint8_t channel, SensorWindow &window) {
+  //  Return the aggregates of the current window.
+  if (channel >= channelCount) return false;
+  window = channels[channel].window;
+  return true;
+}
+
+bool SensorPipeline::getRecent(uint8_t channel, uint8_t age, int &value) {
+  //  Return the recent sample of the channel: 0 for the latest, 1 for the one before, ...
+  if (channel >= channelCount || age >= channels[channel].ringCount) return false;
+  const Channel &ch = channels[channel];
+  value = ch.ring[(ch.ringPos + SENSOR_RING_SIZE - 1 - age) % SENSOR_RING_SIZE];
+  return true;
+}
+
+bool SensorPipeline::getField(uint8_t i, int &value) {
+  //  Return the aggregate of field i in the current window.  Returns false if no samples.
+  const Field &field = fields[i];
+  const SensorWindow &window = channels[field.channel].window;
+  if (window.count == 0) return false;
+  switch (field.aggregate) {
+    case SENSOR_MIN: value = window.min; break;
+    case SENSOR_MAX: value = window.max; break;
+    case SENSOR_MEAN: value = (int) (window.sum / (long) window.count); break;
+    default: value = window.last; break;
+  }
+  return true;
+}
+
+void SensorPipeline::resetWindows() {
+  //  Start a new uplink window for all channels.
+  for (uint8_t i = 0; i < channelCount; i++) resetWindow(i);
+}
+
+unsigned int SensorPipeline::getMissedCount() {
+  //  Return the number of samples missed because poll() was called late.
+  return missedCount;
+}
+
+void SensorPipeline::resetWindow(uint8_t channel) {
+  //  Start a new uplink window for the channel.  The recent samples are kept.
+  memset(&channels[channel].window, 0, sizeof(SensorWindow));
+}
+
+bool SensorPipeline::hasSamples() {
+  //  Return true if any field has samples in the window.
+  for (uint8_t i = 0; i < fieldCount; i++)
+    if (channels[fields[i].channel].window.count > 0) return true;
+  return false;
+}
@@ -0,0 +1,128 @@
+//  Sample the sensors at their own periods and send the aggregates of each uplink window, e.g.
+//  sample an accelerometer at 50 Hz but send the min, max and mean every 10 minutes.  The sketch
+//  registers a sampler function for each channel and calls poll() from loop(), so no timing code
+//  is needed in the sketch.  Sampling continues during an uplink if the sketch sends with
+//  sendMessageAsync() and poll() of the transceiver, instead of the blocking sendMessage().
+#ifndef UNABIZ_ARDUINO_SENSORPIPELINE_H
+#define UNABIZ_ARDUINO_SENSORPIPELINE_H
+
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+const uint8_t SENSOR_MAX_CHANNELS = 4;  //  Max number of sensor channels.
+const uint8_t SENSOR_MAX_FIELDS = 6;  //  Max number of message fields for the aggregates.
+const uint8_t SENSOR_RING_SIZE = 8;  //  Number of recent samples kept for each channel.
+//  Max samples aggregated in a window, e.g. about 21 minutes at 50 Hz.  Later samples in the
+//  window update only the latest sample, so that the count and the sum don't overflow on AVR.
+const unsigned int SENSOR_WINDOW_MAX = 65535;
+
+//  Read one sample scaled by 10, e.g. 25.3 degrees as 253, like MessageCodec::addScaledField().
+//  Return false if no sample is available now.
+typedef bool (*SensorSampler)(int &value);
+
+//  Aggregate of the samples in the uplink window that is sent in a message field.
+enum SensorAggregate {
+  SENSOR_MIN = 0,  //  Lowest sample.
+  SENSOR_MAX = 1,  //  Highest sample.
+  SENSOR_MEAN = 2,  //  Mean of the samples, rounded towards 0.
+  SENSOR_LAST = 3,  //  Latest sample.
+};
+
+//  Aggregates of the samples taken since the window started.
+struct SensorWindow {
+  int min;  //  Lowest sample.
+  int max;  //  Highest sample.
+  long sum;  //  Total of the samples, for the mean.
+  int last;  //  Latest sample.
+  unsigned int count;  //  Number of samples, up to SENSOR_WINDOW_MAX.  The other fields are not valid if 0.
+};
+
+class SensorPipeline
+{
+public:
+  SensorPipeline();
+  //  Call the sampler every periodMillis.  Returns the channel number, or -1 if too many channels.
+  int addChannel(SensorSampler sampler, unsigned long periodMillis);
+  //  Send the aggregate of the channel as a message field with the 3-letter name.
+  bool addField(const char *name, uint8_t channel, SensorAggregate aggregate);
+  void poll();  //  Take the samples that are due.  Call this from loop() as often as possible.
+  bool getWindow(uint8_t channel, SensorWindow &window);  //  Return the aggregates of the current window.
+  //  Return the recent sample of the channel: 0 for the latest, 1 for the one before, ...
+  //  Returns false if there is no such sample.
+  bool getRecent(uint8_t channel, uint8_t age, int &value);
+  //  Add the aggregate fields to the message and start the next window.  Channels without
+  //  samples in the window are skipped.  Returns false if no fields were added.
+  template <class Transceiver> bool addFields(Message<Transceiver> &msg);
+  //  When the budget of the queue allows an uplink, add the aggregates to a message for the
+  //  transceiver and queue it.  Call take() on the queue to send it.  Returns true if queued.
+  //  The window continues if the message could not be queued.
+  template <class Transceiver> bool queueFields(Transceiver &transceiver, UplinkQueue &queue,
+                                                uint8_t priority = UPLINK_PRIORITY_LOW);
+  unsigned int getMissedCount();  //  Return the number of samples missed because poll() was called late.
+
+private:
+  //  Add the aggregate fields to the message, without starting the next window.
+  template <class Transceiver> bool addWindowFields(Message<Transceiver> &msg);
+  void resetWindow(uint8_t channel);  //  Start a new uplink window for the channel.
+  void resetWindows();  //  Start a new uplink window for all channels.
+  bool getField(uint8_t i, int &value);  //  Return the aggregate of field i.  Returns false if no samples.
+  bool hasSamples();  //  Return true if any field has samples in the window.
+
+  //  A sensor sampled at a fixed period.
+  struct Channel {
+    SensorSampler sampler;  //  Function that reads the sensor.
+    unsigned long period;  //  Milliseconds between samples.
+    unsigned long nextSample;  //  Timestamp when the next sample is due.
+    int ring[SENSOR_RING_SIZE];  //  Recent samples, oldest overwritten first.
+    uint8_t ringPos;  //  Position in ring of the next sample.
+    uint8_t ringCount;  //  Number of samples in ring.
+    SensorWindow window;  //  Aggregates of the current uplink window.
+  };
+  //  An aggregate sent in a message field.
+  struct Field {
+    const char *name;  //  3-letter field name.
+    uint8_t channel;  //  Channel to aggregate.
+    SensorAggregate aggregate;  //  Aggregate to send.
+  };
+  Channel channels[SENSOR_MAX_CHANNELS];  //  Registered channels.
+  uint8_t channelCount;  //  Number of registered channels.
+  Field fields[SENSOR_MAX_FIELDS];  //  Fields to send.
+  uint8_t fieldCount;  //  Number of fields.
+  unsigned int missedCount;  //  Samples missed because poll() was called late.
+};
+
+template <class Transceiver> bool SensorPipeline::addFields(Message<Transceiver> &msg) {
+  //  Add the aggregate fields to the message and start the next window.
+  const bool added = addWindowFields(msg);
+  resetWindows();
+  return added;
+}
+
+template <class Transceiver> bool SensorPipeline::addWindowFields(Message<Transceiver> &msg) {
+  //  Add the aggregate fields of the channels with samples in the window.
+  bool added = false;
+  for (uint8_t i = 0; i < fieldCount; i++) {
+    int value;
+    if (!getField(i, value)) continue;  //  No samples in the window.
+    if (msg.addScaledField(fields[i].name, value)) added = true;
+  }
+  return added;
+}
+
+template <class Transceiver> bool SensorPipeline::queueFields(Transceiver &transceiver,
+                                                              UplinkQueue &queue, uint8_t priority) {
+  //  Keep aggregating until the queued message can be sent, so that no window is lost when
+  //  the queued message is replaced.
+  if (!queue.isAvailable() || !hasSamples()) return false;
+  Message<Transceiver> msg(transceiver);
+  if (!addWindowFields(msg) || !queue.add(msg, priority)) return false;
+  resetWindows();  //  Start the next window only when the aggregates are queued.
+  return true;
+}
+
+#endif  //  UNABIZ_ARDUINO_SENSORPIPELINE_H
@@ -0,0 +1,185 @@
+//  Queue the uplink messages and release them within the SIGFOX message budget of the zone.
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+#include "SIGFOX.h"
+
+//  Bits 8 to 12 of the packed header: the sequence header bit and the sequence number.
+static const uint8_t packedSequenceMask = (PACKED_SEQUENCE >> 8) | (SEQUENCE_MODULO - 1);
+
+UplinkBudget::UplinkBudget(Country country):
+    UplinkBudget(
+      (country == COUNTRY_FR || country == COUNTRY_OM || country == COUNTRY_SA)
+        ? SEND_DELAY  //  RCZ1: 1% duty cycle, about 6 uplinks per hour.
+        : (unsigned long) 24 * 60 * 60 * 1000 / UPLINKS_PER_DAY,  //  Other zones: 140 uplinks per day.
+      1) {}  //  Forward to constructor below.
+
+UplinkBudget::UplinkBudget(unsigned long intervalMillis, uint8_t burst0) {
+  //  Allow 1 uplink per interval, up to burst in a row.  The first uplink may be sent right away.
+  interval = intervalMillis;
+  burst = burst0 > 0 ? burst0 : 1;
+  tokens = 1;
+  lastRefill = millis();
+}
+
+void UplinkBudget::refill() {
+  //  Add the uplinks earned since the last refill.
+  const unsigned long now = millis();
+  if (tokens >= burst) { lastRefill = now; return; }  //  Don't save up more than burst.
+  const unsigned long earned = (now - lastRefill) / interval;
+  if (earned == 0) return;
+  tokens = (tokens + earned >= burst) ? burst : tokens + earned;
+  lastRefill = lastRefill + earned * interval;
+}
+
+bool UplinkBudget::isAvailable() {
+  //  Return true if an uplink may be sent now.
+  refill();
+  return tokens > 0;
+}
+
+void UplinkBudget::consume() {
+  //  Use up one uplink.
+  refill();
+  if (tokens > 0) tokens--;
+}
+
+unsigned long UplinkBudget::getWaitMillis() {
+  //  Return the milliseconds until the next uplink is allowed.
+  refill();
+  if (tokens > 0) return 0;
+  return interval - (millis() - lastRefill);
+}
+
+UplinkQueue::UplinkQueue(UplinkBudget &budget0) {
+  budget = &budget0;
+  store = 0;
+  count = 0;
+  droppedCount = 0;
+  coalescedCount = 0;
+}
+
+bool UplinkQueue::add(MessageCodec &msg, uint8_t priority) {
+  //  Queue the structured message, replacing any queued message with the same field names.
+  return addFrame(msg.getPayload(), msg.getLength(), priority, true);
+}
+
+bool UplinkQueue::add(const uint8_t *payload, uint8_t length, uint8_t priority) {
+  //  Queue the raw payload.  Raw payloads are never replaced.
+  return addFrame(payload, length, priority, false);
+}
+
+bool UplinkQueue::addFrame(const uint8_t *payload, uint8_t length, uint8_t priority, bool structured) {
+  //  Add the payload to the queue.  Returns false if the queue is full of messages with
+  //  the same or higher priority.
+  if (length == 0 || length > MAX_BYTES_PER_MESSAGE) return false;
+  uint8_t i;
+  if (structured) {
+    //  If a queued message has the same fields, replace its values and keep its place in the queue.
+    for (i = 0; i < count; i++) {
+      Frame &frame = frames[i];
+      if (!frame.structured || frame.length != length ||
+          !sameFields(frame.payload, payload, length)) continue;
+      memcpy(frame.payload, payload, length);
+      if (priority > frame.priority) frame.priority = priority;
+      coalescedCount++;
+      return true;
+    }
+  }
+  if (count >= UPLINK_QUEUE_SIZE) {
+    //  Queue is full.  Drop the oldest message with the lowest priority, if lower than this message.
+    //  If there is a store, keep the dropped message there.
+    uint8_t lowest = 0;
+    for (i = 1; i < count; i++)
+      if (frames[i].priority < frames[lowest].priority) lowest = i;
+    if (frames[lowest].priority >= priority) {
+      if (store) return store->add(payload, length, priority);
+      droppedCount++;
+      return false;
+    }
+    if (store) store->add(frames[lowest].payload, frames[lowest].length, frames[lowest].priority);
+    else droppedCount++;
+    for (i = lowest; i + 1 < count; i++) frames[i] = frames[i + 1];
+    count--;
+  }
+  Frame &frame = frames[count++];
+  memcpy(frame.payload, payload, length);
+  frame.length = length;
+  frame.priority = priority;
+  frame.structured = structured;
+  return true;
+}
+
+bool UplinkQueue::sameFields(const uint8_t *payload1, const uint8_t *payload2, uint8_t length) {
+  //  Return true if both structured payloads have the same field names.  Each field has 2 bytes
+  //  for the name followed by 2 bytes for the value.  Packed payloads with the same schema ID
+  //  in the header have the same fields, whatever their sequence numbers in bits 8 to 12.
+  if (length >= 2 && (payload1[1] & (PACKED_HEADER >> 8)))
+    return payload1[0] == payload2[0] && (payload1[1] & ~packedSequenceMask) == (payload2[1] & ~packedSequenceMask);
+  for (uint8_t i = 0; i + 1 < length; i = i + 4) {
+    if (payload1[i] != payload2[i] || payload1[i + 1] != payload2[i + 1]) return false;
+  }
+  return true;
+}
+
+bool UplinkQueue::take(uint8_t *payload, uint8_t &length) {
+  //  If the budget allows an uplink now, remove the highest priority message (oldest first)
+  //  and use up one uplink.  Messages in the store are taken if they have a higher priority
+  //  than the queued messages, or if the queue is empty.  If the frames in the store can't be
+  //  read, e.g. overwritten by another sketch, the queued messages are sent instead.
+  const int storePriority = store ? store->getPriority() : -1;
+  if ((count == 0 && storePriority < 0) || !budget->isAvailable()) return false;
+  uint8_t highest = 0, i;
+  for (i = 1; i < count; i++)
+    if (frames[i].priority > frames[highest].priority) highest = i;
+  if (storePriority >= 0 && (count == 0 || storePriority > frames[highest].priority)) {
+    uint8_t priority;  uint16_t age;
+    if (store->take(payload, length, priority, age)) {
+      budget->consume();
+      return true;
+    }
+    if (count == 0) return false;
+  }
+  length = frames[highest].length;
+  memcpy(payload, frames[highest].payload, length);
+  for (i = highest; i + 1 < count; i++) frames[i] = frames[i + 1];
+  count--;
+  budget->consume();
+  return true;
+}
+
+void UplinkQueue::setStore(FrameStore &store0) {
+  //  Keep the messages that don't fit into the queue in the store.
+  store = &store0;
+}
+
+bool UplinkQueue::defer(const uint8_t *payload, uint8_t length, uint8_t priority) {
+  //  Keep the payload that could not be sent.  It's kept as a raw payload, so it's never replaced.
+  if (store) return store->add(payload, length, priority);
+  return addFrame(payload, length, priority, false);
+}
+
+bool UplinkQueue::isAvailable() {
+  //  Return true if the budget allows an uplink now.
+  return budget->isAvailable();
+}
+
+uint8_t UplinkQueue::getCount() {
+  //  Return the number of queued messages.
+  return count;
+}
+
+unsigned int UplinkQueue::getDroppedCount() {
+  //  Return the number of messages dropped because the queue was full.
+  return droppedCount;
+}
+
+unsigned int UplinkQueue::getCoalescedCount() {
+  //  Return the number of messages that replaced a queued message.
+  return coalescedCount;
+}
@@ -0,0 +1,88 @@
+//  Queue the uplink messages and release them within the SIGFOX message budget of the zone.
+#ifndef UNABIZ_ARDUINO_UPLINKQUEUE_H
+#define UNABIZ_ARDUINO_UPLINKQUEUE_H
+
+#ifdef ARDUINO
+  #if (ARDUINO >= 100)
+    #include <Arduino.h>
+  #else  //  ARDUINO >= 100
+    #include <WProgram.h>
+  #endif  //  ARDUINO  >= 100
+#endif  //  ARDUINO
+
+const uint8_t UPLINK_QUEUE_SIZE = 4;  //  Max number of messages waiting to be sent.
+const unsigned long UPLINKS_PER_DAY = 140;  //  SIGFOX subscriptions allow up to 140 uplinks per day.
+
+//  Priority of a queued message.  Higher priority messages are sent first.
+const uint8_t UPLINK_PRIORITY_LOW = 0;  //  E.g. periodic updates.
+const uint8_t UPLINK_PRIORITY_NORMAL = 1;  //  E.g. sensor changes.
+const uint8_t UPLINK_PRIORITY_ALARM = 2;  //  E.g. alarms.
+
+//  Token bucket that allows one uplink per interval, up to burst uplinks in a row.
+class UplinkBudget
+{
+public:
+  //  Budget for the country's zone: RCZ1 allows 1 uplink every SEND_DELAY (1% duty cycle),
+  //  other zones allow UPLINKS_PER_DAY.
+  UplinkBudget(Country country);
+  UplinkBudget(unsigned long intervalMillis, uint8_t burst);  //  Allow 1 uplink per interval, up to burst in a row.
+  bool isAvailable();  //  Return true if an uplink may be sent now.
+  void consume();  //  Use up one uplink.
+  unsigned long getWaitMillis();  //  Return the milliseconds until the next uplink is allowed.
+
+private:
+  void refill();  //  Add the uplinks earned since the last refill.
+
+  unsigned long interval;  //  Milliseconds to earn one uplink.
+  uint8_t burst;  //  Max uplinks that may be saved up.
+  uint8_t tokens;  //  Uplinks that may be sent now.
+  unsigned long lastRefill;  //  Timestamp of the last refill.
+};
+
+//  Fixed-capacity queue of messages waiting to be sent.  A structured message replaces the
+//  queued message with the same field names (or the same schema, for packed messages),
+//  so only the latest values are sent.
+class UplinkQueue
+{
+public:
+  UplinkQueue(UplinkBudget &budget);
+  //  Queue the structured message, replacing any queued message with the same field names.
+  bool add(MessageCodec &msg, uint8_t priority = UPLINK_PRIORITY_NORMAL);
+  //  Queue the raw payload of up to 12 bytes.  Raw payloads are never replaced.
+  bool add(const uint8_t *payload, uint8_t length, uint8_t priority = UPLINK_PRIORITY_NORMAL);
+  //  If the budget allows an uplink now, remove the highest priority message (oldest first) into
+  //  payload, which must have 12 bytes, and use up one uplink.  Returns false if nothing to send now.
+  bool take(uint8_t *payload, uint8_t &length);
+  //  Keep the messages that don't fit into the queue in the store, instead of dropping them.
+  //  take() removes them from the store by priority, oldest first.  Call begin() of the store first.
+  void setStore(FrameStore &store);
+  //  Keep the payload from take() that could not be sent, e.g. out of coverage, to be sent again
+  //  later.  Returns false if there is no space.
+  bool defer(const uint8_t *payload, uint8_t length, uint8_t priority = UPLINK_PRIORITY_NORMAL);
+  bool isAvailable();  //  Return true if the budget allows an uplink now, so take() won't wait.
+  uint8_t getCount();  //  Return the number of queued messages.
+  //  Return the number of messages dropped because the queue was full.  Messages kept in the
+  //  store are not counted, see FrameStore::getLostCount().
+  unsigned int getDroppedCount();
+  unsigned int getCoalescedCount();  //  Return the number of messages that replaced a queued message.
+
+private:
+  bool addFrame(const uint8_t *payload, uint8_t length, uint8_t priority, bool structured);
+  static bool sameFields(const uint8_t *payload1, const uint8_t *payload2, uint8_t length);
+
+  //  A queued message.
+  struct Frame {
+    uint8_t payload[MAX_BYTES_PER_MESSAGE];  //  Encoded message.
+    uint8_t length;  //  Number of bytes in payload.
+    uint8_t priority;  //  Higher priority is sent first.
+    bool structured;  //  True if payload contains name/value fields, which may be replaced.
+  };
+  UplinkBudget *budget;  //  Budget for releasing the messages.
+  FrameStore *store;  //  Store for the messages that don't fit, or 0 if none.
+  Frame frames[UPLINK_QUEUE_SIZE];  //  Queued messages, oldest first.
+  uint8_t count;  //  Number of queued messages.
+  unsigned int droppedCount;  //  Messages dropped because the queue was full.
+  unsigned int coalescedCount;  //  Messages that replaced a queued message.
+};
+
+#endif  //  UNABIZ_ARDUINO_UPLINKQUEUE_H
@@ -8,15 +8,33 @@
 #endif  //  ARDUINO
 
 #include "SIGFOX.h"
+#if UNABIZ_IDENTITY_CACHE && defined(ARDUINO)
+  #include <EEPROM.h>
+#endif  //  UNABIZ_IDENTITY_CACHE && ARDUINO
 
 //  Use a macro for logging because Flash strings not supported with String class in Bean+
+//  Progress messages are logged at UNABIZ_LOG_LEVEL 2 and above, errors at level 1 and above.
+#if UNABIZ_LOG_LEVEL >= 2
 #define log1(x) { echoPort->println(x); }
 #define log2(x, y) { echoPort->print(x); echoPort->println(y); }
 #define log3(x, y, z) { echoPort->print(x); echoPort->print(y); echoPort->println(z); }
 #define log4(x, y, z, a) { echoPort->print(x); echoPort->print(y); echoPort->print(z); echoPort->println(a); }
-
-#define MODEM_BITS_PER_SECOND 9600  //  Connect to modem at this bps.
-#define END_OF_RESPONSE '\r'  //  Character '\r' marks the end of response.
+#else  //  UNABIZ_LOG_LEVEL >= 2
+#define log1(x) {}
+#define log2(x, y) {}
+#define log3(x, y, z) {}
+#define log4(x, y, z, a) {}
+#endif  //  UNABIZ_LOG_LEVEL >= 2
+#if UNABIZ_LOG_LEVEL >= 1
+#define logErr1(x) { echoPort->println(x); }
+#define logErr2(x, y) { echoPort->print(x); echoPort->println(y); }
+#else  //  UNABIZ_LOG_LEVEL >= 1
+#define logErr1(x) {}
+#define logErr2(x, y) {}
+#endif  //  UNABIZ_LOG_LEVEL >= 1
+
+#define WISOL_BITS_PER_SECOND 9600  //  Connect to modem at this bps.
+#define WISOL_END_OF_RESPONSE '\r'  //  Character '\r' marks the end of response.
 #define CMD_OUTPUT_POWER_MAX "ATS302=15"  //  For RCZ1: Set output power to maximum power level.
 #define CMD_PRESEND "AT$GI?"  //  For RCZ2, 4: Send this command before sending messages.  Returns X,Y.
 #define CMD_PRESEND2 "AT$RC"  //  For RCZ2, 4: Send this command if presend returns X=0 or Y<3.
@@ -27,8 +45,9 @@
 #define CMD_GET_TEMPERATURE "AT$T?"  //  Get the module temperature.
 #define CMD_GET_VOLTAGE "AT$V?"  //  Get the module voltage.
 #define CMD_RESET "AT$P=0"  //  Software reset.
-#define CMD_SLEEP "AT$P=1"  //  TODO: Switch to sleep mode : consumption is < 1.5uA
-#define CMD_WAKEUP "AT$P=0"  //  TODO: Switch back to normal mode : consumption is 0.5 mA
+#define CMD_SLEEP "AT$P=1"  //  Switch to sleep mode : consumption is < 1.5uA.  Any char on the serial port wakes up the module.
+#define CMD_WAKEUP "AT$P=0"  //  Switch back to normal mode : consumption is 0.5 mA
+#define CMD_AT "AT"  //  Check that the module is ready.  Returns OK.
 #define CMD_END "\r"
 #define CMD_RCZ1 "AT$IF=868130000"  //  EU / RCZ1 Frequency
 #define CMD_RCZ2 "AT$IF=902200000"  //  US / RCZ2 Frequency
@@ -39,13 +58,15 @@
 #define CMD_EMULATOR_DISABLE "ATS410=0"  //  Device will only talk to Sigfox network.
 #define CMD_EMULATOR_ENABLE "ATS410=1"  //  Device will only talk to SNEK emulator.
 
-static NullPort nullPort;
+static NullPort nullPort3;
 static uint8_t markers = 0;
-static String data;
+static String data3;
 
-//  Remember where in response the '>' markers were seen.
-const uint8_t markerPosMax = 5;
-static uint8_t markerPos[markerPosMax];
+#define WISOL_STARTUP_DELAY 200  //  Wait 200 milliseconds for the serial port to settle after starting.
+#define WISOL_POWER_UP_TIMEOUT 2000  //  Wait up to 2 seconds for the module to power up.
+#define WISOL_READY_POLL_TIMEOUT 100  //  Wait up to 100 milliseconds for each readiness check.
+//  Time to transmit 1 char (start bit + 8 data bits + stop bit) at the modem bps, in microseconds.
+#define WISOL_CHAR_MICROS (10 * 1000000UL / WISOL_BITS_PER_SECOND)
 
 void sleep(int milliSeconds) {
 #ifdef BEAN_BEAN_BEAN_H
@@ -55,148 +76,463 @@ void sleep(int milliSeconds) {
 #endif // BEAN_BEAN_BEAN_H
 }
 
-bool Wisol::sendBuffer(const String &buffer, const int timeout,
-                       uint8_t expectedMarkerCount, String &response,
-                       uint8_t &actualMarkerCount) {
-  //  buffer contains a string of ASCII chars to be sent to the modem.
-  //  We send the buffer to the modem.  Return true if successful.
-  //  expectedMarkerCount is the number of end-of-command markers '\r' we
-  //  expect to see.  actualMarkerCount contains the actual number seen.
-  log2(F(" - Wisol.sendBuffer: "), buffer);
-  response = "";
-
-  actualMarkerCount = 0;
-  //  Start serial interface.
-  serialPort->begin(MODEM_BITS_PER_SECOND);
-  sleep(200);
-  serialPort->flush();
-  serialPort->listen();
-
-  //  Send the buffer: need to write/read char by char because of echo.
-  const char *rawBuffer = buffer.c_str();
-  //  Send buffer and read response.  Loop until timeout or we see the end of response marker.
-  unsigned long startTime = millis(); int i = 0;
-  //  Previous code for verifying that data was sent correctly.
-  //static String echoSend = "", echoReceive = "";
-  for (;;) {
-    //  If there is data to send, send it.
-    if (i < buffer.length()) {
-      //  Send the char.
-      uint8_t txChar = rawBuffer[i];
-      //echoSend.concat(toHex((char) txChar) + ' ');
-      serialPort->write(txChar);
-      sleep(10);  //  Need to wait a while because SoftwareSerial has no FIFO and may overflow.
-      i = i + 1;
-      startTime = millis();  //  Start the timer only when all data has been sent.
-    }
-    //  If timeout, quit.
-    const unsigned long currentTime = millis();
-    if (currentTime - startTime > timeout) break;
-
-    //  If data is available to receive, receive it.
-    if (serialPort->available() > 0) {
-      int rxChar = serialPort->read();
-      //  echoReceive.concat(toHex((char) rxChar) + ' ');
-      if (rxChar == -1) continue;
-      if (rxChar == END_OF_RESPONSE) {
-        if (actualMarkerCount < markerPosMax)
-          markerPos[actualMarkerCount] = response.length();  //  Remember the marker pos.
-        actualMarkerCount++;  //  Count the number of end markers.
-        if (actualMarkerCount >= expectedMarkerCount) break;  //  Seen all markers already.
+//  Commands sent to the module, kept in flash memory so that they don't use up RAM.
+static const char cmdAT[] PROGMEM = CMD_AT;
+static const char cmdOutputPowerMax[] PROGMEM = CMD_OUTPUT_POWER_MAX;
+static const char cmdPresend[] PROGMEM = CMD_PRESEND;
+static const char cmdPresend2[] PROGMEM = CMD_PRESEND2;
+static const char cmdSendMessage[] PROGMEM = CMD_SEND_MESSAGE;
+static const char cmdGetID[] PROGMEM = CMD_GET_ID;
+static const char cmdGetPAC[] PROGMEM = CMD_GET_PAC;
+static const char cmdGetTemperature[] PROGMEM = CMD_GET_TEMPERATURE;
+static const char cmdGetVoltage[] PROGMEM = CMD_GET_VOLTAGE;
+static const char cmdReset[] PROGMEM = CMD_RESET;
+static const char cmdSleep[] PROGMEM = CMD_SLEEP;
+static const char cmdEmulatorDisable[] PROGMEM = CMD_EMULATOR_DISABLE;
+static const char cmdEmulatorEnable[] PROGMEM = CMD_EMULATOR_ENABLE;
+
+//  Text of each command, the number of '\r' markers expected in the response and the deadline.
+struct WisolCommandInfo {
+  const char *text;  //  Command text in flash memory, without CMD_END.
+  uint8_t markers;  //  Number of end-of-response markers expected.
+  uint16_t timeout;  //  Milliseconds to wait for the complete response after sending.
+};
+
+//  Indexed by Wisol::Command.  The status queries and settings reply in a few milliseconds, so a
+//  module that is unplugged or browned out is detected quickly.  Only AT$SF waits for the airtime.
+static const WisolCommandInfo commandTable[] PROGMEM = {
+  { cmdAT, 1, WISOL_QUERY_TIMEOUT },  //  COMMAND_AT
+  { cmdOutputPowerMax, 1, WISOL_QUERY_TIMEOUT },  //  COMMAND_OUTPUT_POWER_MAX
+  { cmdPresend, 1, WISOL_QUERY_TIMEOUT },  //  COMMAND_PRESEND
+  { cmdPresend2, 1, WISOL_QUERY_TIMEOUT },  //  COMMAND_PRESEND2
+  { cmdSendMessage, 1, WISOL_UPLINK_TIMEOUT },  //  COMMAND_SEND_MESSAGE: "OK\r"
+  { cmdSendMessage, 2, WISOL_COMMAND_TIMEOUT },  //  COMMAND_SEND_MESSAGE_RESPONSE: "OK\r RX=...\r"
+  { cmdGetID, 1, WISOL_QUERY_TIMEOUT },  //  COMMAND_GET_ID
+  { cmdGetPAC, 1, WISOL_QUERY_TIMEOUT },  //  COMMAND_GET_PAC
+  { cmdGetTemperature, 1, WISOL_QUERY_TIMEOUT },  //  COMMAND_GET_TEMPERATURE
+  { cmdGetVoltage, 1, WISOL_QUERY_TIMEOUT },  //  COMMAND_GET_VOLTAGE
+  { cmdReset, 1, WISOL_QUERY_TIMEOUT },  //  COMMAND_RESET
+  { cmdSleep, 1, WISOL_QUERY_TIMEOUT },  //  COMMAND_SLEEP
+  { cmdEmulatorDisable, 1, WISOL_QUERY_TIMEOUT },  //  COMMAND_EMULATOR_DISABLE
+  { cmdEmulatorEnable, 1, WISOL_QUERY_TIMEOUT },  //  COMMAND_EMULATOR_ENABLE
+};
+
+bool Wisol::sendBuffer(Command command, const char *argument, const unsigned long timeout,
+                       String &response, uint8_t &actualMarkerCount) {
+  //  Send the command from the command table to the modem, followed by the argument, if not 0,
+  //  and CMD_END.  Return true if we see all the end-of-command markers '\r' expected for the
+  //  command.  actualMarkerCount contains the actual number seen.  Call getLastError() for the
+  //  reason of the failure.  Blocks until the response is complete or the deadline of the command.
+  //  Not allowed while an asynchronous send is in progress.
+  if (bufferBusy) {
+    logErr1(F(" - Wisol.sendBuffer: Error: Busy"));
+    lastError = WISOL_ERROR_BUSY;
+    return false;
+  }
+  startBuffer(command, argument, timeout);
+  SendStatus status = SEND_BUSY;
+  while (status == SEND_BUSY) status = pollBuffer();
+  response = rxResponse;
+  actualMarkerCount = rxActualMarkers;
+  return status == SEND_OK;
+}
+
+void Wisol::startBuffer(Command command, const char *argument, const unsigned long timeout) {
+  //  Start sending the command to the modem.  Call pollBuffer() repeatedly to send the chars
+  //  and receive the response.  The argument must stay unchanged until the response is complete.
+  //  If timeout is 0, wait for the deadline of the command in the command table.
+  txText = (const char *) pgm_read_ptr(&commandTable[command].text);
+  txArgument = argument;
+  txTextLength = strlen_P(txText);
+  txLength = txTextLength + (argument ? strlen(argument) : 0) + strlen(CMD_END);
+  txPos = 0;
+#if UNABIZ_LOG_LEVEL >= 2
+  logCommand(F(" - Wisol.sendBuffer: "));
+#endif  //  UNABIZ_LOG_LEVEL >= 2
+  rxTimeout = timeout > 0 ? timeout : pgm_read_word(&commandTable[command].timeout);
+  rxLineStarted = false;
+  rxExpectedMarkers = pgm_read_byte(&commandTable[command].markers);
+  rxActualMarkers = 0;
+  rxResponse = "";
+  rxResponse.reserve(RESPONSE_LINE_MAX);  //  Avoid growing the response one char at a time.
+  rxParser.reset();
+  rxDownlink = false;
+  bufferBusy = true;
+  txPaced = false;
+  rxStartTime = millis();
+  //  Start serial interface, unless already started in this session.  We wait for the port to settle in pollBuffer().
+  openPort();
+}
+
+uint8_t Wisol::getTxChar(unsigned int pos) {
+  //  Return the char of the command at pos: the text from flash, then the argument, then CMD_END.
+  if (pos < txTextLength) return pgm_read_byte(txText + pos);
+  pos = pos - txTextLength;
+  const unsigned int argumentLength = txLength - txTextLength - strlen(CMD_END);
+  if (pos < argumentLength) return (uint8_t) txArgument[pos];
+  return (uint8_t) CMD_END[pos - argumentLength];
+}
+
+void Wisol::openPort() {
+  //  Start the serial port if not already started.
+  if (portOpen) return;
+  serialPort.begin(WISOL_BITS_PER_SECOND);
+  portOpen = true;
+  portReady = false;
+  portStartTime = millis();
+}
+
+void Wisol::closePort() {
+  //  Stop the serial port if started.
+  if (!portOpen) return;
+  serialPort.end();
+  portOpen = false;
+  portReady = false;
+}
+
+void Wisol::beginSession() {
+  //  Keep the serial port open across a batch of commands, until endSession() is called.
+  //  This avoids restarting the port and waiting for it to settle before every command.
+  sessionDepth++;
+}
+
+void Wisol::endSession() {
+  //  End the batch of commands and stop the serial port.
+  if (sessionDepth == 0) return;
+  sessionDepth--;
+  if (sessionDepth == 0 && !bufferBusy) closePort();
+}
+
+static uint8_t readAvailable3(ModemPort &port, uint8_t *buffer, uint8_t length) {
+  //  Copy up to length received chars into buffer without waiting.  Returns the number of chars copied.
+#ifdef BEAN_BEAN_BEAN_H
+  return port.getSoftwarePort()->readAvailable(buffer, length);  //  Drain the receive buffer in one call.
+#else  //  BEAN_BEAN_BEAN_H
+  uint8_t count = 0;
+  while (count < length && port.available() > 0) {
+    int rxChar = port.read();
+    if (rxChar == -1) break;
+    buffer[count++] = (uint8_t) rxChar;
+  }
+  return count;
+#endif  //  BEAN_BEAN_BEAN_H
+}
+
+SendStatus Wisol::pollBuffer() {
+  //  Send the next char of the buffer and receive the response, without blocking.
+  //  Returns SEND_BUSY until we see all the end of response markers or timeout.
+  if (!bufferBusy) return SEND_IDLE;
+  const unsigned long currentTime = millis();
+  if (!portReady) {
+    //  Wait for the serial port to settle before sending.  Only needed once per session.
+    if (currentTime - portStartTime < WISOL_STARTUP_DELAY) return SEND_BUSY;
+    serialPort.clearInput();
+    portReady = true;
+  }
+  if (txPos == 0) {
+    serialPort.listen();
+    rxStartTime = currentTime;
+#if UNABIZ_COMMAND_STATS
+    commandStartTime = currentTime;
+#endif  //  UNABIZ_COMMAND_STATS
+  }
+  //  If there is data to send, send it.  SoftwareSerial write() returns after the char has been
+  //  transmitted, so we may send the next char right away at the full line rate.  If the module
+  //  is sending to us at the same time (e.g. echo), we leave a gap of 1 char time after each char
+  //  so that the receive interrupt is not blocked by the transmit.  A hardware UART is never paced.
+  if (txPos < txLength &&
+      (!txPaced || micros() - txMicros >= WISOL_CHAR_MICROS)) {
+    serialPort.write(getTxChar(txPos));
+    txPos++;
+    txMicros = micros();
+    rxStartTime = currentTime;  //  Start the timer only when all data has been sent.
+  }
+  //  If data is available to receive, receive it.  We drain the received chars before checking
+  //  the deadlines, in case poll() was called late.
+  uint8_t rxChunk[WISOL_RX_CHUNK_SIZE];
+  uint8_t rxCount;
+  while ((rxCount = readAvailable3(serialPort, rxChunk, WISOL_RX_CHUNK_SIZE)) > 0) {
+    rxLastTime = currentTime;
+    for (uint8_t rxIndex = 0; rxIndex < rxCount; rxIndex++) {
+      const uint8_t rxChar = rxChunk[rxIndex];
+      //  Module is talking while we send: interleave, unless the hardware UART sends from its FIFO.
+      if (txPos < txLength && !serialPort.isHardware()) txPaced = true;
+      const ResponseToken token = rxParser.feed((char) rxChar);
+      //  If the module returns an error instead of OK, don't wait for the downlink.
+      if (token == TOKEN_LINE && (rxDownlink || strcmp(rxParser.getLine(), "ERROR") == 0))
+        return finishBuffer(WISOL_ERROR_RESPONSE);
+      //  The module ends OK with "\r\n", e.g. "OK\r\nRX=...\r".  Skip the '\n', so that it
+      //  doesn't start a line and the wait for the downlink is not cut short by the idle timer.
+      if (rxChar == '\n') continue;
+      if (rxChar == WISOL_END_OF_RESPONSE) {
+        if (rxActualMarkers < WISOL_MARKER_POS_MAX)
+          markerPos[rxActualMarkers] = rxResponse.length();  //  Remember the marker pos.
+        rxActualMarkers++;  //  Count the number of end markers.
+        rxLineStarted = false;
+        if (rxActualMarkers >= rxExpectedMarkers) return finishBuffer(WISOL_ERROR_NONE);  //  Seen all markers already.
       } else {
-        // log2(F("rxChar "), rxChar);
-        response.concat(String((char) rxChar));
+        rxResponse.concat((char) rxChar);
+        rxLineStarted = true;
       }
     }
   }
-  serialPort->end();
+  //  If the deadline of the command has passed, quit.
+  if (currentTime - rxStartTime > rxTimeout) return finishBuffer(WISOL_ERROR_TIMEOUT);
+  //  If the module stopped sending in the middle of a line, quit.  The wait between the lines,
+  //  e.g. between OK and the downlink, is limited only by the deadline.
+  if (rxLineStarted && currentTime - rxLastTime > WISOL_IDLE_TIMEOUT) return finishBuffer(WISOL_ERROR_IDLE);
+  return SEND_BUSY;
+}
+
+SendStatus Wisol::finishBuffer(WisolError error) {
+  //  Stop the serial port, unless the session is still open, and check the response.
+  bufferBusy = false;
+  lastError = error;
+#ifdef BEAN_BEAN_BEAN_H
+  if (serialPort.getSoftwarePort()->overflow()) {
+    logErr2(F(" - Wisol.sendBuffer: Error: Receive buffer overflow, chars lost: "),
+            serialPort.getSoftwarePort()->overflowCount());
+  }
+#endif  //  BEAN_BEAN_BEAN_H
+  if (sessionDepth == 0) closePort();
+  diagnose(rxResponse.length());  //  Record the response length and free memory.
+#if UNABIZ_COMMAND_STATS
+  char text[COMMAND_KEY_MAX + 4], key[COMMAND_KEY_MAX + 1];  //  Key is at most 5 chars after "AT$".
+  strncpy_P(text, txText, sizeof(text) - 1);  text[sizeof(text) - 1] = 0;
+  CommandStats::getATKey(text, key);
+  commandStats.record(key, millis() - commandStartTime,
+                      error == WISOL_ERROR_NONE,
+                      txPos, rxResponse.length() + rxActualMarkers);
+#endif  //  UNABIZ_COMMAND_STATS
+#if UNABIZ_LOG_LEVEL >= 3
   //  Log the actual bytes sent and received.
-  //log2(F(">> "), echoSend);
-  //  if (echoReceive.length() > 0) { log2(F("<< "), echoReceive); }
-  logBuffer(F(">> "), rawBuffer, 0, 0);
-  logBuffer(F("<< "), response.c_str(), markerPos, actualMarkerCount);
+  logCommand(F(">> "));
+  logBuffer(F("<< "), rxResponse.c_str(), markerPos, rxActualMarkers);
+#endif  //  UNABIZ_LOG_LEVEL >= 3
 
   //  If we did not see the terminating '\r', something is wrong.
-  if (actualMarkerCount < expectedMarkerCount) {
-    if (response.length() == 0) {
-      log1(F(" - Wisol.sendBuffer: Error: No response"));  //  Response timeout.
+  if (error != WISOL_ERROR_NONE) {
+    if (rxResponse.length() == 0) {
+      logErr1(F(" - Wisol.sendBuffer: Error: No response"));  //  Response timeout.
+    } else if (error == WISOL_ERROR_IDLE) {
+      logErr2(F(" - Wisol.sendBuffer: Error: Incomplete response: "), rxResponse);
     } else {
-      log2(F(" - Wisol.sendBuffer: Error: Unknown response: "), response);
+      logErr2(F(" - Wisol.sendBuffer: Error: Unknown response: "), rxResponse);
     }
-    return false;
+    return SEND_FAILED;
   }
-  log2(F(" - Wisol.sendBuffer: response: "), response);
-  return true;
+  log2(F(" - Wisol.sendBuffer: response: "), rxResponse);
+  return SEND_OK;
 }
 
 bool Wisol::sendMessage(const String &payload) {
   //  Payload contains a string of hex digits, up to 24 digits / 12 bytes.
   //  We prefix with AT$SF= and send to SIGFOX.  Return true if successful.
   log2(F(" - Wisol.sendMessage: "), device + ',' + payload);
-  if (!isReady()) return false;  //  Prevent user from sending too many messages.
-  //  Exit command mode and prepare to send message.
-  if (!exitCommandMode()) return false;
-  //  Set the output power for the zone.
-  if (!setOutputPower()) return false;
-  //  Send the data.
-  String message = String(CMD_SEND_MESSAGE) + payload + CMD_END, data;
-  if (sendBuffer(message, WISOL_COMMAND_TIMEOUT, 1, data, markers)) {  //  One '\r' marker expected ("OK\r").
-    log1(data);
-    lastSend = millis();
-    return true;
-  }
-  return false;
+  if (!startSend(payload, false)) return false;
+  SendStatus status = SEND_BUSY;
+  while (status == SEND_BUSY) status = poll();
+  return status == SEND_OK;
 }
 
 bool Wisol::sendMessageAndGetResponse(const String &payload, String &response) {
   //  Payload contains a string of hex digits, up to 24 digits / 12 bytes.
   //  We prefix with AT$SF= and send to SIGFOX.  Return response message from Sigfox in the response parameter.
   log2(F(" - Wisol.sendMessageAndGetResponse: "), device + ',' + payload);
+  if (!startSend(payload, true)) return false;
+  SendStatus status = SEND_BUSY;
+  while (status == SEND_BUSY) status = poll();
+  if (status != SEND_OK) return false;
+  response = sendResponse;
+  return true;
+}
+
+bool Wisol::sendMessageAndGetResponse(const String &payload, uint8_t downlink[MAX_BYTES_PER_DOWNLINK]) {
+  //  Payload contains a string of hex digits, up to 24 digits / 12 bytes.  Return the 8 bytes of the
+  //  downlink response from Sigfox in downlink.
+  String response;
+  if (!sendMessageAndGetResponse(payload, response)) return false;
+  return getResponse(downlink);
+}
+
+bool Wisol::sendMessageAsync(const String &payload) {
+  //  Start sending the payload and return immediately.  Call poll() until it returns SEND_OK or SEND_FAILED.
+  log2(F(" - Wisol.sendMessageAsync: "), device + ',' + payload);
+  return startSend(payload, false);
+}
+
+bool Wisol::sendMessageAndGetResponseAsync(const String &payload) {
+  //  Start sending the payload and return immediately.  Call poll() until it returns SEND_OK or SEND_FAILED,
+  //  then call getResponse() to get the downlink response.
+  log2(F(" - Wisol.sendMessageAndGetResponseAsync: "), device + ',' + payload);
+  return startSend(payload, true);
+}
+
+bool Wisol::startSend(const String &payload, bool getResponse) {
+  //  Start the steps for sending the payload.  Return false if the send could not be started.
+  if (sendStep != STEP_IDLE) {
+    logErr1(F("***MESSAGE NOT SENT - Another message is being sent"));
+    lastError = WISOL_ERROR_BUSY;
+    return false;
+  }
   if (!isReady()) return false;  //  Prevent user from sending too many messages.
+  if (sleeping && !wakeUp()) return false;  //  Wake up the module if sleeping.
   //  Exit command mode and prepare to send message.
   if (!exitCommandMode()) return false;
-  //  Set the output power for the zone.
-  if (!setOutputPower()) return false;
-  //  Send the data.
-  String message = String(CMD_SEND_MESSAGE) + payload + CMD_SEND_MESSAGE_RESPONSE + CMD_END, data;
-  //  Two '\r' markers expected ("OK\r RX=...\r").
-  if (sendBuffer(message, WISOL_COMMAND_TIMEOUT, 2, data, markers)) {
-    log1(data);
-    lastSend = millis();
-    response = data;
-    //  Response contains OK\nRX=01 23 45 67 89 AB CD EF
-    //  Remove the prefix and spaces.
-    response.replace("OK\nRX=", "");
-    response.replace(" ", "");
-    return true;
-  }
-  return false;
-}
-
-bool Wisol::setOutputPower() {
-  //  Set the output power for the zone before sending a message.
+  sendGetResponse = getResponse;
+  sendResponse = "";
+  sendDownlinkLength = 0;
+  beginSession();  //  Keep the port open for the presend steps and the message.
+  //  Argument of the AT$SF command.
+  sendMessageBuffer = payload;
+  if (getResponse) sendMessageBuffer.concat(F(CMD_SEND_MESSAGE_RESPONSE));
+  //  Set the output power for the zone before sending the message.
   switch(zone) {
     case 1:  //  RCZ1
     case 3:  //  RCZ3
-      if (!sendCommand(String(CMD_OUTPUT_POWER_MAX) + CMD_END, 1, data, markers)) return false;
+      sendStep = STEP_OUTPUT_POWER;
+      startBuffer(COMMAND_OUTPUT_POWER_MAX, 0);
       break;
     case 2:  //  RCZ2
-    case 4: {  //  RCZ4
-      if (!sendCommand(String(CMD_PRESEND) + CMD_END, 1, data, markers)) return false;
-      //  Parse the returned X,Y.
-      int x = data.charAt(0) - '0';
-      int y = data.charAt(2) - '0';
-      // log4("x,y=", String(x), ',', String(y));
-      if (x == 0 || y < 3) sendCommand(String(CMD_PRESEND2) + CMD_END, 1, data, markers);
+    case 4:  //  RCZ4
+      if (isChannelCheckValid()) {
+        //  The last AT$GI? showed enough free channels for this uplink.  Skip the channel check.
+        channelStats.skipped++;
+        channelStats.savedMillis += channelStats.lastQueryMillis;
+        startMessage();
+        break;
+      }
+      sendStep = STEP_PRESEND;
+      channelQueryStart = millis();
+      startBuffer(COMMAND_PRESEND, 0);
       break;
-    }
     default:
-      log2(F(" - Wisol.setOutputPower: Unknown zone "), zone);
+      logErr2(F(" - Wisol.sendMessage: Unknown zone "), zone);
+      endSession();
       return false;
   }
   return true;
 }
 
+SendStatus Wisol::poll() {
+  //  Continue the asynchronous send without blocking.  Returns SEND_BUSY while sending,
+  //  SEND_OK or SEND_FAILED when the send has just completed, SEND_IDLE if nothing to send.
+  if (sendStep == STEP_IDLE) return SEND_IDLE;
+  SendStatus status = pollBuffer();
+  if (status == SEND_BUSY) return SEND_BUSY;
+  switch(sendStep) {
+    case STEP_OUTPUT_POWER:
+      if (status != SEND_OK) return finishSend(SEND_FAILED);
+      break;
+    case STEP_PRESEND: {
+      if (status != SEND_OK) return finishSend(SEND_FAILED);
+      //  Parse the returned X,Y.  Remember them so that the next uplinks may skip the check.
+      int x = rxResponse.charAt(0) - '0';
+      int y = rxResponse.charAt(2) - '0';
+      channelStats.queries++;
+      channelStats.lastQueryMillis = millis() - channelQueryStart;
+      channelChecked = (rxResponse.length() >= 3 && x >= 0 && x <= 9 && y >= 0 && y <= 9);
+      channelX = x;  channelY = y;  channelUplinks = 0;
+      if (x == 0 || y < WISOL_CHANNELS_MIN) {
+        sendStep = STEP_PRESEND2;
+        channelStats.resets++;
+        channelChecked = false;  //  Check the channels again after resetting.
+        startBuffer(COMMAND_PRESEND2, 0);
+        return SEND_BUSY;
+      }
+      break;
+    }
+    case STEP_PRESEND2:
+      break;  //  Send the message even if channel reset failed.
+    case STEP_SEND:
+      if (status != SEND_OK) {
+        channelChecked = false;  //  Don't trust the last channel check if the send failed.
+        return finishSend(SEND_FAILED);
+      }
+      log1(rxResponse);
+      lastSend = millis();
+      channelUplinks++;
+      if (sendGetResponse) {
+        //  Response contains OK\nRX=01 23 45 67 89 AB CD EF
+        //  The parser has already decoded the downlink bytes as they arrived.
+        if (!rxParser.hasDownlink()) {
+          logErr2(F(" - Wisol.sendMessage: Error: Unknown downlink response: "), rxResponse);
+          lastError = WISOL_ERROR_RESPONSE;
+          return finishSend(SEND_FAILED);
+        }
+        sendDownlinkLength = rxParser.getDownlinkLength();
+        memcpy(sendDownlink, rxParser.getDownlink(), sendDownlinkLength);
+        sendResponse = "";
+        appendHex(sendResponse, sendDownlink, sendDownlinkLength, true);  //  Uppercase like the module.
+      }
+      return finishSend(SEND_OK);
+    default:
+      return finishSend(SEND_FAILED);
+  }
+  //  Presend steps completed.  Send the message.
+  startMessage();
+  return SEND_BUSY;
+}
+
+void Wisol::startMessage() {
+  //  Send the AT$SF command after the presend steps.
+  sendStep = STEP_SEND;
+  //  Two '\r' markers expected for downlink ("OK\r RX=...\r"), else one ("OK\r").
+  startBuffer(sendGetResponse ? COMMAND_SEND_MESSAGE_RESPONSE : COMMAND_SEND_MESSAGE,
+              sendMessageBuffer.c_str());
+  rxDownlink = sendGetResponse;
+}
+
+bool Wisol::isChannelCheckValid() {
+  //  For RCZ2, 4: Return true if the last AT$GI? result still allows this uplink without
+  //  checking or resetting the channels, assuming each uplink uses up WISOL_CHANNELS_PER_UPLINK.
+  if (!channelChecked || channelX == 0) return false;
+  return channelY >= WISOL_CHANNELS_MIN + channelUplinks * WISOL_CHANNELS_PER_UPLINK;
+}
+
+const WisolChannelStats &Wisol::getChannelStats() {
+  //  Return the counters for the RCZ2, 4 channel check.
+  return channelStats;
+}
+
+WisolError Wisol::getLastError() {
+  //  Return the reason for the failure of the last command or send, WISOL_ERROR_NONE if it succeeded.
+  return lastError;
+}
+
+SendStatus Wisol::finishSend(SendStatus status) {
+  //  Complete the asynchronous send and notify the callback.
+  sendStep = STEP_IDLE;
+  endSession();
+  if (sendCallback) sendCallback(status, sendResponse);
+  return status;
+}
+
+bool Wisol::isBusy() {
+  //  Return true if an asynchronous send is in progress.
+  return sendStep != STEP_IDLE;
+}
+
+void Wisol::setSendCallback(SendCallback callback) {
+  //  Set the function to be called when the asynchronous send completes.
+  sendCallback = callback;
+}
+
+const String &Wisol::getResponse() {
+  //  Return the downlink response of the last completed send.
+  return sendResponse;
+}
+
+bool Wisol::getResponse(uint8_t downlink[MAX_BYTES_PER_DOWNLINK]) {
+  //  Copy the 8 downlink bytes of the last completed send.  Return false if the downlink is incomplete.
+  if (sendDownlinkLength != MAX_BYTES_PER_DOWNLINK) {
+    logErr2(F(" - Wisol.getResponse: Error: Incomplete downlink, bytes: "), sendDownlinkLength);
+    return false;
+  }
+  memcpy(downlink, sendDownlink, MAX_BYTES_PER_DOWNLINK);
+  return true;
+}
+
 bool Wisol::enterCommandMode() {
   //  Enter Command Mode for sending module commands, not data.
   //  Not used for Wisol.
@@ -211,41 +547,79 @@ bool Wisol::exitCommandMode() {
 
 bool Wisol::getID(String &id, String &pac) {
   //  Get the SIGFOX ID and PAC for the module.
-  if (!sendCommand(String(CMD_GET_ID) + CMD_END, 1, data, markers)) return false;
-  id = data;
+  if (!sendCommand(COMMAND_GET_ID, data3, markers)) return false;
+  id = data3;
   device = id;
-  if (!sendCommand(String(CMD_GET_PAC) + CMD_END, 1, data, markers)) return false;
-  pac = data;
+  if (!sendCommand(COMMAND_GET_PAC, data3, markers)) return false;
+  pac = data3;
   log2(F(" - Wisol.getID: returned id="), id + ", pac=" + pac);
   return true;
 }
 
 bool Wisol::getTemperature(float &temperature) {
   //  Returns the temperature of the SIGFOX module.
-  if (!sendCommand(String(CMD_GET_TEMPERATURE) + CMD_END, 1, data, markers)) return false;
-  temperature = data.toInt() / 10.0;
+  if (!sendCommand(COMMAND_GET_TEMPERATURE, data3, markers)) return false;
+  temperature = data3.toInt() / 10.0;
   log2(F(" - Wisol.getTemperature: returned "), temperature);
   return true;
 }
 
 bool Wisol::getVoltage(float &voltage) {
   //  Returns the power supply voltage.
-  if (!sendCommand(String(CMD_GET_VOLTAGE) + CMD_END, 1, data, markers)) return false;
-  voltage = data.toFloat() / 1000.0;
+  if (!sendCommand(COMMAND_GET_VOLTAGE, data3, markers)) return false;
+  voltage = data3.toFloat() / 1000.0;
   log2(F(" - Wisol.getVoltage: returned "), voltage);
   return true;
 }
 
+static bool parseDecimal3(const String &str, long &value) {
+  //  Parse the decimal integer in str, with optional '-', without converting to float.
+  //  Return false if str is not a number.
+  const char *s = str.c_str();
+  const bool negative = (*s == '-');
+  if (negative) s++;
+  if (*s == 0) return false;
+  long result = 0;
+  for (; *s != 0; s++) {
+    if (*s < '0' || *s > '9') return false;
+    result = result * 10 + (*s - '0');
+  }
+  value = negative ? -result : result;
+  return true;
+}
+
+bool Wisol::getHealth(WisolHealth &health) {
+  //  Query AT$T? and AT$V? with the serial port kept open, and parse the replies as integers.
+  if (sleeping && !wakeUp()) return false;
+  long temperature = 0, voltage = 0;
+  beginSession();
+  const bool status =
+    sendCommand(COMMAND_GET_TEMPERATURE, data3, markers) &&
+    parseDecimal3(data3, temperature) &&
+    sendCommand(COMMAND_GET_VOLTAGE, data3, markers) &&
+    parseDecimal3(data3, voltage);
+  endSession();
+  if (!status) {
+    logErr2(F(" - Wisol.getHealth: Unknown response: "), data3);
+    return false;
+  }
+  health.temperature = (int16_t) temperature;
+  health.voltage = (uint16_t) voltage;
+  health.freeChannels = channelChecked ? channelY : 0xff;
+  log4(F(" - Wisol.getHealth: temperature="), health.temperature, F(" voltage="), health.voltage);
+  return true;
+}
+
 bool Wisol::getHardware(String &hardware) {
   //  TODO
-  log1(F(" - Wisol.getHardware: ERROR - Not implemented"));
+  logErr1(F(" - Wisol.getHardware: ERROR - Not implemented"));
   hardware = "TODO";
   return true;
 }
 
 bool Wisol::getFirmware(String &firmware) {
   //  TODO
-  log1(F(" - Wisol.getFirmware: ERROR - Not implemented"));
+  logErr1(F(" - Wisol.getFirmware: ERROR - Not implemented"));
   firmware = "TODO";
   return true;
 }
@@ -253,21 +627,21 @@ bool Wisol::getFirmware(String &firmware) {
 bool Wisol::getParameter(uint8_t address, String &value) {
   //  Read the parameter at the address.
   log2(F(" - Wisol.getParameter: address=0x"), toHex((char) address));
-  log1(F(" - Wisol.getParameter: ERROR - Not implemented"));
+  logErr1(F(" - Wisol.getParameter: ERROR - Not implemented"));
   log4(F(" - Wisol.getParameter: address=0x"), toHex((char) address), F(" returned "), value);
   return true;
 }
 
 bool Wisol::getPower(int &power) {
   //  Get the power step-down.
-  log1(F(" - Wisol.getPower: ERROR - Not implemented"));
+  logErr1(F(" - Wisol.getPower: ERROR - Not implemented"));
   power = 0;
   return true;
 }
 
 bool Wisol::setPower(int power) {
   //  TODO: Power value: 0...14
-  log1(F(" - Wisol.setPower: ERROR - Not implemented"));
+  logErr1(F(" - Wisol.setPower: ERROR - Not implemented"));
   return true;
 }
 
@@ -285,7 +659,7 @@ bool Wisol::disableEmulator(String &result) {
   //  Set the module key to the unique SIGFOX key.  This is needed for sending
   //  to a real SIGFOX base station.
   log1(F(" - Disabling SNEK emulation mode..."));
-  if (!sendCommand(String(CMD_EMULATOR_DISABLE) + CMD_END, 1, data, markers)) return false;
+  if (!sendCommand(COMMAND_EMULATOR_DISABLE, data3, markers)) return false;
   return true;
 }
 
@@ -294,7 +668,7 @@ bool Wisol::enableEmulator(String &result) {
   //  to an emulator.
   log1(F(" - Enabling SNEK emulation mode..."));
   log1(F(" - WARNING: SNEK emulation mode will NOT work with a Sigfox network"));
-  if (!sendCommand(String(CMD_EMULATOR_ENABLE) + CMD_END, 1, data, markers)) return false;
+  if (!sendCommand(COMMAND_EMULATOR_ENABLE, data3, markers)) return false;
   return true;
 }
 
@@ -318,28 +692,28 @@ bool Wisol::setFrequency(int zone0, String &result) {
   zone = zone0;
   switch(zone) {
     case 1:  //  RCZ1
-      // if (!sendCommand(String(CMD_RCZ1) + CMD_END, 1, data, markers)) return false;
-      // if (!sendCommand(String(CMD_OUTPUT_POWER_MAX) + CMD_END, 1, data, markers)) return false;
-      // if (!sendCommand(String(CMD_MODULATION_ON) + CMD_END, 1, data, markers)) return false;
+      // if (!sendCommand(COMMAND_RCZ1, data3, markers)) return false;
+      // if (!sendCommand(COMMAND_OUTPUT_POWER_MAX, data3, markers)) return false;
+      // if (!sendCommand(COMMAND_MODULATION_ON, data3, markers)) return false;
       break;
     case 2:  //  RCZ2
-      // if (!sendCommand(String(CMD_RCZ2) + CMD_END, 1, data, markers)) return false;
-      // if (!sendCommand(String(CMD_MODULATION_ON) + CMD_END, 1, data, markers)) return false;
+      // if (!sendCommand(COMMAND_RCZ2, data3, markers)) return false;
+      // if (!sendCommand(COMMAND_MODULATION_ON, data3, markers)) return false;
       break;
     case 3:  //  RCZ3
-      // if (!sendCommand(String(CMD_RCZ3) + CMD_END, 1, data, markers)) return false;
-      // if (!sendCommand(String(CMD_OUTPUT_POWER_MAX) + CMD_END, 1, data, markers)) return false;
-      // if (!sendCommand(String(CMD_MODULATION_ON) + CMD_END, 1, data, markers)) return false;
+      // if (!sendCommand(COMMAND_RCZ3, data3, markers)) return false;
+      // if (!sendCommand(COMMAND_OUTPUT_POWER_MAX, data3, markers)) return false;
+      // if (!sendCommand(COMMAND_MODULATION_ON, data3, markers)) return false;
       break;
     case 4:  //  RCZ4
-      // if (!sendCommand(String(CMD_RCZ4) + CMD_END, 1, data, markers)) return false;
-      // if (!sendCommand(String(CMD_MODULATION_ON) + CMD_END, 1, data, markers)) return false;
+      // if (!sendCommand(COMMAND_RCZ4, data3, markers)) return false;
+      // if (!sendCommand(COMMAND_MODULATION_ON, data3, markers)) return false;
       break;
     default:
-      log2(F(" - Wisol.setFrequency: Unknown zone "), zone);
+      logErr2(F(" - Wisol.setFrequency: Unknown zone "), zone);
       return false;
   }
-  // if (!sendCommand(String(CMD_MODULATION_OFF) + CMD_END, 1, data, markers)) return false;
+  // if (!sendCommand(COMMAND_MODULATION_OFF, data3, markers)) return false;
   result = "OK";
   return true;
 }
@@ -372,13 +746,13 @@ bool Wisol::setFrequencyJP(String &result) {
 bool Wisol::reboot(String &result) {
   //  Software reset the module.
   log1(F(" - Wisol.reboot"));
-  if (!sendCommand(String(CMD_RESET) + CMD_END, 1, data, markers)) return false;
+  if (!sendCommand(COMMAND_RESET, data3, markers)) return false;
   return true;
 }
 
 bool Wisol::writeSettings(String &result) {
   //  TODO: Write settings to module's flash memory.
-  log1(F(" - Wisol.writeSettings: ERROR - Not implemented"));
+  logErr1(F(" - Wisol.writeSettings: ERROR - Not implemented"));
   return true;
 }
 
@@ -399,47 +773,83 @@ Wisol::Wisol(Country country0, bool useEmulator0, const String device0, bool ech
                          uint8_t rx, uint8_t tx) {
   //  Init the module with the specified transmit and receive pins.
   //  Default to no echo.
+  //  Bean+ firmware 0.6.1 can't receive serial data properly. We provide
+  //  an alternative class BeanSoftwareSerial to work around this.
+  //  For Bean, SoftwareSerial is a #define alias for BeanSoftwareSerial.
+#ifdef BEAN_BEAN_BEAN_H
+  //  Give the module its own receive buffer so the downlink response doesn't overflow.
+  serialPort.attach(new BeanSoftwareSerialBuffer<WISOL_RX_BUFFER_SIZE>(rx, tx));
+#else  //  BEAN_BEAN_BEAN_H
+  serialPort.attach(new SoftwareSerial(rx, tx));
+#endif  //  BEAN_BEAN_BEAN_H
+  init(country0, useEmulator0, device0, echo);
+}
+
+#ifdef MODEM_PORT_HARDWARE
+Wisol::Wisol(Country country0, bool useEmulator0, const String device0, bool echo,
+             HardwareSerial *port) {
+  //  Init the module connected to a hardware UART, e.g. Serial1.
+  serialPort.attach(port);
+  init(country0, useEmulator0, device0, echo);
+}
+#endif  //  MODEM_PORT_HARDWARE
+
+void Wisol::init(Country country0, bool useEmulator0, const String &device0, bool echo) {
+  //  Init the state shared by the constructors.
   zone = 4;  //  RCZ4
   country = country0;
   useEmulator = useEmulator0;
   device = device0;
-  //  Bean+ firmware 0.6.1 can't receive serial data properly. We provide
-  //  an alternative class BeanSoftwareSerial to work around this.
-  //  For Bean, SoftwareSerial is a #define alias for BeanSoftwareSerial.
-  serialPort = new SoftwareSerial(rx, tx);
   if (echo) echoPort = &Serial;
-  else echoPort = &nullPort;
+  else echoPort = &nullPort3;
   lastEchoPort = &Serial;
+  lastSend = 0;
+  bufferBusy = false;
+  rxDownlink = false;
+  rxTimeout = rxLastTime = 0;
+  rxLineStarted = false;
+  lastError = WISOL_ERROR_NONE;
+  portOpen = false;
+  portReady = false;
+  sessionDepth = 0;
+  txText = txArgument = 0;
+  txTextLength = 0;
+  txLength = txPos = 0;
+  sendStep = STEP_IDLE;
+  sendGetResponse = false;
+  sendDownlinkLength = 0;
+  sendCallback = 0;
+  channelChecked = false;
+  channelX = channelY = channelUplinks = 0;
+  channelQueryStart = 0;
+  memset(&channelStats, 0, sizeof(channelStats));
+  sleeping = false;
+  powerStateStart = 0;
+  memset(&powerStats, 0, sizeof(powerStats));
 }
 
 bool Wisol::begin() {
   //  Wait for the module to power up, configure transmission frequency.
   //  Return true if module is ready to send.
   lastSend = 0;
+  channelChecked = false;  //  Module may have been reset, check the channels before the next uplink.
+  updatePowerStats();
+  sleeping = false;  //  Module is awake after power up.
   for (int i = 0; i < 5; i++) {
     //  Retry 5 times.
 #ifdef BEAN_BEAN_BEAN_H
     Bean.sleep(7000);  //  For Bean, delay longer to allow Bluetooth debug console to connect.
-#else  // BEAN_BEAN_BEAN_H
-    delay(2000);
 #endif // BEAN_BEAN_BEAN_H
     String result;
-    if (useEmulator) {
-      //  Emulation mode.
-      if (!enableEmulator(result)) continue;
-    } else {
-      //  Disable emulation mode.
-      if (!disableEmulator(result)) continue;
+    //  Keep the port open for all the commands below.
+    endSession();  beginSession();
+    //  Wait for the module to power up.  If it doesn't send anything for a whole power-up
+    //  wait, no module is connected, so fail now instead of waiting for each retry.
+    bool silent;
+    if (!waitReady(WISOL_POWER_UP_TIMEOUT, silent)) {
+      if (silent) break;
+      continue;
     }
-    //  TODO: Check whether emulator is used for transmission.
-    //  log1(F(" - Checking emulation mode (expecting 0)...")); int emulator = 0;
-    //  if (!getEmulator(emulator)) continue;
-
-    //  Read SIGFOX ID and PAC from module.
-    log1(F(" - Getting SIGFOX ID..."));  String id, pac;
-    if (!getID(id, pac)) continue;
-    echoPort->print(F(" - SIGFOX ID = "));  Serial.println(id);
-    echoPort->print(F(" - PAC = "));  Serial.println(pac);
 
     //  Set the frequency of SIGFOX module.
     // log1(F(" - Setting frequency for country "));
@@ -459,35 +869,218 @@ bool Wisol::begin() {
     }
     log2(F(" - Set frequency result = "), result);
 
+    //  If the module was set up with the same emulator mode and zone before, reuse the ID and PAC.
+    String id, pac;
+    if (loadIdentity(id, pac)) {
+      device = id;
+      log2(F(" - Cached SIGFOX ID = "), id);
+      log2(F(" - Cached PAC = "), pac);
+      endSession();
+      return true;  //  Init module succeeded.
+    }
+
+    if (useEmulator) {
+      //  Emulation mode.
+      if (!enableEmulator(result)) continue;
+    } else {
+      //  Disable emulation mode.
+      if (!disableEmulator(result)) continue;
+    }
+    //  TODO: Check whether emulator is used for transmission.
+    //  log1(F(" - Checking emulation mode (expecting 0)...")); int emulator = 0;
+    //  if (!getEmulator(emulator)) continue;
+
+    //  Read SIGFOX ID and PAC from module.
+    log1(F(" - Getting SIGFOX ID..."));
+    if (!getID(id, pac)) continue;
+    log2(F(" - SIGFOX ID = "), id);
+    log2(F(" - PAC = "), pac);
+    saveIdentity(id, pac);
+
     //  Get and display the frequency used by the SIGFOX module.  Should return 3 for RCZ4 (SG/TW).
     log1(F(" - Getting frequency (expecting 3)..."));  String frequency;
     if (!getFrequency(frequency)) continue;
     log2(F(" - Frequency (expecting 3) = "), frequency);
+    endSession();
     return true;  //  Init module succeeded.
   }
+  endSession();
   return false;  //  Failed to init module.
 }
 
-bool Wisol::sendCommand(const String &cmd, uint8_t expectedMarkerCount,
-                              String &result, uint8_t &actualMarkerCount) {
-  //  We send the command string in cmd to SIGFOX.  Return true if successful.
+bool Wisol::waitReady(unsigned long timeout, bool &silent) {
+  //  Poll the module with "AT" until it returns OK, instead of waiting a fixed time for
+  //  the module to power up.  Return false if the module is not ready after timeout milliseconds.
+  //  silent is true if the module didn't answer any poll.
+  const unsigned long startTime = millis();
+  silent = true;
+  for (;;) {
+    if (sendBuffer(COMMAND_AT, 0, WISOL_READY_POLL_TIMEOUT, data3, markers)) { silent = false;  return true; }
+    if (lastError != WISOL_ERROR_TIMEOUT) silent = false;  //  Module answered, but not OK yet.
+    if (millis() - startTime > timeout) return false;
+  }
+}
+
+#if UNABIZ_IDENTITY_CACHE
+//  Identity of the module cached in EEPROM.  Increment the version when the layout changes.
+static const uint8_t identityVersion = 1;
+static const uint8_t identityIdMax = 8;  //  SIGFOX ID has 8 hex digits.
+static const uint8_t identityPacMax = 16;  //  PAC has 16 hex digits.
+struct WisolIdentity {
+  uint8_t version;  //  Layout version, must be identityVersion.
+  uint8_t emulator;  //  1 if the module was set to emulator mode, else 0.
+  uint8_t zone;  //  1 to 4 representing SIGFOX frequencies RCZ 1 to 4.
+  char id[identityIdMax + 1];  //  SIGFOX ID, null-terminated.
+  char pac[identityPacMax + 1];  //  PAC, null-terminated.
+  uint8_t crc;  //  CRC-8 of the bytes above.
+};
+//  FrameStore keeps clear of the last WISOL_IDENTITY_SIZE bytes of the EEPROM.
+static_assert(sizeof(WisolIdentity) == WISOL_IDENTITY_SIZE, "Update WISOL_IDENTITY_SIZE");
+
+static uint8_t identityCrc(const uint8_t *bytes, uint8_t length) {
+  //  Compute the CRC-8 (polynomial 0x07) of the bytes.
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < length; i++) {
+    crc ^= bytes[i];
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+  }
+  return crc;
+}
+
+static int identityAddress() {
+  //  Store the identity at the end of the EEPROM, away from the sketch's own data at the start.
+  return EEPROM.length() - sizeof(WisolIdentity);
+}
+#endif  //  UNABIZ_IDENTITY_CACHE
+
+bool Wisol::loadIdentity(String &id, String &pac) {
+  //  Read the ID and PAC cached in EEPROM.  Return false if there is no valid cache for the
+  //  current emulator mode and zone.
+#if UNABIZ_IDENTITY_CACHE
+  WisolIdentity identity;
+  uint8_t *bytes = (uint8_t *) &identity;
+  const int address = identityAddress();
+  for (uint8_t i = 0; i < sizeof(identity); i++) bytes[i] = EEPROM.read(address + i);
+  if (identity.crc != identityCrc(bytes, sizeof(identity) - 1)) return false;
+  if (identity.version != identityVersion ||
+      identity.emulator != (useEmulator ? 1 : 0) ||
+      identity.zone != zone) return false;
+  identity.id[identityIdMax] = 0;
+  identity.pac[identityPacMax] = 0;
+  id = identity.id;
+  pac = identity.pac;
+  return true;
+#else  //  UNABIZ_IDENTITY_CACHE
+  return false;
+#endif  //  UNABIZ_IDENTITY_CACHE
+}
+
+void Wisol::saveIdentity(const String &id, const String &pac) {
+  //  Cache the ID and PAC in EEPROM for the current emulator mode and zone.
+#if UNABIZ_IDENTITY_CACHE
+  if (id.length() > identityIdMax || pac.length() > identityPacMax) return;
+  WisolIdentity identity;
+  memset(&identity, 0, sizeof(identity));
+  identity.version = identityVersion;
+  identity.emulator = useEmulator ? 1 : 0;
+  identity.zone = zone;
+  strcpy(identity.id, id.c_str());
+  strcpy(identity.pac, pac.c_str());
+  const uint8_t *bytes = (const uint8_t *) &identity;
+  identity.crc = identityCrc(bytes, sizeof(identity) - 1);
+  //  update() writes only the bytes that have changed, to reduce EEPROM wear.
+  const int address = identityAddress();
+  for (uint8_t i = 0; i < sizeof(identity); i++) EEPROM.update(address + i, bytes[i]);
+#endif  //  UNABIZ_IDENTITY_CACHE
+}
+
+void Wisol::clearIdentityCache() {
+  //  Forget the cached ID and PAC, so that the next begin() queries the module again.
+#if UNABIZ_IDENTITY_CACHE
+  const int address = identityAddress() + sizeof(WisolIdentity) - 1;
+  EEPROM.update(address, EEPROM.read(address) ^ 0xff);  //  Invalidate the CRC.
+#endif  //  UNABIZ_IDENTITY_CACHE
+}
+
+bool Wisol::sendCommand(Command command, String &result, uint8_t &actualMarkerCount) {
+  //  We send the command from the command table to SIGFOX.  Return true if successful.
   //  Enter command mode.
   if (!enterCommandMode()) return false;
-  if (!sendBuffer(cmd, WISOL_COMMAND_TIMEOUT, expectedMarkerCount,
-                  data, actualMarkerCount)) return false;
-  result = data;
+  if (!sendBuffer(command, 0, 0, data3, actualMarkerCount)) return false;
+  result = data3;
+  return true;
+}
+
+bool Wisol::sleep() {
+  //  Put the module in sleep mode (AT$P=1), consuming less than 1.5 uA.  The begin() setup is
+  //  retained, and sending a message wakes up the module automatically.
+  if (sleeping) return true;
+  if (isBusy()) {
+    logErr1(F(" - Wisol.sleep: Error: Message is being sent"));
+    return false;
+  }
+  log1(F(" - Wisol.sleep"));
+  if (!sendCommand(COMMAND_SLEEP, data3, markers)) return false;
+  updatePowerStats();
+  sleeping = true;
+  powerStats.sleeps++;
+  return true;
+}
+
+bool Wisol::wakeUp() {
+  //  Wake up the module from sleep mode.  The first "AT" wakes up the module and we poll until
+  //  it returns OK.  The frequency and emulator settings are retained, so begin() is not repeated.
+  if (!sleeping) return true;
+  log1(F(" - Wisol.wakeUp"));
+  const unsigned long start = millis();
+  beginSession();
+  bool silent;
+  const bool ready = waitReady(WISOL_WAKEUP_TIMEOUT, silent);
+  endSession();
+  if (!ready) {
+    logErr1(F(" - Wisol.wakeUp: Error: Module did not wake up"));
+    powerStats.wakeFailures++;
+    return false;
+  }
+  powerStats.lastWakeMillis = millis() - start;
+  updatePowerStats();
+  sleeping = false;
   return true;
 }
 
+bool Wisol::isSleeping() {
+  //  Return true if the module is in sleep mode.
+  return sleeping;
+}
+
+void Wisol::updatePowerStats() {
+  //  Add the time spent in the current power state.
+  const unsigned long now = millis();
+  if (sleeping) powerStats.sleepMillis += now - powerStateStart;
+  else powerStats.awakeMillis += now - powerStateStart;
+  powerStateStart = now;
+}
+
+const WisolPowerStats &Wisol::getPowerStats() {
+  //  Return the time spent by the module in each power state, up to now.
+  updatePowerStats();
+  return powerStats;
+}
+
+#if UNABIZ_COMMAND_STATS
+const CommandStats &Wisol::getCommandStats() {
+  //  Return the round-trip time and bytes for each command sent.
+  return commandStats;
+}
+#endif  //  UNABIZ_COMMAND_STATS
+
 bool Wisol::sendString(const String &str) {
   //  For convenience, allow sending of a text string with automatic encoding into bytes.  Max 12 characters allowed.
   //  Convert each character into 2 bytes.
   log2(F(" - Wisol.sendString: "), str);
   String payload;
-  for (unsigned i = 0; i < str.length(); i++) {
-    char ch = str.charAt(i);
-    payload.concat(toHex(ch));
-  }
+  appendHex(payload, (const uint8_t *) str.c_str(), str.length());
   //  Send the encoded payload.
   return sendMessage(payload);
 }
@@ -519,7 +1112,7 @@ bool Wisol::isReady()
   const unsigned long elapsedTime = currentTime - lastSend;
   //  For development, allow sending every 2 seconds.
   if (elapsedTime <= 2 * 1000) {
-    log1(F("***MESSAGE NOT SENT - Must wait 2 seconds before sending the next message"));
+    logErr1(F("***MESSAGE NOT SENT - Must wait 2 seconds before sending the next message"));
     return false;
   }  //  Wait before sending.
   if (elapsedTime <= SEND_DELAY)
@@ -535,7 +1128,7 @@ void Wisol::echoOn() {
 
 void Wisol::echoOff() {
   //  Stop echoing commands and responses to the echo port.
-  lastEchoPort = echoPort; echoPort = &nullPort;
+  lastEchoPort = echoPort; echoPort = &nullPort3;
 }
 
 void Wisol::setEchoPort(Print *port) {
@@ -549,110 +1142,92 @@ void Wisol::echo(const String &msg) {
   log2(F(" - "), msg);
 }
 
+void Wisol::echo(const char *msg) {
+  //  Echo debug message to the echo port.
+  log2(F(" - "), msg);
+}
+
+bool Wisol::receive(uint8_t downlink[MAX_BYTES_PER_DOWNLINK]) {
+  //  Send an empty frame with a downlink request and return the 8 bytes of the downlink response.
+  return sendMessageAndGetResponse("", downlink);
+}
+
 bool Wisol::receive(String &data) {
-  //  TODO
-  log1(F(" - Wisol.receive: ERROR - Not implemented"));
+  //  Return the received bytes as hex digits.
+  uint8_t downlink[MAX_BYTES_PER_DOWNLINK];
+  if (!receive(downlink)) return false;
+  data = "";
+  appendHex(data, downlink, MAX_BYTES_PER_DOWNLINK);
   return true;
 }
 
 String Wisol::toHex(int i) {
   //  Convert the integer to a string of 4 hex digits.
-  byte *b = (byte *) &i;
   String bytes;
-  for (int j=0; j<2; j++) {
-    if (b[j] <= 0xF) bytes.concat('0');
-    bytes.concat(String(b[j], 16));
-  }
+  appendHex(bytes, (const uint8_t *) &i, 2);
   return bytes;
 }
 
 String Wisol::toHex(unsigned int ui) {
   //  Convert the integer to a string of 4 hex digits.
-  byte *b = (byte *) &ui;
   String bytes;
-  for (int i=0; i<2; i++) {
-    if (b[i] <= 0xF) bytes.concat('0');
-    bytes.concat(String(b[i], 16));
-  }
+  appendHex(bytes, (const uint8_t *) &ui, 2);
   return bytes;
 }
 
 String Wisol::toHex(long l) {
   //  Convert the long to a string of 8 hex digits.
-  byte *b = (byte *) &l;
   String bytes;
-  for (int i=0; i<4; i++) {
-    if (b[i] <= 0xF) bytes.concat('0');
-    bytes.concat(String(b[i], 16));
-  }
+  appendHex(bytes, (const uint8_t *) &l, 4);
   return bytes;
 }
 
 String Wisol::toHex(unsigned long ul) {
   //  Convert the long to a string of 8 hex digits.
-  byte * b = (byte *) &ul;
   String bytes;
-  for (int i=0; i<4; i++) {
-    if (b[i] <= 0xF) bytes.concat('0');
-    bytes.concat(String(b[i], 16));
-  }
+  appendHex(bytes, (const uint8_t *) &ul, 4);
   return bytes;
 }
 
 String Wisol::toHex(float f) {
   //  Convert the float to a string of 8 hex digits.
-  byte *b = (byte *) &f;
   String bytes;
-  for (int i=0; i<4; i++) {
-    if (b[i] <= 0xF) bytes.concat('0');
-    bytes.concat(String(b[i], 16));
-  }
+  appendHex(bytes, (const uint8_t *) &f, 4);
   return bytes;
 }
 
 String Wisol::toHex(double d) {
   //  Convert the double to a string of 8 hex digits.
-  byte *b = (byte *) &d;
   String bytes;
-  for (int i=0; i<4; i++) {
-    if (b[i] <= 0xF) bytes.concat('0');
-    bytes.concat(String(b[i], 16));
-  }
+  appendHex(bytes, (const uint8_t *) &d, 4);
   return bytes;
 }
 
 String Wisol::toHex(char c) {
   //  Convert the char to a string of 2 hex digits.
-  byte *b = (byte *) &c;
   String bytes;
-  if (b[0] <= 0xF) bytes.concat('0');
-  bytes.concat(String(b[0], 16));
+  appendHex(bytes, (const uint8_t *) &c, 1);
   return bytes;
 }
 
 String Wisol::toHex(char *c, int length) {
   //  Convert the string to a string of hex digits.
-  byte *b = (byte *) c;
   String bytes;
-  for (int i=0; i<length; i++) {
-    if (b[i] <= 0xF) bytes.concat('0');
-    bytes.concat(String(b[i], 16));
-  }
+  appendHex(bytes, (const uint8_t *) c, length);
   return bytes;
 }
 
-uint8_t Wisol::hexDigitToDecimal(char ch) {
-  //  Convert 0..9, a..f, A..F to decimal.
-  if (ch >= '0' && ch <= '9') return (uint8_t) ch - '0';
-  if (ch >= 'a' && ch <= 'z') return (uint8_t) ch - 'a' + 10;
-  if (ch >= 'A' && ch <= 'Z') return (uint8_t) ch - 'A' + 10;
-  log2(F(" - Wisol.hexDigitToDecimal: Error: Invalid hex digit "), ch);
-  return 0;
+#if UNABIZ_LOG_LEVEL >= 2
+void Wisol::logCommand(const __FlashStringHelper *prefix) {
+  //  Log the command being sent, streamed from flash memory without building a String.
+  echoPort->print(prefix);
+  echoPort->print((const __FlashStringHelper *) txText);
+  if (txArgument) echoPort->print(txArgument);
+  echoPort->write('\n');
 }
+#endif  //  UNABIZ_LOG_LEVEL >= 2
 
-//  Convert nibble to hex digit.
-static const char nibbleToHex[] = "0123456789abcdef";
-
+#if UNABIZ_LOG_LEVEL >= 3
 void Wisol::logBuffer(const __FlashStringHelper *prefix, const char *buffer,
                             uint8_t *markerPos, uint8_t markerCount) {
   //  Log the send/receive buffer for debugging.  markerPos is an array of positions in buffer
@@ -662,8 +1237,8 @@ void Wisol::logBuffer(const __FlashStringHelper *prefix, const char *buffer,
   for (i = 0; i < strlen(buffer); i = i + 2) {
     if (m < markerCount && markerPos[m] == i) {
       echoPort->print("0x");
-      echoPort->write((uint8_t) nibbleToHex[END_OF_RESPONSE / 16]);
-      echoPort->write((uint8_t) nibbleToHex[END_OF_RESPONSE % 16]);
+      echoPort->write((uint8_t) nibbleToHexDigit(WISOL_END_OF_RESPONSE >> 4));
+      echoPort->write((uint8_t) nibbleToHexDigit(WISOL_END_OF_RESPONSE));
       m++;
     }
     echoPort->write((uint8_t) buffer[i]);
@@ -671,10 +1246,11 @@ void Wisol::logBuffer(const __FlashStringHelper *prefix, const char *buffer,
   }
   if (m < markerCount && markerPos[m] == i) {
     echoPort->print("0x");
-    echoPort->write((uint8_t) nibbleToHex[END_OF_RESPONSE / 16]);
-    echoPort->write((uint8_t) nibbleToHex[END_OF_RESPONSE % 16]);
+    echoPort->write((uint8_t) nibbleToHexDigit(WISOL_END_OF_RESPONSE >> 4));
+    echoPort->write((uint8_t) nibbleToHexDigit(WISOL_END_OF_RESPONSE));
     m++;
   }
   echoPort->write('\n');
 }
+#endif  //  UNABIZ_LOG_LEVEL >= 3
 
@@ -25,7 +25,55 @@
 
 const uint8_t WISOL_TX = 4;  //  Transmit port for For UnaBiz / Wisol Dev Kit
 const uint8_t WISOL_RX = 5;  //  Receive port for UnaBiz / Wisol Dev Kit
-const unsigned int WISOL_COMMAND_TIMEOUT = 60000;  //  Wait up to 60 seconds for response from SIGFOX module.  Includes downlink response.
+//  Deadlines for the response of each command, counted from the last char sent.  See the command table in Wisol.cpp.
+const unsigned int WISOL_COMMAND_TIMEOUT = 60000;  //  Wait up to 60 seconds for the downlink response after AT$SF=...,1
+const unsigned int WISOL_UPLINK_TIMEOUT = 15000;  //  Wait up to 15 seconds for AT$SF to transmit the uplink 3 times.
+const unsigned int WISOL_QUERY_TIMEOUT = 500;  //  Wait up to 500 milliseconds for the status queries and settings, which reply in a few ms.
+const unsigned int WISOL_IDLE_TIMEOUT = 100;  //  Fail if the module stops sending for 100 milliseconds in the middle of a response line.
+const uint8_t WISOL_RX_BUFFER_SIZE = 96;  //  For Bean: Receive buffer for the module, fits the downlink response and echo.
+const uint8_t WISOL_RX_CHUNK_SIZE = 16;  //  Drain up to 16 received chars at a time.
+const unsigned long WISOL_WAKEUP_TIMEOUT = 500;  //  Wait up to 500 milliseconds for the module to wake up.
+const uint8_t WISOL_MARKER_POS_MAX = 5;  //  Remember up to 5 positions of '\r' markers in the response.
+const uint8_t WISOL_CHANNELS_MIN = 3;  //  For RCZ2, 4: Reset the channels with AT$RC if fewer than 3 micro channels are free.
+//  For RCZ2, 4: Assume each uplink uses up 1 free micro channel reported by AT$GI?.  The module may
+//  use fewer (the examples/downlink trace shows 1,5 before every uplink), so this errs on the safe side.
+const uint8_t WISOL_CHANNELS_PER_UPLINK = 1;
+const uint8_t WISOL_IDENTITY_SIZE = 30;  //  Bytes of the ID and PAC cached at the end of the EEPROM.
+
+//  For RCZ2, 4: Counters for the AT$GI? channel check that is done before sending.
+struct WisolChannelStats {
+  unsigned int queries;  //  Number of AT$GI? commands sent.
+  unsigned int skipped;  //  Number of AT$GI? commands skipped because the last result is still valid.
+  unsigned int resets;  //  Number of AT$RC commands sent.
+  unsigned long lastQueryMillis;  //  Duration of the last AT$GI? round trip.
+  unsigned long savedMillis;  //  Estimated time saved by skipping AT$GI?, based on lastQueryMillis.
+};
+
+//  Reason for the failure of the last command, returned by getLastError().
+enum WisolError {
+  WISOL_ERROR_NONE = 0,  //  Last command succeeded.
+  WISOL_ERROR_TIMEOUT = 1,  //  No complete response before the deadline of the command, e.g. module unplugged.
+  WISOL_ERROR_IDLE = 2,  //  Module stopped sending in the middle of a response line, e.g. browned out.
+  WISOL_ERROR_RESPONSE = 3,  //  Module returned an error or an unknown response.
+  WISOL_ERROR_BUSY = 4,  //  Another command or message is being sent.
+};
+
+//  Status of the module returned by getHealth(), as integers without float conversion.
+//  The fields can be added to a Message with addScaledField(), e.g. "tmp" with temperature.
+struct WisolHealth {
+  int16_t temperature;  //  Module temperature in deci-degrees Celsius, e.g. 277 for 27.7 C.
+  uint16_t voltage;  //  Power supply voltage in millivolts.
+  uint8_t freeChannels;  //  For RCZ2, 4: Free micro channels at the last AT$GI? check, 0xff if unknown.
+};
+
+//  Time spent by the module in each power state.
+struct WisolPowerStats {
+  unsigned long awakeMillis;  //  Total milliseconds with the module awake.
+  unsigned long sleepMillis;  //  Total milliseconds with the module in sleep mode.
+  unsigned long lastWakeMillis;  //  Duration of the last wake up, until the module returned OK.
+  unsigned int sleeps;  //  Number of times the module was put to sleep.
+  unsigned int wakeFailures;  //  Number of times the module did not wake up.
+};
 
 class Wisol
 {
@@ -33,18 +81,49 @@ public:
   Wisol(Country country, bool useEmulator, const String device, bool echo);
   Wisol(Country country, bool useEmulator, const String device, bool echo,
               uint8_t rx, uint8_t tx);
+#ifdef MODEM_PORT_HARDWARE
+  //  Use a spare hardware UART for the module, e.g. Serial1 on Mega, Leonardo and SAMD boards.
+  Wisol(Country country, bool useEmulator, const String device, bool echo,
+        HardwareSerial *port);
+#endif  //  MODEM_PORT_HARDWARE
   bool begin();
   void echoOn();  //  Turn on send/receive echo.
   void echoOff();  //  Turn off send/receive echo.
   void setEchoPort(Print *port);  //  Set the port for sending echo output.
   void echo(const String &msg);  //  Echo the debug message.
+  void echo(const char *msg);  //  Echo the debug message without allocating a String.
   bool isReady();
   bool sendMessage(const String &payload);  //  Send the payload of hex digits to the network, max 12 bytes.
   bool sendMessageAndGetResponse(const String &payload, String &response);  //  Send the payload of hex digits to the network and get response.
+  //  Send the payload of hex digits to the network and get the 8 bytes of the downlink response.
+  bool sendMessageAndGetResponse(const String &payload, uint8_t downlink[MAX_BYTES_PER_DOWNLINK]);
+  //  Asynchronous send: start the send and return immediately.  Call poll() in loop() until the send completes.
+  bool sendMessageAsync(const String &payload);  //  Start sending the payload of hex digits to the network, max 12 bytes.
+  bool sendMessageAndGetResponseAsync(const String &payload);  //  Start sending the payload and wait for downlink response.
+  SendStatus poll();  //  Continue the asynchronous send.  Returns SEND_BUSY until the send completes.
+  bool isBusy();  //  Return true if an asynchronous send is in progress.
+  void beginSession();  //  Keep the serial port open across a batch of commands.
+  void endSession();  //  End the batch of commands and stop the serial port.
+  void setSendCallback(SendCallback callback);  //  Set the function to be called when the asynchronous send completes.
+  const String &getResponse();  //  Return the downlink response of the last completed send.
+  bool getResponse(uint8_t downlink[MAX_BYTES_PER_DOWNLINK]);  //  Copy the 8 downlink bytes of the last completed send.
+  const WisolChannelStats &getChannelStats();  //  Return the counters for the RCZ2, 4 channel check.
+  WisolError getLastError();  //  Return the reason for the failure of the last command or send.
   bool sendString(const String &str);  //  Sending a text string, max 12 characters allowed.
-  bool receive(String &data);  //  Receive a message.
+  bool receive(uint8_t downlink[MAX_BYTES_PER_DOWNLINK]);  //  Send an empty frame and get the 8 bytes of the downlink response.
+  bool receive(String &data);  //  Receive a message as hex digits.
   bool enterCommandMode();  //  Enter Command Mode for sending module commands, not data.
   bool exitCommandMode();  //  Exit Command Mode so we can send data.
+  void clearIdentityCache();  //  Forget the ID and PAC cached in EEPROM, so that begin() queries the module again.
+  //  Put the module in sleep mode (AT$P=1), consuming less than 1.5 uA.  Sending a message wakes
+  //  up the module automatically.
+  bool sleep();
+  bool wakeUp();  //  Wake up the module from sleep mode.  Doesn't repeat the begin() setup.
+  bool isSleeping();  //  Return true if the module is in sleep mode.
+  const WisolPowerStats &getPowerStats();  //  Return the time spent by the module in each power state.
+#if UNABIZ_COMMAND_STATS
+  const CommandStats &getCommandStats();  //  Return the round-trip time and bytes for each command sent.
+#endif  //  UNABIZ_COMMAND_STATS
 
   //  Commands for the module, must be run in Command Mode.
   bool getEmulator(int &result);  //  Return 0 if emulator mode disabled, else return 1.
@@ -67,6 +146,9 @@ public:
   bool getTemperature(float &temperature);
   bool getID(String &id, String &pac);  //  Get the SIGFOX ID and PAC for the module.
   bool getVoltage(float &voltage);
+  //  Query the temperature and voltage in one serial port session.  Faster than calling
+  //  getTemperature() and getVoltage(), which start and stop the port for each command.
+  bool getHealth(WisolHealth &health);
   bool getHardware(String &hardware);
   bool getFirmware(String &firmware);
   bool getPower(int &power);
@@ -84,24 +166,118 @@ public:
   String toHex(char *c, int length);
 
 private:
-  bool sendCommand(const String &cmd, uint8_t expectedMarkers,
-                   String &result, uint8_t &actualMarkers);
-  bool sendBuffer(const String &buffer, int timeout, uint8_t expectedMarkers,
+  void init(Country country, bool useEmulator, const String &device, bool echo);  //  Shared by the constructors.
+  //  Steps of the asynchronous send.
+  enum SendStep {
+    STEP_IDLE = 0,  //  No send in progress.
+    STEP_OUTPUT_POWER = 1,  //  RCZ1, 3: Setting output power.
+    STEP_PRESEND = 2,  //  RCZ2, 4: Checking channels with AT$GI?
+    STEP_PRESEND2 = 3,  //  RCZ2, 4: Resetting channels with AT$RC
+    STEP_SEND = 4,  //  Sending the AT$SF message.
+  };
+  //  Commands in the command table, which is kept in flash memory.  See Wisol.cpp.
+  enum Command {
+    COMMAND_AT = 0,  //  Check that the module is ready.
+    COMMAND_OUTPUT_POWER_MAX,  //  For RCZ1, 3: Set output power to maximum power level.
+    COMMAND_PRESEND,  //  For RCZ2, 4: Check the free channels.
+    COMMAND_PRESEND2,  //  For RCZ2, 4: Reset the channels.
+    COMMAND_SEND_MESSAGE,  //  Send the payload in the argument.
+    COMMAND_SEND_MESSAGE_RESPONSE,  //  Send the payload and ",1" in the argument, and wait for the downlink.
+    COMMAND_GET_ID,  //  Get SIGFOX device ID.
+    COMMAND_GET_PAC,  //  Get SIGFOX device PAC.
+    COMMAND_GET_TEMPERATURE,  //  Get the module temperature.
+    COMMAND_GET_VOLTAGE,  //  Get the module voltage.
+    COMMAND_RESET,  //  Software reset.
+    COMMAND_SLEEP,  //  Switch to sleep mode.
+    COMMAND_EMULATOR_DISABLE,  //  Talk only to the Sigfox network.
+    COMMAND_EMULATOR_ENABLE,  //  Talk only to the SNEK emulator.
+  };
+  bool sendCommand(Command command, String &result, uint8_t &actualMarkers);
+  //  timeout is the milliseconds to wait for the response, or 0 for the deadline of the command.
+  bool sendBuffer(Command command, const char *argument, unsigned long timeout,
                   String &dataOut, uint8_t &actualMarkers);
+  bool startSend(const String &payload, bool getResponse);
+  void startBuffer(Command command, const char *argument, unsigned long timeout = 0);
+  uint8_t getTxChar(unsigned int pos);  //  Return the char of the command at pos.
+  SendStatus pollBuffer();
+  SendStatus finishBuffer(WisolError error);
+  SendStatus finishSend(SendStatus status);
+  void startMessage();  //  Send the AT$SF command after the presend steps.
+  bool isChannelCheckValid();  //  Return true if the last AT$GI? result allows this uplink.
+  void openPort();
+  void closePort();
   bool setFrequency(int zone, String &result);
-  uint8_t hexDigitToDecimal(char ch);
+  bool waitReady(unsigned long timeout, bool &silent);  //  Wait for the module to respond to "AT".
+  bool loadIdentity(String &id, String &pac);  //  Read the ID and PAC cached in EEPROM.
+  void saveIdentity(const String &id, const String &pac);  //  Cache the ID and PAC in EEPROM.
+#if UNABIZ_LOG_LEVEL >= 3
   void logBuffer(const __FlashStringHelper *prefix, const char *buffer,
                  uint8_t markerPos[], uint8_t markerCount);
+#endif  //  UNABIZ_LOG_LEVEL >= 3
+#if UNABIZ_LOG_LEVEL >= 2
+  void logCommand(const __FlashStringHelper *prefix);  //  Log the command being sent.
+#endif  //  UNABIZ_LOG_LEVEL >= 2
 
   int zone;  //  1 to 4 representing SIGFOX frequencies RCZ 1 to 4.
   Country country;   //  Country to be set for SIGFOX transmission frequencies.
   bool useEmulator;  //  Set to true if using UnaBiz Emulator.
   String device;  //  Name of device if using UnaBiz Emulator.
-  SoftwareSerial *serialPort;  //  Serial port for the SIGFOX module.
+  ModemPort serialPort;  //  Serial port for the SIGFOX module.
   Print *echoPort;  //  Port for sending echo output.  Defaults to Serial.
   Print *lastEchoPort;  //  Last port used for sending echo output.
   unsigned long lastSend;  //  Timestamp of last send.
-  bool setOutputPower();
+
+  //  State of the buffer being exchanged with the module.
+  bool bufferBusy;  //  True if a buffer is being exchanged.
+  bool portOpen;  //  True if the serial port has been started.
+  bool portReady;  //  True if the serial port has been started and settled.
+  unsigned long portStartTime;  //  Timestamp when the serial port was started.
+  uint8_t sessionDepth;  //  Number of nested sessions keeping the serial port open.
+  const char *txText;  //  Text of the command being sent, in flash memory.
+  const char *txArgument;  //  Argument after the command text, in RAM, or 0.
+  uint8_t txTextLength;  //  Number of chars in txText.
+  unsigned int txLength;  //  Number of chars to be sent: text, argument and CMD_END.
+  unsigned int txPos;  //  Position of the next char to be sent.
+  unsigned long txMicros;  //  Timestamp of the last char sent, in microseconds.
+  bool txPaced;  //  True if we should leave a gap after each char because the module is sending.
+  unsigned long rxStartTime;  //  Timestamp when the response timer started.
+  unsigned long rxTimeout;  //  Milliseconds to wait for the response after sending.
+  unsigned long rxLastTime;  //  Timestamp of the last char received.
+  bool rxLineStarted;  //  True if chars have been received after the last marker.
+  uint8_t rxExpectedMarkers;  //  Number of '\r' markers expected in the response.
+  uint8_t rxActualMarkers;  //  Number of '\r' markers seen in the response.
+  String rxResponse;  //  Response received so far, without markers.
+  ResponseParser rxParser;  //  Recognises OK and the downlink bytes as the response arrives.
+  bool rxDownlink;  //  True if we expect "OK" followed by a downlink "RX=" line.
+  uint8_t markerPos[WISOL_MARKER_POS_MAX];  //  Where in the response the markers were seen.
+  WisolError lastError;  //  Reason for the failure of the last command or send.
+
+  //  State of the asynchronous send.
+  SendStep sendStep;  //  Current step of the send.
+  bool sendGetResponse;  //  True if downlink response requested.
+  String sendMessageBuffer;  //  Argument of the AT$SF command to be sent after the presend steps.
+  String sendResponse;  //  Downlink response of the last completed send.
+  uint8_t sendDownlink[MAX_BYTES_PER_DOWNLINK];  //  Downlink bytes of the last completed send.
+  uint8_t sendDownlinkLength;  //  Number of downlink bytes of the last completed send.
+  SendCallback sendCallback;  //  Function to be called when the send completes.
+
+  //  For RCZ2, 4: Last result of the AT$GI? channel check, valid if channelChecked is true.
+  bool channelChecked;  //  True if channelX and channelY are known.
+  uint8_t channelX;  //  X returned by AT$GI?: 0 if the channels must be reset.
+  uint8_t channelY;  //  Y returned by AT$GI?: number of free micro channels.
+  uint8_t channelUplinks;  //  Number of uplinks sent since the channel check.
+  unsigned long channelQueryStart;  //  Timestamp when the last AT$GI? was sent.
+  WisolChannelStats channelStats;  //  Counters for the channel check.
+
+  //  Power state of the module.
+  void updatePowerStats();  //  Add the time spent in the current power state.
+  bool sleeping;  //  True if the module is in sleep mode.
+  unsigned long powerStateStart;  //  Timestamp when the time in the current power state was last added.
+  WisolPowerStats powerStats;  //  Time spent in each power state.
+#if UNABIZ_COMMAND_STATS
+  CommandStats commandStats;  //  Round-trip time and bytes for each command.
+  unsigned long commandStartTime;  //  Timestamp when the first char of the command was sent.
+#endif  //  UNABIZ_COMMAND_STATS
 };
 
 #endif // UNABIZ_ARDUINO_WISOL_H
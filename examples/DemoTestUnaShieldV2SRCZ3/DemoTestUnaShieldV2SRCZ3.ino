@@ -36,7 +36,7 @@ void loop() {  //  Will be called repeatedly.
   transceiver.getVoltage(voltage);
 
   //  Convert the numeric counter, temperature and voltage into a compact message with binary fields.
-  Message msg(transceiver);  //  Will contain the structured sensor data.
+  Message<UnaShieldV2S> msg(transceiver);  //  Will contain the structured sensor data.
   msg.addField("ctr", counter);  //  4 bytes for the counter.
   msg.addField("tmp", temperature);  //  4 bytes for the temperature.
   msg.addField("vlt", voltage);  //  4 bytes for the voltage.
@@ -1,8 +1,10 @@
 //  Send sensor data from 3 Digital Input ports on the Arduino as a Structured Sigfox message,
-//  using the UnaBiz UnaShield V2S Arduino Shield. Data is sent as soon as the values have
-//  changed, or when no data has been sent for 30 seconds. The Arduino Uno onboard LED will flash every
+//  using the UnaBiz UnaShield V2S Arduino Shield. Data is queued as soon as the values have
+//  changed, or when no data has been sent for 30 seconds, and sent within the Sigfox message budget
+//  of the country (1 message every 10 minutes in RCZ1, 140 messages per day elsewhere). The Arduino Uno onboard LED will flash every
 //  few seconds when the sketch is running properly. The program manages
-//  multitasking by using a Finite State Machine: https://github.com/jonblack/arduino-fsm
+//  multitasking by running each input and the transceiver as a task of the library's TaskScheduler,
+//  which powers down the Arduino when no event is pending.
 //
 //  The data is sent in the Structured Message Format, which requires a decoding function in the receiving cloud:
 //  https://github.com/UnaBiz/sigfox-iot-cloud/blob/master/decodeStructuredMessage/structuredMessage.js
@@ -12,10 +14,14 @@
 //  - Pressing the push button on the UnaShield sends sw1=1 immediately upon pressing
 //  - Releasing the push button sends sw1=10 immediately upon release
 //  - If no messages sent in 30 seconds, it will send the last value of sw1
+//  - Changes that arrive while the message budget is used up are merged, so only the latest value
+//    of sw1 is sent when the budget allows.  For development, change "uplinkBudget" below
+//    to send more often.
 //  - There is a lag before the value appears in Ubidots, before optimisation
 //
 //  For minimal latency:
 //  - Set "echo=false" in the "transceiver" settings below
+//  - Set UNABIZ_LOG_LEVEL to 0 in SIGFOX.h, so that the library doesn't build the log messages at all
 //  - Set the Ubidots Adapter sigfox-iot-ubidots to use the UDP Ubidots API: "UBIDOTS_API=UDP"
 //    https://github.com/UnaBiz/sigfox-iot-ubidots/tree/socket
 //  - After tuning, thet latency from Arduino Serial Monitor to Sigfox to Google Cloud Ubidots is roughly 5 seconds:
@@ -32,17 +38,20 @@ static const bool useEmulator = false;  //  Set to true if using Sigfox Emulator
 static const bool echo = true;          //  Set to true if the Sigfox library should display the executed commands.
 static const Country country = COUNTRY_SG;  //  Set this to your country to configure the Sigfox transmission frequencies.
 static UnaShieldV2S transceiver(country, useEmulator, device, echo);  //  Assumes you are using UnaBiz UnaShield V2S Dev Kit
+// static UnaShieldV2S transceiver(country, useEmulator, device, echo, &Serial1);  //  Uncomment this for Mega, Leonardo or SAMD with the module wired to Serial1.  Input interrupts are not blocked while sending.
+static UplinkBudget uplinkBudget(country);  //  Sigfox message budget for the country.  For development, use
+                                            //  uplinkBudget(30 * 1000UL, 1) to send every 30 seconds.
+static UplinkQueue uplinkQueue(uplinkBudget);  //  Messages waiting for the budget to allow sending.
 
 //  End Sigfox Transceiver Declaration
 ////////////////////////////////////////////////////////////
 
 ////////////////////////////////////////////////////////////
-//  Begin Sensor Transitions - Add your sensor declarations and code here
+////////////////////////////////////////////////////////////
+//  Begin Sensor Tasks - Add your sensor declarations and code here
 //  Don't use ports D0, D1: Reserved for viewing debug output through Arduino Serial Monitor
 //  Don't use ports D4, D5: Reserved for serial comms with the Sigfox module.
 
-#include "Fsm.h"  //  If missing, install from https://github.com/jonblack/arduino-fsm
-
 //  TODO: When sending the input data, we will multiply by SEND_INPUT_MULTIPLIER and add SEND_INPUT_OFFSET
 //  So input value "0" will be sent as "1" and input value "1" will be sent as "10".
 //  This is to work around a bug in Structured Message Decoder that doesn't decode "0" properly.
@@ -53,90 +62,60 @@ static const int SEND_INPUT_OFFSET = 1;
 static const int DIGITAL_INPUT_PIN1 = 6;  //  Check for input on D6, which is connected to the pushbutton on the UnaShield V2S.
 static const int DIGITAL_INPUT_PIN2 = -1;  //  "-1" means currently unused.
 static const int DIGITAL_INPUT_PIN3 = -1;  //  "-1" means currently unused.
-
-//  Finite State Machine Events that will be triggered.  Assign a unique value to each event.
-static const int INPUT_CHANGED = 1;
-static const int INPUT_SENT = 2;
-
-//  Declare the Finite State Machine Functions that we will define later.
-void checkInput1(); void checkInput2(); void checkInput3();
-void input1IdleToSending(); void input2IdleToSending(); void input3IdleToSending();
-void input1SendingToIdle(); void input2SendingToIdle(); void input3SendingToIdle();
-void input1IdleToIdle(); void input2IdleToIdle(); void input3IdleToIdle();
-void checkPin(Fsm *fsm, int inputNum, int inputPin);
-void whenTransceiverIdle(); void whenTransceiverSending();
-
-//  Declare the Finite State Machine States for each input and for the Sigfox transceiver.
-//  Each state has 3 properties:
-//  "When Entering State" - The function to run when entering this state
-//  "When Inside State" - The function to run repeatedly when we are in this state
-//  "When Exiting State" - The function to run when exiting this state and entering another state.
-//  Refer to the diagram: https://github.com/UnaBiz/unabiz-arduino/blob/master/examples/multiple_inputs/finite_state_machine.png
-
-//    Name of state   Enter  When inside state   Exit
-State input1Idle(     0,     &checkInput1,       0);  // In "Idle" state, we check
-State input2Idle(     0,     &checkInput2,       0);  // the input repeatedly for changes.
-State input3Idle(     0,     &checkInput3,       0);
-State input1Sending(  0,     0,                  0);  // In "Sending" state, we stop
-State input2Sending(  0,     0,                  0);  // checking the input temporarily
-State input3Sending(  0,     0,                  0);  // while the transceiver is sending.
-
-//    Name of state       Enter  When inside state         When exiting state
-State transceiverIdle(    0,     &whenTransceiverIdle,     0);  // Transceiver is idle until any input changes.
-State transceiverSending( 0,     &whenTransceiverSending,  0);  // Transceiver enters "Sending" state to send changed inputs.
-State transceiverSent(    0,     0,                        0);  // After sending, it waits 2.1 seconds in "Sent" state before going to "Idle" state.
-
-//  Declare the Finite State Machines for each input and for the Sigfox transceiver.
-//  Name of Finite State Machine    Starting state
-Fsm input1Fsm(                      &input1Idle);
-Fsm input2Fsm(                      &input2Idle);
-Fsm input3Fsm(                      &input3Idle);
-Fsm transceiverFsm(                 &transceiverIdle);
-
-int lastInputValues[] = {0, 0, 0};  //  Remember the last value of each input.
-
-void addSensorTransitions() {
-  //  Add the Finite State Machine Transitions for the sensors.
-  //  Each state has 4 properties:
-  //  "From State" - The starting state of the transition
-  //  "To State" - The ending state of the transition
-  //  "Triggering Event" - The event that will trigger the transition.
-  //  "When Transitioning States" - The function to run when the state transition occurs.
-
-  //                        From state   To state        Triggering event When transitioning states
-  input1Fsm.add_transition( &input1Idle, &input1Sending, INPUT_CHANGED,   &input1IdleToSending); // If the input has changed while
-  input2Fsm.add_transition( &input2Idle, &input2Sending, INPUT_CHANGED,   &input2IdleToSending); // in the "Idle" state, send the input
-  input3Fsm.add_transition( &input3Idle, &input3Sending, INPUT_CHANGED,   &input3IdleToSending); // and go to the "Sending" state,
-                                                                                                 // which will temporarily stop checking the input.
-
-  input1Fsm.add_transition( &input1Sending, &input1Idle, INPUT_SENT,      &input1SendingToIdle); // If we are in the "Sending" state and
-  input2Fsm.add_transition( &input2Sending, &input2Idle, INPUT_SENT,      &input2SendingToIdle); // transceiver notifies us that the input
-  input3Fsm.add_transition( &input3Sending, &input3Idle, INPUT_SENT,      &input3SendingToIdle); // has been sent, go into "Idle" state
-                                                                                                 // and resume checking the input.
-
-  input1Fsm.add_transition( &input1Idle, &input1Idle,    INPUT_SENT,      &input1IdleToIdle); //  If the input has been sent and
-  input2Fsm.add_transition( &input2Idle, &input2Idle,    INPUT_SENT,      &input2IdleToIdle); // we are in "Idle" state, do nothing.
-  input3Fsm.add_transition( &input3Idle, &input3Idle,    INPUT_SENT,      &input3IdleToIdle);
+static const unsigned long INPUT_CHECK_INTERVAL = 50;  //  Check the inputs every 50 milliseconds.
+
+//  Set to true to power down the Arduino between events.  A change on DIGITAL_INPUT_PIN1 wakes it up.
+static const bool idleSleep = true;
+
+//  Events that will be posted to the tasks.  Assign a unique value from 0 to 15 to each event.
+static const uint8_t INPUT_CHECK = 0;  //  Time to check the input.
+static const uint8_t INPUT_CHANGED = 1;  //  An input has changed.
+static const uint8_t INPUT_SENT = 2;  //  The transceiver has sent the inputs.
+static const uint8_t SEND_DONE = 3;  //  The asynchronous send has completed.
+static const uint8_t TRANSCEIVER_TIMEOUT = 4;  //  The transceiver has waited long enough in its state.
+
+//  Each input and the Sigfox transceiver is a task that handles one event at a time.  The scheduler
+//  delivers the events and the timers, and powers down the Arduino when nothing is pending.
+//  Refer to the diagram of the states: https://github.com/UnaBiz/unabiz-arduino/blob/master/examples/multiple_inputs/finite_state_machine.png
+static TaskScheduler scheduler;
+static int inputTasks[] = {-1, -1, -1};  //  Task number of each input.
+static int transceiverTask = -1;  //  Task number of the transceiver.
+
+//  In "Idle" state, we check the input every INPUT_CHECK_INTERVAL for changes.  In "Sending" state,
+//  we stop checking the input temporarily while the transceiver is sending.
+static const int inputPins[] = {DIGITAL_INPUT_PIN1, DIGITAL_INPUT_PIN2, DIGITAL_INPUT_PIN3};
+static bool inputSending[] = {false, false, false};  //  True if the input is in "Sending" state.
+static int lastInputValues[] = {0, 0, 0};  //  Remember the last value of each input.
+
+void handleInput(int inputNum, uint8_t event);
+void input1Task(uint8_t event) { handleInput(0, event); }
+void input2Task(uint8_t event) { handleInput(1, event); }
+void input3Task(uint8_t event) { handleInput(2, event); }
+void transceiverTaskHandler(uint8_t event);
+void enterTransceiverIdle(); void transceiverSendCompleted(SendStatus sendStatus); void notifyInputsSent();
+
+void addSensorTasks() {
+  //  Add the tasks for the inputs that are used, and start checking them.
+  static const TaskHandler handlers[] = {&input1Task, &input2Task, &input3Task};
+  for (int i = 0; i < 3; i++) {
+    if (inputPins[i] < 0) continue;
+    inputTasks[i] = scheduler.addTask(handlers[i]);
+    scheduler.post(inputTasks[i], INPUT_CHECK);
+  }
 }
 
 void initSensors() {
   //  Initialise the sensors here, if necessary.
 }
 
-//  Check the inputs #1, #2, #3.  If any input has changed, trigger the INPUT_CHANGED event.
-//                             Finite State Machine   Input Number - 1  Digital Input Pin
-void checkInput1() { checkPin( &input1Fsm,            0,                DIGITAL_INPUT_PIN1); }
-void checkInput2() { checkPin( &input2Fsm,            1,                DIGITAL_INPUT_PIN2); }
-void checkInput3() { checkPin( &input3Fsm,            2,                DIGITAL_INPUT_PIN3); }
-
-Message composeSensorMessage() {
+Message<UnaShieldV2S> composeSensorMessage() {
   //  Compose the Structured Message contain field names and values, total 12 bytes.
   //  This requires a decoding function in the receiving cloud (e.g. Google Cloud) to decode the message.
-  //  This is called when the transceiver is ready to send a message.
+  //  This is called when any input has changed, and when nothing has been sent for 30 seconds.
   //  We will send the 3 inputs as sensor fields named "sw1", "sw2", "sw3".
   //  We will multply by SEND_INPUT_MULTIPLIER and add SEND_INPUT_OFFSET before sending.
   Serial.println(F("Composing sensor message..."));
-  Message msg(transceiver);  //  Will contain the structured sensor data.
+  Message<UnaShieldV2S> msg(transceiver);  //  Will contain the structured sensor data.
   msg.addField("sw1", (lastInputValues[0] * SEND_INPUT_MULTIPLIER) + SEND_INPUT_OFFSET);  //  4 bytes for the first input.
   msg.addField("sw2", (lastInputValues[1] * SEND_INPUT_MULTIPLIER) + SEND_INPUT_OFFSET);  //  4 bytes for the second input.
   msg.addField("sw3", (lastInputValues[2] * SEND_INPUT_MULTIPLIER) + SEND_INPUT_OFFSET);  //  4 bytes for the third input.
@@ -144,8 +123,8 @@ Message composeSensorMessage() {
   return msg;
 }
 
-void checkPin(Fsm *fsm, int inputNum, int inputPin) {
-  //  Check whether input #inputNum has changed. If so, trigger the INPUT_CHANGED event.
+void checkPin(int inputNum, int inputPin) {
+  //  Check whether input #inputNum has changed. If so, post the INPUT_CHANGED event.
   //  inputNum is in the range 0 to 2.
   //  Read the input pin.
   int inputValue = digitalRead(inputPin);
@@ -154,73 +133,108 @@ void checkPin(Fsm *fsm, int inputNum, int inputPin) {
   lastInputValues[inputNum] = inputValue;
   //  Compare the new and old values of the input.
   if (inputValue != lastInputValue) {
-    //  If changed, trigger a transition.
+    //  If changed, go to "Sending" state, which will temporarily stop checking the input.
     Serial.print(F("Input #")); Serial.print(inputNum + 1);
     Serial.print(F(" Pin ")); Serial.print(inputPin);
     Serial.print(F(" changed from ")); Serial.print(lastInputValue);
     Serial.print(F(" to ")); Serial.println(inputValue);
-    //  Transition from "Idle" state to "Sending" state, which will temporarily stop checking the input.
     Serial.print(F("Input #")); Serial.print(inputNum + 1);
-    Serial.println(F(" triggering INPUT_CHANGED to transceiver and itself"));
-    fsm->trigger(INPUT_CHANGED);
-    //  Tell Sigfox transceiver we got something to send from input 1.
-    transceiverFsm.trigger(INPUT_CHANGED);
+    Serial.println(F(" posting INPUT_CHANGED to transceiver and itself"));
+    scheduler.post(inputTasks[inputNum], INPUT_CHANGED);
+    //  Queue the sensor values.  This replaces any queued sensor values that have not been sent.
+    Message<UnaShieldV2S> msg = composeSensorMessage();
+    uplinkQueue.add(msg, UPLINK_PRIORITY_NORMAL);
+    //  Tell Sigfox transceiver we got something to send.
+    scheduler.post(transceiverTask, INPUT_CHANGED);
   }
 }
 
-//  Show debug messages to trace the states of the inputs.
-void input1IdleToSending() { Serial.println(F("Input #1 requested to send")); }
-void input2IdleToSending() { Serial.println(F("Input #2 requested to send")); }
-void input3IdleToSending() { Serial.println(F("Input #3 requested to send")); }
-void input1SendingToIdle() { Serial.println(F("Input #1 Idle now")); }
-void input2SendingToIdle() { Serial.println(F("Input #2 Idle now")); }
-void input3SendingToIdle() { Serial.println(F("Input #3 Idle now")); }
-void input1IdleToIdle() { Serial.println(F("Input #1 stays idle")); }
-void input2IdleToIdle() { Serial.println(F("Input #2 stays idle")); }
-void input3IdleToIdle() { Serial.println(F("Input #3 stays idle")); }
-
-//  End Sensor Transitions
+void handleInput(int inputNum, uint8_t event) {
+  //  Handle the event for input #inputNum, in the range 0 to 2.
+  switch (event) {
+    case INPUT_CHECK:  //  Check the input and check again later.  Any pin change also wakes us up.
+      if (!inputSending[inputNum]) checkPin(inputNum, inputPins[inputNum]);
+      scheduler.setTimer(inputTasks[inputNum], INPUT_CHECK, INPUT_CHECK_INTERVAL);
+      break;
+    case INPUT_CHANGED:  //  Stop checking the input until the transceiver has sent it.
+      Serial.print(F("Input #")); Serial.print(inputNum + 1); Serial.println(F(" requested to send"));
+      inputSending[inputNum] = true;
+      break;
+    case INPUT_SENT:  //  Resume checking the input.
+      Serial.print(F("Input #")); Serial.print(inputNum + 1);
+      Serial.println(inputSending[inputNum] ? F(" Idle now") : F(" stays idle"));
+      inputSending[inputNum] = false;
+      break;
+  }
+}
+
+//  End Sensor Tasks
 ////////////////////////////////////////////////////////////
 
 ////////////////////////////////////////////////////////////
-//  Begin Sigfox Transceiver Transitions - Should not be modified
-
-int pendingResend = 0; //  How many times we have been asked to resend while the transceiver is already sending.
-
-void addTransceiverTransitions() {
-  //  Add the Finite State Machine Transitions for the transceiver.
-
-  //  From state           To state             Triggering event   When transitioning states
-  transceiverFsm.add_transition(                                   //  If inputs have changed when idle, send the inputs.
-      &transceiverIdle,    &transceiverSending, INPUT_CHANGED,     0);
-  transceiverFsm.add_transition(                                   //  If inputs have changed when busy, send the inputs later.
-      &transceiverSending, &transceiverSending, INPUT_CHANGED,     &scheduleResend);
-  transceiverFsm.add_transition(                                   //  When inputs have been sent, go to the "Sent" state
-      &transceiverSending, &transceiverSent,    INPUT_SENT,        0);  //  and wait 2.1 seconds.
-  transceiverFsm.add_transition(                                   //  If inputs have changed when busy, send the inputs later.
-      &transceiverSent,    &transceiverSent,    INPUT_CHANGED,     &scheduleResend);
-
-  //  From state           To state             Interval (millisecs) When transitioning states
-  transceiverFsm.add_timed_transition(                               //  Wait 2.1 seconds before next send.  Else the transceiver library
-      &transceiverSent,    &transceiverIdle,    2.1 * 1000,          &transceiverSentToIdle);  //  will reject the send.
-  transceiverFsm.add_timed_transition(                               //  If nothing has been sent in the past 30 seconds,
-      &transceiverIdle,    &transceiverSending, 30 * 1000,           &transceiverIdleToSending);  //  send the inputs.
+//  Begin Sigfox Transceiver Task - Should not be modified
+
+static const unsigned long IDLE_SEND_INTERVAL = 30 * 1000UL;  //  If nothing sent in 30 seconds, send the inputs.
+static const unsigned long SENT_PAUSE = 2100;  //  Wait 2.1 seconds after sending.  Else the transceiver library will reject the send.
+
+//  States of the transceiver task.
+enum TransceiverState {
+  TRANSCEIVER_IDLE,  //  Transceiver is idle until any input changes.
+  TRANSCEIVER_SENDING,  //  Transceiver is sending the queued inputs in the background.
+  TRANSCEIVER_SENT,  //  After sending, it waits 2.1 seconds in "Sent" state before going to "Idle" state.
+};
+static TransceiverState transceiverState = TRANSCEIVER_IDLE;
+static unsigned long idleStart = 0;  //  Time when the transceiver last started idling or sending.
+static int counter = 0, successCount = 0, failCount = 0;  //  Count messages sent and failed.
+
+void addTransceiverTask() {
+  //  Add the task for the transceiver, which starts in "Idle" state.
+  transceiverTask = scheduler.addTask(&transceiverTaskHandler);
+  enterTransceiverIdle();
 }
 
-void whenTransceiverSending() {
-  //  Send the sensor values to Sigfox in a single Structured message.
-  //  This occurs when the transceiver enters the "Sending" state.
-  //  TODO: We may miss some changes to the input while sending a message.
-  //  The send operation should be converted to Finite State Machine too.
+void scheduleIdleTimeout() {
+  //  Wake up the transceiver when the message budget allows the queued messages to be sent,
+  //  or when nothing has been sent for 30 seconds.
+  const unsigned long idle = millis() - idleStart;
+  unsigned long wait = (idle >= IDLE_SEND_INTERVAL) ? 0 : IDLE_SEND_INTERVAL - idle;
+  if (uplinkQueue.getCount() > 0 && uplinkBudget.getWaitMillis() < wait) wait = uplinkBudget.getWaitMillis();
+  scheduler.setTimer(transceiverTask, TRANSCEIVER_TIMEOUT, wait);
+}
 
-  //  Compose the message with the sensor data.
-  Message msg = composeSensorMessage();
+void enterTransceiverIdle() {
+  //  Go to "Idle" state.
+  transceiverState = TRANSCEIVER_IDLE;
+  idleStart = millis();
+  scheduleIdleTimeout();
+}
 
-  //  Send the encoded structured message.
-  pendingResend = 0; //  Clear the pending resend count, so we will know when transceiver has been asked to resend.
-  static int counter = 0, successCount = 0, failCount = 0;  //  Count messages sent and failed.
+void transceiverStartSending() {
+  //  Start sending the sensor values to Sigfox in a single Structured message.  The send runs
+  //  in the background while we continue checking the inputs.  The scheduler posts SEND_DONE
+  //  to the transceiver task when the send completes.
+  //  Take the next queued message, highest priority first, if the message budget allows.
+  uint8_t payload[MAX_BYTES_PER_MESSAGE]; uint8_t length = 0;
+  if (!uplinkQueue.take(payload, length)) {
+    Serial.print(F("Transceiver waiting for message budget, seconds: "));
+    Serial.println(uplinkBudget.getWaitMillis() / 1000);
+    notifyInputsSent();  //  The message stays queued, so the inputs may resume checking.
+    enterTransceiverIdle();  //  Nothing sent.  Try again when the budget allows.
+    return;
+  }
+  //  Start sending the encoded structured message.
+  char hex[MAX_BYTES_PER_MESSAGE * 2 + 1];
   Serial.print(F("\nTransceiver Sending message #")); Serial.println(counter);
-  if (msg.send()) {
+  scheduler.cancelTimer(transceiverTask);
+  transceiverState = TRANSCEIVER_SENDING;
+  if (!scheduler.sendAsync(transceiver, bytesToHex(payload, length, hex), transceiverTask, SEND_DONE)) {
+    transceiverSendCompleted(SEND_FAILED);  //  Unable to start the send.
+  }
+}
+
+void transceiverSendCompleted(SendStatus sendStatus) {
+  //  The send has completed.  Count the message and notify the inputs.
+  if (sendStatus == SEND_OK) {
     successCount++;  //  If successful, count the message sent successfully.
   } else {
     failCount++;  //  If failed, count the message that could not be sent.
@@ -240,32 +254,61 @@ void whenTransceiverSending() {
     Serial.print(F(", failed: "));  Serial.println(failCount);
   }
   //  Switch the transceiver to the "Sent" state, which waits 2.1 seconds before next send.
-  Serial.println(F("Transceiver Sending completed, now triggering INPUT_SENT to all inputs and itself and pausing..."));
-  if (DIGITAL_INPUT_PIN1 >= 0) input1Fsm.trigger(INPUT_SENT);
-  if (DIGITAL_INPUT_PIN2 >= 0) input2Fsm.trigger(INPUT_SENT);
-  if (DIGITAL_INPUT_PIN3 >= 0) input3Fsm.trigger(INPUT_SENT);
-  transceiverFsm.trigger(INPUT_SENT);
+  Serial.println(F("Transceiver Sending completed, now posting INPUT_SENT to all inputs and pausing..."));
+  notifyInputsSent();
+  transceiverState = TRANSCEIVER_SENT;
+  scheduler.setTimer(transceiverTask, TRANSCEIVER_TIMEOUT, SENT_PAUSE);
 }
 
-void whenTransceiverIdle() {
-  //  The transceiver has just finished waiting 2.1 seconds.  If there are pending resend requests, send now.
-  if (pendingResend > 0) {
-    Serial.println(F("Transceiver Idle, sending pending requests..."));
-    transceiverFsm.trigger(INPUT_CHANGED);
+void notifyInputsSent() {
+  //  Post INPUT_SENT to all inputs, so that they resume checking.
+  for (int i = 0; i < 3; i++) {
+    if (inputTasks[i] >= 0) scheduler.post(inputTasks[i], INPUT_SENT);
   }
 }
 
-void scheduleResend() {
-  //  The transceiver is already sending now, can't resend now.  Wait till idle in 2.1 seconds to resend.
-  Serial.println(F("Transceiver is busy now, will send pending requests later"));
-  pendingResend++;
+void transceiverTaskHandler(uint8_t event) {
+  //  Handle the event for the transceiver in its current state.
+  switch (transceiverState) {
+    case TRANSCEIVER_IDLE:
+      if (event == INPUT_CHANGED) {
+        transceiverStartSending();  //  If inputs have changed when idle, send the inputs.
+      } else if (event == TRANSCEIVER_TIMEOUT) {
+        if (uplinkQueue.getCount() > 0 && uplinkBudget.isAvailable()) {
+          Serial.println(F("Transceiver Idle, sending queued messages..."));
+          transceiverStartSending();
+        } else if (millis() - idleStart >= IDLE_SEND_INTERVAL) {
+          //  Nothing sent for 30 seconds.  Queue the last sensor values, unless newer values are already queued.
+          Serial.println(F("Transceiver Idle is now sending after idle period..."));
+          Message<UnaShieldV2S> msg = composeSensorMessage();
+          uplinkQueue.add(msg, UPLINK_PRIORITY_LOW);
+          transceiverStartSending();
+        } else {
+          scheduleIdleTimeout();  //  Woken up too early.
+        }
+      }
+      break;
+    case TRANSCEIVER_SENDING:
+      if (event == SEND_DONE) {
+        transceiverSendCompleted(scheduler.getSendStatus());  //  When inputs have been sent, go to the "Sent" state.
+      } else if (event == INPUT_CHANGED) {
+        //  The transceiver is already sending now, can't send now.  The inputs have been queued
+        //  and will be sent when idle.
+        Serial.println(F("Transceiver is busy now, will send queued messages later"));
+      }
+      break;
+    case TRANSCEIVER_SENT:
+      if (event == TRANSCEIVER_TIMEOUT) {
+        Serial.println(F("Transceiver Idle now"));  //  Waited 2.1 seconds.  Go to "Idle" state.
+        enterTransceiverIdle();
+      } else if (event == INPUT_CHANGED) {
+        Serial.println(F("Transceiver is busy now, will send queued messages later"));
+      }
+      break;
+  }
 }
 
-//  Show the transceiver transitions taking place.
-void transceiverSentToIdle() { Serial.println(F("Transceiver Idle now")); }
-void transceiverIdleToSending() { Serial.println(F("Transceiver Idle is now sending after idle period...")); }
-
-//  End Sigfox Transceiver Transitions
+//  End Sigfox Transceiver Task
 ////////////////////////////////////////////////////////////
 
 ////////////////////////////////////////////////////////////
@@ -280,22 +323,20 @@ void setup() {  //  Will be called only once.
   //  Initialize the sensors.
   initSensors();
 
-  //  Add the sensor and transceiver transitions for the Finite State Machine.
-  addSensorTransitions();
-  addTransceiverTransitions();
-
   //  Check whether the Sigfox module is functioning.
   if (!transceiver.begin()) stop("Unable to init Sigfox module, may be missing");  //  Will never return.
+
+  //  Add the sensor and transceiver tasks to the scheduler.
+  addSensorTasks();
+  addTransceiverTask();
+  //  Power down when no event is pending.  A change on input #1 wakes up its task.
+  if (idleSleep && inputTasks[0] >= 0) scheduler.setIdleSleep(true, DIGITAL_INPUT_PIN1, inputTasks[0], INPUT_CHECK);
 }
 
 void loop() {  //  Will be called repeatedly.
-  //  Execute the sensor and transceiver transitions for the Finite State Machine.
-  if (DIGITAL_INPUT_PIN1 >= 0) input1Fsm.run_machine();
-  if (DIGITAL_INPUT_PIN2 >= 0) input2Fsm.run_machine();
-  if (DIGITAL_INPUT_PIN3 >= 0) input3Fsm.run_machine();
-  transceiverFsm.run_machine();
-
-  delay(0.1 * 1000);  //  Wait 0.1 seconds between loops. Easier to debug.
+  //  Dispatch the events to the sensor and transceiver tasks.  The scheduler polls the transceiver
+  //  while sending, else it powers down until the next timer is due or the input changes.
+  scheduler.run(transceiver);
 }
 
 //  End Main Program
@@ -329,7 +370,7 @@ Running setup...
  - Getting frequency (expecting 3)...
  - Frequency (expecting 3) = 52
 Input #1 Pin 6 changed from 0 to 1
-Input #1 triggering INPUT_CHANGED to transceiver and itself
+Input #1 posting INPUT_CHANGED to transceiver and itself
 Input #1 requested to send
 Transceiver Idle is now sending after idle period...
 Composing sensor message...
@@ -352,7 +393,7 @@ Transceiver Sending message #0
 << OK0x0d
  - Wisol.sendBuffer: response: OK
 OK
-Transceiver Sending completed, now triggering INPUT_SENT to all inputs and itself and pausing...
+Transceiver Sending completed, now posting INPUT_SENT to all inputs and pausing...
 Input #1 Idle now
 Transceiver Idle now
 Transceiver Idle is now sending after idle period...
@@ -382,11 +423,11 @@ Warning: Should wait 10 mins before sending the next message
 << OK0x0d
  - Wisol.sendBuffer: response: OK
 OK
-Transceiver Sending completed, now triggering INPUT_SENT to all inputs and itself and pausing...
+Transceiver Sending completed, now posting INPUT_SENT to all inputs and pausing...
 Input #1 stays idle
 Transceiver Idle now
 Input #1 Pin 6 changed from 1 to 0
-Input #1 triggering INPUT_CHANGED to transceiver and itself
+Input #1 posting INPUT_CHANGED to transceiver and itself
 Input #1 requested to send
 Composing sensor message...
  - Message.addField: sw1=1
@@ -409,10 +450,10 @@ Warning: Should wait 10 mins before sending the next message
 << OK0x0d
  - Wisol.sendBuffer: response: OK
 OK
-Transceiver Sending completed, now triggering INPUT_SENT to all inputs and itself and pausing...
+Transceiver Sending completed, now posting INPUT_SENT to all inputs and pausing...
 Input #1 Idle now
 Input #1 Pin 6 changed from 0 to 1
-Input #1 triggering INPUT_CHANGED to transceiver and itself
+Input #1 posting INPUT_CHANGED to transceiver and itself
 Input #1 requested to send
 Transceiver is busy now, will send pending requests later
 Transceiver Idle now
@@ -443,11 +484,11 @@ Warning: Should wait 10 mins before sending the next message
 << OK0x0d
  - Wisol.sendBuffer: response: OK
 OK
-Transceiver Sending completed, now triggering INPUT_SENT to all inputs and itself and pausing...
+Transceiver Sending completed, now posting INPUT_SENT to all inputs and pausing...
 Input #1 Idle now
 Transceiver Idle now
 Input #1 Pin 6 changed from 1 to 0
-Input #1 triggering INPUT_CHANGED to transceiver and itself
+Input #1 posting INPUT_CHANGED to transceiver and itself
 Input #1 requested to send
 Composing sensor message...
  - Message.addField: sw1=1
@@ -470,10 +511,10 @@ Warning: Should wait 10 mins before sending the next message
 << OK0x0d
  - Wisol.sendBuffer: response: OK
 OK
-Transceiver Sending completed, now triggering INPUT_SENT to all inputs and itself and pausing...
+Transceiver Sending completed, now posting INPUT_SENT to all inputs and pausing...
 Input #1 Idle now
 Input #1 Pin 6 changed from 0 to 1
-Input #1 triggering INPUT_CHANGED to transceiver and itself
+Input #1 posting INPUT_CHANGED to transceiver and itself
 Input #1 requested to send
 Transceiver is busy now, will send pending requests later
 Transceiver Idle now
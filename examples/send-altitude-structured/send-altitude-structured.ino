@@ -126,14 +126,24 @@ void loop() {  //  Will be called repeatedly.
   //  Compose the Structured Message contain field names and values, total 12 bytes.
   //  This requires a decoding function in the receiving cloud (e.g. Google Cloud) to decode the message.
   //  If you wish to use Sigfox Custom Payload format, look at the sample sketch "send-altitude".
-  Message msg(transceiver);  //  Will contain the structured sensor data.
+  //  Only the fields that have changed beyond the deadband are added.  All fields are sent
+  //  every DELTA_KEYFRAME_INTERVAL messages so the cloud can rebuild the state.
+  static MessageDelta delta;  //  Remembers the values last sent.
+  if (counter == 0) {
+    delta.setDeadband("tmp", 0.5);  //  Ignore temperature changes up to 0.5 degrees C.
+    delta.setDeadband("hmd", 2.0);  //  Ignore humidity changes up to 2 %.
+    delta.setDeadband("alt", 5.0);  //  Ignore altitude changes up to 5 metres.
+  }
+  Message<UnaShieldV2S> msg(transceiver, delta);  //  Will contain the structured sensor data.
   msg.addField("tmp", scaledTemp);  //  4 bytes for the temperature (1 decimal place).
   msg.addField("hmd", scaledHumidity);  //  4 bytes for the humidity (1 decimal place).
   msg.addField("alt", scaledAltitude);  //  4 bytes for the altitude (1 decimal place).
   //  Total 12 bytes out of 12 bytes used.
 
-  //  Send the encoded structured message.
-  if (msg.send()) {
+  //  Send the encoded structured message, unless nothing has changed.
+  if (msg.isEmpty()) {
+    Serial.println(F("Nothing changed, skipping send"));
+  } else if (msg.send()) {
     successCount++;  //  If successful, count the message sent successfully.
   } else {
     failCount++;  //  If failed, count the message that could not be sent.
@@ -156,9 +166,13 @@ void loop() {  //  Will be called repeatedly.
   //  End SIGFOX Module Loop
   ////////////////////////////////////////////////////////////
 
-  //  Wait a while before looping. 10000 milliseconds = 10 seconds.
-  Serial.println(F("Waiting 10 seconds..."));
-  delay(10000);
+  //  Wait a while before looping. 10000 milliseconds = 10 seconds.  To save power, put the
+  //  SIGFOX module to sleep and power down the Arduino while waiting.  The module wakes up
+  //  automatically when we send the next message.
+  Serial.println(F("Sleeping 10 seconds..."));
+  transceiver.sleep();
+  Serial.flush();  //  Finish sending the debug output before powering down.
+  powerDown(10000);
 }
 /* Expected Output:
 Running setup...
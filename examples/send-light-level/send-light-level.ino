@@ -88,7 +88,7 @@ void loop() {  //  Will be called repeatedly.
   int temperature;  transceiver.getTemperature(temperature);
 
   //  Convert the numeric counter, light level and temperature into a compact message with binary fields.
-  Message msg(transceiver);  //  Will contain the structured sensor data.
+  Message<UnaShieldV1> msg(transceiver);  //  Will contain the structured sensor data.
   msg.addField("ctr", counter);  //  4 bytes for the counter.
   msg.addField("lig", light_level);  //  4 bytes for the light level.
   msg.addField("tmp", temperature);  //  4 bytes for the temperature.
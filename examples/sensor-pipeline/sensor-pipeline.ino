@@ -0,0 +1,90 @@
+//  Sample the accelerometer on the UnaShield V2S at 50 Hz and the light sensor every second, then
+//  send the min, max and mean acceleration and the mean light level as a Structured Sigfox message
+//  whenever the Sigfox message budget of the country allows (1 message every 10 minutes in RCZ1,
+//  140 messages per day elsewhere).  The SensorPipeline takes the samples and computes the
+//  aggregates, so the sketch has no timing code.  The message is sent with sendMessageAsync(),
+//  so the sampling continues while the message is being sent.
+//
+//  The data is sent in the Structured Message Format, which requires a decoding function in the receiving cloud:
+//  https://github.com/UnaBiz/sigfox-iot-cloud/blob/master/decodeStructuredMessage/structuredMessage.js
+
+////////////////////////////////////////////////////////////
+//  Begin Sigfox Transceiver Declaration - Update the settings if necessary
+
+#include "SIGFOX.h"  //  If missing, install from https://github.com/UnaBiz/unabiz-arduino
+
+//  IMPORTANT: Check these settings with UnaBiz to use the Sigfox library correctly.
+static const String device = "";        //  Set this to your device name if you're using Sigfox Emulator.
+static const bool useEmulator = false;  //  Set to true if using Sigfox Emulator.
+static const bool echo = true;          //  Set to true if the Sigfox library should display the executed commands.
+static const Country country = COUNTRY_SG;  //  Set this to your country to configure the Sigfox transmission frequencies.
+static UnaShieldV2S transceiver(country, useEmulator, device, echo);  //  Assumes you are using UnaBiz UnaShield V2S Dev Kit
+static UplinkBudget uplinkBudget(country);  //  Sigfox message budget for the country.  For development, use
+                                            //  uplinkBudget(30 * 1000UL, 1) to send every 30 seconds.
+static UplinkQueue uplinkQueue(uplinkBudget);  //  Messages waiting for the budget to allow sending.
+static SensorPipeline pipeline;  //  Samples the sensors and aggregates them for each message.
+
+//  End Sigfox Transceiver Declaration
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+//  Begin Sensor Declaration - Add your sensor samplers here
+//  Don't use ports D0, D1: Reserved for viewing debug output through Arduino Serial Monitor
+//  Don't use ports D4, D5: Reserved for serial comms with the Sigfox module.
+
+#include <Wire.h>
+#include <Adafruit_MMA8451.h>  //  If missing, install the Adafruit MMA8451 library.
+#include <Adafruit_Sensor.h>
+
+static Adafruit_MMA8451 mma = Adafruit_MMA8451();
+static const int LIGHT_SENSOR_PIN = A0;  //  Analog pin for the light sensor.
+
+bool readAcceleration(int &value) {
+  //  Return the acceleration on the Z axis in m/s^2, scaled by 10.
+  sensors_event_t event;
+  mma.getEvent(&event);
+  value = (int) (event.acceleration.z * 10.0);
+  return true;
+}
+
+bool readLight(int &value) {
+  //  Return the light level from 0 to 1023, scaled by 10.
+  value = analogRead(LIGHT_SENSOR_PIN) * 10;
+  return true;
+}
+
+void initSensors() {
+  //  Register the samplers and the fields to be sent.  Up to 3 fields fit into a message.
+  if (!mma.begin(0x1c)) stop(F("MMA8451 not found"));  //  NOTE: Must use 0x1c for UnaShield V2S
+  mma.setRange(MMA8451_RANGE_2_G);
+  const int accel = pipeline.addChannel(&readAcceleration, 20);  //  50 Hz.
+  const int light = pipeline.addChannel(&readLight, 1000);  //  1 Hz.
+  pipeline.addField("acc", accel, SENSOR_MAX);
+  pipeline.addField("acm", accel, SENSOR_MEAN);
+  pipeline.addField("lig", light, SENSOR_MEAN);
+}
+
+//  End Sensor Declaration
+////////////////////////////////////////////////////////////
+
+void setup() {
+  //  Initialize console serial communication at 9600 bits per second:
+  Serial.begin(9600);
+  Serial.println(F("Running setup..."));
+  //  Check whether the SIGFOX module is functioning.
+  if (!transceiver.begin()) stop(F("Unable to init SIGFOX module, may be missing"));  //  Will never return.
+  initSensors();
+}
+
+void loop() {
+  //  Take the samples that are due, queue the aggregates when the budget allows, and send them.
+  pipeline.poll();
+  pipeline.queueFields(transceiver, uplinkQueue);
+  if (transceiver.isBusy()) {
+    transceiver.poll();  //  Continue sending the message.
+    return;
+  }
+  uint8_t payload[MAX_BYTES_PER_MESSAGE], length = 0;
+  char hex[MAX_BYTES_PER_MESSAGE * 2 + 1];
+  if (uplinkQueue.take(payload, length)) transceiver.sendMessageAsync(bytesToHex(payload, length, hex));
+}
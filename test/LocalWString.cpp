@@ -22,6 +22,8 @@
 
 #include "LocalWString.h"
 
+unsigned long stringAllocations = 0;  //  Number of heap allocations by String, counted for the benchmark.
+
 /*********************************************/
 /*  Constructors                             */
 /*********************************************/
@@ -156,6 +158,7 @@ unsigned char String::reserve(unsigned int size)
 unsigned char String::changeBuffer(unsigned int maxStrLen)
 {
 	char *newbuffer = (char *)realloc(buffer, maxStrLen + 1);
+	stringAllocations++;
 	if (newbuffer) {
 		buffer = newbuffer;
 		capacity = maxStrLen;
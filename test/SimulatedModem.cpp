@@ -0,0 +1,322 @@
+//  Simulated SIGFOX modules for testing the transceivers under Windows or Mac without Arduino.
+//  Each module responds to the commands received through SoftwareSerial on the virtual clock,
+//  at the bit rate of the serial port.  Uses plain char buffers so that the String heap
+//  allocations counted by the benchmark come only from the library.
+#ifndef ARDUINO
+#include <string.h>
+
+//  Bytes sent and received on the serial port, counted for the benchmark.
+unsigned long serialTxBytes = 0;
+unsigned long serialRxBytes = 0;
+
+class SimulatedModem {
+public:
+  SimulatedModem(): unknownCommands(0), head(0), tail(0), lastReadyMicros(0), charMicros(1042) {}
+  virtual ~SimulatedModem() {}
+
+  void setBitsPerSecond(unsigned long bps) {
+    //  Time to transmit 1 char: start bit + 8 data bits + stop bit.
+    charMicros = 10 * 1000000UL / bps;
+  }
+
+  unsigned long getCharMicros() { return charMicros; }
+
+  void receive(uint8_t ch) {
+    //  Called when the transceiver has transmitted a char to the module.
+    process(ch);
+  }
+
+  int available() {
+    //  Return the number of chars that have arrived by now.
+    int count = 0;
+    for (unsigned int i = tail; i != head; i = (i + 1) % queueSize) {
+      if (queue[i].readyMicros > getVirtualMicros()) break;
+      count++;
+    }
+    return count;
+  }
+
+  int read() {
+    //  Return the next char that has arrived by now, or -1 if none.
+    if (tail == head || queue[tail].readyMicros > getVirtualMicros()) return -1;
+    const uint8_t ch = queue[tail].ch;
+    tail = (tail + 1) % queueSize;
+    return ch;
+  }
+
+  unsigned int unknownCommands;  //  Number of commands the module didn't recognise.
+
+protected:
+  virtual void process(uint8_t ch) = 0;  //  Handle the char received from the transceiver.
+
+  void reply(const uint8_t *bytes, unsigned int length, unsigned long delayMillis) {
+    //  Send the bytes to the transceiver after delayMillis, one char time apart.
+    unsigned long long readyMicros = getVirtualMicros() + (unsigned long long) delayMillis * 1000;
+    if (readyMicros < lastReadyMicros) readyMicros = lastReadyMicros;
+    for (unsigned int i = 0; i < length; i++) {
+      const unsigned int next = (head + 1) % queueSize;
+      if (next == tail) return;  //  Queue full, drop the chars.
+      readyMicros += charMicros;
+      queue[head].ch = bytes[i];
+      queue[head].readyMicros = readyMicros;
+      head = next;
+    }
+    lastReadyMicros = readyMicros;
+  }
+
+  void reply(const char *s, unsigned long delayMillis = 0) {
+    reply((const uint8_t *) s, strlen(s), delayMillis);
+  }
+
+private:
+  static const unsigned int queueSize = 512;
+  struct Pending {
+    uint8_t ch;  //  Char to be received.
+    unsigned long long readyMicros;  //  Virtual time when the char has arrived.
+  };
+  Pending queue[queueSize];  //  Chars sent by the module, in order of arrival.
+  unsigned int head, tail;
+  unsigned long long lastReadyMicros;  //  Arrival time of the last queued char.
+  unsigned long charMicros;  //  Time to transmit 1 char.
+};
+
+SimulatedModem *simulatedModem = 0;  //  Module connected to all SoftwareSerial ports, or 0 if none.
+
+//  Simulated uplink and downlink times.  An uplink is sent 3 times, about 2 seconds each.
+const unsigned long SIMULATED_COMMAND_MILLIS = 10;
+const unsigned long SIMULATED_UPLINK_MILLIS = 6000;
+const unsigned long SIMULATED_DOWNLINK_MILLIS = 20000;
+
+//  Line-based AT command module.  Calls command() for each line ending with '\r'.
+class SimulatedATModem: public SimulatedModem {
+protected:
+  SimulatedATModem(): lineLength(0) {}
+  virtual void command(const char *line) = 0;
+  virtual void process(uint8_t ch) {
+    if (ch == '\n') return;
+    if (ch != '\r') {
+      if (lineLength + 1 < sizeof(line)) line[lineLength++] = ch;
+      return;
+    }
+    line[lineLength] = 0;
+    lineLength = 0;
+    command(line);
+  }
+  static bool startsWith(const char *line, const char *prefix) {
+    return strncmp(line, prefix, strlen(prefix)) == 0;
+  }
+  static bool endsWith(const char *line, const char *suffix) {
+    const size_t len = strlen(line), suffixLen = strlen(suffix);
+    return len >= suffixLen && strcmp(line + len - suffixLen, suffix) == 0;
+  }
+private:
+  char line[64];  //  Command received so far.
+  unsigned int lineLength;
+};
+
+//  Wisol WSSFM10R module on the UnaShield V2S.  Responses end with '\r', except OK, which ends
+//  with "\r\n", e.g. "OK\r\nRX=...\r" for a downlink.
+class SimulatedWisol: public SimulatedATModem {
+public:
+  SimulatedWisol(): sleeping(false), channelsFree(3) {}
+  bool sleeping;  //  True after AT$P=1.  The next command wakes up the module and is lost.
+  uint8_t channelsFree;  //  Y returned by AT$GI?.
+protected:
+  virtual void process(uint8_t ch) {
+    if (sleeping) {
+      if (ch == '\r') sleeping = false;  //  Woken up by the command, which is lost.
+      return;
+    }
+    SimulatedATModem::process(ch);
+  }
+  virtual void command(const char *line) {
+    if (strcmp(line, "AT") == 0) reply("OK\r\n", SIMULATED_COMMAND_MILLIS);
+    else if (startsWith(line, "AT$SF=")) {
+      reply("OK\r\n", SIMULATED_UPLINK_MILLIS);
+      if (endsWith(line, ",1")) reply("RX=01 23 45 67 89 AB CD EF\r", SIMULATED_DOWNLINK_MILLIS);
+      if (channelsFree > 0) channelsFree--;
+    }
+    else if (strcmp(line, "AT$GI?") == 0) {
+      char response[] = "1,0\r";
+      response[2] = (char) ('0' + channelsFree);
+      reply(response, SIMULATED_COMMAND_MILLIS);
+    }
+    else if (strcmp(line, "AT$RC") == 0) { channelsFree = 3; reply("OK\r\n", SIMULATED_COMMAND_MILLIS); }
+    else if (strcmp(line, "AT$I=10") == 0) reply("002C30EB\r", SIMULATED_COMMAND_MILLIS);
+    else if (strcmp(line, "AT$I=11") == 0) reply("A8664B5523B5405D\r", SIMULATED_COMMAND_MILLIS);
+    else if (strcmp(line, "AT$T?") == 0) reply("322\r", SIMULATED_COMMAND_MILLIS);
+    else if (strcmp(line, "AT$V?") == 0) reply("3300\r", SIMULATED_COMMAND_MILLIS);
+    else if (strcmp(line, "AT$P=1") == 0) { reply("OK\r\n", SIMULATED_COMMAND_MILLIS); sleeping = true; }
+    else if (startsWith(line, "ATS410=") || startsWith(line, "ATS302=") ||
+             startsWith(line, "AT$IF=") || startsWith(line, "AT$DR=") ||
+             startsWith(line, "AT$CB=") || startsWith(line, "AT$P="))
+      reply("OK\r\n", SIMULATED_COMMAND_MILLIS);
+    else { unknownCommands++; reply("ERROR\r", SIMULATED_COMMAND_MILLIS); }
+  }
+};
+
+//  Telecom Design TD1208 module on the Akene shield.  Echoes each char, responses end with "\r\n".
+class SimulatedAkeru: public SimulatedATModem {
+public:
+  SimulatedAkeru(): downlinkMillis(SIMULATED_DOWNLINK_MILLIS) {}
+  unsigned long downlinkMillis;  //  Time from OK to the +RX lines.
+protected:
+  virtual void process(uint8_t ch) {
+    reply(&ch, 1, 0);  //  Echo.
+    SimulatedATModem::process(ch);
+  }
+  virtual void command(const char *line) {
+    if (strcmp(line, "AT") == 0) reply("OK\r\n", SIMULATED_COMMAND_MILLIS);
+    else if (strcmp(line, "ATI7") == 0) reply("1AE8E2\r\nOK\r\n", SIMULATED_COMMAND_MILLIS);
+    else if (strcmp(line, "ATI26") == 0) reply("25\r\nOK\r\n", SIMULATED_COMMAND_MILLIS);
+    else if (strcmp(line, "ATI27") == 0) reply("3.30\r\nOK\r\n", SIMULATED_COMMAND_MILLIS);
+    else if (startsWith(line, "AT$SS=") || startsWith(line, "AT$SB=")) {
+      reply("OK\r\n", SIMULATED_UPLINK_MILLIS);
+      if (endsWith(line, ",2,1"))
+        reply("+RX BEGIN\r\n+RX=01 23 45 67 89 AB CD EF\r\n+RX END\r\n", downlinkMillis);
+    }
+    else if (startsWith(line, "AT$IF=") || startsWith(line, "ATS302=") || strcmp(line, "AT&W") == 0)
+      reply("OK\r\n", SIMULATED_COMMAND_MILLIS);
+    else { unknownCommands++; reply("ERROR\r\n", SIMULATED_COMMAND_MILLIS); }
+  }
+};
+
+//  Radiocrafts RC1692HP-SIG module on the UnaShield V1.  Binary protocol: in Send Mode, a length
+//  byte followed by the payload.  0x00 enters Command Mode, which replies with the '>' prompt.
+class SimulatedRadiocrafts: public SimulatedModem {
+public:
+  SimulatedRadiocrafts(): mode(SIMULATED_SEND_MODE), command(0), expected(0), received(0) {
+    memset(memory, 0, sizeof(memory));
+    memory[0x00] = 3;  //  RCZ4.
+  }
+protected:
+  virtual void process(uint8_t ch) {
+    if (expected > 0) {
+      //  Collect the bytes for the current command.
+      data[received++] = ch;
+      if (received < expected) return;
+      expected = 0;
+      finish();
+      return;
+    }
+    switch (mode) {
+      case SIMULATED_SEND_MODE:
+        if (ch == 0x00) { mode = SIMULATED_COMMAND_MODE; reply(">", SIMULATED_COMMAND_MILLIS); }
+        else if (ch <= 12) start(ch, ch);  //  Payload length.
+        else unknownCommands++;
+        break;
+      case SIMULATED_COMMAND_MODE:
+        if (ch == 'X') mode = SIMULATED_SEND_MODE;
+        else if (ch == 'M') { mode = SIMULATED_CONFIG_MODE; reply(">", SIMULATED_COMMAND_MILLIS); }
+        else if (ch == '9') {
+          //  4 bytes ID (LSB first) and 8 bytes PAC (MSB first).
+          const uint8_t id[] = { 0xeb, 0x30, 0x2c, 0x00, 0xa8, 0x66, 0x4b, 0x55, 0x23, 0xb5, 0x40, 0x5d, '>' };
+          reply(id, sizeof(id), SIMULATED_COMMAND_MILLIS);
+        }
+        else if (ch == 'U') { const uint8_t temp[] = { 128 + 25, '>' }; reply(temp, 2, SIMULATED_COMMAND_MILLIS); }
+        else if (ch == 'V') { const uint8_t volt[] = { 110, '>' }; reply(volt, 2, SIMULATED_COMMAND_MILLIS); }
+        else if (ch == 'Y') { reply(">", SIMULATED_COMMAND_MILLIS); start(ch, 1); }
+        else if (ch == 'B') start(ch, 1);  //  Length byte, then payload.
+        else unknownCommands++;
+        break;
+      case SIMULATED_CONFIG_MODE:
+        if (ch == 0xff) { mode = SIMULATED_COMMAND_MODE; reply(">", SIMULATED_COMMAND_MILLIS); }
+        else { command = 'M'; data[0] = ch; received = 1; expected = 2; }  //  Address, then value.
+        break;
+    }
+  }
+private:
+  void start(uint8_t cmd, uint8_t length) { command = cmd; expected = length; received = 0; }
+  void finish() {
+    //  All bytes for the command have been received.
+    if (command == 'Y') {
+      const uint8_t value[] = { memory[data[0]], '>' };
+      reply(value, 2, SIMULATED_COMMAND_MILLIS);
+    } else if (command == 'M') {
+      memory[data[0]] = data[1];
+    } else if (command == 'B' && received == 1) {
+      start('b', data[0]);  //  Now collect the payload.
+      if (expected == 0) finish();
+    } else if (command == 'b') {
+      const uint8_t downlink[] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef, '>' };
+      reply(downlink, sizeof(downlink), SIMULATED_DOWNLINK_MILLIS);
+    }
+    //  Else uplink payload sent in Send Mode, no response.
+  }
+  enum { SIMULATED_SEND_MODE, SIMULATED_COMMAND_MODE, SIMULATED_CONFIG_MODE } mode;  //  Current mode of the module.
+  uint8_t command;  //  Command waiting for more bytes.
+  uint8_t expected, received;  //  Number of bytes expected and received for the command.
+  uint8_t data[16];  //  Bytes received for the command.
+  uint8_t memory[256];  //  Config memory.
+};
+
+//  Modules connected to the SoftwareSerial ports with these transmit pins, e.g. a second module
+//  on other pins for failover.  Other ports are connected to simulatedModem.
+const unsigned int SIMULATED_PIN_COUNT = 20;
+SimulatedModem *simulatedModemOnPin[SIMULATED_PIN_COUNT] = {0};
+
+//  SoftwareSerial port connected to simulatedModem.  If no module is connected, sent chars are
+//  printed and nothing is received.
+class SoftwareSerial: public Print {
+public:
+  SoftwareSerial(unsigned rx, unsigned tx): Print(rx, tx), txPin(tx) {}
+  void begin(long bps) { if (modem()) modem()->setBitsPerSecond(bps); }
+  void write(uint8_t ch) {
+    if (!modem()) { putchar(ch); return; }
+    //  Transmit blocks for 1 char time, then the module receives the char.
+    advanceMicros(modem()->getCharMicros());
+    serialTxBytes++;
+    modem()->receive(ch);
+  }
+  void print(char ch) { write((uint8_t) ch); }
+  void print(const char *s) { while (*s) write((uint8_t) *s++); }
+  void print(const String &s) { print(s.c_str()); }
+  int read() {
+    if (!modem()) return -1;
+    const int ch = modem()->read();
+    if (ch >= 0) serialRxBytes++;
+    return ch;
+  }
+  int available() { return modem() ? modem()->available() : 0; }
+  void flush() { while (modem() && modem()->read() >= 0) {} }  //  Discard the chars that have arrived.
+private:
+  SimulatedModem *modem() {
+    //  Return the module connected to this port, or 0 if none.
+    if (txPin < SIMULATED_PIN_COUNT && simulatedModemOnPin[txPin]) return simulatedModemOnPin[txPin];
+    return simulatedModem;
+  }
+  unsigned txPin;  //  Transmit pin of the port.
+};
+
+//  Hardware UART connected to simulatedModem.  write() returns as soon as the char is in the
+//  transmit FIFO and only waits when the FIFO is full.  For simplicity the module receives
+//  each char when it's written, not when it leaves the FIFO.
+class HardwareSerial: public Print {
+public:
+  HardwareSerial(): txIdleMicros(0) {}
+  void begin(unsigned long bps) { if (simulatedModem) simulatedModem->setBitsPerSecond(bps); }
+  size_t write(uint8_t ch) {
+    if (!simulatedModem) { putchar(ch); return 1; }
+    const unsigned long charMicros = simulatedModem->getCharMicros();
+    if (txIdleMicros < getVirtualMicros()) txIdleMicros = getVirtualMicros();
+    //  Wait for room in the FIFO.
+    const unsigned long long fifoMicros = (unsigned long long) fifoSize * charMicros;
+    if (txIdleMicros - getVirtualMicros() >= fifoMicros)
+      advanceMicros(txIdleMicros - getVirtualMicros() - fifoMicros + charMicros);
+    txIdleMicros += charMicros;
+    serialTxBytes++;
+    simulatedModem->receive(ch);
+    return 1;
+  }
+  int read() {
+    if (!simulatedModem) return -1;
+    const int ch = simulatedModem->read();
+    if (ch >= 0) serialRxBytes++;
+    return ch;
+  }
+  int available() { return simulatedModem ? simulatedModem->available() : 0; }
+private:
+  static const unsigned int fifoSize = 64;  //  Same as the Arduino AVR core.
+  unsigned long long txIdleMicros;  //  Virtual time when the FIFO will be empty.
+};
+#endif  //  ARDUINO
@@ -0,0 +1,291 @@
+//  Benchmark the transceivers under Windows or Mac without Arduino, against the simulated
+//  SIGFOX modules in SimulatedModem.cpp.  For each operation, reports the simulated time on the
+//  virtual clock, the bytes sent and received on the serial port, and the String heap allocations.
+//  Returns a non-zero exit code if any operation fails, so that it may be used as a regression gate.
+#ifndef ARDUINO
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#define UNABIZ_COMMAND_STATS 1  //  Show the round-trip time and bytes for each command.
+#include "util.cpp"
+#include "../HexCodec.cpp"
+#include "../CommandStats.cpp"
+#include "../Diagnostics.cpp"
+#include "../ResponseParser.cpp"
+#include "../PowerDown.cpp"
+#include "../Wisol.cpp"
+#include "../Radiocrafts.cpp"
+#include "../Akeru.cpp"
+#include "../Message.cpp"
+#include "../FrameStore.cpp"
+#include "../UplinkQueue.cpp"
+#include "../Failover.cpp"
+#include "../Retry.cpp"
+#include "../SensorPipeline.cpp"
+#include "../Scheduler.cpp"
+
+static int failures = 0;  //  Number of operations that failed.
+
+static double realSeconds() {
+  //  Return the real time in seconds, for the throughput measurements that don't use the virtual clock.
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+//  Measure the counters before and after an operation.
+struct BenchSample {
+  unsigned long long micros;
+  unsigned long txBytes, rxBytes, allocations;
+};
+
+static BenchSample sample() {
+  BenchSample s = { getVirtualMicros(), serialTxBytes, serialRxBytes, stringAllocations };
+  return s;
+}
+
+static void report(const char *name, const BenchSample &start, bool ok) {
+  //  Print the counters for the operation since start.
+  const BenchSample end = sample();
+  printf("%-48s %-4s %10.1f ms %6lu tx %6lu rx %6lu allocs\n", name, ok ? "ok" : "FAIL",
+         (end.micros - start.micros) / 1000.0, end.txBytes - start.txBytes,
+         end.rxBytes - start.rxBytes, end.allocations - start.allocations);
+  if (!ok) failures++;
+}
+
+//  Run the expression as a benchmarked operation.
+#define BENCH(name, expr) { const BenchSample start = sample(); const bool ok = (expr); report(name, start, ok); }
+
+static const String device = "";
+static const bool useEmulator = false;
+static const bool echo = false;  //  Logging is not measured.
+static const Country country = COUNTRY_SG;  //  RCZ4, which checks the channels before each uplink.
+static const String payload = "0102030405060708090a0b0c";
+
+template <class Transceiver> static void benchSend(const char *prefix, Transceiver &transceiver) {
+  //  Benchmark the sends, waiting the regulatory delay between sends.
+  char name[64]; uint8_t downlink[MAX_BYTES_PER_DOWNLINK];
+  delay(SEND_DELAY);
+  snprintf(name, sizeof(name), "%s.sendMessage", prefix);
+  BENCH(name, transceiver.sendMessage(payload));
+  delay(SEND_DELAY);
+  snprintf(name, sizeof(name), "%s.sendMessageAndGetResponse", prefix);
+  BENCH(name, transceiver.sendMessageAndGetResponse(payload, downlink) && downlink[7] == 0xef);
+  delay(SEND_DELAY);
+  snprintf(name, sizeof(name), "%s.receive", prefix);
+  BENCH(name, transceiver.receive(downlink) && downlink[7] == 0xef);
+}
+
+int main() {
+  //  Wisol WSSFM10R on UnaShield V2S.
+  {
+    static SimulatedWisol modem;  simulatedModem = &modem;
+    static Wisol transceiver(country, useEmulator, device, echo);
+    BENCH("Wisol.begin (cold)", transceiver.begin());
+    BENCH("Wisol.begin (identity cached)", transceiver.begin());
+    benchSend("Wisol", transceiver);
+    //  The downlink as a String keeps the uppercase hex digits of the module.
+    delay(SEND_DELAY);
+    String response;
+    BENCH("Wisol.sendMessageAndGetResponse (String)", transceiver.sendMessageAndGetResponse(payload, response) &&
+          strcmp(response.c_str(), "0123456789ABCDEF") == 0);
+    float temperature, voltage;  WisolHealth health;
+    BENCH("Wisol.getTemperature + getVoltage",
+          transceiver.getTemperature(temperature) && transceiver.getVoltage(voltage));
+    BENCH("Wisol.getHealth", transceiver.getHealth(health) && health.temperature == 322 &&
+          health.voltage == 3300);
+    BENCH("Wisol.sleep", transceiver.sleep());
+    BENCH("Wisol.wakeUp", transceiver.wakeUp());
+    if (modem.unknownCommands > 0) { printf("Wisol: %u unknown commands\n", modem.unknownCommands); failures++; }
+    transceiver.getCommandStats().dump(&Serial);
+  }
+  //  Wisol on a hardware UART, e.g. Serial1 on Mega.  The chars are not paced.
+  {
+    static SimulatedWisol modem;  simulatedModem = &modem;
+    static HardwareSerial uart;
+    static Wisol transceiver(country, useEmulator, device, echo, &uart);
+    BENCH("Wisol.begin (hardware UART)", transceiver.begin());
+    benchSend("Wisol (hardware UART)", transceiver);
+    if (modem.unknownCommands > 0) { printf("Wisol: %u unknown commands\n", modem.unknownCommands); failures++; }
+  }
+  //  Wisol unplugged: each command fails at its own deadline instead of waiting 60 seconds.
+  {
+    simulatedModem = 0;
+    static Wisol transceiver(country, useEmulator, device, echo);
+    float temperature;
+    BENCH("Wisol.getTemperature (no module)", !transceiver.getTemperature(temperature) &&
+          transceiver.getLastError() == WISOL_ERROR_TIMEOUT);
+    //  Boot fails after one power-up wait of 2 seconds, not after all the retries.
+    const unsigned long bootStart = millis();
+    BENCH("Wisol.begin (no module, one power-up wait)", !transceiver.begin() && millis() - bootStart < 3000);
+    //  Retries stop when the budget of the zone is used up, instead of waiting for it.
+    static RetryPolicy retry;
+    static UplinkBudget zoneBudget(country), testBudget(1000, 3);
+    Message<Wisol> msg(transceiver);
+    msg.addField("ctr", 1);
+    BENCH("RetryPolicy.send (no module, zone budget)", !retry.send(msg, zoneBudget) &&
+          retry.getRetryCount() == 0);
+    BENCH("RetryPolicy.send (no module, 3 attempts)", !retry.send(msg, testBudget) &&
+          retry.getRetryCount() == 2);
+  }
+  //  Sample a sensor at 50 Hz for 2 minutes and send the aggregates every minute with the
+  //  asynchronous Wisol send, which doesn't stop the sampling.
+  {
+    static SimulatedWisol modem;  simulatedModem = &modem;
+    static Wisol transceiver(country, useEmulator, device, echo);
+    struct Accelerometer {
+      static bool read(int &value) { static int next = 0; value = next++ % 100; return true; }
+    };
+    static SensorPipeline pipeline;
+    static UplinkBudget budget((unsigned long) 60 * 1000, 1);
+    static UplinkQueue queue(budget);
+    transceiver.begin();
+    delay(SEND_DELAY);  //  Wait for the regulatory delay after the last send.
+    const int channel = pipeline.addChannel(&Accelerometer::read, 20);
+    pipeline.addField("min", channel, SENSOR_MIN); pipeline.addField("max", channel, SENSOR_MAX);
+    pipeline.addField("avg", channel, SENSOR_MEAN);
+    BENCH("SensorPipeline 50 Hz with Wisol async send", ([&]() {
+      uint8_t payload[MAX_BYTES_PER_MESSAGE], length = 0; char hex[MAX_BYTES_PER_MESSAGE * 2 + 1];
+      unsigned int sent = 0;
+      const unsigned long start = millis();
+      while (millis() - start < (unsigned long) 2 * 60 * 1000 + 100) {
+        pipeline.poll();
+        pipeline.queueFields(transceiver, queue);
+        if (transceiver.isBusy()) { if (transceiver.poll() == SEND_OK) sent++; }
+        else if (queue.take(payload, length)) transceiver.sendMessageAsync(bytesToHex(payload, length, hex));
+      }
+      while (transceiver.isBusy()) { if (transceiver.poll() == SEND_OK) sent++; }
+      return sent == 3 && pipeline.getMissedCount() == 0; }()));
+    if (modem.unknownCommands > 0) { printf("Wisol: %u unknown commands\n", modem.unknownCommands); failures++; }
+  }
+  //  Radiocrafts RC1692HP-SIG on UnaShield V1.
+  {
+    static SimulatedRadiocrafts modem;  simulatedModem = &modem;
+    static Radiocrafts transceiver(country, useEmulator, device, echo);
+    BENCH("Radiocrafts.begin", transceiver.begin());
+    benchSend("Radiocrafts", transceiver);
+    if (modem.unknownCommands > 0) { printf("Radiocrafts: %u unknown commands\n", modem.unknownCommands); failures++; }
+    transceiver.getCommandStats().dump(&Serial);
+  }
+  //  UnaShield V2S and V1 on the same Arduino, with Radiocrafts on pins D6, D7.  Each module has its
+  //  own budget, so 2 uplinks may be sent in a burst.  When Wisol is unplugged, the uplink fails
+  //  over to Radiocrafts within the same send.
+  {
+    static SimulatedWisol wisolModem;  simulatedModem = &wisolModem;
+    static SimulatedRadiocrafts radiocraftsModem;  simulatedModemOnPin[7] = &radiocraftsModem;
+    static Wisol wisol(country, useEmulator, device, echo);
+    static Radiocrafts radiocrafts(country, useEmulator, device, echo, 6, 7);
+    static UplinkBudget wisolBudget(SEND_DELAY, 1), radiocraftsBudget(SEND_DELAY, 1);
+    static TransceiverGroup<Wisol, Radiocrafts> group(wisol, wisolBudget, radiocrafts, radiocraftsBudget);
+    BENCH("TransceiverGroup begin", wisol.begin() && radiocrafts.begin());
+    BENCH("TransceiverGroup burst of 2 uplinks", group.sendMessage(payload) &&
+          group.getLastTransceiver() == 0 && group.sendMessage(payload) && group.getLastTransceiver() == 1);
+    BENCH("TransceiverGroup 3rd uplink in burst", !group.sendMessage(payload));
+    delay(SEND_DELAY);
+    BENCH("TransceiverGroup.sendMessage (faster module)", group.sendMessage(payload) &&
+          group.getLastTransceiver() == 1);
+    //  Wisol is tried first until its results are known, but it's unplugged.
+    static UplinkBudget wisolBudget2(SEND_DELAY, 1), radiocraftsBudget2(SEND_DELAY, 1);
+    static TransceiverGroup<Wisol, Radiocrafts> failoverGroup(wisol, wisolBudget2, radiocrafts,
+                                                              radiocraftsBudget2);
+    failoverGroup.setProbeInterval(2 * SEND_DELAY);
+    delay(SEND_DELAY);
+    simulatedModem = 0;
+    BENCH("TransceiverGroup failover (Wisol unplugged)", failoverGroup.sendMessage(payload) &&
+          failoverGroup.getLastTransceiver() == 1);
+    delay(SEND_DELAY);
+    BENCH("TransceiverGroup after failover", failoverGroup.sendMessage(payload) &&
+          failoverGroup.getLastTransceiver() == 1);
+    //  When Wisol is plugged in again, it's probed one interval after the failure, without an
+    //  uplink, and is no longer avoided.
+    simulatedModem = &wisolModem;
+    BENCH("TransceiverGroup.probe (not due yet)", !failoverGroup.probe());
+    delay(SEND_DELAY);
+    FailoverStats probedStats;
+    BENCH("TransceiverGroup.probe (Wisol plugged in)", failoverGroup.probe() &&
+          failoverGroup.getStats(0, probedStats) && probedStats.successRate > FAILOVER_RATE_PROBE &&
+          !failoverGroup.probe());
+    for (uint8_t i = 0; i < 2; i++) {
+      FailoverStats stats;
+      failoverGroup.getStats(i, stats);
+      printf("TransceiverGroup %u: rate=%u latency=%lu ms sent=%u failed=%u probed=%u\n", i,
+             stats.successRate, stats.latency, stats.sentCount, stats.failedCount, stats.probeCount);
+    }
+    simulatedModemOnPin[7] = 0;
+    if (wisolModem.unknownCommands > 0) { printf("Wisol: %u unknown commands\n", wisolModem.unknownCommands); failures++; }
+    if (radiocraftsModem.unknownCommands > 0) { printf("Radiocrafts: %u unknown commands\n", radiocraftsModem.unknownCommands); failures++; }
+  }
+  //  Telecom Design TD1208 on Akene.
+  {
+    static SimulatedAkeru modem;  simulatedModem = &modem;
+    static Akeru transceiver;
+    BENCH("Akeru.begin", transceiver.begin());
+    benchSend("Akeru", transceiver);
+    //  The +RX lines may follow OK at once, so the port must stay open between them.
+    uint8_t downlink[MAX_BYTES_PER_DOWNLINK];
+    modem.downlinkMillis = 0;
+    delay(SEND_DELAY);
+    BENCH("Akeru.sendMessageAndGetResponse (fast downlink)",
+          transceiver.sendMessageAndGetResponse(payload, downlink) && downlink[7] == 0xef);
+    modem.downlinkMillis = SIMULATED_DOWNLINK_MILLIS;
+    if (modem.unknownCommands > 0) { printf("Akeru: %u unknown commands\n", modem.unknownCommands); failures++; }
+    transceiver.getCommandStats().dump(&Serial);
+  }
+  //  Akeru on a hardware UART.  The echo is skipped as the first response line.
+  {
+    static SimulatedAkeru modem;  simulatedModem = &modem;
+    static HardwareSerial uart;
+    static Akeru transceiver(&uart);
+    BENCH("Akeru.begin (hardware UART)", transceiver.begin());
+    benchSend("Akeru (hardware UART)", transceiver);
+    if (modem.unknownCommands > 0) { printf("Akeru: %u unknown commands\n", modem.unknownCommands); failures++; }
+  }
+  //  Message encode and decode, no serial port.
+  {
+    static NullPort nullPort4;
+    static Akeru transceiver;  transceiver.setEchoPort(&nullPort4);
+    char hex[MAX_BYTES_PER_MESSAGE * 2 + 1];
+    String decoded;
+    //  Encoding, including the log of each field, must not allocate Strings.
+    BENCH("Message encode (no allocations)", ([&]() {
+      const unsigned long allocations = stringAllocations;
+      Message<Akeru> msg(transceiver);
+      msg.addField("ctr", 123); msg.addField("tmp", 30.1); msg.addField("hmd", 98.7);
+      return strcmp(msg.getEncodedMessage(hex), "920ece04b0512d01a421db03") == 0 &&
+             stringAllocations == allocations; }()));
+    BENCH("Message decode", ([&]() {
+      decoded = MessageCodec::decodeMessage(hex);
+      return decoded == "{\"ctr\":123.0,\"tmp\":30.1,\"hmd\":98.7}"; }()));
+    //  Throughput on the host, e.g. for a gateway decoding buffered frames.  Measured on the real clock.
+    uint8_t frame[MAX_BYTES_PER_MESSAGE];
+    const uint8_t frameLength = hexToBytes(hex, strlen(hex), frame);
+    DecodedMessage fields;  char json[DECODED_JSON_MAX];
+    const unsigned long frames = 200000;  long checksum = 0;
+    double start = realSeconds();
+    for (unsigned long i = 0; i < frames; i++) {
+      frame[2] = (uint8_t) i;  //  Vary the value so the decode is not optimised away.
+      MessageCodec::decode(frame, frameLength, fields);
+      checksum += fields.fields[0].value;
+    }
+    const double decodeSeconds = realSeconds() - start;
+    start = realSeconds();
+    for (unsigned long i = 0; i < frames; i++) {
+      MessageCodec::decode(frame, frameLength, fields);
+      checksum += MessageCodec::toJson(fields, json, sizeof(json))[1];
+    }
+    const double jsonSeconds = realSeconds() - start;
+    start = realSeconds();
+    for (unsigned long i = 0; i < frames / 10; i++)
+      checksum += MessageCodec::decodeMessage(hex).length();
+    const double stringSeconds = realSeconds() - start;
+    printf("Message decode throughput: %.0f frames/s decode, %.0f frames/s decode + toJson, "
+           "%.0f frames/s decodeMessage (checksum %ld)\n", frames / decodeSeconds, frames / jsonSeconds,
+           frames / 10 / stringSeconds, checksum % 10);
+  }
+  simulatedModem = 0;
+  printf("%d failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
+#endif  //  ARDUINO
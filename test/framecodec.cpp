@@ -0,0 +1,312 @@
+//  Decode a stream of hex frames on the host, e.g. the uplinks exported from the Sigfox backend,
+//  one frame per line.  Same results as MessageCodec::decodeMessage(), but the frames are decoded in
+//  batches: the hex digits of all frames are converted to bytes in one pass, then the 5-bit names
+//  and the values of the structured fields are unpacked in another pass, into arrays with one
+//  entry per frame (struct of arrays), so that the compiler can vectorise the loops.  Packed
+//  frames are rare and are decoded one at a time with MessageCodec::decode().
+//
+//  Usage: framecodecexec [-c | -b] [-j threads] [file]
+//    -c          Write CSV records "line,name,value" to stdout, one per field (default).
+//    -b          Write binary records to stdout, see FrameRecord.
+//    -j threads  Decode each batch with the threads.
+//    file        Read the frames from the file instead of stdin.
+//  For packed frames with an unknown schema, the name is "#" and the value is the schema ID.
+//  The sequence number in the header of a packed frame is written as the field "seq".
+//
+//  framecodecexec --self-test compares the results with MessageCodec::decodeMessage() and reports the
+//  throughput of both.
+#ifndef ARDUINO
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <vector>
+#include <thread>
+#include "util.cpp"
+#include "../HexCodec.cpp"
+#include "../Message.cpp"
+
+const unsigned long FRAME_BATCH_SIZE = 65536;  //  Frames decoded in each batch.
+const uint8_t FRAME_HEX_MAX = MAX_BYTES_PER_MESSAGE * 2;  //  Hex digits kept for each frame.
+const uint8_t FRAME_FIELDS_MAX = MAX_BYTES_PER_MESSAGE / 4;  //  Structured fields in each frame.
+const char FRAME_PAD = 'x';  //  Pads the short frames, decoded as an invalid digit.
+
+//  Binary output record, little endian.
+struct FrameRecord {
+  uint32_t line;  //  Line number of the frame, starting from 1.
+  char name[4];  //  3-letter field name, null-terminated.
+  int32_t value;  //  Value scaled by 10, e.g. 255 for 25.5.
+};
+
+//  A batch of frames.  The results are stored as arrays of FRAME_BATCH_SIZE entries, one
+//  entry per frame, e.g. bytes[k * FRAME_BATCH_SIZE + i] is byte k of frame i.
+struct FrameBatch {
+  unsigned long count;  //  Number of frames in the batch.
+  std::vector<unsigned long> lines;  //  Line number of each frame.
+  std::vector<char> hex;  //  FRAME_HEX_MAX hex digits per frame, padded with FRAME_PAD.
+  std::vector<uint8_t> bytes;  //  Byte k of frame i, for k < MAX_BYTES_PER_MESSAGE.
+  std::vector<uint8_t> lengths;  //  Number of bytes decoded for frame i, up to the first invalid digit.
+  std::vector<char> names;  //  Letter j of the name of field f of frame i, at (f * 3 + j).
+  std::vector<int16_t> values;  //  Value of field f of frame i, scaled by 10.
+
+  FrameBatch(): count(0), lines(FRAME_BATCH_SIZE), hex(FRAME_BATCH_SIZE * FRAME_HEX_MAX),
+    bytes(FRAME_BATCH_SIZE * MAX_BYTES_PER_MESSAGE), lengths(FRAME_BATCH_SIZE),
+    names(FRAME_BATCH_SIZE * FRAME_FIELDS_MAX * 3), values(FRAME_BATCH_SIZE * FRAME_FIELDS_MAX) {}
+
+  bool add(unsigned long line, const char *text, unsigned int length) {
+    //  Add the frame of hex digits.  Digits beyond FRAME_HEX_MAX are ignored, like decodeMessage().
+    //  Returns false if the batch is full.
+    if (count >= FRAME_BATCH_SIZE) return false;
+    if (length > FRAME_HEX_MAX) length = FRAME_HEX_MAX;
+    char *row = &hex[count * FRAME_HEX_MAX];
+    memcpy(row, text, length);
+    memset(row + length, FRAME_PAD, FRAME_HEX_MAX - length);
+    lines[count++] = line;
+    return true;
+  }
+
+  bool isPacked(unsigned long i) const {
+    //  Return true if frame i has the packed mode header.
+    return lengths[i] >= 2 && (bytes[FRAME_BATCH_SIZE + i] & (PACKED_HEADER >> 8));
+  }
+
+  void getBytes(unsigned long i, uint8_t *frame) const {
+    //  Copy the bytes of frame i.
+    for (uint8_t k = 0; k < lengths[i]; k++) frame[k] = bytes[k * FRAME_BATCH_SIZE + i];
+  }
+};
+
+static inline uint8_t bulkNibble(uint8_t ch) {
+  //  Convert the hex digit to 0..15, or 0x10 if invalid.  Computed without a table or branches,
+  //  so that the loop over the frames can be vectorised.
+  const uint8_t digit = ch - '0';
+  const uint8_t letter = (ch | 0x20) - 'a';
+  const uint8_t isDigit = (uint8_t) -(digit < 10), isLetter = (uint8_t) -(letter < 6);
+  return (digit & isDigit) | ((uint8_t) (letter + 10) & isLetter) | (0x10 & ~(isDigit | isLetter));
+}
+
+static inline char bulkLetter(uint8_t code) {
+  //  Convert the 5-bit code to a letter, like decodeLetter() in Message.cpp.
+  const uint8_t isLetter = (uint8_t) -(code < 27), isCode = (uint8_t) -(code != 0);
+  return (char) ((((uint8_t) ('a' - 1 + code) & isLetter) | ((uint8_t) ('0' - 27 + code) & ~isLetter)) & isCode);
+}
+
+static void decodeHex(FrameBatch &batch, unsigned long first, unsigned long last) {
+  //  Convert the hex digits of frames first to last - 1 into bytes.  Like hexToBytes(), the
+  //  frame stops at the first invalid digit.
+  //  The pointers don't alias, so the compiler may keep them in registers.
+  const uint8_t *__restrict__ hex = (const uint8_t *) &batch.hex[0];
+  uint8_t *__restrict__ bytes = &batch.bytes[0];
+  uint8_t *__restrict__ lengths = &batch.lengths[0];
+  for (unsigned long i = first; i < last; i++) {
+    const uint8_t *row = hex + i * FRAME_HEX_MAX;
+    uint8_t length = 0, invalid = 0;
+    for (uint8_t k = 0; k < MAX_BYTES_PER_MESSAGE; k++) {
+      const uint8_t high = bulkNibble(row[2 * k]), low = bulkNibble(row[2 * k + 1]);
+      bytes[k * FRAME_BATCH_SIZE + i] = (uint8_t) ((high << 4) | (low & 0x0f));
+      invalid |= (high | low) >> 4;
+      length += 1 - invalid;
+    }
+    lengths[i] = length;
+  }
+}
+
+static void unpackFields(FrameBatch &batch, unsigned long first, unsigned long last) {
+  //  Unpack the names and values of the structured fields of frames first to last - 1.
+  //  Each loop runs over the frames with unit stride.  Fields beyond the length are unpacked
+  //  too but never used.
+  for (uint8_t f = 0; f < FRAME_FIELDS_MAX; f++) {
+    const uint8_t *__restrict__ name0 = &batch.bytes[(4 * f) * FRAME_BATCH_SIZE];
+    const uint8_t *__restrict__ name1 = &batch.bytes[(4 * f + 1) * FRAME_BATCH_SIZE];
+    const uint8_t *__restrict__ value0 = &batch.bytes[(4 * f + 2) * FRAME_BATCH_SIZE];
+    const uint8_t *__restrict__ value1 = &batch.bytes[(4 * f + 3) * FRAME_BATCH_SIZE];
+    char *__restrict__ letters0 = &batch.names[(f * 3) * FRAME_BATCH_SIZE];
+    char *__restrict__ letters1 = &batch.names[(f * 3 + 1) * FRAME_BATCH_SIZE];
+    char *__restrict__ letters2 = &batch.names[(f * 3 + 2) * FRAME_BATCH_SIZE];
+    int16_t *__restrict__ values = &batch.values[f * FRAME_BATCH_SIZE];
+    for (unsigned long i = first; i < last; i++) {
+      //  [x000] [0011] [1112] [2222], least significant byte first.
+      const unsigned int code = name0[i] | (name1[i] << 8);
+      letters0[i] = bulkLetter((code >> 10) & 31);
+      letters1[i] = bulkLetter((code >> 5) & 31);
+      letters2[i] = bulkLetter(code & 31);
+      values[i] = (int16_t) (value0[i] | (value1[i] << 8));
+    }
+  }
+}
+
+static void decodeRange(FrameBatch *batch, unsigned long first, unsigned long last) {
+  decodeHex(*batch, first, last);
+  unpackFields(*batch, first, last);
+}
+
+static void decodeBatch(FrameBatch &batch, unsigned int threads) {
+  //  Decode all frames in the batch, spread across the threads.
+  if (threads <= 1 || batch.count < threads * 1024) { decodeRange(&batch, 0, batch.count); return; }
+  std::vector<std::thread> workers;
+  const unsigned long step = (batch.count + threads - 1) / threads;
+  for (unsigned long first = 0; first < batch.count; first += step) {
+    const unsigned long last = first + step < batch.count ? first + step : batch.count;
+    workers.push_back(std::thread(decodeRange, &batch, first, last));
+  }
+  for (unsigned int t = 0; t < workers.size(); t++) workers[t].join();
+}
+
+static void getDecoded(const FrameBatch &batch, unsigned long i, DecodedMessage &decoded) {
+  //  Return the fields of frame i, as MessageCodec::decode() would.
+  if (batch.isPacked(i)) {
+    uint8_t frame[MAX_BYTES_PER_MESSAGE];
+    batch.getBytes(i, frame);
+    MessageCodec::decode(frame, batch.lengths[i], decoded);
+    return;
+  }
+  decoded.schema = -1;
+  decoded.unknownSchema = false;
+  decoded.sequence = -1;
+  decoded.fieldCount = batch.lengths[i] / 4;
+  for (uint8_t f = 0; f < decoded.fieldCount; f++) {
+    DecodedField &field = decoded.fields[f];
+    //  A 0 letter ends the name, like decodeMessage().
+    for (uint8_t j = 0; j < 3; j++) field.name[j] = batch.names[(f * 3 + j) * FRAME_BATCH_SIZE + i];
+    field.name[3] = 0;
+    field.value = batch.values[f * FRAME_BATCH_SIZE + i];
+  }
+}
+
+static void writeBatch(const FrameBatch &batch, bool binary, FILE *out) {
+  //  Write one record for each field of each frame.
+  DecodedMessage decoded;
+  for (unsigned long i = 0; i < batch.count; i++) {
+    getDecoded(batch, i, decoded);
+    if (decoded.unknownSchema) {
+      decoded.fieldCount = 1;
+      memset(decoded.fields[0].name, 0, sizeof(decoded.fields[0].name));
+      decoded.fields[0].name[0] = '#';
+      decoded.fields[0].value = decoded.schema;
+    }
+    if (decoded.sequence >= 0 && decoded.fieldCount < DECODED_MAX_FIELDS) {
+      //  Sequence number in the packed header, same as the "seq" field of a structured frame.
+      DecodedField &field = decoded.fields[decoded.fieldCount++];
+      strcpy(field.name, "seq");
+      field.value = decoded.sequence * 10;
+    }
+    for (uint8_t f = 0; f < decoded.fieldCount; f++) {
+      const DecodedField &field = decoded.fields[f];
+      if (binary) {
+        FrameRecord record;
+        record.line = (uint32_t) batch.lines[i];
+        memcpy(record.name, field.name, sizeof(record.name));
+        record.value = (int32_t) field.value;
+        fwrite(&record, sizeof(record), 1, out);
+      } else if (field.name[0] == '#') {
+        fprintf(out, "%lu,%s,%ld\n", batch.lines[i], field.name, field.value);
+      } else {
+        const unsigned long magnitude = field.value < 0 ? 0UL - (unsigned long) field.value : field.value;
+        fprintf(out, "%lu,%s,%s%lu.%lu\n", batch.lines[i], field.name, field.value < 0 ? "-" : "",
+                magnitude / 10, magnitude % 10);
+      }
+    }
+  }
+}
+
+static unsigned int trimLine(char *line) {
+  //  Remove the line ending and trailing spaces.  Returns the length.
+  unsigned int length = strlen(line);
+  while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' ||
+                        line[length - 1] == ' ' || line[length - 1] == '\t')) line[--length] = 0;
+  return length;
+}
+
+static double realSeconds() {
+  //  Return the real time in seconds.
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int selfTest(unsigned int threads) {
+  //  Compare the bulk decode with MessageCodec::decodeMessage() for random frames, including short,
+  //  odd-length, invalid and packed frames.  Then report the throughput.
+  static FrameBatch batch;
+  std::vector<String> frames;
+  unsigned long seed = 12345;
+  char hex[FRAME_HEX_MAX + 1];
+  for (unsigned long i = 0; i < FRAME_BATCH_SIZE; i++) {
+    //  Mostly complete frames of 3 fields, like the backend export.
+    unsigned int length = FRAME_HEX_MAX;
+    seed = seed * 1103515245 + 12345;
+    if ((seed >> 16) % 4 == 0) length = (seed >> 8) % (FRAME_HEX_MAX + 1);
+    for (unsigned int k = 0; k < length; k++) {
+      seed = seed * 1103515245 + 12345;
+      hex[k] = "0123456789abcdefABCDEF"[(seed >> 16) % 22];
+    }
+    if ((seed >> 24) % 16 == 0 && length > 0) hex[(seed >> 4) % length] = 'g';  //  Invalid digit.
+    if ((seed >> 24) % 16 == 1 && length > 3) hex[2] = '8';  //  Packed header.
+    hex[length] = 0;
+    frames.push_back(String(hex));
+    batch.add(i + 1, hex, length);
+  }
+  decodeBatch(batch, threads);
+  DecodedMessage decoded;  char json[DECODED_JSON_MAX];
+  unsigned long mismatches = 0;
+  for (unsigned long i = 0; i < batch.count; i++) {
+    getDecoded(batch, i, decoded);
+    const String expected = MessageCodec::decodeMessage(frames[i]);
+    if (expected == MessageCodec::toJson(decoded, json, sizeof(json))) continue;
+    if (mismatches++ < 5) printf("mismatch line %lu: %s: %s != %s\n", batch.lines[i],
+                                 frames[i].c_str(), json, expected.c_str());
+  }
+  printf("framecodec self-test: %lu frames, %lu mismatches\n", batch.count, mismatches);
+
+  //  Throughput of the bulk decode, excluding the input and output.
+  const unsigned int rounds = 20;
+  double start = realSeconds();
+  for (unsigned int r = 0; r < rounds; r++) decodeBatch(batch, 1);
+  const double bulkSeconds = realSeconds() - start;
+  start = realSeconds();
+  for (unsigned int r = 0; r < rounds; r++) decodeBatch(batch, threads);
+  const double threadSeconds = realSeconds() - start;
+  start = realSeconds();
+  unsigned long checksum = 0;
+  for (unsigned long i = 0; i < batch.count; i++) checksum += MessageCodec::decodeMessage(frames[i]).length();
+  const double stringSeconds = realSeconds() - start;
+  printf("framecodec throughput: %.0f frames/s bulk, %.0f frames/s bulk with %u threads, "
+         "%.0f frames/s decodeMessage (checksum %lu)\n", rounds * batch.count / bulkSeconds,
+         rounds * batch.count / threadSeconds, threads, batch.count / stringSeconds, checksum % 10);
+  return mismatches == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  bool binary = false;  unsigned int threads = 1;  const char *path = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-c") == 0) binary = false;
+    else if (strcmp(argv[i], "-b") == 0) binary = true;
+    else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) threads = (unsigned int) atoi(argv[++i]);
+    else if (strcmp(argv[i], "--self-test") == 0) return selfTest(threads > 1 ? threads : 4);
+    else if (argv[i][0] == '-') {
+      fprintf(stderr, "Usage: %s [-c | -b] [-j threads] [file]\n", argv[0]);
+      return 2;
+    }
+    else path = argv[i];
+  }
+  FILE *in = path ? fopen(path, "r") : stdin;
+  if (!in) { perror(path); return 1; }
+  static FrameBatch batch;
+  char line[256];  unsigned long lineNumber = 0;
+  for (;;) {
+    //  Read a batch of frames, decode them and write the records.  Empty lines are skipped.
+    batch.count = 0;
+    while (batch.count < FRAME_BATCH_SIZE && fgets(line, sizeof(line), in)) {
+      lineNumber++;
+      const unsigned int length = trimLine(line);
+      if (length > 0) batch.add(lineNumber, line, length);
+    }
+    if (batch.count == 0) break;
+    decodeBatch(batch, threads);
+    writeBatch(batch, binary, stdout);
+  }
+  if (path) fclose(in);
+  return 0;
+}
+#endif  //  ARDUINO
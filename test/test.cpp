@@ -5,10 +5,28 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <time.h>
+#define UNABIZ_DIAGNOSTICS 1  //  Record the longest response.  The memory fields are 0 on the host.
 #include "util.cpp"
+#include "../HexCodec.cpp"
+#include "../CommandStats.cpp"
+#include "../Diagnostics.cpp"
+#include "../ResponseParser.cpp"
+#include "../PowerDown.cpp"
+#include "../Wisol.cpp"
 #include "../Radiocrafts.cpp"
 #include "../Akeru.cpp"
 #include "../Message.cpp"
+#include "../FrameStore.cpp"
+#include "../UplinkQueue.cpp"
+#include "../Failover.cpp"
+#include "../Retry.cpp"
+#include "../SensorPipeline.cpp"
+#include "../Scheduler.cpp"
+
+static int failures = 0;  //  Number of checks that failed.
+
+//  Check a result, like BENCH in bench.cpp, so that the test fails when a result changes.
+#define CHECK(name, expr) { if (!(expr)) { printf("FAIL: %s\n", name); failures++; } }
 
 int main() {
   puts("test");
@@ -19,16 +37,358 @@ int main() {
   static const Country country = COUNTRY_SG;  //  Set this to your country to configure the SIGFOX transmission frequencies.
   static Radiocrafts transceiver(country, useEmulator, device, echo);  //  Uncomment this for UnaBiz UnaShield Dev Kit with Radiocrafts module.
 
-  Message msg(transceiver);
+  char hex[MAX_BYTES_PER_MESSAGE * 2 + 1];
+  Message<Radiocrafts> msg(transceiver);
   msg.addField("ctr", 123);
   msg.addField("tmp", 30.1);
   msg.addField("hmd", 98.7);
   String encodedMsg = msg.getEncodedMessage();
   printf("encodedMsg=%s\n", encodedMsg.c_str());
-  String decodedMsg = Message::decodeMessage(encodedMsg);
+  String decodedMsg = MessageCodec::decodeMessage(encodedMsg);
   printf("decodedMsg=%s\n", decodedMsg.c_str());
+  CHECK("encodedMsg", strcmp(encodedMsg.c_str(), "920ece04b0512d01a421db03") == 0);
+  CHECK("decodedMsg", strcmp(decodedMsg.c_str(), "{\"ctr\":123.0,\"tmp\":30.1,\"hmd\":98.7}") == 0);
   msg.send();
 
+  //  Compose the same message for Akeru.
+  static Akeru akeru;
+  Message<Akeru> akeruMsg(akeru);
+  akeruMsg.addField("ctr", 123);
+  printf("akeruMsg=%s\n", akeruMsg.getEncodedMessage().c_str());
+  CHECK("akeruMsg", strcmp(akeruMsg.getEncodedMessage(hex), "920ece04") == 0);
+
+  //  Compose the same message for a group of transceivers with failover.
+  static UplinkBudget akeruBudget(country);
+  static TransceiverGroup<Akeru> group(akeru, akeruBudget);
+  Message<TransceiverGroup<Akeru> > groupMsg(group);
+  groupMsg.addField("ctr", 123);
+  printf("groupMsg=%s available=%d\n", groupMsg.getEncodedMessage().c_str(), group.isAvailable());
+  CHECK("groupMsg", strcmp(groupMsg.getEncodedMessage(hex), "920ece04") == 0 && group.isAvailable());
+
+  //  Decode the hex digits back into bytes and encode again.
+  uint8_t bytes[MAX_BYTES_PER_MESSAGE];
+  unsigned int byteCount = hexToBytes("920ECE04b0zz", 12, bytes);
+  printf("hexToBytes=%u hex=%s\n", byteCount, bytesToHex(bytes, byteCount, hex));
+  CHECK("hexToBytes", byteCount == 5 && strcmp(hex, "920ece04b0") == 0);
+
+  //  Parse a downlink response one byte at a time.
+  ResponseParser parser;
+  const char *downlinkResponse = "OK\r\n+RX BEGIN\r\n+RX=01 23 45 67 89 AB CD EF\r\n+RX END\r\n";
+  int tokens = 0;
+  for (const char *ch = downlinkResponse; *ch; ch++) {
+    ResponseToken token = parser.feed(*ch);
+    if (token != TOKEN_NONE) tokens = tokens * 10 + token;
+  }
+  printf("tokens=%d downlink=%s\n", tokens,
+         bytesToHex(parser.getDownlink(), parser.getDownlinkLength(), hex));
+  CHECK("ResponseParser", tokens == 2134 && strcmp(hex, "0123456789abcdef") == 0);
+
+  //  Send asynchronously with Wisol and poll until the send completes.
+  static Wisol wisol(country, useEmulator, device, echo);
+  const bool asyncStarted = wisol.sendMessageAsync(encodedMsg);
+  if (asyncStarted) {
+    SendStatus status = SEND_BUSY;
+    while (status == SEND_BUSY) status = wisol.poll();
+    printf("async status=%d busy=%d\n", status, wisol.isBusy());
+    printf("async error=%d\n", wisol.getLastError());
+    //  No module is attached, so the send times out.
+    CHECK("Wisol async", status == SEND_FAILED && !wisol.isBusy() && wisol.getLastError() == WISOL_ERROR_TIMEOUT);
+  }
+  CHECK("Wisol async started", asyncStarted);
+
+  //  Pack 8 sensor values into one message with a schema and decode them.
+  static const MessageField sensorFields[] = {
+    {"tmp", 10, 10, -200}, {"hmd", 7, 1, 0}, {"sw1", 1, 1, 0}, {"sw2", 1, 1, 0},
+    {"lux", 12, 1, 0}, {"bat", 8, 10, 0}, {"co2", 12, 1, 0}, {"prs", 10, 1, 500},
+  };
+  static MessageSchema sensorSchema(7, sensorFields, 8);
+  Message<Akeru> packedMsg(akeru, sensorSchema);
+  packedMsg.addField("tmp", 25.5f); packedMsg.addField("hmd", 64); packedMsg.addField("sw1", 1);
+  packedMsg.addField("lux", 1234); packedMsg.addField("bat", 3.5f); packedMsg.addField("co2", 415);
+  packedMsg.addField("prs", 1013);
+  String packedHex = packedMsg.getEncodedMessage();
+  printf("packedMsg=%s length=%u\n", packedHex.c_str(), packedMsg.getLength());
+  printf("decodedPacked=%s\n", MessageCodec::decodeMessage(packedHex).c_str());
+  CHECK("packedMsg", strcmp(packedHex.c_str(), "0780c70193a691cf0810") == 0 && packedMsg.getLength() == 10);
+  CHECK("decodedPacked", strcmp(MessageCodec::decodeMessage(packedHex).c_str(), "{\"tmp\":25.5,\"hmd\":64.0,"
+        "\"sw1\":1.0,\"sw2\":0.0,\"lux\":1234.0,\"bat\":3.5,\"co2\":415.0,\"prs\":1013.0}") == 0);
+
+  //  Decode into fields without allocating.  Negative values are sent as 16-bit ints.
+  Message<Akeru> negativeMsg(akeru);
+  negativeMsg.addField("tmp", -2.5f);
+  DecodedMessage decodedFields;  char json[DECODED_JSON_MAX];
+  MessageCodec::decode(negativeMsg.getPayload(), negativeMsg.getLength(), decodedFields);
+  printf("decoded fields=%u %s=%ld json=%s\n", decodedFields.fieldCount, decodedFields.fields[0].name,
+         decodedFields.fields[0].value, MessageCodec::toJson(decodedFields, json, sizeof(json)));
+  CHECK("decode", decodedFields.fieldCount == 1 && decodedFields.fields[0].value == -25 &&
+        strcmp(json, "{\"tmp\":-2.5}") == 0);
+
+  //  Send only the fields that changed beyond the deadband, with a keyframe every 3 messages.
+  //  Sends always succeed with this transceiver.
+  struct AcceptAll {
+    void echo(const String &msg) {}
+    bool sendMessage(const String &payload) { return true; }
+    bool sendMessageAndGetResponse(const String &payload, uint8_t *downlink) {
+      for (uint8_t i = 0; i < MAX_BYTES_PER_DOWNLINK; i++) downlink[i] = i * 0x11;
+      return true;
+    }
+  };
+  static AcceptAll acceptAll;
+  static MessageDelta delta(3);
+  delta.setDeadband("tmp", 0.5);
+  const float temps[] = { 30.1f, 30.3f, 31.0f, 31.0f }; const int hmds[] = { 98, 98, 98, 98 };
+  String deltas;
+  for (int i = 0; i < 4; i++) {
+    Message<AcceptAll> deltaMsg(acceptAll, delta);
+    deltaMsg.addField("tmp", temps[i]); deltaMsg.addField("hmd", hmds[i]);
+    if (deltaMsg.isEmpty()) { deltas += "[] "; continue; }
+    deltas += MessageCodec::decodeMessage(deltaMsg.getEncodedMessage()) + " ";
+    deltaMsg.send();
+  }
+  printf("delta=%s\n", deltas.c_str());
+  CHECK("delta", strcmp(deltas.c_str(), "{\"tmp\":30.1,\"hmd\":98.0} [] {\"tmp\":31.0} [] ") == 0);
+  //  The sequence number is not tracked by the delta, and alone is not worth sending.
+  static MessageDelta seqDelta;
+  Message<AcceptAll> seqMsg(acceptAll, seqDelta);
+  seqMsg.addField("tmp", 30.1f);  seqMsg.setSequence(1);  seqMsg.send();
+  Message<AcceptAll> seqMsg2(acceptAll, seqDelta);
+  seqMsg2.addField("tmp", 30.1f);  seqMsg2.setSequence(2);
+  printf("delta seq empty=%d\n", seqMsg2.isEmpty());
+  CHECK("delta seq", seqMsg2.isEmpty());
+  //  A negative field within the deadband is not sent again.
+  static MessageDelta negativeDelta;
+  negativeDelta.setDeadband("tmp", 0.5);
+  Message<AcceptAll> coldMsg(acceptAll, negativeDelta);
+  coldMsg.addField("tmp", -0.5f);  coldMsg.send();
+  Message<AcceptAll> coldMsg2(acceptAll, negativeDelta);
+  coldMsg2.addField("tmp", -0.3f);
+  printf("delta negative empty=%d\n", coldMsg2.isEmpty());
+  CHECK("delta negative", coldMsg2.isEmpty());
+
+  //  Get the downlink response as bytes.
+  Message<AcceptAll> downlinkMsg(acceptAll);
+  downlinkMsg.addField("ctr", 1);
+  String downlinkHex;
+  const bool downlinkSent = downlinkMsg.sendAndGetResponse(downlinkHex);
+  printf("sendAndGetResponse=%d downlink=%s\n", downlinkSent, downlinkHex.c_str());
+  CHECK("sendAndGetResponse", downlinkSent && strcmp(downlinkHex.c_str(), "0011223344556677") == 0);
+
+  //  Resend with backoff when the first 2 sends fail.  Both attempts carry the same sequence number.
+  struct FailTwice {
+    int sends = 0;
+    void echo(const String &msg) {}
+    bool sendMessage(const String &payload) { return ++sends > 2; }
+    bool sendMessageAndGetResponse(const String &payload, uint8_t *downlink) { return false; }
+  };
+  static FailTwice failTwice;
+  static UplinkBudget retryBudget(1000, 3);
+  static RetryPolicy retry;
+  retry.setSeed(0x002C30EB);  retry.setSequence(true);
+  Message<FailTwice> retryMsg(failTwice, sensorSchema);
+  retryMsg.addField("tmp", 25.5f);
+  const unsigned long retryStart = millis();
+  const bool retried = retry.send(retryMsg, retryBudget);
+  printf("retry sent=%d sends=%d retries=%u waited=%lus next=%u delays=%lu,%lu,%lu,%lu json=%s\n",
+         retried, failTwice.sends, retry.getRetryCount(), (millis() - retryStart) / 1000,
+         retry.getSequence(), retry.getDelay(0), retry.getDelay(1), retry.getDelay(4), retry.getDelay(9),
+         MessageCodec::decodeMessage(retryMsg.getEncodedMessage()).c_str());
+  CHECK("retry", retried && failTwice.sends == 3 && retry.getRetryCount() == 2 && retry.getSequence() == 1 &&
+        MessageCodec::decodeMessage(retryMsg.getEncodedMessage()).indexOf("\"seq\":0.0") >= 0);
+  //  Each delay is between half and all of the doubled backoff, capped at 1 minute.
+  CHECK("retry delays", retry.getDelay(0) >= 2500 && retry.getDelay(0) <= 5000 &&
+        retry.getDelay(1) >= 5000 && retry.getDelay(1) <= 10000 && retry.getDelay(9) >= 30000 &&
+        retry.getDelay(9) <= 60000);
+  //  The same without blocking: poll() returns at once until the retry is due.
+  failTwice.sends = 0;
+  Message<FailTwice> asyncRetryMsg(failTwice, sensorSchema);
+  asyncRetryMsg.addField("tmp", 25.5f);
+  const bool retryStarted = retry.startSend(asyncRetryMsg, retryBudget);
+  const SendStatus firstStatus = retry.poll(asyncRetryMsg, retryBudget);
+  const SendStatus earlyStatus = retry.poll(asyncRetryMsg, retryBudget);
+  const bool retryScheduled = (long) (retry.nextAttemptAt() - millis()) > 0;
+  SendStatus retryStatus = SEND_BUSY;
+  while (retryStatus == SEND_BUSY) { delay(100); retryStatus = retry.poll(asyncRetryMsg, retryBudget); }
+  const bool retryIdle = retry.poll(asyncRetryMsg, retryBudget) == SEND_IDLE;
+  printf("retry async started=%d first=%d early=%d scheduled=%d status=%d sends=%d idle=%d\n",
+         retryStarted, firstStatus, earlyStatus, retryScheduled, retryStatus, failTwice.sends, retryIdle);
+  CHECK("retry async", retryStarted && firstStatus == SEND_BUSY && earlyStatus == SEND_BUSY && retryScheduled &&
+        retryStatus == SEND_OK && failTwice.sends == 3 && retryIdle);
+
+  //  Power down for 5 milliseconds.  On the host we just wait.
+  const unsigned long slept = powerDown(5);
+  printf("powerDown=%d powerDowns=%u\n", slept >= 5, getPowerDownStats().powerDowns);
+  CHECK("powerDown", slept >= 5 && getPowerDownStats().powerDowns == 1);
+
+  //  Queue two updates of the same fields and an alarm.  The alarm is sent first and the
+  //  updates are coalesced into the latest value.  The budget allows only 1 uplink now.
+  UplinkBudget budget(SEND_DELAY, 1);
+  UplinkQueue queue(budget);
+  Message<Akeru> update1(akeru), update2(akeru);
+  update1.addField("ctr", 1); update2.addField("ctr", 2);
+  const uint8_t alarm[] = { 0xa1 };
+  queue.add(update1); queue.add(update2); queue.add(alarm, 1, UPLINK_PRIORITY_ALARM);
+  uint8_t length = 0;
+  bool taken = queue.take(bytes, length);
+  printf("queue taken=%d first=%s count=%u coalesced=%u", taken,
+         bytesToHex(bytes, length, hex), queue.getCount(), queue.getCoalescedCount());
+  CHECK("queue", taken && strcmp(hex, "a1") == 0 && queue.getCount() == 1 && queue.getCoalescedCount() == 1);
+  const bool takenAgain = queue.take(bytes, length);
+  printf(" again=%d\n", takenAgain);
+  CHECK("queue budget", !takenAgain);
+  //  Packed messages with the same schema are coalesced, whatever their sequence numbers.
+  UplinkQueue packedQueue(budget);
+  Message<Akeru> packed1(akeru, sensorSchema), packed2(akeru, sensorSchema);
+  packed1.addField("tmp", 25.5f);  packed1.setSequence(1);
+  packed2.addField("tmp", 26.5f);  packed2.setSequence(2);
+  packedQueue.add(packed1);  packedQueue.add(packed2);
+  printf("packed queue count=%u coalesced=%u\n", packedQueue.getCount(), packedQueue.getCoalescedCount());
+  CHECK("packed queue", packedQueue.getCount() == 1 && packedQueue.getCoalescedCount() == 1);
+
+  //  Keep the frames that can't be sent in EEPROM.  With 3 slots, the 4th frame replaces the
+  //  oldest.  After a reset, begin() finds the frames not sent yet.  The alarm is taken first.
+  static FrameStore store(FRAME_STORE_ADDRESS_AUTO, 3);
+  store.begin();
+  for (uint8_t i = 0; i < 4; i++) {
+    const uint8_t frame[] = { i };
+    store.add(frame, 1, i == 2 ? UPLINK_PRIORITY_ALARM : UPLINK_PRIORITY_LOW);
+  }
+  static FrameStore restored(FRAME_STORE_ADDRESS_AUTO, 3);
+  const bool found = restored.begin();
+  printf("store count=%u lost=%u found=%d restored=%u order=", store.getCount(), store.getLostCount(),
+         found, restored.getCount());
+  CHECK("store", store.getCount() == 3 && store.getLostCount() == 1 && found && restored.getCount() == 3);
+  uint8_t priority;  uint16_t age;  String order;
+  while (restored.take(bytes, length, priority, age))
+    order += String(bytesToHex(bytes, length, hex)) + "(" + age + ") ";
+  printf("%s", order.c_str());
+  CHECK("store order", strcmp(order.c_str(), "02(1) 01(2) 03(0) ") == 0);
+  //  The queue keeps a frame that could not be sent in the store and takes it from there.
+  UplinkBudget storeBudget(1, 1);
+  UplinkQueue storeQueue(storeBudget);
+  storeQueue.setStore(restored);
+  const uint8_t deferred[] = { 0xde, 0xf0 };
+  storeQueue.defer(deferred, 2);
+  printf("deferred=%u", restored.getCount());
+  CHECK("store defer", restored.getCount() == 1);
+  taken = storeQueue.take(bytes, length);
+  printf(" taken=%d %s\n", taken, bytesToHex(bytes, length, hex));
+  CHECK("store deferred", taken && strcmp(hex, "def0") == 0);
+  //  If the frame in the store can't be read, e.g. overwritten by another sketch, the queued
+  //  message is sent instead.
+  static FrameStore brokenStore(0, 1);
+  brokenStore.begin();
+  UplinkBudget brokenBudget(1, 1);
+  UplinkQueue brokenQueue(brokenBudget);
+  brokenQueue.setStore(brokenStore);
+  const uint8_t queued[] = { 0x51 };
+  brokenQueue.add(queued, 1, UPLINK_PRIORITY_LOW);
+  brokenStore.add(alarm, 1, UPLINK_PRIORITY_ALARM);
+  EEPROM.write(0, EEPROM.read(0) ^ 0xff);  //  Overwrite the sequence number of the slot.
+  taken = brokenQueue.take(bytes, length);
+  printf("store broken taken=%d %s\n", taken, bytesToHex(bytes, length, hex));
+  CHECK("store broken", taken && strcmp(hex, "51") == 0 && brokenQueue.getCount() == 0);
+  //  A store that would overlap the identity cache at the end of the EEPROM is cut short.
+  FrameStore fullStore, overlapStore(EEPROM.length() - WISOL_IDENTITY_SIZE - 2 * sizeof(StoredFrame) - 1, 4);
+  printf("store slots=%u overlap=%u\n", fullStore.getSlotCount(), overlapStore.getSlotCount());
+  CHECK("store slots", fullStore.getSlotCount() == FRAME_STORE_SLOTS && overlapStore.getSlotCount() == 2);
+
+  //  Add the deci-degrees and millivolts from a health snapshot without float conversion.
+  Message<Akeru> healthMsg(akeru);
+  const WisolHealth health = { 277, 3350, 0xff };
+  healthMsg.addScaledField("tmp", health.temperature);
+  healthMsg.addScaledField("vlt", health.voltage / 100);
+  printf("health=%s\n", MessageCodec::decodeMessage(healthMsg.getEncodedMessage()).c_str());
+  CHECK("health", strcmp(MessageCodec::decodeMessage(healthMsg.getEncodedMessage()).c_str(),
+                         "{\"tmp\":27.7,\"vlt\":3.3}") == 0);
+
+  //  Key the AT commands and record their round trips.
+  CommandStats commandStats;
+  char key1[COMMAND_KEY_MAX + 1], key2[COMMAND_KEY_MAX + 1], key3[COMMAND_KEY_MAX + 1];
+  CommandStats::getATKey("AT$SF=0102,1\r", key1);
+  CommandStats::getATKey("AT$I=10\r", key2);
+  CommandStats::getATKey("AT\r", key3);
+  commandStats.record(key1, 6000, true, 15, 3);
+  commandStats.record(key1, 8000, false, 15, 0);
+  const CommandStat *sf = commandStats.find("SF");
+  printf("commandStats keys=%s,%s,%s SF n=%u fail=%u ms=%u/%lu/%u tx=%lu\n", key1, key2, key3,
+         sf->count, sf->failures, sf->minMillis, sf->totalMillis / sf->count, sf->maxMillis, sf->txBytes);
+  CHECK("commandStats", strcmp(key1, "SF") == 0 && strcmp(key2, "I=10") == 0 && strcmp(key3, "AT") == 0 &&
+        sf->count == 2 && sf->failures == 1 && sf->minMillis == 6000 && sf->maxMillis == 8000 &&
+        sf->totalMillis == 14000 && sf->txBytes == 30);
+
+  //  No module is attached, so every response so far was empty.  Record a longer one.
+  sampleDiagnostics(24);
+  char diagnosticsHex[DIAGNOSTICS_BYTES * 2 + 1];
+  printf("diagnostics responseMax=%u hex=%s\n", getDiagnostics().responseMax,
+         getDiagnosticsHex(diagnosticsHex));
+  CHECK("diagnostics", getDiagnostics().responseMax == 24 && strcmp(diagnosticsHex, "0000000000000018") == 0);
+
+  //  Sample a rising sensor every 20 ms for 90 ms, i.e. 5 samples, and send the min, max and mean of the window.
+  struct RisingSensor {
+    static bool read(int &value) { static int next = 250; value = next; next = next + 2; return true; }
+  };
+  SensorPipeline pipeline;
+  const int channel = pipeline.addChannel(&RisingSensor::read, 20);
+  pipeline.addField("min", channel, SENSOR_MIN); pipeline.addField("max", channel, SENSOR_MAX);
+  pipeline.addField("tmp", channel, SENSOR_MEAN);
+  const unsigned long pipelineStart = millis();
+  while (millis() - pipelineStart < 90) pipeline.poll();
+  SensorWindow window; int recent = 0;
+  pipeline.getWindow(channel, window); pipeline.getRecent(channel, 1, recent);
+  Message<Akeru> pipelineMsg(akeru);
+  const bool pipelineAdded = pipeline.addFields(pipelineMsg);
+  pipeline.getWindow(channel, window);
+  printf("pipeline added=%d recent=%d next=%u msg=%s\n", pipelineAdded, recent, window.count,
+         MessageCodec::decodeMessage(pipelineMsg.getEncodedMessage()).c_str());
+  CHECK("pipeline", pipelineAdded && recent == 256 && window.count == 0 &&
+        strcmp(MessageCodec::decodeMessage(pipelineMsg.getEncodedMessage()).c_str(),
+               "{\"min\":25.0,\"max\":25.8,\"tmp\":25.4}") == 0);
+  //  A full window keeps its aggregates.  If the queue is full, the window is not lost.
+  struct SteadySensor {
+    static bool read(int &value) { value = 100; return true; }
+  };
+  SensorPipeline steadyPipeline;
+  const int steadyChannel = steadyPipeline.addChannel(&SteadySensor::read, 1);
+  steadyPipeline.addField("tmp", steadyChannel, SENSOR_MEAN);
+  SensorWindow steadyWindow;  steadyWindow.count = 0;
+  while (steadyWindow.count < SENSOR_WINDOW_MAX) {
+    steadyPipeline.poll();  steadyPipeline.getWindow(steadyChannel, steadyWindow);
+  }
+  delay(10);  steadyPipeline.poll();  steadyPipeline.getWindow(steadyChannel, steadyWindow);
+  UplinkBudget fullBudget(1, 1);
+  UplinkQueue fullQueue(fullBudget);
+  for (uint8_t i = 0; i < UPLINK_QUEUE_SIZE; i++) fullQueue.add(alarm, 1, UPLINK_PRIORITY_ALARM);
+  const bool steadyQueued = steadyPipeline.queueFields(akeru, fullQueue);
+  SensorWindow keptWindow;
+  steadyPipeline.getWindow(steadyChannel, keptWindow);
+  printf("pipeline full count=%u mean=%ld queued=%d kept=%u\n", steadyWindow.count,
+         steadyWindow.sum / steadyWindow.count, steadyQueued, keptWindow.count);
+  CHECK("pipeline full", steadyWindow.count == SENSOR_WINDOW_MAX && steadyWindow.sum / steadyWindow.count == 100 &&
+        !steadyQueued && keptWindow.count == SENSOR_WINDOW_MAX);
+
+  //  Fire the timers of 3 tasks in deadline order, after cancelling one and restarting another.
+  //  Idle sleep waits out the time between the timers.
+  struct TimedTasks {
+    static char *order() { static char s[8] = ""; return s; }
+    static void record(char ch) { char *s = order(); const size_t n = strlen(s); s[n] = ch; s[n + 1] = 0; }
+    static void a(uint8_t event) { record('a' + event); }
+    static void b(uint8_t event) { record('A' + event); }
+    static void c(uint8_t event) { record('0' + event); }
+  };
+  TaskScheduler scheduler;
+  const int taskA = scheduler.addTask(&TimedTasks::a), taskB = scheduler.addTask(&TimedTasks::b),
+    taskC = scheduler.addTask(&TimedTasks::c);
+  scheduler.setTimer(taskA, 1, 300); scheduler.setTimer(taskB, 2, 100); scheduler.setTimer(taskC, 3, 200);
+  scheduler.cancelTimer(taskC); scheduler.setTimer(taskB, 4, 400);
+  scheduler.post(taskC, 5); scheduler.post(taskC, 5);
+  scheduler.setIdleSleep(true);
+  const unsigned int schedulerSleeps = getPowerDownStats().powerDowns;
+  while (scheduler.getWaitMillis() != 0xffffffff || scheduler.getDispatchCount() < 3) scheduler.run();
+  printf("scheduler order=%s dispatches=%lu sleeps=%u\n", TimedTasks::order(),
+         scheduler.getDispatchCount(), getPowerDownStats().powerDowns - schedulerSleeps);
+  CHECK("scheduler", strcmp(TimedTasks::order(), "5bE") == 0 && scheduler.getDispatchCount() == 3 &&
+        getPowerDownStats().powerDowns - schedulerSleeps == 2);
+
 #if NOTUSED
   setup();
   for (;;) {
@@ -36,6 +396,7 @@ int main() {
     break;
   }
 #endif
-  return 0;
+  printf("%d failures\n", failures);
+  return failures == 0 ? 0 : 1;
 }
 #endif  //  ARDUINO
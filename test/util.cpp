@@ -8,9 +8,8 @@
 
 char *ltoa(long num, char *str, int radix) {
   char sign = 0;
-  char temp[33];  //an int can only be 32 bits long
-  //at radix 2 (binary) the string
-  //is at most 16 + 1 null long.
+  char temp[8 * sizeof(num)];  //at radix 2 (binary) there is one digit per bit.
+  //On the host, int and long may be longer than on Arduino.
   int temp_loc = 0;
   int digit;
   int str_loc = 0;
@@ -49,9 +48,8 @@ char *ltoa(long num, char *str, int radix) {
 }
 
 char *utoa(unsigned num, char *str, int radix) {
-  char temp[17];  //an int can only be 16 bits long
-  //at radix 2 (binary) the string
-  //is at most 16 + 1 null long.
+  char temp[8 * sizeof(num)];  //at radix 2 (binary) there is one digit per bit.
+  //On the host, int and long may be longer than on Arduino.
   int temp_loc = 0;
   int digit;
   int str_loc = 0;
@@ -80,9 +78,8 @@ char *utoa(unsigned num, char *str, int radix) {
 
 char *itoa(int num, char *str, int radix) {
   char sign = 0;
-  char temp[17];  //an int can only be 16 bits long
-  //at radix 2 (binary) the string
-  //is at most 16 + 1 null long.
+  char temp[8 * sizeof(num)];  //at radix 2 (binary) there is one digit per bit.
+  //On the host, int and long may be longer than on Arduino.
   int temp_loc = 0;
   int digit;
   int str_loc = 0;
@@ -121,9 +118,8 @@ char *itoa(int num, char *str, int radix) {
 }
 
 char *ultoa(unsigned long num, char *str, int radix) {
-  char temp[33];  //an int can only be 16 bits long
-  //at radix 2 (binary) the string
-  //is at most 16 + 1 null long.
+  char temp[8 * sizeof(num)];  //at radix 2 (binary) there is one digit per bit.
+  //On the host, int and long may be longer than on Arduino.
   int temp_loc = 0;
   int digit;
   int str_loc = 0;
@@ -154,6 +150,11 @@ char *dtostrf(double value, unsigned char d1, unsigned char d2, char *buf) {
   return (char *) "888";
 }
 
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_ptr(addr) (*(const void * const *)(addr))
+#define strncpy_P strncpy
 #define strcpy_P strcpy
 #define strlen_P strlen
 typedef const char *PSTR;
@@ -167,11 +168,14 @@ public:
   void begin(int i) {}
   void print(const char *s) { printf(s); }
   void print(const String &s) { printf(s.c_str()); }
+  void print(char c) { putchar(c); }
   void print(int i) { printf("%d", i); }
+  void print(unsigned long ul) { printf("%lu", ul); }
   void print(float f) { printf("%f", f); }
   void println(const char *s) { puts(s); }
   void println(const String &s) { puts(s.c_str()); }
   void println(int i) { printf("%d\n", i); }
+  void println(unsigned long ul) { printf("%lu\n", ul); }
   void println(float f) { printf("%f\n", f); }
   void flush() {}
   void listen() {}
@@ -182,22 +186,49 @@ public:
 };
 Print Serial;
 
-class SoftwareSerial: public Print {
-public:
-  SoftwareSerial(unsigned rx, unsigned tx): Print(rx, tx) {}
-};
+//  Virtual clock in microseconds.  Each call to millis() or micros() advances the clock by
+//  VIRTUAL_TICK_MICROS, roughly the time taken by a polling loop on Arduino, so that busy-wait
+//  loops finish.  delay() and serial port transmits advance the clock by the time they take.
+const unsigned long VIRTUAL_TICK_MICROS = 4;
+static unsigned long long virtualMicros = 0;
+
+void advanceMicros(unsigned long long us) {
+  virtualMicros += us;
+}
+
+unsigned long long getVirtualMicros() {
+  return virtualMicros;
+}
 
 unsigned long millis() {
-  return (unsigned long) clock();
+  virtualMicros += VIRTUAL_TICK_MICROS;
+  return (unsigned long) (virtualMicros / 1000);
+}
+
+unsigned long micros() {
+  virtualMicros += VIRTUAL_TICK_MICROS;
+  return (unsigned long) virtualMicros;
 }
 
 void delay(long i) {  //  Milliseconds.
-  const unsigned long start = millis();
-  for (;;) {
-    if (millis() - start > i) return;
-  }
+  if (i > 0) virtualMicros += (unsigned long long) i * 1000;
 }
 
+//  SoftwareSerial that talks to a simulated SIGFOX module.
+#include "SimulatedModem.cpp"
+
 typedef uint8_t byte;
 
+class EEPROMClass {
+public:
+  EEPROMClass() { memset(bytes, 0xff, sizeof(bytes)); }  //  Erased EEPROM reads as 0xff.
+  uint8_t read(int address) { return bytes[address]; }
+  void write(int address, uint8_t value) { bytes[address] = value; }
+  void update(int address, uint8_t value) { if (bytes[address] != value) bytes[address] = value; }
+  uint16_t length() { return sizeof(bytes); }
+private:
+  uint8_t bytes[1024];  //  Same size as ATmega328P.
+};
+EEPROMClass EEPROM;
+
 #endif  //  ARDUINO